@@ -89,6 +89,8 @@ extern int	openat(int fd, const char *path, int openMode, ...);
 
 extern int	fcntl(int fd, int op, ...);
 
+extern int	posix_fallocate(int fd, off_t offset, off_t length);
+
 #ifdef __cplusplus
 }
 #endif
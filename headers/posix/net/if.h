@@ -75,6 +75,21 @@ struct ifmediareq {
 	int*			ifm_ulist;
 };
 
+#define IF_MAX_RECEIVE_QUEUES	16
+
+struct ifreq_queue_stats {
+	uint64_t		packets;
+	uint64_t		bytes;
+	uint32_t		dropped;
+};
+
+/* used with B_SOCKET_GET_RECEIVE_QUEUES */
+struct ifreceivequeuereq {
+	char			ifrq_name[IF_NAMESIZE];
+	int				ifrq_count;
+	struct ifreq_queue_stats ifrq_queues[IF_MAX_RECEIVE_QUEUES];
+};
+
 
 /* interface flags */
 #define IFF_UP				0x0001
@@ -60,6 +60,13 @@
 #define atomic_and			fssh_atomic_and
 #define atomic_or			fssh_atomic_or
 #define atomic_get			fssh_atomic_get
+#define atomic_set64		fssh_atomic_set64
+#define atomic_get_and_set64	fssh_atomic_get_and_set64
+#define atomic_test_and_set64	fssh_atomic_test_and_set64
+#define atomic_add64		fssh_atomic_add64
+#define atomic_and64		fssh_atomic_and64
+#define atomic_or64			fssh_atomic_or64
+#define atomic_get64		fssh_atomic_get64
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -850,6 +857,7 @@
 #define block_cache_get					fssh_block_cache_get
 #define block_cache_set_dirty			fssh_block_cache_set_dirty
 #define block_cache_put					fssh_block_cache_put
+#define block_cache_prefetch			fssh_block_cache_prefetch
 
 /* file cache */
 #define file_cache_create				fssh_file_cache_create
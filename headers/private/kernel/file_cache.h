@@ -16,6 +16,8 @@
 
 #define CACHE_CLEAR			1	// takes no parameters
 #define CACHE_SET_MODULE	2	// gets the module name as parameter
+#define CACHE_GET_READAHEAD_STATS	3
+	// fills in a file_cache_readahead_stats structure
 
 #define CACHE_MODULES_NAME	"file_cache"
 
@@ -23,6 +25,14 @@
 #define FILE_CACHE_LOADED_COMPLETELY	0x02
 #define FILE_CACHE_NO_IO				0x04
 
+struct file_cache_readahead_stats {
+	uint64	streams;			// number of access streams detected
+	uint64	requests;			// asynchronous readahead requests issued
+	uint64	pages_read_ahead;
+	uint64	pages_hit;			// read ahead pages that were actually read
+	uint64	pages_wasted;		// read ahead pages its stream never reached
+};
+
 struct cache_module_info {
 	module_info	info;
 
@@ -44,6 +54,8 @@ extern void cache_node_closed(struct vnode *vnode, int32 fdType, VMCache *cache,
 extern void cache_node_launched(size_t argCount, char * const *args);
 extern void cache_prefetch_vnode(struct vnode *vnode, off_t offset, size_t size);
 extern void cache_prefetch(dev_t mountID, ino_t vnodeID, off_t offset, size_t size);
+extern void file_cache_fault_read(struct file_cache_ref *ref, off_t offset,
+				size_t size);
 
 extern status_t file_map_init(void);
 extern status_t file_cache_init_post_boot_device(void);
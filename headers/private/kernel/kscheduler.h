@@ -14,6 +14,8 @@
 #include <thread_types.h>
 
 
+struct scheduler_cpu_latency_stats;
+struct scheduler_thread_latency_stats;
 struct scheduling_analysis;
 struct SchedulerListener;
 
@@ -94,6 +96,12 @@ status_t _user_analyze_scheduling(bigtime_t from, bigtime_t until, void* buffer,
 status_t _user_set_scheduler_mode(int32 mode);
 int32 _user_get_scheduler_mode(void);
 
+status_t _user_get_scheduler_cpu_latency_stats(int32 cpu,
+	struct scheduler_cpu_latency_stats* stats, size_t size);
+status_t _user_get_scheduler_thread_latency_stats(thread_id thread,
+	struct scheduler_thread_latency_stats* stats, size_t size);
+status_t _user_reset_scheduler_latency_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,15 @@
 
 struct DepotMagazine;
 
+typedef struct object_depot_stats {
+	uint64					alloc_hits;
+	uint64					free_hits;
+	uint64					exchanges;
+	uint64					contentions;
+	uint32					resizes;
+	size_t					magazine_capacity;
+} object_depot_stats;
+
 typedef struct object_depot {
 	rw_lock					outer_lock;
 	spinlock				inner_lock;
@@ -22,9 +31,18 @@ typedef struct object_depot {
 	size_t					empty_count;
 	size_t					max_count;
 	size_t					magazine_capacity;
+	size_t					min_capacity;
+	size_t					max_capacity;
 	struct depot_cpu_store*	stores;
 	void*					cookie;
 
+	// contention statistics, protected by the inner lock
+	uint64					exchanges;
+	uint64					contentions;
+	uint32					resizes;
+	uint32					interval_acquisitions;
+	uint32					interval_contentions;
+
 	void (*return_object)(struct object_depot* depot, void* cookie,
 		void* object, uint32 flags);
 } object_depot;
@@ -45,6 +63,8 @@ void object_depot_store(object_depot* depot, void* object, uint32 flags);
 
 void object_depot_make_empty(object_depot* depot, uint32 flags);
 
+void object_depot_get_stats(object_depot* depot, object_depot_stats* stats);
+
 #if PARANOID_KERNEL_FREE
 bool object_depot_contains_object(object_depot* depot, void* object);
 #endif
@@ -149,6 +149,8 @@ status_t	vfs_create_special_node(const char *path, fs_vnode *subVnode,
 /* service call for the node monitor */
 status_t	vfs_resolve_vnode_to_covering_vnode(dev_t mountID, ino_t nodeID,
 				dev_t *resolvedMountID, ino_t *resolvedNodeID);
+void		vfs_entry_cache_invalidate_missing(dev_t mountID, ino_t dirID,
+				const char *name);
 
 /* service calls for private file systems */
 status_t	vfs_get_mount_point(dev_t mountID, dev_t* _mountPointMountID,
@@ -168,6 +170,8 @@ dev_t		_user_next_device(int32 *_cookie);
 status_t	_user_sync(void);
 status_t	_user_get_next_fd_info(team_id team, uint32 *cookie,
 				struct fd_info *info, size_t infoSize);
+status_t	_user_get_entry_cache_stats(dev_t device,
+				struct entry_cache_stats *stats, size_t statsSize);
 status_t	_user_entry_ref_to_path(dev_t device, ino_t inode, const char *leaf,
 				char *userPath, size_t pathLength);
 status_t	_user_normalize_path(const char* userPath, bool traverseLink,
@@ -182,6 +186,7 @@ int			_user_open_dir(int fd, const char *path);
 int			_user_open_parent_dir(int fd, char *name, size_t nameLength);
 status_t	_user_fcntl(int fd, int op, size_t argument);
 status_t	_user_fsync(int fd);
+status_t	_user_preallocate(int fd, off_t offset, off_t length);
 status_t	_user_flock(int fd, int op);
 status_t	_user_read_stat(int fd, const char *path, bool traverseLink,
 				struct stat *stat, size_t statSize);
@@ -268,6 +273,7 @@ ssize_t		_user_send(int socket, const void *data, size_t length, int flags);
 ssize_t		_user_sendto(int socket, const void *data, size_t length, int flags,
 				const struct sockaddr *address, socklen_t addressLength);
 ssize_t		_user_sendmsg(int socket, const struct msghdr *message, int flags);
+ssize_t		_user_sendfile(int socket, int fd, off_t *offset, size_t count);
 status_t	_user_getsockopt(int socket, int level, int option, void *value,
 				socklen_t *_length);
 status_t	_user_setsockopt(int socket, int level, int option,
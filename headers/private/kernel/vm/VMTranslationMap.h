@@ -39,6 +39,12 @@ public:
 									vm_page_reservation* reservation) = 0;
 	virtual	status_t			Unmap(addr_t start, addr_t end) = 0;
 
+	virtual	size_t				LargePageSize() const;
+	virtual	status_t			MapLargePage(addr_t virtualAddress,
+									phys_addr_t physicalAddress,
+									uint32 attributes, uint32 memoryType,
+									vm_page_reservation* reservation);
+
 	virtual	status_t			DebugMarkRangePresent(addr_t start, addr_t end,
 									bool markPresent);
 
@@ -75,6 +81,9 @@ public:
 
 	virtual	void				Flush() = 0;
 
+	virtual	void				BeginBatch();
+	virtual	void				EndBatch();
+
 	// backends for KDL commands
 	virtual	void				DebugPrintMappingInfo(addr_t virtualAddress);
 	virtual	bool				DebugGetReverseMappingInfo(
@@ -143,6 +152,24 @@ struct VMPhysicalPageMapper {
 
 
 
+struct VMTranslationMapBatch {
+	VMTranslationMapBatch(VMTranslationMap* map)
+		:
+		fMap(map)
+	{
+		fMap->BeginBatch();
+	}
+
+	~VMTranslationMapBatch()
+	{
+		fMap->EndBatch();
+	}
+
+private:
+	VMTranslationMap*	fMap;
+};
+
+
 inline status_t
 VMTranslationMap::ProtectPage(VMArea* area, addr_t address, uint32 attributes)
 {
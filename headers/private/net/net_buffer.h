@@ -35,6 +35,9 @@ typedef struct net_buffer {
 	uint32					flags;
 	uint32					size;
 	uint8					protocol;
+	uint16					segment_size;
+		// if non-zero, the buffer contains several TCP segments with this
+		// many bytes of data each that still need to be split
 } net_buffer;
 
 struct ancillary_data_container;
@@ -101,6 +104,10 @@ struct net_buffer_module_info {
 	void			(*swap_addresses)(net_buffer* buffer);
 
 	void			(*dump)(net_buffer* buffer);
+
+	status_t		(*append_external)(net_buffer* buffer, const void* data,
+						size_t bytes, void (*freeFunction)(void* cookie),
+						void* cookie);
 };
 
 
@@ -75,6 +75,10 @@ struct net_stack_interface_module_info {
 
 	status_t (*get_next_socket_stat)(int family, uint32 *cookie,
 					struct net_stat *stat);
+
+	ssize_t (*send_external)(net_socket* socket, const void* data,
+					size_t length, void (*freeFunction)(void* cookie),
+					void* cookie, int flags);
 };
 
 
@@ -25,6 +25,13 @@ typedef struct net_stat {
 	struct	sockaddr_storage peer;
 	size_t	receive_queue_size;
 	size_t	send_queue_size;
+
+	// connection oriented protocols only
+	char	congestion_control[16];
+	uint32	congestion_window;
+	uint32	slow_start_threshold;
+	uint32	round_trip_time;
+		// in microseconds
 } net_stat;
 
 #endif	// NET_STAT_H
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _SYSTEM_ICI_STATISTICS_H
+#define _SYSTEM_ICI_STATISTICS_H
+
+#include <OS.h>
+
+
+#define ICI_STATISTICS					"ici statistics"
+#define GET_ICI_STATISTICS				0x01
+
+
+// The buffer passed with GET_ICI_STATISTICS must hold one entry per CPU.
+typedef struct ici_statistics {
+	uint64	sent;					// messages sent, counted per target CPU
+	uint64	received;				// messages processed
+	uint64	tlb_shootdowns_sent;	// TLB invalidation requests issued
+	uint64	tlb_shootdowns_received;
+} ici_statistics;
+
+
+#endif	/* _SYSTEM_ICI_STATISTICS_H */
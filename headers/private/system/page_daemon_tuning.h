@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _SYSTEM_PAGE_DAEMON_TUNING_H
+#define _SYSTEM_PAGE_DAEMON_TUNING_H
+
+#include <OS.h>
+
+
+#define PAGE_DAEMON_SYSCALLS			"page daemon"
+#define GET_PAGE_DAEMON_TUNING			0x01
+#define SET_PAGE_DAEMON_TUNING			0x02
+#define GET_PAGE_DAEMON_STATS			0x03
+
+#define PAGE_RESERVE_WAIT_BUCKETS		20
+
+
+typedef struct page_daemon_tuning {
+	// page daemon
+	uint32		free_pages_target;
+	uint32		free_or_cached_pages_target;
+	uint32		inactive_pages_target;
+	bigtime_t	idle_scan_interval;
+	bigtime_t	busy_scan_interval;
+	uint32		idle_runs_for_full_queue;
+	int32		page_usage_advance;
+	int32		page_usage_decline;
+
+	// page scrubber
+	uint32		min_clear_pages_target;
+	uint32		max_clear_pages_target;
+} page_daemon_tuning;
+
+
+typedef struct page_daemon_stats {
+	// page scrubber
+	uint32		clear_pages;
+	uint32		clear_pages_target;		// current, adapted to the demand
+	uint64		clear_page_allocations;
+	uint64		clear_page_misses;		// had to be cleared synchronously
+	uint64		pages_scrubbed;
+
+	// vm_page_reserve_pages() waits; bucket 0 counts waits shorter than
+	// 32 us, bucket i > 0 those from 2^(i + 4) to 2^(i + 5) us, the last one
+	// everything longer than that.
+	uint64		reserve_waits;
+	bigtime_t	reserve_wait_time;
+	bigtime_t	max_reserve_wait_time;
+	uint64		reserve_wait_histogram[PAGE_RESERVE_WAIT_BUCKETS];
+} page_daemon_stats;
+
+
+#endif	/* _SYSTEM_PAGE_DAEMON_TUNING_H */
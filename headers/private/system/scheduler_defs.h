@@ -32,6 +32,7 @@ struct scheduling_analysis_thread {
 	bigtime_t	unspecified_wait_time;
 
 	int64		preemptions;
+	int64		migrations;
 
 	scheduling_analysis_thread_wait_object* wait_objects;
 };
@@ -62,4 +63,42 @@ struct scheduling_analysis {
 };
 
 
+// Wake-up latency histograms: bucket 0 counts latencies shorter than 2 us,
+// bucket i > 0 those from 2^i to 2^(i + 1) us, the last one everything
+// longer than that.
+#define SCHEDULER_LATENCY_BUCKETS		16
+
+// Run queue length histograms: bucket i counts the reschedules that found i
+// threads waiting in the core's run queue, the last one also all longer ones.
+#define SCHEDULER_RUN_QUEUE_BUCKETS		16
+
+
+struct scheduler_cpu_latency_stats {
+	int32		cpu;
+	int32		core;
+
+	int64		context_switches;
+	int64		preemptions;
+
+	int64		wakeups;
+	bigtime_t	total_latency;
+	bigtime_t	max_latency;
+	int64		latency_histogram[SCHEDULER_LATENCY_BUCKETS];
+
+	int64		run_queue_histogram[SCHEDULER_RUN_QUEUE_BUCKETS];
+};
+
+
+struct scheduler_thread_latency_stats {
+	thread_id	id;
+
+	int64		preemptions;
+
+	int64		wakeups;
+	bigtime_t	total_latency;
+	bigtime_t	max_latency;
+	int64		latency_histogram[SCHEDULER_LATENCY_BUCKETS];
+};
+
+
 #endif	/* _SYSTEM_SCHEDULER_DEFS_H */
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _SYSTEM_SLAB_STATISTICS_H
+#define _SYSTEM_SLAB_STATISTICS_H
+
+#include <OS.h>
+
+
+#define SLAB_STATISTICS					"slab statistics"
+#define GET_NEXT_OBJECT_CACHE_STATS		0x01
+
+
+typedef struct object_cache_stats {
+	char	name[32];
+	size_t	object_size;
+	size_t	usage;				// bytes allocated for slabs
+	size_t	used_count;			// objects in use, or in magazines
+	size_t	total_objects;
+	uint32	flags;
+
+	// per CPU magazine layer, all zero if the cache has no depot
+	uint32	magazine_capacity;
+	uint32	magazine_resizes;
+	uint64	alloc_hits;			// served from a per CPU magazine
+	uint64	free_hits;
+	uint64	depot_exchanges;	// magazines swapped with the depot
+	uint64	depot_contentions;	// depot lock acquisitions that had to spin
+
+	// slab layer
+	uint64	slab_allocs;
+	uint64	slab_frees;
+	uint64	slab_refills;		// slabs created
+} object_cache_stats;
+
+
+typedef struct object_cache_stats_args {
+	int32				cookie;		// in/out, start with 0
+	object_cache_stats	stats;
+} object_cache_stats_args;
+
+
+#endif	/* _SYSTEM_SLAB_STATISTICS_H */
@@ -23,6 +23,7 @@ extern "C" {
 
 struct attr_info;
 struct dirent;
+struct entry_cache_stats;
 struct fd_info;
 struct fd_set;
 struct fs_info;
@@ -31,6 +32,8 @@ struct msqid_ds;
 struct net_stat;
 struct pollfd;
 struct rlimit;
+struct scheduler_cpu_latency_stats;
+struct scheduler_thread_latency_stats;
 struct scheduling_analysis;
 struct _sem_t;
 struct sembuf;
@@ -199,6 +202,15 @@ extern bigtime_t	_kern_estimate_max_scheduling_latency(thread_id thread);
 extern status_t		_kern_set_scheduler_mode(int32 mode);
 extern int32		_kern_get_scheduler_mode(void);
 
+extern status_t		_kern_get_scheduler_cpu_latency_stats(int32 cpu,
+						struct scheduler_cpu_latency_stats* stats,
+						size_t size);
+extern status_t		_kern_get_scheduler_thread_latency_stats(
+						thread_id thread,
+						struct scheduler_thread_latency_stats* stats,
+						size_t size);
+extern status_t		_kern_reset_scheduler_latency_stats(void);
+
 // user/group functions
 extern gid_t		_kern_getgid(bool effective);
 extern uid_t		_kern_getuid(bool effective);
@@ -263,6 +275,7 @@ extern int			_kern_open_parent_dir(int fd, char *name,
 						size_t nameLength);
 extern status_t		_kern_fcntl(int fd, int op, size_t argument);
 extern status_t		_kern_fsync(int fd);
+extern status_t		_kern_preallocate(int fd, off_t offset, off_t length);
 extern status_t		_kern_flock(int fd, int op);
 extern off_t		_kern_seek(int fd, off_t pos, int seekType);
 extern status_t		_kern_create_dir_entry_ref(dev_t device, ino_t inode,
@@ -338,6 +351,8 @@ extern status_t		_kern_lock_node(int fd);
 extern status_t		_kern_unlock_node(int fd);
 extern status_t		_kern_get_next_fd_info(team_id team, uint32 *_cookie,
 						struct fd_info *info, size_t infoSize);
+extern status_t		_kern_get_entry_cache_stats(dev_t device,
+						struct entry_cache_stats *stats, size_t statsSize);
 
 // socket functions
 extern int			_kern_socket(int family, int type, int protocol);
@@ -363,6 +378,8 @@ extern ssize_t		_kern_sendto(int socket, const void *data, size_t length,
 						socklen_t addressLength);
 extern ssize_t		_kern_sendmsg(int socket, const struct msghdr *message,
 						int flags);
+extern ssize_t		_kern_sendfile(int socket, int fd, off_t *offset,
+						size_t count);
 extern status_t		_kern_getsockopt(int socket, int level, int option,
 						void *value, socklen_t *_length);
 extern status_t		_kern_setsockopt(int socket, int level, int option,
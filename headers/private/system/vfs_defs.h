@@ -23,6 +23,18 @@ struct fd_info {
 	ino_t	node;
 };
 
+struct entry_cache_stats {
+	uint64	lookups;
+	uint64	hits;
+	uint64	negative_hits;
+	uint64	additions;
+	uint64	negative_additions;
+	uint64	removals;
+	uint64	invalidations;
+		/* negative entries invalidated by node monitoring events */
+	uint32	entries;
+};
+
 
 /* maximum write size to a pipe/FIFO that is guaranteed not to be interleaved
    with other writes (aka {PIPE_BUF}; must be >= _POSIX_PIPE_BUF) */
@@ -31,6 +31,16 @@ namespace BFS {
 #endif
 
 
+#if !_BOOT_MODE
+static const int32 kMaxCountedDuplicateNodes = 32;
+	// the statistics only look at that many nodes of a duplicate chain
+static const int32 kMaxCompactSteps = 32;
+	// the number of nodes Compact() merges or gives back per transaction
+static const int32 kReadAheadNodes = 16;
+	// the number of nodes a TreeIterator reads ahead when moving forward
+#endif
+
+
 /*!	Simple array used for the duplicate handling in the B+Tree. This is an
 	on disk structure.
 */
@@ -585,6 +595,7 @@ BPlusTree::BPlusTree(Transaction& transaction, Inode* stream, int32 nodeSize)
 	fInTransaction(false)
 {
 	mutex_init(&fIteratorLock, "bfs b+tree iterator");
+	fStatistics = NULL;
 	SetTo(transaction, stream);
 }
 #endif // !_BOOT_MODE
@@ -597,6 +608,7 @@ BPlusTree::BPlusTree(Inode* stream)
 {
 #if !_BOOT_MODE
 	mutex_init(&fIteratorLock, "bfs b+tree iterator");
+	fStatistics = NULL;
 #endif
 
 	SetTo(stream);
@@ -613,6 +625,7 @@ BPlusTree::BPlusTree()
 {
 #if !_BOOT_MODE
 	mutex_init(&fIteratorLock, "bfs b+tree iterator");
+	fStatistics = NULL;
 #endif
 }
 
@@ -632,6 +645,8 @@ BPlusTree::~BPlusTree()
 
 	mutex_destroy(&fIteratorLock);
 
+	free(fStatistics);
+
 	ASSERT(!fInTransaction);
 #endif // !_BOOT_MODE
 }
@@ -645,6 +660,7 @@ BPlusTree::SetTo(Transaction& transaction, Inode* stream, int32 nodeSize)
 	// initializes in-memory B+Tree
 
 	fStream = stream;
+	_FreeStatistics();
 
 	CachedNode cached(this);
 	bplustree_header* header = cached.SetToWritableHeader(transaction);
@@ -695,6 +711,9 @@ BPlusTree::SetTo(Inode* stream)
 		RETURN_ERROR(fStatus = B_BAD_VALUE);
 
 	fStream = stream;
+#if !_BOOT_MODE
+	_FreeStatistics();
+#endif
 
 	// get on-disk B+Tree header
 
@@ -840,6 +859,7 @@ BPlusTree::MakeEmpty()
 {
 	// Put all nodes into the free list in order
 	Transaction transaction(fStream->GetVolume(), fStream->BlockNumber());
+	_FreeStatistics();
 
 	// Reset the header, and root node
 	CachedNode cached(this);
@@ -1004,6 +1024,32 @@ BPlusTree::_RemoveIterator(TreeIterator* iterator)
 	MutexLocker _(fIteratorLock);
 	fIterators.Remove(iterator);
 }
+
+
+/*!	Starts reading the nodes from \a offset to \a offset + \a size into
+	the block cache. You need to have the inode read locked.
+*/
+void
+BPlusTree::_Prefetch(off_t offset, off_t size)
+{
+	Volume* volume = fStream->GetVolume();
+	off_t end = min_c(offset + size, fHeader.MaximumSize());
+
+	while (offset < end) {
+		block_run run;
+		off_t fileOffset;
+		if (fStream->FindBlockRun(offset, run, fileOffset) != B_OK)
+			return;
+
+		off_t runEnd = min_c(end,
+			fileOffset + ((off_t)run.Length() << volume->BlockShift()));
+		off_t first = (offset - fileOffset) >> volume->BlockShift();
+		off_t last = (runEnd - 1 - fileOffset) >> volume->BlockShift();
+
+		volume->Prefetch(volume->ToBlock(run) + first, last + 1 - first);
+		offset = runEnd;
+	}
+}
 #endif // !_BOOT_MODE
 
 
@@ -1442,10 +1488,21 @@ BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 	// "bytesAfter" are the bytes after the new key, if any
 	int32 bytes = 0, bytesBefore = 0, bytesAfter = 0;
 
+	// If the key is appended to the last node of its level, the keys are
+	// most likely inserted in ascending order (like when a directory is
+	// copied, or an index is filled). Splitting in halves would leave every
+	// node half empty then, so we keep all old keys in the other node, and
+	// start the new one with the new key.
+	bool append = keyIndex == node->NumKeys()
+		&& node->RightLink() == BPLUSTREE_NULL;
+
 	size_t size = fNodeSize >> 1;
 	int32 out, in;
 	size_t keyLengths = 0;
 	for (in = out = 0; in < node->NumKeys() + 1;) {
+		if (append && in == keyIndex)
+			break;
+
 		keyLengths = BFS_ENDIAN_TO_HOST_INT16(inKeyLengths[in]);
 
 		if (in == keyIndex && !bytes) {
@@ -1460,7 +1517,7 @@ BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 		}
 		out++;
 
-		if (key_align(sizeof(bplustree_node) + bytes + keyLengths)
+		if (!append && key_align(sizeof(bplustree_node) + bytes + keyLengths)
 				+ out * (sizeof(uint16) + sizeof(off_t)) >= size) {
 			// we have found the number of keys in the new node!
 			break;
@@ -1677,6 +1734,18 @@ BPlusTree::_SplitNode(bplustree_node* node, off_t nodeOffset,
 status_t
 BPlusTree::Insert(Transaction& transaction, const uint8* key, uint16 keyLength,
 	off_t value)
+{
+	status_t status = _Insert(transaction, key, keyLength, value);
+	if (status == B_OK)
+		_UpdateStatistics(key, keyLength, 1);
+
+	return status;
+}
+
+
+status_t
+BPlusTree::_Insert(Transaction& transaction, const uint8* key,
+	uint16 keyLength, off_t value)
 {
 	if (keyLength < BPLUSTREE_MIN_KEY_LENGTH
 		|| keyLength > BPLUSTREE_MAX_KEY_LENGTH)
@@ -2099,6 +2168,18 @@ BPlusTree::_RemoveKey(bplustree_node* node, uint16 index)
 status_t
 BPlusTree::Remove(Transaction& transaction, const uint8* key, uint16 keyLength,
 	off_t value)
+{
+	status_t status = _Remove(transaction, key, keyLength, value);
+	if (status == B_OK)
+		_UpdateStatistics(key, keyLength, -1);
+
+	return status;
+}
+
+
+status_t
+BPlusTree::_Remove(Transaction& transaction, const uint8* key,
+	uint16 keyLength, off_t value)
 {
 	if (keyLength < BPLUSTREE_MIN_KEY_LENGTH
 		|| keyLength > BPLUSTREE_MAX_KEY_LENGTH)
@@ -2261,6 +2342,424 @@ BPlusTree::Replace(Transaction& transaction, const uint8* key, uint16 keyLength,
 	}
 	RETURN_ERROR(B_ERROR);
 }
+
+
+/*!	Compacts the tree step by step; every call should be done in its own
+	\a transaction, and only touches a limited number of nodes.
+	First, every leaf node is merged with its right sibling in case the keys
+	of both fit into a single node. Then, the free nodes at the end of the
+	tree are given back, moving the last nodes into free nodes in front of
+	them where necessary.
+	The \a _cookie must be set to zero before the first call. The number of
+	merged and freed nodes are added to \a _merged, and \a _freed.
+	Returns B_ENTRY_NOT_FOUND when there is nothing left to do.
+	You need to have the inode write locked.
+*/
+status_t
+BPlusTree::Compact(Transaction& transaction, off_t* _cookie, uint32* _merged,
+	uint32* _freed)
+{
+	ASSERT_WRITE_LOCKED_INODE(fStream);
+
+	off_t offset = *_cookie;
+	if (offset == 0) {
+		// start with the first leaf node
+		offset = fHeader.RootNode();
+
+		CachedNode cached(this);
+		const bplustree_node* node;
+		while ((node = cached.SetTo(offset)) != NULL && !node->IsLeaf()) {
+			offset = node->NumKeys() > 0
+				? BFS_ENDIAN_TO_HOST_INT64(node->Values()[0])
+				: node->OverflowLink();
+		}
+		if (node == NULL)
+			RETURN_ERROR(B_BAD_DATA);
+	}
+
+	// merge the leaf nodes
+
+	for (int32 i = 0; i < kMaxCompactSteps && offset != BPLUSTREE_NULL; i++) {
+		bool merged;
+		status_t status = _MergeWithRightSibling(transaction, offset, &offset,
+			&merged);
+		if (status != B_OK)
+			return status;
+		if (merged)
+			(*_merged)++;
+	}
+	*_cookie = offset;
+	if (offset != BPLUSTREE_NULL)
+		return B_OK;
+
+	// give back the nodes at the end of the tree
+
+	for (int32 i = 0; i < kMaxCompactSteps; i++) {
+		bool freed;
+		status_t status = _FreeLastNode(transaction, &freed);
+		if (status != B_OK)
+			return status;
+		if (!freed)
+			return i == 0 ? B_ENTRY_NOT_FOUND : B_OK;
+
+		(*_freed)++;
+	}
+	return B_OK;
+}
+
+
+/*!	Finds the index node that links to the node at \a offset, and fills
+	\a _parent with its offset, and the index of the link. The node is found
+	by looking up its last key, so this won't work for empty nodes, or nodes
+	that aren't part of the tree, like duplicate nodes.
+	Returns B_ENTRY_NOT_FOUND if there is no such node, which is always the
+	case for the root node.
+*/
+status_t
+BPlusTree::_FindParent(const bplustree_node* node, off_t offset,
+	node_and_key& _parent)
+{
+	if (node->NumKeys() == 0 || node->CheckIntegrity(fNodeSize) != B_OK)
+		return B_ENTRY_NOT_FOUND;
+
+	uint16 keyLength;
+	uint8* key = node->KeyAt(node->NumKeys() - 1, &keyLength);
+	if (keyLength < BPLUSTREE_MIN_KEY_LENGTH
+		|| keyLength > BPLUSTREE_MAX_KEY_LENGTH)
+		return B_ENTRY_NOT_FOUND;
+
+	Stack<node_and_key> stack;
+	status_t status = _SeekDown(stack, key, keyLength);
+	if (status != B_OK)
+		return status;
+
+	CachedNode cached(this);
+	while (stack.Pop(&_parent)) {
+		const bplustree_node* parent = cached.SetTo(_parent.nodeOffset);
+		if (parent == NULL)
+			RETURN_ERROR(B_IO_ERROR);
+		if (parent->IsLeaf())
+			continue;
+
+		off_t child = _parent.keyIndex < parent->NumKeys()
+			? BFS_ENDIAN_TO_HOST_INT64(parent->Values()[_parent.keyIndex])
+			: parent->OverflowLink();
+		if (child == offset)
+			return B_OK;
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+/*!	Moves all keys of the leaf node at \a offset into its right sibling, if
+	they fit, and both nodes have the same parent. The node is freed then,
+	and the root node is dropped in case it no longer has any keys.
+	\a _next is set to the next node to look at.
+*/
+status_t
+BPlusTree::_MergeWithRightSibling(Transaction& transaction, off_t offset,
+	off_t* _next, bool* _merged)
+{
+	*_merged = false;
+
+	CachedNode cached(this);
+	const bplustree_node* node = cached.SetTo(offset);
+	if (node == NULL || !node->IsLeaf()) {
+		// the tree has been changed since the last step
+		*_next = BPLUSTREE_NULL;
+		return B_OK;
+	}
+
+	*_next = node->RightLink();
+	if (*_next == BPLUSTREE_NULL || node->NumKeys() == 0)
+		return B_OK;
+
+	CachedNode cachedRight(this);
+	const bplustree_node* right = cachedRight.SetTo(*_next);
+	if (right == NULL || !right->IsLeaf())
+		RETURN_ERROR(B_BAD_DATA);
+
+	uint16 leftKeys = node->NumKeys();
+	uint16 leftLength = node->AllKeyLength();
+	if (key_align(sizeof(bplustree_node) + leftLength + right->AllKeyLength())
+			+ (leftKeys + right->NumKeys()) * (sizeof(uint16) + sizeof(off_t))
+			> fNodeSize) {
+		return B_OK;
+	}
+
+	// Both nodes need to have the same parent, or else we would have to
+	// change the keys of other index nodes, too
+	node_and_key parentAndKey;
+	status_t status = _FindParent(node, offset, parentAndKey);
+	if (status == B_ENTRY_NOT_FOUND)
+		return B_OK;
+	if (status != B_OK)
+		return status;
+
+	CachedNode cachedParent(this);
+	const bplustree_node* parent = cachedParent.SetTo(parentAndKey.nodeOffset);
+	if (parent == NULL)
+		RETURN_ERROR(B_IO_ERROR);
+
+	uint16 keyIndex = parentAndKey.keyIndex;
+	if (keyIndex >= parent->NumKeys()
+		|| (keyIndex + 1 < parent->NumKeys()
+			? BFS_ENDIAN_TO_HOST_INT64(parent->Values()[keyIndex + 1])
+			: parent->OverflowLink()) != *_next)
+		return B_OK;
+
+	uint8* buffer = (uint8*)malloc(fNodeSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+	MemoryDeleter bufferDeleter(buffer);
+
+	bplustree_node* writableParent = cachedParent.MakeWritable(transaction);
+	bplustree_node* writableRight = cachedRight.MakeWritable(transaction);
+	bplustree_node* writableNode = cached.MakeWritable(transaction);
+	if (writableParent == NULL || writableRight == NULL
+		|| writableNode == NULL)
+		return B_IO_ERROR;
+
+	// put the keys of the node in front of those of its sibling
+
+	memcpy(buffer, writableRight, fNodeSize);
+	const bplustree_node* oldRight = (const bplustree_node*)buffer;
+	uint16 rightKeys = oldRight->NumKeys();
+
+	writableRight->all_key_count = HOST_ENDIAN_TO_BFS_INT16(
+		leftKeys + rightKeys);
+	writableRight->all_key_length = HOST_ENDIAN_TO_BFS_INT16(
+		leftLength + oldRight->AllKeyLength());
+
+	memcpy(writableRight->Keys(), writableNode->Keys(), leftLength);
+	memcpy(writableRight->Keys() + leftLength, oldRight->Keys(),
+		oldRight->AllKeyLength());
+
+	uint16* keyLengths = writableRight->KeyLengths();
+	off_t* values = writableRight->Values();
+	memcpy(keyLengths, writableNode->KeyLengths(), leftKeys * sizeof(uint16));
+	memcpy(values, writableNode->Values(), leftKeys * sizeof(off_t));
+
+	for (uint16 i = 0; i < rightKeys; i++) {
+		keyLengths[leftKeys + i] = HOST_ENDIAN_TO_BFS_INT16(
+			BFS_ENDIAN_TO_HOST_INT16(oldRight->KeyLengths()[i]) + leftLength);
+	}
+	memcpy(values + leftKeys, oldRight->Values(), rightKeys * sizeof(off_t));
+
+	// unlink and free the node
+
+	writableRight->left_link = writableNode->left_link;
+
+	CachedNode cachedLeft(this);
+	if (writableNode->LeftLink() != BPLUSTREE_NULL) {
+		bplustree_node* left = cachedLeft.SetToWritable(transaction,
+			writableNode->LeftLink());
+		if (left == NULL)
+			return B_IO_ERROR;
+
+		left->right_link = HOST_ENDIAN_TO_BFS_INT64(*_next);
+	}
+
+	_UpdateIterators(*_next, BPLUSTREE_NULL, 0, 0, leftKeys);
+	_UpdateIterators(offset, *_next, 0, 0, 0);
+
+	_RemoveKey(writableParent, keyIndex);
+
+	status = cached.Free(transaction, offset);
+	if (status != B_OK)
+		return status;
+
+	*_merged = true;
+
+	// if the root node lost its last key, its only child becomes the root
+	if (parentAndKey.nodeOffset != fHeader.RootNode()
+		|| writableParent->NumKeys() > 0)
+		return B_OK;
+
+	CachedNode cachedHeader(this);
+	bplustree_header* header = cachedHeader.SetToWritableHeader(transaction);
+	if (header == NULL)
+		return B_IO_ERROR;
+
+	header->root_node_pointer = writableParent->overflow_link;
+	header->max_number_of_levels = HOST_ENDIAN_TO_BFS_INT32(
+		header->MaxNumberOfLevels() - 1);
+
+	return cachedParent.Free(transaction, parentAndKey.nodeOffset);
+}
+
+
+/*!	Gives back the last node of the tree, if it's a free node, or if it can
+	be moved into a free node.
+*/
+status_t
+BPlusTree::_FreeLastNode(Transaction& transaction, bool* _freed)
+{
+	*_freed = false;
+
+	off_t lastOffset = fHeader.MaximumSize() - fNodeSize;
+	if (lastOffset <= fNodeSize || fHeader.FreeNode() == BPLUSTREE_NULL)
+		return B_OK;
+
+	CachedNode cached(this);
+	const bplustree_node* node = cached.SetTo(lastOffset, false);
+	if (node == NULL)
+		RETURN_ERROR(B_IO_ERROR);
+
+	status_t status;
+	if (node->OverflowLink() == BPLUSTREE_FREE)
+		status = _UnlinkFreeNode(transaction, lastOffset, node->LeftLink());
+	else {
+		bool moved;
+		status = _MoveNode(transaction, node, lastOffset, &moved);
+		if (status == B_OK && !moved)
+			return B_OK;
+	}
+	if (status != B_OK)
+		return status;
+
+	cached.Unset();
+
+	CachedNode cachedHeader(this);
+	bplustree_header* header = cachedHeader.SetToWritableHeader(transaction);
+	if (header == NULL)
+		return B_IO_ERROR;
+
+	header->maximum_size = HOST_ENDIAN_TO_BFS_INT64(lastOffset);
+	cachedHeader.Unset();
+
+	status = fStream->SetFileSize(transaction, lastOffset);
+	if (status != B_OK)
+		return status;
+
+	*_freed = true;
+	return B_OK;
+}
+
+
+/*!	Removes the free node at \a offset, whose successor is \a next, from
+	the list of free nodes.
+*/
+status_t
+BPlusTree::_UnlinkFreeNode(Transaction& transaction, off_t offset, off_t next)
+{
+	if (fHeader.FreeNode() == offset) {
+		CachedNode cached(this);
+		bplustree_header* header = cached.SetToWritableHeader(transaction);
+		if (header == NULL)
+			return B_IO_ERROR;
+
+		header->free_node_pointer = HOST_ENDIAN_TO_BFS_INT64(next);
+		return B_OK;
+	}
+
+	off_t maxNodes = fHeader.MaximumSize() / fNodeSize;
+	off_t freeOffset = fHeader.FreeNode();
+
+	CachedNode cached(this);
+	for (off_t count = 0; freeOffset != BPLUSTREE_NULL && count < maxNodes;
+			count++) {
+		const bplustree_node* node = cached.SetTo(freeOffset, false);
+		if (node == NULL)
+			RETURN_ERROR(B_IO_ERROR);
+		if (node->OverflowLink() != BPLUSTREE_FREE)
+			break;
+
+		if (node->LeftLink() == offset) {
+			bplustree_node* writableNode = cached.MakeWritable(transaction);
+			if (writableNode == NULL)
+				return B_IO_ERROR;
+
+			writableNode->left_link = HOST_ENDIAN_TO_BFS_INT64(next);
+			return B_OK;
+		}
+
+		freeOffset = node->LeftLink();
+	}
+
+	FATAL(("free node %" B_PRIdOFF " is not in the free list, inode %"
+		B_PRIdOFF "\n", offset, fStream->ID()));
+	RETURN_ERROR(B_BAD_DATA);
+}
+
+
+/*!	Moves the \a node at \a offset into the first free node of the tree,
+	if it's in front of it. This only works for nodes that can be found
+	in the tree, \a _moved will be false if it's not one of those.
+*/
+status_t
+BPlusTree::_MoveNode(Transaction& transaction, const bplustree_node* node,
+	off_t offset, bool* _moved)
+{
+	*_moved = false;
+
+	if (fHeader.FreeNode() >= offset)
+		return B_OK;
+
+	node_and_key parentAndKey;
+	parentAndKey.nodeOffset = BPLUSTREE_NULL;
+	if (offset != fHeader.RootNode()) {
+		status_t status = _FindParent(node, offset, parentAndKey);
+		if (status == B_ENTRY_NOT_FOUND)
+			return B_OK;
+		if (status != B_OK)
+			return status;
+	}
+
+	CachedNode cachedNew(this);
+	bplustree_node* newNode;
+	off_t newOffset;
+	status_t status = cachedNew.Allocate(transaction, &newNode, &newOffset);
+	if (status != B_OK)
+		return status;
+
+	memcpy(newNode, node, fNodeSize);
+
+	// update the links to the node
+
+	CachedNode cached(this);
+	if (parentAndKey.nodeOffset == BPLUSTREE_NULL) {
+		bplustree_header* header = cached.SetToWritableHeader(transaction);
+		if (header == NULL)
+			return B_IO_ERROR;
+
+		header->root_node_pointer = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	} else {
+		bplustree_node* parent = cached.SetToWritable(transaction,
+			parentAndKey.nodeOffset);
+		if (parent == NULL)
+			return B_IO_ERROR;
+
+		if (parentAndKey.keyIndex < parent->NumKeys()) {
+			parent->Values()[parentAndKey.keyIndex]
+				= HOST_ENDIAN_TO_BFS_INT64(newOffset);
+		} else
+			parent->overflow_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+
+	if (newNode->LeftLink() != BPLUSTREE_NULL) {
+		bplustree_node* left = cached.SetToWritable(transaction,
+			newNode->LeftLink());
+		if (left == NULL)
+			return B_IO_ERROR;
+
+		left->right_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+	if (newNode->RightLink() != BPLUSTREE_NULL) {
+		bplustree_node* right = cached.SetToWritable(transaction,
+			newNode->RightLink());
+		if (right == NULL)
+			return B_IO_ERROR;
+
+		right->left_link = HOST_ENDIAN_TO_BFS_INT64(newOffset);
+	}
+
+	_UpdateIterators(offset, newOffset, 0, 0, 0);
+
+	*_moved = true;
+	return B_OK;
+}
 #endif // !_BOOT_MODE
 
 
@@ -2328,6 +2827,253 @@ BPlusTree::Find(const uint8* key, uint16 keyLength, off_t* _value)
 
 
 #if !_BOOT_MODE
+/*!	Returns the (estimated) number of entries in the tree, including all
+	duplicates.
+*/
+off_t
+BPlusTree::CountEntries()
+{
+	return EstimateEntries(NULL, 0, NULL, 0);
+}
+
+
+/*!	Estimates the number of entries with keys between \a from and \a to
+	(both inclusive); if either of them is \c NULL, the range is open on
+	that side.
+	The first call builds the tree statistics which are then maintained by
+	Insert() and Remove(), so this is cheap enough to be used to plan queries.
+	The estimate is only exact for the tree as a whole if it has just a
+	single level.
+*/
+off_t
+BPlusTree::EstimateEntries(const uint8* from, uint16 fromLength,
+	const uint8* to, uint16 toLength)
+{
+	InodeReadLocker locker(fStream);
+
+	if (_GetStatistics() != B_OK)
+		return -1;
+
+	const bplustree_statistics& statistics = *fStatistics;
+	int32 last = statistics.bucket_count - 1;
+	off_t entries = 0;
+
+	for (int32 i = 0; i <= last; i++) {
+		if (statistics.entries[i] == 0)
+			continue;
+
+		// bucket i contains the keys in (boundary i - 1, boundary i]
+		bool containsStart = from == NULL || (i > 0
+			&& _CompareKeys(from, fromLength, statistics.boundaries[i - 1],
+				statistics.boundary_lengths[i - 1]) <= 0);
+		bool containsEnd = to == NULL || (i < last
+			&& _CompareKeys(statistics.boundaries[i],
+				statistics.boundary_lengths[i], to, toLength) <= 0);
+
+		if (containsStart && containsEnd) {
+			entries += statistics.entries[i];
+			continue;
+		}
+
+		if ((from != NULL && i < last
+				&& _CompareKeys(from, fromLength, statistics.boundaries[i],
+					statistics.boundary_lengths[i]) > 0)
+			|| (to != NULL && i > 0
+				&& _CompareKeys(to, toLength, statistics.boundaries[i - 1],
+					statistics.boundary_lengths[i - 1]) <= 0)) {
+			// the range doesn't overlap with this bucket
+			continue;
+		}
+
+		// the range covers only part of the bucket
+		entries += max_c(statistics.entries[i] / 2, 1);
+	}
+
+	return entries;
+}
+
+
+/*!	Builds the statistics of the tree if they don't exist yet.
+	The keys of the root node are used to divide the tree into up to
+	BPLUSTREE_STATISTICS_BUCKETS buckets; the number of entries in each of
+	them is estimated from the fan-out of its leftmost path. A tree that
+	consists of only the root node is counted exactly.
+	You need to have the inode read or write locked.
+*/
+status_t
+BPlusTree::_GetStatistics()
+{
+	if (fStatistics != NULL)
+		return B_OK;
+
+	bplustree_statistics* statistics
+		= (bplustree_statistics*)malloc(sizeof(bplustree_statistics));
+	if (statistics == NULL)
+		return B_NO_MEMORY;
+
+	memset(statistics, 0, sizeof(bplustree_statistics));
+
+	CachedNode cached(this);
+	const bplustree_node* root = cached.SetTo(fHeader.RootNode());
+	if (root == NULL) {
+		free(statistics);
+		RETURN_ERROR(B_IO_ERROR);
+	}
+
+	if (root->IsLeaf()) {
+		statistics->bucket_count = 1;
+		statistics->entries[0] = _CountLeafEntries(root);
+	} else {
+		int32 children = root->NumKeys() + 1;
+		int32 bucketCount = min_c(children, BPLUSTREE_STATISTICS_BUCKETS);
+		statistics->bucket_count = bucketCount;
+
+		for (int32 i = 0; i < children; i++) {
+			int32 bucket = i * bucketCount / children;
+			if (i < children - 1
+				&& (i + 1) * bucketCount / children != bucket) {
+				// the boundary of a bucket is the key of its last child
+				uint16 length;
+				uint8* key = root->KeyAt(i, &length);
+				if (length > BPLUSTREE_STATISTICS_KEY_LENGTH)
+					length = BPLUSTREE_STATISTICS_KEY_LENGTH;
+
+				memcpy(statistics->boundaries[bucket], key, length);
+				statistics->boundary_lengths[bucket] = length;
+			}
+
+			off_t entries = _EstimateSubtreeEntries(i < children - 1
+				? BFS_ENDIAN_TO_HOST_INT64(root->Values()[i])
+				: root->OverflowLink());
+			if (entries < 0) {
+				free(statistics);
+				return B_IO_ERROR;
+			}
+			statistics->entries[bucket] += entries;
+		}
+	}
+
+	// Someone else might have been faster
+	MutexLocker _(fIteratorLock);
+	if (fStatistics == NULL)
+		fStatistics = statistics;
+	else
+		free(statistics);
+
+	return B_OK;
+}
+
+
+void
+BPlusTree::_FreeStatistics()
+{
+	free(fStatistics);
+	fStatistics = NULL;
+}
+
+
+/*!	Returns the number of entries in the given leaf \a node, including
+	duplicates.
+*/
+off_t
+BPlusTree::_CountLeafEntries(const bplustree_node* node)
+{
+	if (!fAllowDuplicates)
+		return node->NumKeys();
+
+	CachedNode cached(this);
+	off_t entries = 0;
+
+	for (int32 i = 0; i < node->NumKeys(); i++) {
+		off_t value = BFS_ENDIAN_TO_HOST_INT64(node->Values()[i]);
+		uint8 type = bplustree_node::LinkType(value);
+		if (type != BPLUSTREE_DUPLICATE_FRAGMENT
+			&& type != BPLUSTREE_DUPLICATE_NODE) {
+			entries++;
+			continue;
+		}
+
+		bool isFragment = type == BPLUSTREE_DUPLICATE_FRAGMENT;
+		off_t offset = bplustree_node::FragmentOffset(value);
+
+		for (int32 count = 0; offset != BPLUSTREE_NULL
+				&& count < kMaxCountedDuplicateNodes; count++) {
+			const bplustree_node* duplicate = cached.SetTo(offset, false);
+			if (duplicate == NULL)
+				break;
+
+			entries += duplicate->CountDuplicates(value, isFragment);
+			if (isFragment)
+				break;
+
+			offset = duplicate->RightLink();
+		}
+	}
+
+	return entries;
+}
+
+
+/*!	Estimates the number of entries in the subtree starting at \a offset
+	by assuming that all of its nodes look like the ones on its leftmost
+	path.
+*/
+off_t
+BPlusTree::_EstimateSubtreeEntries(off_t offset)
+{
+	CachedNode cached(this);
+	off_t factor = 1;
+
+	for (uint32 level = 0; level < fHeader.MaxNumberOfLevels(); level++) {
+		const bplustree_node* node = cached.SetTo(offset);
+		if (node == NULL)
+			RETURN_ERROR(B_IO_ERROR);
+
+		if (node->IsLeaf())
+			return factor * _CountLeafEntries(node);
+
+		factor *= node->NumKeys() + 1;
+		offset = node->NumKeys() > 0
+			? BFS_ENDIAN_TO_HOST_INT64(node->Values()[0])
+			: node->OverflowLink();
+	}
+
+	RETURN_ERROR(B_BAD_DATA);
+}
+
+
+int32
+BPlusTree::_FindStatisticsBucket(const uint8* key, uint16 keyLength)
+{
+	int32 last = fStatistics->bucket_count - 1;
+	for (int32 i = 0; i < last; i++) {
+		if (_CompareKeys(key, keyLength, fStatistics->boundaries[i],
+				fStatistics->boundary_lengths[i]) <= 0)
+			return i;
+	}
+
+	return last;
+}
+
+
+/*!	Keeps the statistics up to date after a key has been inserted or
+	removed. The buckets are not changed, even if the root node is.
+	You need to have the inode write locked.
+*/
+void
+BPlusTree::_UpdateStatistics(const uint8* key, uint16 keyLength, int32 change)
+{
+	if (fStatistics == NULL)
+		return;
+
+	off_t& entries = fStatistics->entries[_FindStatisticsBucket(key,
+		keyLength)];
+	entries += change;
+	if (entries < 0)
+		entries = 0;
+}
+
+
 status_t
 BPlusTree::_ValidateChildren(TreeCheck& check, uint32 level, off_t offset,
 	const uint8* largestKey, uint16 largestKeyLength,
@@ -2563,6 +3309,7 @@ TreeIterator::TreeIterator(BPlusTree* tree)
 	fCurrentNodeOffset(BPLUSTREE_NULL)
 {
 #if !_BOOT_MODE
+	fReadAheadStart = fReadAheadEnd = 0;
 	tree->_AddIterator(this);
 #endif
 }
@@ -2714,6 +3461,10 @@ TreeIterator::Traverse(int8 direction, void* key, uint16* keyLength,
 
 		// are there any more nodes?
 		if (fCurrentNodeOffset != BPLUSTREE_NULL) {
+#if !_BOOT_MODE
+			if (forward)
+				_ReadAhead(fCurrentNodeOffset);
+#endif
 			node = cached.SetTo(fCurrentNodeOffset);
 			if (!node)
 				RETURN_ERROR(B_ERROR);
@@ -2844,6 +3595,29 @@ TreeIterator::SkipDuplicates()
 }
 
 
+#if !_BOOT_MODE
+/*!	Leaf nodes are often stored one after the other, especially when their
+	keys were inserted in order, so when moving forward to the node at
+	\a offset, the nodes behind it are read ahead as well. The next read
+	ahead is started when half of the previous one has been passed.
+*/
+void
+TreeIterator::_ReadAhead(off_t offset)
+{
+	off_t size = kReadAheadNodes * fTree->fNodeSize;
+	bool inWindow = offset >= fReadAheadStart && offset < fReadAheadEnd;
+	if (inWindow && offset + size / 2 < fReadAheadEnd)
+		return;
+
+	off_t start = inWindow ? fReadAheadEnd : offset;
+	fReadAheadStart = offset;
+	fReadAheadEnd = offset + size;
+
+	fTree->_Prefetch(start, fReadAheadEnd - start);
+}
+#endif
+
+
 void
 TreeIterator::Update(off_t offset, off_t nextOffset, uint16 keyIndex,
 	uint16 splitAt, int8 change)
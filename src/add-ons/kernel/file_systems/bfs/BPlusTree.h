@@ -132,6 +132,25 @@ struct bplustree_node {
 #define NUM_FRAGMENT_VALUES 7
 #define NUM_DUPLICATE_VALUES 125
 
+#if !_BOOT_MODE
+#define BPLUSTREE_STATISTICS_BUCKETS	32
+#define BPLUSTREE_STATISTICS_KEY_LENGTH	32
+
+// In memory statistics about the keys of a tree, used by the query planner.
+// The keys are divided into buckets by (some of) the keys of the root node;
+// the number of entries in each bucket is estimated once, and then kept up
+// to date when the tree is changed.
+struct bplustree_statistics {
+	int32		bucket_count;
+	off_t		entries[BPLUSTREE_STATISTICS_BUCKETS];
+	uint16		boundary_lengths[BPLUSTREE_STATISTICS_BUCKETS - 1];
+	uint8		boundaries[BPLUSTREE_STATISTICS_BUCKETS - 1]
+					[BPLUSTREE_STATISTICS_KEY_LENGTH];
+		// bucket i contains the keys up to boundary i, the last bucket all
+		// keys after the last boundary
+};
+#endif // !_BOOT_MODE
+
 //**************************************
 
 enum bplustree_traversing {
@@ -284,12 +303,21 @@ public:
 			status_t			Replace(Transaction& transaction,
 									const uint8* key, uint16 keyLength,
 									off_t value);
+
+			status_t			Compact(Transaction& transaction,
+									off_t* _cookie, uint32* _merged,
+									uint32* _freed);
 #endif // !_BOOT_MODE
 
 			status_t			Find(const uint8* key, uint16 keyLength,
 									off_t* value);
 
 #if !_BOOT_MODE
+			off_t				CountEntries();
+			off_t				EstimateEntries(const uint8* from,
+									uint16 fromLength, const uint8* to,
+									uint16 toLength);
+
 	static	int32				TypeCodeToKeyType(type_code code);
 	static	int32				ModeToKeyType(mode_t mode);
 
@@ -309,6 +337,12 @@ private:
 									const uint8* key, uint16 keyLength,
 									uint16* index = NULL, off_t* next = NULL);
 #if !_BOOT_MODE
+			status_t			_Insert(Transaction& transaction,
+									const uint8* key, uint16 keyLength,
+									off_t value);
+			status_t			_Remove(Transaction& transaction,
+									const uint8* key, uint16 keyLength,
+									off_t value);
 			status_t			_SeekDown(Stack<node_and_key>& stack,
 									const uint8* key, uint16 keyLength);
 
@@ -335,11 +369,25 @@ private:
 									off_t value);
 			void				_RemoveKey(bplustree_node* node, uint16 index);
 
+			status_t			_FindParent(const bplustree_node* node,
+									off_t offset, node_and_key& _parent);
+			status_t			_MergeWithRightSibling(
+									Transaction& transaction, off_t offset,
+									off_t* _next, bool* _merged);
+			status_t			_FreeLastNode(Transaction& transaction,
+									bool* _freed);
+			status_t			_UnlinkFreeNode(Transaction& transaction,
+									off_t offset, off_t next);
+			status_t			_MoveNode(Transaction& transaction,
+									const bplustree_node* node, off_t offset,
+									bool* _moved);
+
 			void				_UpdateIterators(off_t offset, off_t nextOffset,
 									uint16 keyIndex, uint16 splitAt,
 									int8 change);
 			void				_AddIterator(TreeIterator* iterator);
 			void				_RemoveIterator(TreeIterator* iterator);
+			void				_Prefetch(off_t offset, off_t size);
 
 			status_t			_ValidateChildren(TreeCheck& check,
 									uint32 level, off_t offset,
@@ -350,6 +398,15 @@ private:
 									off_t offset, off_t lastOffset,
 									off_t nextOffset, const uint8* key,
 									uint16 keyLength);
+
+			status_t			_GetStatistics();
+			void				_FreeStatistics();
+			off_t				_CountLeafEntries(const bplustree_node* node);
+			off_t				_EstimateSubtreeEntries(off_t offset);
+			int32				_FindStatisticsBucket(const uint8* key,
+									uint16 keyLength);
+			void				_UpdateStatistics(const uint8* key,
+									uint16 keyLength, int32 change);
 #endif // !_BOOT_MODE
 
 private:
@@ -367,6 +424,8 @@ private:
 #if !_BOOT_MODE
 			mutex				fIteratorLock;
 			SinglyLinkedList<TreeIterator> fIterators;
+
+			bplustree_statistics* fStatistics;
 #endif
 };
 
@@ -409,6 +468,10 @@ private:
 									int8 change);
 			void				Stop();
 
+#if !_BOOT_MODE
+			void				_ReadAhead(off_t offset);
+#endif
+
 private:
 			BPlusTree*			fTree;
 			off_t				fCurrentNodeOffset;
@@ -418,6 +481,11 @@ private:
 			uint16				fDuplicate;
 			uint16				fNumDuplicates;
 			bool				fIsFragment;
+#if !_BOOT_MODE
+			off_t				fReadAheadStart;
+			off_t				fReadAheadEnd;
+									// the nodes that have been read ahead
+#endif
 };
 
 
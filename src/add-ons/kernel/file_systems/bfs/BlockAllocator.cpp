@@ -753,10 +753,14 @@ BlockAllocator::Uninitialize()
 
 	The number of allocated blocks is always a multiple of \a minimum which
 	has to be a power of two value.
+
+	Blocks that are reserved for delayed allocations are not available,
+	except for the \a reserved blocks the caller itself has reserved.
 */
 status_t
 BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
-	uint16 start, uint16 maximum, uint16 minimum, block_run& run)
+	uint16 start, uint16 maximum, uint16 minimum, block_run& run,
+	off_t reserved)
 {
 	if (maximum == 0)
 		return B_BAD_VALUE;
@@ -764,6 +768,14 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 	FUNCTION_START(("group = %ld, start = %u, maximum = %u, minimum = %u\n",
 		groupIndex, start, maximum, minimum));
 
+	// This is checked again below, as someone might reserve blocks in the
+	// mean time
+	off_t available = fVolume->AvailableBlocks() + reserved;
+	if (available < minimum)
+		return B_DEVICE_FULL;
+	if (available < maximum)
+		maximum = available;
+
 	AllocationBlock cached(fVolume);
 	RecursiveLocker lock(fLock);
 
@@ -915,8 +927,29 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 		bestLength = round_down(bestLength, minimum);
 	}
 
-	if (fGroups[bestGroup].Allocate(transaction, bestStart, bestLength) != B_OK)
+	{
+		// Account for the blocks in the same step as checking the
+		// reservations, so that Volume::ReserveBlocks() cannot interfere
+		MutexLocker volumeLocker(fVolume->Lock());
+		if (bestLength > fVolume->AvailableBlocks() + reserved)
+			return B_DEVICE_FULL;
+
+		fVolume->SuperBlock().used_blocks
+			= HOST_ENDIAN_TO_BFS_INT64(fVolume->UsedBlocks() + bestLength);
+			// We are not writing back the disk's superblock - it's
+			// either done by the journaling code, or when the disk
+			// is unmounted.
+			// If the value is not correct at mount time, it will be
+			// fixed anyway.
+	}
+
+	if (fGroups[bestGroup].Allocate(transaction, bestStart, bestLength)
+			!= B_OK) {
+		MutexLocker volumeLocker(fVolume->Lock());
+		fVolume->SuperBlock().used_blocks
+			= HOST_ENDIAN_TO_BFS_INT64(fVolume->UsedBlocks() - bestLength);
 		RETURN_ERROR(B_IO_ERROR);
+	}
 
 	CHECK_ALLOCATION_GROUP(bestGroup);
 
@@ -924,14 +957,6 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 	run.start = HOST_ENDIAN_TO_BFS_INT16(bestStart);
 	run.length = HOST_ENDIAN_TO_BFS_INT16(bestLength);
 
-	fVolume->SuperBlock().used_blocks
-		= HOST_ENDIAN_TO_BFS_INT64(fVolume->UsedBlocks() + bestLength);
-		// We are not writing back the disk's superblock - it's
-		// either done by the journaling code, or when the disk
-		// is unmounted.
-		// If the value is not correct at mount time, it will be
-		// fixed anyway.
-
 	// We need to flush any remaining blocks in the new allocation to make sure
 	// they won't interfere with the file cache.
 	block_cache_discard(fVolume->BlockCache(), fVolume->ToBlock(run),
@@ -992,7 +1017,7 @@ BlockAllocator::Allocate(Transaction& transaction, Inode* inode,
 
 	// Are there already allocated blocks? (then just try to allocate near the
 	// last one)
-	if (inode->Size() > 0) {
+	if (inode->Node().data.Size() > 0) {
 		const data_stream& data = inode->Node().data;
 		// TODO: we currently don't care for when the data stream
 		// is already grown into the indirect ranges
@@ -1016,7 +1041,8 @@ BlockAllocator::Allocate(Transaction& transaction, Inode* inode,
 		group = inode->BlockRun().AllocationGroup() + 1;
 	}
 
-	return AllocateBlocks(transaction, group, start, numBlocks, minimum, run);
+	return AllocateBlocks(transaction, group, start, numBlocks, minimum, run,
+		inode->ReservedBlocks());
 }
 
 
@@ -1072,6 +1098,8 @@ BlockAllocator::Free(Transaction& transaction, block_run run)
 	}
 #endif
 
+	// the volume lock protects the block reservations against this, too
+	MutexLocker volumeLocker(fVolume->Lock());
 	fVolume->SuperBlock().used_blocks =
 		HOST_ENDIAN_TO_BFS_INT64(fVolume->UsedBlocks() - run.Length());
 	return B_OK;
@@ -1966,6 +1994,15 @@ BlockAllocator::_CheckInodeBlocks(Inode* inode, const char* name)
 		return B_OK;
 	}
 
+	if (inode->HasInlineData()) {
+		// the data of inline files is stored in the inode itself
+		if (!fVolume->HasInlineData()
+			|| inode->Node().data.MaxDirectRange() != 0)
+			return B_BAD_DATA;
+
+		return B_OK;
+	}
+
 	data_stream* data = &inode->Node().data;
 
 	// check the direct range
@@ -71,9 +71,12 @@ dump_super_block(const disk_super_block* superBlock)
 	kprintf("  log_end        = %" B_PRIdOFF "\n", superBlock->LogEnd());
 	kprintf("  magic3         = %#08x (%s) %s\n", (int)superBlock->Magic3(),
 		get_tupel(superBlock->magic3),
-		(superBlock->magic3 == SUPER_BLOCK_MAGIC3 ? "valid" : "INVALID"));
+		(superBlock->Magic3() == (int32)SUPER_BLOCK_MAGIC3
+			|| superBlock->Magic3() == (int32)SUPER_BLOCK_MAGIC3_INCOMPATIBLE
+				? "valid" : "INVALID"));
 	dump_block_run("  root_dir       = ", superBlock->root_dir);
 	dump_block_run("  indices        = ", superBlock->indices);
+	kprintf("  features       = %#08x\n", (unsigned)superBlock->Features());
 }
 
 
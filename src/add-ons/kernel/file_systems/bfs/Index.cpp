@@ -17,6 +17,33 @@
 #include "BPlusTree.h"
 
 
+// number of source index entries that are added to a trigram index per
+// transaction while it is filled, and per round the journal is locked for
+static const int32 kTrigramFillBatch = 64;
+static const int32 kTrigramFillRound = 1024;
+
+
+// The trigram index that is currently being filled; all keys of the source
+// index up to and including \a key have already been added to it.
+struct trigram_fill {
+	ino_t	index;
+	uint8	key[BPLUSTREE_MAX_KEY_LENGTH + 1];
+	uint16	length;
+};
+
+
+/*!	Returns whether or not the trigram \a fill has already added the \a key
+	to its index. The caller must hold the journal lock.
+*/
+static bool
+trigram_key_filled(const trigram_fill& fill, const uint8* key, uint16 length)
+{
+	return key != NULL && fill.length > 0
+		&& QueryParser::compareKeys(B_STRING_TYPE, key, length, fill.key,
+			fill.length) <= 0;
+}
+
+
 Index::Index(Volume* volume)
 	:
 	fVolume(volume),
@@ -209,6 +236,79 @@ Index::Create(Transaction& transaction, const char* name, uint32 type)
 }
 
 
+/*!	Creates the trigram index \a name, and fills it with the trigrams of all
+	keys of the index it belongs to. That index must already exist, as it is
+	also the one that keeps the trigram index up to date.
+	The journal is only locked for a round of keys at a time while the index
+	is filled; Update() maintains the trigrams of the keys the fill has
+	already passed, and leaves the others to it.
+	Only one trigram index can be filled at a time.
+*/
+status_t
+Index::CreateTrigrams(const char* name)
+{
+	if (!IsTrigramIndex(name))
+		return B_BAD_VALUE;
+
+	Index source(fVolume);
+	if (source.SetTo(name + strlen(BFS_TRIGRAM_INDEX_PREFIX)) != B_OK)
+		return B_BAD_INDEX;
+	if (source.Type() != B_STRING_TYPE)
+		return B_BAD_TYPE;
+
+	Journal* journal = fVolume->GetJournal(0);
+	status_t status = journal->Lock(NULL, true);
+	if (status != B_OK)
+		return status;
+
+	if (fVolume->TrigramFill() != NULL) {
+		journal->Unlock(NULL, true);
+		return B_BUSY;
+	}
+
+	{
+		Transaction transaction(fVolume, fVolume->Indices());
+
+		status = Create(transaction, name, B_STRING_TYPE);
+		if (status == B_OK)
+			status = transaction.Done();
+	}
+
+	trigram_fill fill;
+	if (status == B_OK) {
+		fill.index = Node()->ID();
+		fill.length = 0;
+
+		fVolume->AddTrigramIndices(1);
+		fVolume->SetTrigramFill(&fill);
+	}
+
+	journal->Unlock(NULL, true);
+	if (status != B_OK)
+		RETURN_ERROR(status);
+
+	status = _FillTrigrams(source, fill);
+	if (status != B_OK) {
+		// don't leave an incomplete index behind
+		Unset();
+
+		if (journal->Lock(NULL, true) == B_OK) {
+			fVolume->SetTrigramFill(NULL);
+
+			Transaction transaction(fVolume, fVolume->Indices());
+			if (fVolume->IndicesNode()->Remove(transaction, name) == B_OK
+				&& transaction.Done() == B_OK)
+				fVolume->AddTrigramIndices(-1);
+
+			journal->Unlock(NULL, true);
+		} else
+			fVolume->SetTrigramFill(NULL);
+	}
+
+	RETURN_ERROR(status);
+}
+
+
 /*!	Updates the specified index, the oldKey will be removed from, the newKey
 	inserted into the tree.
 	If the method returns B_BAD_INDEX, it means the index couldn't be found -
@@ -276,6 +376,12 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 			inode->ID());
 	}
 
+	if (status == B_OK && type == B_STRING_TYPE
+		&& fVolume->HasTrigramIndices()) {
+		status = _UpdateTrigrams(transaction, name, oldKey, oldLength, newKey,
+			newLength, inode->ID());
+	}
+
 	RETURN_ERROR(status);
 }
 
@@ -392,3 +498,280 @@ Index::UpdateLastModified(Transaction& transaction, Inode* inode,
 	return status;
 }
 
+
+
+/*!	Returns whether or not \a name is the name of a trigram index, that is
+	the name of an attribute prefixed by BFS_TRIGRAM_INDEX_PREFIX.
+*/
+/*static*/ bool
+Index::IsTrigramIndex(const char* name)
+{
+	size_t prefixLength = strlen(BFS_TRIGRAM_INDEX_PREFIX);
+	return !strncmp(name, BFS_TRIGRAM_INDEX_PREFIX, prefixLength)
+		&& name[prefixLength] != '\0';
+}
+
+
+/*static*/ status_t
+Index::GetTrigramIndexName(const char* attribute, char* name, size_t size)
+{
+	if ((size_t)snprintf(name, size, "%s%s", BFS_TRIGRAM_INDEX_PREFIX,
+			attribute) >= size)
+		return B_NAME_TOO_LONG;
+
+	return B_OK;
+}
+
+
+/*!	Fills the \a trigrams array with the distinct trigrams of the string
+	\a key in ascending order, and returns their number. The array must have
+	room for \a length entries.
+	The trigrams are folded to lower case, so that the index can be used for
+	case insensitive searches, too.
+*/
+/*static*/ int32
+Index::GetTrigrams(const uint8* key, uint16 length, uint32* trigrams)
+{
+	if (key == NULL)
+		return 0;
+
+	length = strnlen((const char*)key, length);
+
+	int32 count = 0;
+	for (int32 i = 0; i + 2 < length; i++) {
+		uint32 trigram = (FoldTrigramChar(key[i]) << 16)
+			| (FoldTrigramChar(key[i + 1]) << 8) | FoldTrigramChar(key[i + 2]);
+
+		// insert it sorted, and ignore duplicates; there are only a few
+		// hundred of them at most
+		int32 index = count;
+		while (index > 0 && trigrams[index - 1] > trigram)
+			index--;
+		if (index > 0 && trigrams[index - 1] == trigram)
+			continue;
+
+		memmove(&trigrams[index + 1], &trigrams[index],
+			(count - index) * sizeof(uint32));
+		trigrams[index] = trigram;
+		count++;
+	}
+
+	return count;
+}
+
+
+/*!	Returns whether or not the trigram index with the given \a id is still
+	being filled, and therefore can't be used yet.
+*/
+/*static*/ bool
+Index::IsFillingTrigrams(Volume* volume, ino_t id)
+{
+	trigram_fill* fill = volume->TrigramFill();
+	return fill != NULL && fill->index == id;
+}
+
+
+/*static*/ void
+Index::GetTrigramKey(uint32 trigram, uint8* key)
+{
+	key[0] = (trigram >> 16) & 0xff;
+	key[1] = (trigram >> 8) & 0xff;
+	key[2] = trigram & 0xff;
+}
+
+
+/*!	Updates the trigram index of the attribute \a name, if there is one.
+*/
+status_t
+Index::_UpdateTrigrams(Transaction& transaction, const char* name,
+	const uint8* oldKey, uint16 oldLength, const uint8* newKey,
+	uint16 newLength, ino_t id)
+{
+	char indexName[B_FILE_NAME_LENGTH];
+	if (IsTrigramIndex(name)
+		|| GetTrigramIndexName(name, indexName, sizeof(indexName)) != B_OK)
+		return B_OK;
+
+	Index index(fVolume);
+	if (index.SetTo(indexName) != B_OK)
+		return B_OK;
+
+	trigram_fill* fill = fVolume->TrigramFill();
+	if (fill != NULL && fill->index == index.Node()->ID()) {
+		// leave the keys the fill hasn't reached yet to it
+		if (!trigram_key_filled(*fill, oldKey, oldLength))
+			oldKey = NULL;
+		if (!trigram_key_filled(*fill, newKey, newLength))
+			newKey = NULL;
+	}
+
+	return index._ChangeTrigrams(transaction, oldKey, oldLength, newKey,
+		newLength, id);
+}
+
+
+/*!	Removes the trigrams of \a oldKey from this trigram index, and adds
+	those of \a newKey. Trigrams that are part of both keys are left alone.
+	A key with more than MAX_KEY_TRIGRAMS trigrams is only added under
+	OVERFLOW_TRIGRAM, so that changing a key never costs more than twice
+	that many tree operations.
+*/
+status_t
+Index::_ChangeTrigrams(Transaction& transaction, const uint8* oldKey,
+	uint16 oldLength, const uint8* newKey, uint16 newLength, ino_t id)
+{
+	BPlusTree* tree = Node()->Tree();
+	if (tree == NULL)
+		return B_BAD_VALUE;
+
+	uint32* oldTrigrams = (uint32*)malloc(
+		(oldLength + newLength + 1) * sizeof(uint32));
+	if (oldTrigrams == NULL)
+		return B_NO_MEMORY;
+
+	int32 oldCount = GetTrigrams(oldKey, oldLength, oldTrigrams);
+	if (oldCount > MAX_KEY_TRIGRAMS) {
+		oldTrigrams[0] = OVERFLOW_TRIGRAM;
+		oldCount = 1;
+	}
+	uint32* newTrigrams = oldTrigrams + oldCount;
+	int32 newCount = GetTrigrams(newKey, newLength, newTrigrams);
+	if (newCount > MAX_KEY_TRIGRAMS) {
+		newTrigrams[0] = OVERFLOW_TRIGRAM;
+		newCount = 1;
+	}
+
+	Node()->WriteLockInTransaction(transaction);
+
+	status_t status = B_OK;
+	int32 oldIndex = 0;
+	int32 newIndex = 0;
+
+	while (status == B_OK && (oldIndex < oldCount || newIndex < newCount)) {
+		uint8 key[3];
+
+		if (newIndex == newCount || (oldIndex < oldCount
+				&& oldTrigrams[oldIndex] < newTrigrams[newIndex])) {
+			GetTrigramKey(oldTrigrams[oldIndex++], key);
+
+			status = tree->Remove(transaction, key, sizeof(key), id);
+			if (status == B_ENTRY_NOT_FOUND)
+				status = B_OK;
+		} else if (oldIndex == oldCount
+			|| newTrigrams[newIndex] < oldTrigrams[oldIndex]) {
+			GetTrigramKey(newTrigrams[newIndex++], key);
+
+			status = tree->Insert(transaction, key, sizeof(key), id);
+		} else {
+			oldIndex++;
+			newIndex++;
+		}
+	}
+
+	free(oldTrigrams);
+	RETURN_ERROR(status);
+}
+
+
+/*!	Adds the trigrams of all keys in the \a source index to this one, one
+	round at a time. When it's done, the \a fill is removed from the volume.
+*/
+status_t
+Index::_FillTrigrams(Index& source, trigram_fill& fill)
+{
+	if (source.Node()->Tree() == NULL)
+		return B_BAD_VALUE;
+
+	Journal* journal = fVolume->GetJournal(0);
+
+	while (true) {
+		status_t status = journal->Lock(NULL, true);
+		if (status != B_OK)
+			RETURN_ERROR(status);
+
+		status = _FillTrigramRound(source, fill);
+		if (status == B_ENTRY_NOT_FOUND) {
+			// from now on, Update() takes care of all keys
+			fVolume->SetTrigramFill(NULL);
+			status = B_OK;
+		}
+
+		journal->Unlock(NULL, true);
+
+		if (status != B_OK)
+			RETURN_ERROR(status);
+		if (fVolume->TrigramFill() != &fill)
+			return B_OK;
+	}
+}
+
+
+/*!	Adds the trigrams of the keys of the \a source index that follow the
+	last key of the \a fill, and advances it. A round only ends in front of
+	a new key, so that all entries of the last one have been added.
+	Returns B_ENTRY_NOT_FOUND if there are no more keys.
+	The caller must hold the journal lock.
+*/
+status_t
+Index::_FillTrigramRound(Index& source, trigram_fill& fill)
+{
+	InodeReadLocker locker(source.Node());
+	TreeIterator iterator(source.Node()->Tree());
+
+	// skip the entries of the last key, they have already been added, or
+	// were maintained by Update() since
+	bool skip = false;
+	if (fill.length > 0) {
+		status_t status = iterator.Find(fill.key, fill.length);
+		if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+			RETURN_ERROR(status);
+
+		skip = status == B_OK;
+	}
+
+	status_t status = B_OK;
+	int32 count = 0;
+	bool roundDone = false;
+
+	while (status == B_OK && !roundDone) {
+		Transaction transaction(fVolume, Node()->BlockNumber());
+
+		for (int32 i = 0; i < kTrigramFillBatch; i++) {
+			uint8 key[BPLUSTREE_MAX_KEY_LENGTH + 1];
+			uint16 length;
+			off_t id;
+
+			status = iterator.GetNextEntry(key, &length, sizeof(key), &id);
+			if (status != B_OK)
+				break;
+
+			bool sameKey = fill.length > 0
+				&& !QueryParser::compareKeys(B_STRING_TYPE, key, length,
+					fill.key, fill.length);
+			if (skip) {
+				if (sameKey)
+					continue;
+				skip = false;
+			} else if (!sameKey && count >= kTrigramFillRound) {
+				roundDone = true;
+				break;
+			}
+
+			status = _ChangeTrigrams(transaction, NULL, 0, key, length, id);
+			if (status != B_OK)
+				break;
+
+			memcpy(fill.key, key, length);
+			fill.length = length;
+			count++;
+		}
+
+		if (status == B_OK || status == B_ENTRY_NOT_FOUND) {
+			status_t doneStatus = transaction.Done();
+			if (doneStatus != B_OK)
+				status = doneStatus;
+		}
+	}
+
+	return status;
+}
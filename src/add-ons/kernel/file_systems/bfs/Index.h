@@ -12,6 +12,14 @@
 class Transaction;
 class Volume;
 class Inode;
+struct trigram_fill;
+
+
+// Keys with more distinct trigrams than MAX_KEY_TRIGRAMS are only added to
+// a trigram index under OVERFLOW_TRIGRAM, which no string of UTF-8 characters
+// contains; every trigram query has to look at its entries, too.
+#define MAX_KEY_TRIGRAMS	32
+#define OVERFLOW_TRIGRAM	0xffffff
 
 
 class Index {
@@ -23,11 +31,13 @@ public:
 			void			Unset();
 
 			Inode*			Node() const { return fNode; };
+			Volume*			GetVolume() const { return fVolume; }
 			uint32			Type();
 			size_t			KeySize();
 
 			status_t		Create(Transaction& transaction, const char* name,
 								uint32 type);
+			status_t		CreateTrigrams(const char* name);
 
 			status_t		Update(Transaction& transaction, const char* name,
 								int32 type, const uint8* oldKey,
@@ -53,6 +63,31 @@ public:
 			status_t		UpdateLastModified(Transaction& transaction,
 								Inode* inode, bigtime_t modified = -1);
 
+	static	bool			IsTrigramIndex(const char* name);
+	static	status_t		GetTrigramIndexName(const char* attribute,
+								char* name, size_t size);
+	static	int32			GetTrigrams(const uint8* key, uint16 length,
+								uint32* trigrams);
+	static	void			GetTrigramKey(uint32 trigram, uint8* key);
+	static	uint8			FoldTrigramChar(uint8 c)
+								{ return c >= 'A' && c <= 'Z'
+									? c - 'A' + 'a' : c; }
+	static	bool			IsFillingTrigrams(Volume* volume, ino_t id);
+
+private:
+			status_t		_UpdateTrigrams(Transaction& transaction,
+								const char* name, const uint8* oldKey,
+								uint16 oldLength, const uint8* newKey,
+								uint16 newLength, ino_t id);
+			status_t		_ChangeTrigrams(Transaction& transaction,
+								const uint8* oldKey, uint16 oldLength,
+								const uint8* newKey, uint16 newLength,
+								ino_t id);
+			status_t		_FillTrigrams(Index& source,
+								trigram_fill& fill);
+			status_t		_FillTrigramRound(Index& source,
+								trigram_fill& fill);
+
 private:
 							Index(const Index& other);
 							Index& operator=(const Index& other);
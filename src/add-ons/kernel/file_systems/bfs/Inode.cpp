@@ -12,6 +12,10 @@
 #include "BPlusTree.h"
 #include "Index.h"
 
+#if !defined(FS_SHELL) && !defined(_BOOT_MODE)
+#	include <low_resource_manager.h>
+#endif
+
 
 #if BFS_TRACING && !defined(FS_SHELL) && !defined(_BOOT_MODE)
 namespace BFSInodeTracing {
@@ -342,7 +346,9 @@ Inode::Inode(Volume* volume, ino_t id)
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fDelayedSize(0),
+	fReservedBlocks(0)
 {
 	PRINT(("Inode::Inode(volume = %p, id = %Ld) @ %p\n", volume, id, this));
 
@@ -372,7 +378,9 @@ Inode::Inode(Volume* volume, Transaction& transaction, ino_t id, mode_t mode,
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fDelayedSize(0),
+	fReservedBlocks(0)
 {
 	PRINT(("Inode::Inode(volume = %p, transaction = %p, id = %Ld) @ %p\n",
 		volume, &transaction, id, this));
@@ -407,6 +415,9 @@ Inode::~Inode()
 {
 	PRINT(("Inode::~Inode() @ %p\n", this));
 
+	if (fReservedBlocks > 0)
+		fVolume->UnreserveBlocks(fReservedBlocks);
+
 	file_cache_delete(FileCache());
 	file_map_delete(Map());
 	delete fTree;
@@ -546,7 +557,10 @@ Inode::_MakeSpaceForSmallData(Transaction& transaction, bfs_inode* node,
 		int32 index = 0, maxIndex = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
 			// should not remove those
-			if (*item->Name() == FILE_NAME_NAME || !strcmp(name, item->Name()))
+			if (*item->Name() == FILE_NAME_NAME
+				|| *item->Name() == INLINE_DATA_NAME
+				|| *item->Name() == UNWRITTEN_DATA_NAME
+				|| !strcmp(name, item->Name()))
 				continue;
 
 			if (max == NULL || max->Size() < item->Size()) {
@@ -1372,8 +1386,9 @@ Inode::ContainerContentsChanged(Transaction& transaction)
 off_t
 Inode::AllocatedSize() const
 {
-	if (IsSymLink() && (Flags() & INODE_LONG_SYMLINK) == 0) {
-		// This symlink does not have a data stream
+	if ((IsSymLink() && (Flags() & INODE_LONG_SYMLINK) == 0)
+		|| HasInlineData()) {
+		// This node does not have a data stream
 		return Node().InodeSize();
 	}
 
@@ -1556,12 +1571,37 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 
 	locker.Unlock();
 
+	// If the file grows, and we can postpone allocating its blocks until
+	// its data is written back, we don't need a transaction at all
+	bool delayAllocation = changeSize && !transaction.IsStarted()
+		&& _CanDelayAllocation(pos + length);
+
 	// the transaction doesn't have to be started already
-	if (changeSize && !transaction.IsStarted())
+	if (changeSize && !delayAllocation && !transaction.IsStarted())
 		transaction.Start(fVolume, BlockNumber());
 
 	WriteLocker writeLocker(fLock);
 
+	if (delayAllocation && (uint64)pos + (uint64)length > (uint64)Size()) {
+		off_t oldSize = Size();
+		status_t status = _SetDelayedSize(pos + length);
+		if (status == B_OK) {
+			writeLocker.Unlock();
+
+			if (oldSize < pos)
+				FillGapWithZeros(oldSize, pos);
+			if (length == 0)
+				return B_OK;
+
+			return _WriteToFileCache(pos, buffer, _length);
+		}
+
+		// we could not reserve the blocks, allocate them right away instead
+		writeLocker.Unlock();
+		transaction.Start(fVolume, BlockNumber());
+		writeLocker.Lock();
+	}
+
 	// Work around possible race condition: Someone might have shrunken the file
 	// while we had no lock.
 	if (!transaction.IsStarted()
@@ -1605,7 +1645,7 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 	if (length == 0)
 		return B_OK;
 
-	status_t status = file_cache_write(FileCache(), NULL, pos, buffer, _length);
+	status_t status = _WriteToFileCache(pos, buffer, _length);
 
 	if (transaction.IsStarted())
 		WriteLockInTransaction(transaction);
@@ -1630,7 +1670,7 @@ Inode::FillGapWithZeros(off_t pos, off_t newSize)
 		else
 			size = newSize - pos;
 
-		status_t status = file_cache_write(FileCache(), NULL, pos, NULL, &size);
+		status_t status = _WriteToFileCache(pos, NULL, &size);
 		if (status < B_OK)
 			return status;
 
@@ -1711,7 +1751,7 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 	// do we have enough free blocks on the disk?
 	off_t blocksNeeded = (bytes + fVolume->BlockSize() - 1)
 		>> fVolume->BlockShift();
-	if (blocksNeeded > fVolume->FreeBlocks())
+	if (blocksNeeded > fVolume->AvailableBlocks() + fReservedBlocks)
 		return B_DEVICE_FULL;
 
 	off_t blocksRequested = blocksNeeded;
@@ -1723,9 +1763,10 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 	// Attributes, attribute directories, and long symlinks usually won't get
 	// that big, and should stay close to the inode - preallocating could be
 	// counterproductive.
-	// Also, if free disk space is tight, don't preallocate.
+	// Also, if free disk space is tight, don't preallocate; blocks reserved
+	// for delayed allocations (including our own) are not free for that.
 	if (!IsAttribute() && !IsAttributeDirectory() && !IsSymLink()
-		&& fVolume->FreeBlocks() > 128) {
+		&& fVolume->AvailableBlocks() > 128) {
 		off_t roundTo = 0;
 		if (IsFile()) {
 			// Request preallocated blocks depending on the file size and growth
@@ -1770,6 +1811,12 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 		if (status != B_OK)
 			return status;
 
+		if (IsFile()) {
+			bfs_allocation_stats& stats = fVolume->AllocationStats();
+			atomic_add64((int64*)&stats.data_runs, 1);
+			atomic_add64((int64*)&stats.data_blocks, run.Length());
+		}
+
 		// okay, we have the needed blocks, so just distribute them to the
 		// different ranges of the stream (direct, indirect & double indirect)
 
@@ -2216,6 +2263,33 @@ Inode::SetFileSize(Transaction& transaction, off_t size)
 	if (size == oldSize)
 		return B_OK;
 
+	if (HasDelayedAllocation()) {
+		// Shrinking within the unallocated part doesn't need to touch the
+		// data stream; anything else needs the stream to be up to date first
+		status_t status;
+		if (size > Node().data.Size() && size < oldSize)
+			return _SetDelayedSize(size);
+		if (size <= Node().data.Size())
+			status = _SetDelayedSize(0);
+		else
+			status = AllocateDelayedBlocks(transaction);
+		if (status != B_OK)
+			return status;
+
+		oldSize = Size();
+		if (size == oldSize)
+			return WriteBack(transaction);
+	}
+
+	if (_CanUseInlineData(size))
+		return _SetInlineDataSize(transaction, size);
+	if (HasInlineData()) {
+		// the file outgrows its inode
+		status_t status = _MoveInlineData(transaction);
+		if (status != B_OK)
+			return status;
+	}
+
 	T(Resize(this, oldSize, size, false));
 
 	// should the data stream grow or shrink?
@@ -2233,6 +2307,12 @@ Inode::SetFileSize(Transaction& transaction, off_t size)
 	if (status < B_OK)
 		return status;
 
+	if (HasUnwrittenData() && size < oldSize) {
+		status = _TrimUnwrittenExtents(transaction, size);
+		if (status != B_OK)
+			return status;
+	}
+
 	file_cache_set_size(FileCache(), size);
 	file_map_set_size(Map(), size);
 
@@ -2247,6 +2327,862 @@ Inode::Append(Transaction& transaction, off_t bytes)
 }
 
 
+/*!	Allocates the blocks for all data that has been written beyond the end of
+	the data stream, and updates the stream's size accordingly.
+	The inode must be write locked.
+*/
+status_t
+Inode::AllocateDelayedBlocks(Transaction& transaction)
+{
+	if (!HasDelayedAllocation())
+		return B_OK;
+
+	off_t allocatedSize = Node().data.Size();
+	off_t size = fDelayedSize;
+
+	T(Resize(this, allocatedSize, size, false));
+
+	// The reservation is kept until the blocks have been allocated, so that
+	// _GrowStream() can take it into account.
+	status_t status = _GrowStream(transaction, size);
+	if (status != B_OK) {
+		_ShrinkStream(transaction, allocatedSize);
+		return status;
+	}
+
+	bfs_allocation_stats& stats = fVolume->AllocationStats();
+	atomic_add64((int64*)&stats.delayed_allocations, 1);
+	atomic_add64((int64*)&stats.delayed_blocks, fReservedBlocks);
+
+	fVolume->UnreserveBlocks(fReservedBlocks);
+	fReservedBlocks = 0;
+	fDelayedSize = 0;
+
+	// the file map only knows the new range as a sparse one so far
+	off_t offset = round_down(allocatedSize, fVolume->BlockSize());
+	file_map_invalidate(Map(), offset, size - offset);
+
+	return WriteBack(transaction);
+}
+
+
+/*!	Same as above, but runs in its own transaction. If \a wait is \c false,
+	and the journal is currently in use, this method returns
+	\c B_WOULD_BLOCK instead of waiting for it. Writing back pages must
+	never wait, as the owner of the journal might wait for them to become
+	unbusy in file_cache_set_size().
+	The inode must not be locked.
+*/
+status_t
+Inode::AllocateDelayedBlocks(bool wait)
+{
+	if (!HasDelayedAllocation())
+		return B_OK;
+
+	Transaction transaction;
+	status_t status = wait ? transaction.Start(fVolume, BlockNumber())
+		: transaction.TryStart(fVolume, BlockNumber());
+	if (status != B_OK)
+		return status;
+
+	WriteLockInTransaction(transaction);
+
+	status = AllocateDelayedBlocks(transaction);
+	if (status == B_OK)
+		status = transaction.Done();
+
+	return status;
+}
+
+
+/*!	Makes sure that the blocks for the range from \a pos to \a pos + \a length
+	are allocated, and grows the file if necessary. Since BFS files cannot
+	have holes, only the delayed allocation needs to be done for a range
+	within the file.
+	The blocks of the new part of the file are not cleared, but remembered
+	as an unwritten extent instead; they read as zeros until they are written
+	to. The caller still has to clear the rest of the last block of the old
+	file with FillGapWithZeros(), once the inode is no longer locked.
+	The inode must be write locked.
+*/
+status_t
+Inode::Preallocate(Transaction& transaction, off_t pos, off_t length)
+{
+	off_t size = pos + length;
+	if (pos < 0 || length <= 0 || size < pos)
+		return B_BAD_VALUE;
+	if (!IsFile())
+		return B_BAD_VALUE;
+
+	off_t oldSize = Size();
+	if (size <= oldSize) {
+		// the range might not have any blocks yet
+		if (HasDelayedAllocation())
+			return AllocateDelayedBlocks(transaction);
+		return B_OK;
+	}
+
+	status_t status = SetFileSize(transaction, size);
+	if (status != B_OK || HasInlineData())
+		return status;
+
+#if defined(FS_SHELL) || defined(_BOOT_MODE)
+	// nothing preallocates here, the caller fills the file with zeros
+	return B_OK;
+#else
+	uint32 blockSize = fVolume->BlockSize();
+	off_t start = round_up(oldSize, blockSize);
+	off_t end = round_up(size, blockSize);
+	if (start >= end)
+		return B_OK;
+
+	// older drivers must not expose the contents of the new blocks
+	status = fVolume->AddFeatures(SUPER_BLOCK_FEATURE_UNWRITTEN_DATA);
+	if (status != B_OK)
+		return status;
+
+	unwritten_extent extents[MAX_UNWRITTEN_EXTENTS + 1];
+	int32 count;
+
+	{
+		NodeGetter node(fVolume, this);
+		if (node.Node() == NULL)
+			return B_IO_ERROR;
+
+		RecursiveLocker locker(fSmallDataLock);
+		count = _GetUnwrittenExtents(node.Node(), extents);
+	}
+
+	// all other extents lie within the old file size
+	if (count > 0 && extents[count - 1].End() == start) {
+		extents[count - 1].length = HOST_ENDIAN_TO_BFS_INT64(
+			end - extents[count - 1].Offset());
+	} else {
+		extents[count].offset = HOST_ENDIAN_TO_BFS_INT64(start);
+		extents[count].length = HOST_ENDIAN_TO_BFS_INT64(end - start);
+		count++;
+	}
+
+	status = _SetUnwrittenExtents(transaction, extents, count);
+	if (status != B_OK)
+		return status;
+
+	// the file map only knows the new range as a sparse one from now on
+	file_map_invalidate(Map(), start, end - start);
+	return B_OK;
+#endif
+}
+
+
+/*!	Looks up the first unwritten extent that ends behind \a offset, and
+	returns its range in \a _start, and \a _end. If \a offset is unwritten,
+	\a _start is not behind it.
+	Returns \c B_ENTRY_NOT_FOUND if there is no such extent.
+*/
+status_t
+Inode::FindUnwrittenExtent(off_t offset, off_t& _start, off_t& _end)
+{
+	if (!HasUnwrittenData())
+		return B_ENTRY_NOT_FOUND;
+
+	NodeGetter node(fVolume, this);
+	if (node.Node() == NULL)
+		return B_IO_ERROR;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	unwritten_extent extents[MAX_UNWRITTEN_EXTENTS];
+	int32 count = _GetUnwrittenExtents(node.Node(), extents);
+
+	for (int32 i = 0; i < count; i++) {
+		if (extents[i].End() > offset) {
+			_start = extents[i].Offset();
+			_end = extents[i].End();
+			return B_OK;
+		}
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+/*!	Prepares the range from \a pos to \a end for being written to: the range
+	is removed from the unwritten extents, so that it can be mapped, and
+	written to as usual afterwards. Only the unwritten blocks at its edges
+	that the range does not completely cover are cleared on disk.
+	The inode must be write locked.
+*/
+status_t
+Inode::InitializeUnwritten(Transaction& transaction, off_t pos, off_t end)
+{
+	if (!HasUnwrittenData())
+		return B_OK;
+
+	uint32 blockSize = fVolume->BlockSize();
+	off_t start = round_down(pos, blockSize);
+	off_t blockEnd = round_up(end, blockSize);
+
+	unwritten_extent extents[MAX_UNWRITTEN_EXTENTS];
+	int32 count;
+
+	{
+		NodeGetter node(fVolume, this);
+		if (node.Node() == NULL)
+			return B_IO_ERROR;
+
+		RecursiveLocker locker(fSmallDataLock);
+		count = _GetUnwrittenExtents(node.Node(), extents);
+	}
+
+	// splitting an extent might need one more entry
+	unwritten_extent newExtents[MAX_UNWRITTEN_EXTENTS + 1];
+	int32 newCount = 0;
+	bool headCleared = false;
+	bool changed = false;
+
+	for (int32 i = 0; i < count; i++) {
+		off_t extentStart = extents[i].Offset();
+		off_t extentEnd = extents[i].End();
+		if (extentEnd <= start || extentStart >= blockEnd) {
+			newExtents[newCount++] = extents[i];
+			continue;
+		}
+
+		// The data is written after us, so only the parts of the first, and
+		// the last block that it does not cover need to be cleared
+		status_t status = B_OK;
+		if (pos > start && start >= extentStart) {
+			status = _ZeroBlocks(start, start + blockSize);
+			headCleared = true;
+		}
+		if (status == B_OK && end < blockEnd && blockEnd <= extentEnd
+			&& (!headCleared || blockEnd - blockSize != start))
+			status = _ZeroBlocks(blockEnd - blockSize, blockEnd);
+		if (status != B_OK)
+			return status;
+
+		if (extentStart < start) {
+			unwritten_extent& head = newExtents[newCount++];
+			head.offset = HOST_ENDIAN_TO_BFS_INT64(extentStart);
+			head.length = HOST_ENDIAN_TO_BFS_INT64(start - extentStart);
+		}
+		if (extentEnd > blockEnd) {
+			unwritten_extent& tail = newExtents[newCount++];
+			tail.offset = HOST_ENDIAN_TO_BFS_INT64(blockEnd);
+			tail.length = HOST_ENDIAN_TO_BFS_INT64(extentEnd - blockEnd);
+		}
+		changed = true;
+	}
+
+	if (!changed)
+		return B_OK;
+
+	status_t status = _SetUnwrittenExtents(transaction, newExtents, newCount);
+	if (status != B_OK)
+		return status;
+
+	file_map_invalidate(Map(), start, blockEnd - start);
+	return B_OK;
+}
+
+
+/*!	Same as above, but runs in its own transaction, if the range touches any
+	unwritten extent at all. If \a wait is \c false, and the journal is
+	currently in use, this method returns \c B_WOULD_BLOCK instead of waiting
+	for it. Only the page writer may do that, as the owner of the journal
+	might wait for its pages.
+	The inode must not be locked.
+*/
+status_t
+Inode::InitializeUnwritten(off_t pos, off_t end, bool wait)
+{
+	off_t extentStart;
+	off_t extentEnd;
+	status_t status = FindUnwrittenExtent(pos, extentStart, extentEnd);
+	if (status == B_ENTRY_NOT_FOUND || (status == B_OK && extentStart >= end))
+		return B_OK;
+	if (status != B_OK)
+		return status;
+
+	Transaction transaction;
+	status = wait ? transaction.Start(fVolume, BlockNumber())
+		: transaction.TryStart(fVolume, BlockNumber());
+	if (status != B_OK)
+		return status;
+
+	WriteLockInTransaction(transaction);
+
+	status = InitializeUnwritten(transaction, pos, end);
+	if (status == B_OK)
+		status = transaction.Done();
+
+	return status;
+}
+
+
+/*!	Returns the number of physically contiguous extents the data stream
+	consists of; only the allocated part of the stream is taken into account.
+*/
+uint32
+Inode::CountFileExtents()
+{
+	InodeReadLocker locker(this);
+
+	off_t size = Node().data.Size();
+	off_t offset = 0;
+	off_t lastBlock = -1;
+	uint32 count = 0;
+
+	while (offset < size) {
+		block_run run;
+		off_t fileOffset;
+		if (FindBlockRun(offset, run, fileOffset) != B_OK)
+			break;
+
+		if (fVolume->ToBlock(run) != lastBlock)
+			count++;
+
+		lastBlock = fVolume->ToBlock(run) + run.Length();
+		offset = fileOffset + ((off_t)run.Length() << fVolume->BlockShift());
+	}
+
+	return count;
+}
+
+
+/*!	Decides whether or not the allocation of the blocks needed to grow the
+	file to \a size can be postponed until its data is written back.
+*/
+bool
+Inode::_CanDelayAllocation(off_t size) const
+{
+#if defined(FS_SHELL) || defined(_BOOT_MODE)
+	// the fs_shell file cache writes through to the disk
+	return false;
+#else
+	if (!IsFile() || FileCache() == NULL
+		|| !file_cache_is_enabled(FileCache())
+		|| low_resource_state(B_KERNEL_RESOURCE_PAGES) != B_NO_LOW_RESOURCE)
+		return false;
+
+	// files that can be stored in their inode don't need any blocks at all
+	if (HasInlineData() || _CanUseInlineData(size))
+		return false;
+
+	off_t blocks = (round_up(size, fVolume->BlockSize())
+		- round_up(Node().data.Size(), fVolume->BlockSize()))
+			>> fVolume->BlockShift();
+
+	// leave some room for the block arrays of the data stream, and others
+	return blocks + 128 < fVolume->AvailableBlocks() + fReservedBlocks;
+#endif
+}
+
+
+/*!	Writes to the file cache, which might write the data through to the
+	file right away. Writing back to blocks that still have to be allocated,
+	or that are unwritten, fails with \c B_WOULD_BLOCK if the journal is
+	busy, as the write-back must never wait for it while it keeps pages
+	busy. No pages are busy here, though, so the transaction is done here,
+	and the write is retried.
+	The inode must not be locked.
+*/
+status_t
+Inode::_WriteToFileCache(off_t pos, const uint8* buffer, size_t* _length)
+{
+	while (true) {
+		size_t length = *_length;
+		status_t status = file_cache_write(FileCache(), NULL, pos, buffer,
+			&length);
+		if (status != B_WOULD_BLOCK) {
+			*_length = length;
+			return status;
+		}
+
+		if (HasInlineData()) {
+			// Writing back inline data always needs a transaction; the
+			// write-back joins ours, as it runs in this thread
+			Transaction transaction(fVolume, BlockNumber());
+			length = *_length;
+			status = file_cache_write(FileCache(), NULL, pos, buffer,
+				&length);
+			if (status == B_OK)
+				status = transaction.Done();
+
+			*_length = length;
+			return status;
+		}
+
+		status = AllocateDelayedBlocks(true);
+		if (status == B_OK && HasUnwrittenData())
+			status = InitializeUnwritten(pos, pos + (off_t)*_length, true);
+		if (status != B_OK)
+			return status;
+	}
+}
+
+
+/*!	Sets the file size beyond the end of the data stream to \a size, and
+	reserves the blocks needed to allocate it later on. A \a size that is
+	not larger than the data stream discards the delayed allocation.
+	The inode must be write locked.
+*/
+status_t
+Inode::_SetDelayedSize(off_t size)
+{
+	off_t allocatedSize = Node().data.Size();
+	off_t blocks = 0;
+
+	if (size > allocatedSize) {
+		blocks = (round_up(size, fVolume->BlockSize())
+			- round_up(allocatedSize, fVolume->BlockSize()))
+				>> fVolume->BlockShift();
+	} else
+		size = 0;
+
+	if (blocks > fReservedBlocks) {
+		status_t status = fVolume->ReserveBlocks(blocks - fReservedBlocks);
+		if (status != B_OK)
+			return status;
+	} else if (blocks < fReservedBlocks)
+		fVolume->UnreserveBlocks(fReservedBlocks - blocks);
+
+	fReservedBlocks = blocks;
+	fDelayedSize = size;
+
+	file_cache_set_size(FileCache(), Size());
+	file_map_set_size(Map(), Size());
+	return B_OK;
+}
+
+
+/*!	Reads the data of an inline file at \a pos into the given vectors; what
+	lies beyond the end of the file is filled with zeros.
+	The inode must be read locked.
+*/
+status_t
+Inode::ReadInlineData(off_t pos, const iovec* vecs, size_t count,
+	size_t* _numBytes)
+{
+	NodeGetter node(fVolume, this);
+	if (node.Node() == NULL)
+		return B_IO_ERROR;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+	small_data* item = FindSmallData(node.Node(), nameTag);
+	if (item == NULL)
+		RETURN_ERROR(B_BAD_DATA);
+
+	off_t size = min_c((off_t)item->DataSize(), Size());
+	size_t bytesLeft = *_numBytes;
+
+	for (size_t i = 0; i < count && bytesLeft > 0; i++) {
+		uint8* buffer = (uint8*)vecs[i].iov_base;
+		size_t length = min_c(vecs[i].iov_len, bytesLeft);
+		size_t bytes = 0;
+		if (pos < size) {
+			bytes = (size_t)min_c((off_t)length, size - pos);
+			memcpy(buffer, item->Data() + pos, bytes);
+		}
+		memset(buffer + bytes, 0, length - bytes);
+
+		pos += length;
+		bytesLeft -= length;
+	}
+
+	*_numBytes -= bytesLeft;
+	return B_OK;
+}
+
+
+/*!	Writes \a length bytes from \a buffer to the data of an inline file at
+	\a pos; what lies beyond the end of the file is ignored.
+	The inode must be write locked in the \a transaction.
+*/
+status_t
+Inode::WriteInlineData(Transaction& transaction, off_t pos,
+	const uint8* buffer, size_t length)
+{
+	NodeGetter node(fVolume, transaction, this);
+	if (node.WritableNode() == NULL)
+		return B_IO_ERROR;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+	small_data* item = FindSmallData(node.Node(), nameTag);
+	if (item == NULL)
+		RETURN_ERROR(B_BAD_DATA);
+
+	off_t size = min_c((off_t)item->DataSize(), Size());
+	if (pos < size) {
+		memcpy(item->Data() + pos, buffer,
+			(size_t)min_c((off_t)length, size - pos));
+	}
+
+	return B_OK;
+}
+
+
+/*!	Writes the given vectors to the data of an inline file at \a pos in a
+	transaction of its own. This is used by bfs_write_pages() to write back
+	the file cache; like all write-back, it doesn't wait for the journal,
+	but returns \c B_WOULD_BLOCK if it is busy.
+	The inode must not be locked.
+*/
+status_t
+Inode::WriteInlineData(off_t pos, const iovec* vecs, size_t count,
+	size_t* _numBytes)
+{
+	Transaction transaction;
+	status_t status = transaction.TryStart(fVolume, BlockNumber());
+	if (status != B_OK)
+		return status;
+
+	WriteLockInTransaction(transaction);
+
+	if (!HasInlineData()) {
+		// The data has just been moved into a data stream of its own, the
+		// pages will be written there next time
+		transaction.Done();
+		return B_WOULD_BLOCK;
+	}
+
+	size_t bytesLeft = *_numBytes;
+
+	for (size_t i = 0; i < count && bytesLeft > 0; i++) {
+		size_t length = min_c(vecs[i].iov_len, bytesLeft);
+		status = WriteInlineData(transaction, pos,
+			(const uint8*)vecs[i].iov_base, length);
+		if (status != B_OK)
+			return status;
+
+		pos += length;
+		bytesLeft -= length;
+	}
+
+	return transaction.Done();
+}
+
+
+/*!	Decides whether or not the data of this file can be kept in the
+	small_data section of its inode when it has the given \a size. Only empty
+	files that don't own any blocks can be turned into inline files.
+*/
+bool
+Inode::_CanUseInlineData(off_t size) const
+{
+	if (!HasInlineData()) {
+		if (!fVolume->HasInlineData() || !IsFile() || HasDelayedAllocation()
+			|| Node().data.Size() != 0 || Node().data.MaxDirectRange() != 0)
+			return false;
+	}
+
+	if (size >= fVolume->InodeSize())
+		return false;
+
+	NodeGetter node(fVolume, this);
+	if (node.Node() == NULL)
+		return false;
+
+	RecursiveLocker locker(fSmallDataLock);
+	return _InlineDataFits(node.Node(), size);
+}
+
+
+/*!	Checks if \a size bytes of file data fit into the small_data section of
+	the given node, without having to move any other attribute out of it.
+	Enough space is left for the name to grow to its maximum length, as
+	renaming a file must not fail because of its data.
+	You need to hold the fSmallDataLock when you call this method
+*/
+bool
+Inode::_InlineDataFits(const bfs_inode* node, off_t size) const
+{
+	ASSERT_LOCKED_RECURSIVE(&fSmallDataLock);
+
+	off_t needed = sizeof(small_data) + INLINE_DATA_NAME_LENGTH + 3 + size + 1
+		+ sizeof(small_data) + FILE_NAME_NAME_LENGTH + 3
+		+ INODE_FILE_NAME_LENGTH;
+
+	small_data* item = NULL;
+	while (_GetNextSmallData(const_cast<bfs_inode*>(node), &item) == B_OK) {
+		if (item->NameSize() == 1 && (*item->Name() == FILE_NAME_NAME
+				|| *item->Name() == INLINE_DATA_NAME))
+			continue;
+
+		needed += item->Size();
+	}
+
+	return needed <= (off_t)(fVolume->InodeSize() - sizeof(bfs_inode));
+}
+
+
+/*!	Resizes the data of an inline file, and turns an empty file into one if
+	necessary. The caller must have made sure that the data fits.
+	The inode must be write locked.
+*/
+status_t
+Inode::_SetInlineDataSize(Transaction& transaction, off_t size)
+{
+	NodeGetter node(fVolume, transaction, this);
+	if (node.WritableNode() == NULL)
+		return B_IO_ERROR;
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+
+	if (!HasInlineData()) {
+		status_t status = _AddSmallData(transaction, node, nameTag,
+			INLINE_DATA_TYPE, 0, (const uint8*)"", 0);
+		if (status != B_OK)
+			return status;
+
+		Node().flags |= HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+	}
+
+	// growing the data fills the gap with zeros
+	status_t status = _AddSmallData(transaction, node, nameTag,
+		INLINE_DATA_TYPE, size, (const uint8*)"", 0);
+	if (status != B_OK)
+		return status;
+
+	T(Resize(this, Size(), size, false));
+
+	Node().data.size = HOST_ENDIAN_TO_BFS_INT64(size);
+
+	file_cache_set_size(FileCache(), size);
+	file_map_set_size(Map(), size);
+
+	return WriteBack(transaction);
+}
+
+
+/*!	Moves the data of an inline file into a data stream of its own, so that
+	it can grow beyond its inode. The data is written directly to its new
+	blocks; any newer data the file cache holds will be written later on.
+	The inode must be write locked.
+*/
+status_t
+Inode::_MoveInlineData(Transaction& transaction)
+{
+	off_t size = Size();
+	uint32 blockSize = fVolume->BlockSize();
+
+	uint8* buffer = (uint8*)malloc(blockSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	memset(buffer, 0, blockSize);
+
+	NodeGetter node(fVolume, transaction, this);
+	if (node.WritableNode() == NULL) {
+		free(buffer);
+		return B_IO_ERROR;
+	}
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+
+	{
+		RecursiveLocker locker(fSmallDataLock);
+
+		small_data* item = FindSmallData(node.Node(), nameTag);
+		if (item == NULL) {
+			free(buffer);
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		memcpy(buffer, item->Data(), min_c((off_t)item->DataSize(), size));
+	}
+
+	status_t status = _RemoveSmallData(transaction, node, nameTag);
+	if (status == B_OK) {
+		Node().flags &= ~HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+		Node().data.size = 0;
+
+		status = _GrowStream(transaction, size);
+	}
+
+	block_run run;
+	off_t offset;
+	if (status == B_OK && size > 0
+		&& (status = FindBlockRun(0, run, offset)) == B_OK
+		&& write_pos(fVolume->Device(), fVolume->ToOffset(run), buffer,
+			blockSize) != (ssize_t)blockSize) {
+		status = B_IO_ERROR;
+	}
+	if (status == B_OK)
+		file_map_invalidate(Map(), 0, size);
+
+	free(buffer);
+	return status;
+}
+
+
+/*!	Copies the unwritten extents of the file into \a extents, which must have
+	room for \c MAX_UNWRITTEN_EXTENTS entries, and returns their number.
+	You need to hold the fSmallDataLock when you call this method
+*/
+int32
+Inode::_GetUnwrittenExtents(const bfs_inode* node,
+	unwritten_extent* extents) const
+{
+	ASSERT_LOCKED_RECURSIVE(&fSmallDataLock);
+
+	const char nameTag[2] = {UNWRITTEN_DATA_NAME, 0};
+	small_data* item = FindSmallData(node, nameTag);
+	if (item == NULL)
+		return 0;
+
+	int32 count = min_c(item->DataSize() / sizeof(unwritten_extent),
+		MAX_UNWRITTEN_EXTENTS);
+	memcpy(extents, item->Data(), count * sizeof(unwritten_extent));
+	return count;
+}
+
+
+/*!	Replaces the unwritten extents of the file with the \a count sorted
+	\a extents, and removes the unwritten state if there are none left.
+	If they do not fit into the inode, the smallest ones are cleared on disk
+	instead, and are forgotten about.
+	The inode must be write locked.
+*/
+status_t
+Inode::_SetUnwrittenExtents(Transaction& transaction,
+	unwritten_extent* extents, int32 count)
+{
+	NodeGetter node(fVolume, transaction, this);
+	if (node.WritableNode() == NULL)
+		return B_IO_ERROR;
+
+	const char nameTag[2] = {UNWRITTEN_DATA_NAME, 0};
+
+	while (count > 0) {
+		status_t status = B_DEVICE_FULL;
+		if (count <= MAX_UNWRITTEN_EXTENTS) {
+			status = _AddSmallData(transaction, node, nameTag,
+				UNWRITTEN_DATA_TYPE, 0, (const uint8*)extents,
+				count * sizeof(unwritten_extent));
+		}
+		if (status == B_OK) {
+			Node().flags |= HOST_ENDIAN_TO_BFS_INT32(INODE_UNWRITTEN_DATA);
+			return WriteBack(transaction);
+		}
+		if (status != B_DEVICE_FULL)
+			return status;
+
+		int32 smallest = 0;
+		for (int32 i = 1; i < count; i++) {
+			if (extents[i].Length() < extents[smallest].Length())
+				smallest = i;
+		}
+
+		status = _ZeroBlocks(extents[smallest].Offset(),
+			extents[smallest].End());
+		if (status != B_OK)
+			return status;
+
+		file_map_invalidate(Map(), extents[smallest].Offset(),
+			extents[smallest].Length());
+
+		count--;
+		memmove(&extents[smallest], &extents[smallest + 1],
+			(count - smallest) * sizeof(unwritten_extent));
+	}
+
+	status_t status = _RemoveSmallData(transaction, node, nameTag);
+	if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+		return status;
+
+	Node().flags &= ~HOST_ENDIAN_TO_BFS_INT32(INODE_UNWRITTEN_DATA);
+	return WriteBack(transaction);
+}
+
+
+/*!	Cuts off everything behind the last block of a file of \a size bytes
+	from its unwritten extents.
+	The inode must be write locked.
+*/
+status_t
+Inode::_TrimUnwrittenExtents(Transaction& transaction, off_t size)
+{
+	off_t end = round_up(size, fVolume->BlockSize());
+
+	unwritten_extent extents[MAX_UNWRITTEN_EXTENTS];
+	int32 count;
+
+	{
+		NodeGetter node(fVolume, this);
+		if (node.Node() == NULL)
+			return B_IO_ERROR;
+
+		RecursiveLocker locker(fSmallDataLock);
+		count = _GetUnwrittenExtents(node.Node(), extents);
+	}
+
+	if (count == 0 || extents[count - 1].End() <= end)
+		return B_OK;
+
+	while (count > 0 && extents[count - 1].Offset() >= end)
+		count--;
+	if (count > 0 && extents[count - 1].End() > end) {
+		extents[count - 1].length = HOST_ENDIAN_TO_BFS_INT64(
+			end - extents[count - 1].Offset());
+	}
+
+	return _SetUnwrittenExtents(transaction, extents, count);
+}
+
+
+/*!	Clears the blocks of the data stream from \a offset to \a end directly on
+	disk, bypassing the file cache. Both offsets must be block aligned.
+	The inode must be locked.
+*/
+status_t
+Inode::_ZeroBlocks(off_t offset, off_t end)
+{
+	if (offset >= end)
+		return B_OK;
+
+	const size_t kBufferSize = 65536;
+	uint8* buffer = (uint8*)malloc(kBufferSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	memset(buffer, 0, kBufferSize);
+
+	status_t status = B_OK;
+	while (status == B_OK && offset < end) {
+		block_run run;
+		off_t fileOffset;
+		status = FindBlockRun(offset, run, fileOffset);
+		if (status != B_OK)
+			break;
+
+		off_t diskOffset = fVolume->ToOffset(run) + offset - fileOffset;
+		off_t length = min_c(((off_t)run.Length() << fVolume->BlockShift())
+			- (offset - fileOffset), end - offset);
+
+		while (length > 0) {
+			size_t bytes = (size_t)min_c(length, (off_t)kBufferSize);
+			if (write_pos(fVolume->Device(), diskOffset, buffer, bytes)
+					!= (ssize_t)bytes) {
+				status = B_IO_ERROR;
+				break;
+			}
+
+			diskOffset += bytes;
+			offset += bytes;
+			length -= bytes;
+		}
+	}
+
+	free(buffer);
+	return status;
+}
+
+
 /*!	Checks whether or not this inode's data stream needs to be trimmed
 	because of an earlier preallocation.
 	Returns true if there are any blocks to be trimmed.
@@ -2258,7 +3194,8 @@ Inode::NeedsTrimming() const
 	// possible. There are only few indices anyway, so this doesn't hurt.
 	// Also, if an inode is already in deleted state, we don't bother trimming
 	// it.
-	if (IsIndex() || IsDeleted()
+	// Delayed allocations need to be committed before.
+	if (IsIndex() || IsDeleted() || HasDelayedAllocation()
 		|| (IsSymLink() && (Flags() & INODE_LONG_SYMLINK) == 0))
 		return false;
 
@@ -2325,8 +3262,24 @@ Inode::Free(Transaction& transaction)
 status_t
 Inode::Sync()
 {
-	if (FileCache())
+	if (FileCache()) {
+		if (HasDelayedAllocation()) {
+			status_t status = AllocateDelayedBlocks(true);
+			if (status != B_OK)
+				return status;
+		}
+		if (HasInlineData() || HasUnwrittenData()) {
+			// Writing back inline data, or into unwritten blocks needs a
+			// transaction, but the write-back doesn't wait for the journal;
+			// it just joins our transaction, as it runs in this thread.
+			Transaction transaction(fVolume, BlockNumber());
+			status_t status = file_cache_sync(FileCache());
+			if (status == B_OK)
+				status = transaction.Done();
+			return status;
+		}
 		return file_cache_sync(FileCache());
+	}
 
 	// We may also want to flush the attribute's data stream to
 	// disk here... (do we?)
@@ -2823,8 +3776,12 @@ AttributeIterator::GetNext(char* name, size_t* _length, uint32* _type,
 
 		int32 index = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
-			if (item->NameSize() == FILE_NAME_NAME_LENGTH
-				&& *item->Name() == FILE_NAME_NAME)
+			if ((item->NameSize() == FILE_NAME_NAME_LENGTH
+					&& *item->Name() == FILE_NAME_NAME)
+				|| (item->NameSize() == INLINE_DATA_NAME_LENGTH
+					&& *item->Name() == INLINE_DATA_NAME)
+				|| (item->NameSize() == UNWRITTEN_DATA_NAME_LENGTH
+					&& *item->Name() == UNWRITTEN_DATA_NAME))
 				continue;
 
 			if (index >= fCurrentSmallData)
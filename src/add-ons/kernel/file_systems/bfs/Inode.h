@@ -87,7 +87,10 @@ public:
 			uint32				Type() const { return fNode.Type(); }
 			int32				Flags() const { return fNode.Flags(); }
 
-			off_t				Size() const { return fNode.data.Size(); }
+			off_t				Size() const
+									{ return fDelayedSize > 0
+										? fDelayedSize : fNode.data.Size(); }
+									// includes data not yet allocated
 			off_t				AllocatedSize() const;
 			off_t				LastModified() const
 									{ return fNode.LastModifiedTime(); }
@@ -155,6 +158,40 @@ public:
 			status_t			Free(Transaction& transaction);
 			status_t			Sync();
 
+			// delayed allocation
+			bool				HasDelayedAllocation() const
+									{ return fDelayedSize > 0; }
+			status_t			AllocateDelayedBlocks(Transaction& transaction);
+			status_t			AllocateDelayedBlocks(bool wait);
+			off_t				ReservedBlocks() const
+									{ return fReservedBlocks; }
+			uint32				CountFileExtents();
+
+			// inline data
+			bool				HasInlineData() const
+									{ return (Flags() & INODE_INLINE_DATA)
+										!= 0; }
+			status_t			ReadInlineData(off_t pos, const iovec* vecs,
+									size_t count, size_t* _numBytes);
+			status_t			WriteInlineData(Transaction& transaction,
+									off_t pos, const uint8* buffer,
+									size_t length);
+			status_t			WriteInlineData(off_t pos, const iovec* vecs,
+									size_t count, size_t* _numBytes);
+
+			// preallocation
+			status_t			Preallocate(Transaction& transaction,
+									off_t pos, off_t length);
+			bool				HasUnwrittenData() const
+									{ return (Flags() & INODE_UNWRITTEN_DATA)
+										!= 0; }
+			status_t			FindUnwrittenExtent(off_t offset,
+									off_t& _start, off_t& _end);
+			status_t			InitializeUnwritten(Transaction& transaction,
+									off_t pos, off_t end);
+			status_t			InitializeUnwritten(off_t pos, off_t end,
+									bool wait);
+
 			bfs_inode&			Node() { return fNode; }
 			const bfs_inode&	Node() const { return fNode; }
 
@@ -250,6 +287,26 @@ private:
 			status_t			_ShrinkStream(Transaction& transaction,
 									off_t size);
 
+			bool				_CanDelayAllocation(off_t size) const;
+			status_t			_WriteToFileCache(off_t pos,
+									const uint8* buffer, size_t* _length);
+			status_t			_SetDelayedSize(off_t size);
+
+			bool				_CanUseInlineData(off_t size) const;
+			bool				_InlineDataFits(const bfs_inode* node,
+									off_t size) const;
+			status_t			_SetInlineDataSize(Transaction& transaction,
+									off_t size);
+			status_t			_MoveInlineData(Transaction& transaction);
+
+			int32				_GetUnwrittenExtents(const bfs_inode* node,
+									unwritten_extent* extents) const;
+			status_t			_SetUnwrittenExtents(Transaction& transaction,
+									unwritten_extent* extents, int32 count);
+			status_t			_TrimUnwrittenExtents(
+									Transaction& transaction, off_t size);
+			status_t			_ZeroBlocks(off_t offset, off_t end);
+
 private:
 			rw_lock				fLock;
 			Volume*				fVolume;
@@ -265,6 +322,11 @@ private:
 				// we need those values to ensure we will remove
 				// the correct keys from the indices
 
+			off_t				fDelayedSize;
+			off_t				fReservedBlocks;
+				// the file size, and the number of blocks reserved for it,
+				// when data was written beyond the allocated data stream
+
 			mutable recursive_lock fSmallDataLock;
 			SinglyLinkedList<AttributeIterator> fIterators;
 };
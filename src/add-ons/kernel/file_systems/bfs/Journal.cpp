@@ -404,11 +404,16 @@ Journal::Journal(Volume* volume)
 	fMaxTransactionSize(fLogSize / 2 - 5),
 	fUsed(0),
 	fUnwrittenTransactions(0),
+	fCompletedTransactions(0),
+	fLoggedTransactions(0),
 	fHasSubtransaction(false),
 	fSeparateSubTransactions(false)
 {
 	recursive_lock_init(&fLock, "bfs journal");
 	mutex_init(&fEntriesLock, "bfs journal entries");
+
+	memset(&fStats, 0, sizeof(fStats));
+	fStats.mounted = system_time();
 }
 
 
@@ -754,6 +759,10 @@ Journal::_WriteTransactionToLog()
 		}
 	}
 
+	// All completed transactions are part of this log entry, but the
+	// sub-transaction we detach (the last one)
+	int32 loggedTransactions = fCompletedTransactions - (detached ? 1 : 0);
+
 	if (runArrays.CountBlocks() == 0) {
 		// nothing has changed during this transaction
 		if (detached) {
@@ -765,6 +774,7 @@ Journal::_WriteTransactionToLog()
 				NULL);
 			fUnwrittenTransactions = 0;
 		}
+		fLoggedTransactions = loggedTransactions;
 		return B_OK;
 	}
 
@@ -780,6 +790,7 @@ Journal::_WriteTransactionToLog()
 
 	// Write log entries to disk
 
+	bigtime_t startTime = system_time();
 	int32 maxVecs = runArrays.MaxArrayLength() + 1;
 		// one extra for the index block
 
@@ -879,6 +890,12 @@ Journal::_WriteTransactionToLog()
 	// If that call fails, we can't do anything about it anyway
 	ioctl(fVolume->Device(), B_FLUSH_DRIVE_CACHE);
 
+	fStats.log_writes++;
+	fStats.logged_transactions += loggedTransactions - fLoggedTransactions;
+	fStats.logged_blocks += runArrays.LogEntryLength();
+	fStats.log_write_time += system_time() - startTime;
+	fLoggedTransactions = loggedTransactions;
+
 	// at this point, we can finally end the transaction - we're in
 	// a guaranteed valid state
 
@@ -911,10 +928,17 @@ Journal::_WriteTransactionToLog()
 
 /*!	Flushes the current log entry to disk. If \a flushBlocks is \c true it will
 	also write back all dirty blocks for this volume.
+	Callers that come in while the log is being written will wait for the
+	journal; they are all served with a single log write, and the ones whose
+	transactions have been written by someone else in the mean time do not
+	need to write anything at all.
 */
 status_t
 Journal::_FlushLog(bool canWait, bool flushBlocks)
 {
+	int32 completed = atomic_get(&fCompletedTransactions);
+	bool pending = completed - atomic_get(&fLoggedTransactions) > 0;
+
 	status_t status = canWait ? recursive_lock_lock(&fLock)
 		: recursive_lock_trylock(&fLock);
 	if (status != B_OK)
@@ -926,9 +950,16 @@ Journal::_FlushLog(bool canWait, bool flushBlocks)
 		return B_OK;
 	}
 
+	fStats.log_flushes++;
+
 	// write the current log entry to disk
 
-	if (fUnwrittenTransactions != 0 && _TransactionSize() != 0) {
+	if (fLoggedTransactions - completed >= 0) {
+		// Our transactions are already in the log; if there were any, another
+		// flush took care of them while we were waiting
+		if (pending)
+			fStats.merged_log_flushes++;
+	} else if (fUnwrittenTransactions != 0 && _TransactionSize() != 0) {
 		status = _WriteTransactionToLog();
 		if (status < B_OK)
 			FATAL(("writing current log entry failed: %s\n", strerror(status)));
@@ -942,6 +973,16 @@ Journal::_FlushLog(bool canWait, bool flushBlocks)
 }
 
 
+/*!	Makes sure that all transactions that were completed before this call
+	are in the log on disk, ie. that they will survive a crash.
+*/
+status_t
+Journal::FlushLog()
+{
+	return _FlushLog(true, false);
+}
+
+
 /*!	Flushes the current log entry to disk, and also writes back all dirty
 	blocks for this volume (completing all open transactions).
 */
@@ -953,9 +994,10 @@ Journal::FlushLogAndBlocks()
 
 
 status_t
-Journal::Lock(Transaction* owner, bool separateSubTransactions)
+Journal::Lock(Transaction* owner, bool separateSubTransactions, bool wait)
 {
-	status_t status = recursive_lock_lock(&fLock);
+	status_t status = wait
+		? recursive_lock_lock(&fLock) : recursive_lock_trylock(&fLock);
 	if (status != B_OK)
 		return status;
 
@@ -1036,6 +1078,17 @@ Journal::Unlock(Transaction* owner, bool success)
 }
 
 
+void
+Journal::GetStatistics(bfs_journal_stats& stats)
+{
+	RecursiveLocker locker(fLock);
+
+	stats = fStats;
+	stats.transactions = (uint32)fCompletedTransactions;
+	stats.unwritten_transactions = fUnwrittenTransactions;
+}
+
+
 uint32
 Journal::_TransactionSize() const
 {
@@ -1061,11 +1114,14 @@ Journal::_TransactionDone(bool success)
 		} else {
 			cache_abort_transaction(fVolume->BlockCache(), fTransactionID);
 			fUnwrittenTransactions = 0;
+			fLoggedTransactions = fCompletedTransactions;
 		}
 
 		return B_OK;
 	}
 
+	atomic_add(&fCompletedTransactions, 1);
+
 	// Up to a maximum size, we will just batch several
 	// transactions together to improve speed
 	uint32 size = _TransactionSize();
@@ -1100,6 +1156,13 @@ Journal::Dump()
 	kprintf("  max transaction size: %" B_PRIu32 "\n", fMaxTransactionSize);
 	kprintf("  used:                 %" B_PRIu32 "\n", fUsed);
 	kprintf("  unwritten:            %" B_PRId32 "\n", fUnwrittenTransactions);
+	kprintf("  completed:            %" B_PRId32 "\n", fCompletedTransactions);
+	kprintf("  logged:               %" B_PRId32 "\n", fLoggedTransactions);
+	kprintf("  log writes:           %" B_PRIu64 " (%" B_PRIu64 " transactions,"
+		" %" B_PRIu64 " blocks)\n", fStats.log_writes,
+		fStats.logged_transactions, fStats.logged_blocks);
+	kprintf("  log flushes:          %" B_PRIu64 " (%" B_PRIu64 " merged)\n",
+		fStats.log_flushes, fStats.merged_log_flushes);
 	kprintf("  timestamp:            %" B_PRId64 "\n", fTimestamp);
 	kprintf("  transaction ID:       %" B_PRId32 "\n", fTransactionID);
 	kprintf("  has subtransaction:   %d\n", fHasSubtransaction);
@@ -1169,6 +1232,28 @@ Transaction::Start(Volume* volume, off_t refBlock)
 }
 
 
+/*!	Like Start(), but doesn't wait in case another thread is currently
+	running a transaction; returns \c B_WOULD_BLOCK in this case.
+*/
+status_t
+Transaction::TryStart(Volume* volume, off_t refBlock)
+{
+	// has it already been started?
+	if (fJournal != NULL)
+		return B_OK;
+
+	fJournal = volume->GetJournal(refBlock);
+	if (fJournal == NULL)
+		return B_ERROR;
+
+	status_t status = fJournal->Lock(this, false, false);
+	if (status != B_OK)
+		fJournal = NULL;
+
+	return status;
+}
+
+
 void
 Transaction::AddListener(TransactionListener* listener)
 {
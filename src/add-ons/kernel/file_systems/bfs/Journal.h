@@ -26,7 +26,8 @@ public:
 			status_t		InitCheck();
 
 			status_t		Lock(Transaction* owner,
-								bool separateSubTransactions);
+								bool separateSubTransactions,
+								bool wait = true);
 			status_t		Unlock(Transaction* owner, bool success);
 
 			status_t		ReplayLog();
@@ -35,12 +36,15 @@ public:
 			size_t			CurrentTransactionSize() const;
 			bool			CurrentTransactionTooLarge() const;
 
+			status_t		FlushLog();
 			status_t		FlushLogAndBlocks();
 			Volume*			GetVolume() const { return fVolume; }
 			int32			TransactionID() const { return fTransactionID; }
 
 	inline	uint32			FreeLogBlocks() const;
 
+			void			GetStatistics(bfs_journal_stats& stats);
+
 #ifdef BFS_DEBUGGER_COMMANDS
 			void			Dump();
 #endif
@@ -70,6 +74,9 @@ private:
 			uint32			fMaxTransactionSize;
 			uint32			fUsed;
 			int32			fUnwrittenTransactions;
+			int32			fCompletedTransactions;
+			int32			fLoggedTransactions;
+			bfs_journal_stats fStats;
 			mutex			fEntriesLock;
 			LogEntryList	fEntries;
 			bigtime_t		fTimestamp;
@@ -133,6 +140,7 @@ public:
 	}
 
 	status_t Start(Volume* volume, off_t refBlock);
+	status_t TryStart(Volume* volume, off_t refBlock);
 	bool IsStarted() const { return fJournal != NULL; }
 
 	status_t Done()
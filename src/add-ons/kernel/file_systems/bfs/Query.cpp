@@ -41,6 +41,23 @@
 using namespace QueryParser;
 
 
+// When choosing the trigram of a pattern to look up in a trigram index,
+// only the first few of them are considered, and their entries are only
+// counted up to a limit.
+static const int32 kMaxTrigramCandidates = 16;
+static const int32 kMaxTrigramEntries = 4096;
+
+// The cost of an equation is the number of index entries that have to be
+// read to evaluate it. The entries are counted up to kMaxCountedEntries,
+// beyond that, the statistics of the index tree are used to estimate them.
+// Equations that cost no more than kMaxIntersectionEntries filter the entries
+// of the other side of an AND operator by the IDs they contain, before its
+// inodes are loaded.
+static const off_t kUnknownCost = 1LL << 48;
+static const int32 kMaxCountedEntries = 1024;
+static const int32 kMaxIntersectionEntries = 4096;
+
+
 enum ops {
 	OP_NONE,
 
@@ -87,11 +104,16 @@ public:
 							size_t size = 0) = 0;
 	virtual	void		Complement() = 0;
 
-	virtual	void		CalculateScore(Index& index) = 0;
-	virtual	int32		Score() const = 0;
+	virtual	void		CalculateCost(Index& index) = 0;
+	virtual	off_t		Cost() const = 0;
+	virtual	off_t		Matches() const = 0;
+	virtual	bool		MightMatch(Volume* volume, ino_t id) = 0;
 
 	virtual	status_t	InitCheck() = 0;
 
+	virtual	void		Explain(char* buffer, size_t size, int32 level,
+							bool driving) = 0;
+
 #ifdef DEBUG
 	virtual	void		PrintToStream() = 0;
 #endif
@@ -107,7 +129,7 @@ protected:
 	Although an Equation object is quite independent from the volume on which
 	the query is run, there are some dependencies that are produced while
 	querying:
-	The type/size of the value, the score, and if it has an index or not.
+	The type/size of the value, the cost, and if it has an index or not.
 	So you could run more than one query on the same volume, but it might return
 	wrong values when it runs concurrently on another volume.
 	That's not an issue right now, because we run single-threaded and don't use
@@ -130,11 +152,19 @@ public:
 
 			status_t	PrepareQuery(Volume* volume, Index& index,
 							TreeIterator** iterator, bool queryNonIndexed);
+			status_t	PrepareTrigramQuery(Index& index,
+							TreeIterator** iterator);
 			status_t	GetNextMatching(Volume* volume, TreeIterator* iterator,
-							struct dirent* dirent, size_t bufferSize);
+							struct dirent* dirent, size_t bufferSize,
+							Equation** previous, int32 previousCount);
 
-	virtual	void		CalculateScore(Index &index);
-	virtual	int32		Score() const { return fScore; }
+	virtual	void		CalculateCost(Index& index);
+	virtual	off_t		Cost() const { return fCost; }
+	virtual	off_t		Matches() const { return fMatches; }
+	virtual	bool		MightMatch(Volume* volume, ino_t id);
+
+	virtual	void		Explain(char* buffer, size_t size, int32 level,
+							bool driving);
 
 #ifdef DEBUG
 	virtual	void		PrintToStream();
@@ -150,6 +180,15 @@ private:
 			uint8*		Value() const { return (uint8*)&fValue; }
 			status_t	MatchEmptyString();
 
+			void		_CountIndexEntries(Index& index);
+			int32		_ChooseTrigram(TreeIterator& iterator);
+			status_t	_NextIndexEntry(TreeIterator* iterator, off_t* _offset,
+							bool* _isMatch);
+			bool		_MightMatchPath(Volume* volume, ino_t id);
+			status_t	_MatchPath(Inode* inode, bool matchSelf);
+			bool		_HasReturned(Volume* volume, Inode* inode);
+			void		_CollectCandidates(Volume* volume);
+
 			char*		fAttribute;
 			char*		fString;
 			union value fValue;
@@ -158,8 +197,18 @@ private:
 			bool		fIsPattern;
 			bool		fIsSpecialTime;
 
-			int32		fScore;
+			off_t		fCost;
+			off_t		fMatches;
+			bool		fUsesIndex;
 			bool		fHasIndex;
+
+			char*		fTrigramIndex;
+			bool		fUsesTrigrams;
+			uint32		fTrigram;
+
+			ino_t*		fCandidates;
+			int32		fCandidateCount;
+			bool		fCandidatesCollected;
 };
 
 
@@ -179,11 +228,16 @@ public:
 							size_t size = 0);
 	virtual	void		Complement();
 
-	virtual	void		CalculateScore(Index& index);
-	virtual	int32		Score() const;
+	virtual	void		CalculateCost(Index& index);
+	virtual	off_t		Cost() const;
+	virtual	off_t		Matches() const;
+	virtual	bool		MightMatch(Volume* volume, ino_t id);
 
 	virtual	status_t	InitCheck();
 
+	virtual	void		Explain(char* buffer, size_t size, int32 level,
+							bool driving);
+
 #ifdef DEBUG
 	virtual	void		PrintToStream();
 #endif
@@ -201,13 +255,199 @@ private:
 //	#pragma mark -
 
 
+/*!	Reads the next token of the \a pattern, and returns its character folded
+	to lower case if it is a literal one, or -1 if it may match more than one
+	character. Sets that only contain the same letter in different case,
+	like "[Hh]", count as literals, too.
+	The pattern must be valid.
+*/
+static int32
+next_pattern_literal(const char*& pattern)
+{
+	char c = *pattern++;
+	switch (c) {
+		case '*':
+		case '?':
+			return -1;
+
+		case '\\':
+			return Index::FoldTrigramChar(*pattern++);
+
+		case '[':
+		{
+			const char* start = pattern;
+			while (*pattern != ']') {
+				if (*pattern == '\\')
+					pattern++;
+				pattern++;
+			}
+			int32 length = pattern++ - start;
+
+			if (length == 1 && start[0] != '^' && start[0] != '!')
+				return Index::FoldTrigramChar(start[0]);
+			if (length == 2 && start[0] != start[1]
+				&& Index::FoldTrigramChar(start[0])
+					== Index::FoldTrigramChar(start[1]))
+				return Index::FoldTrigramChar(start[0]);
+
+			return -1;
+		}
+
+		default:
+			return Index::FoldTrigramChar(c);
+	}
+}
+
+
+/*!	Copies the longest run of literal characters of the \a pattern, as
+	returned by next_pattern_literal(), into \a literal, and returns its
+	length. Every string that matches the pattern contains that run.
+*/
+static int32
+get_pattern_literal(const char* pattern, char* literal, int32 size)
+{
+	const char* bestStart = NULL;
+	int32 bestLength = 0;
+	const char* start = NULL;
+	int32 length = 0;
+
+	while (*pattern != '\0') {
+		const char* token = pattern;
+		if (next_pattern_literal(pattern) < 0) {
+			length = 0;
+			continue;
+		}
+
+		if (length++ == 0)
+			start = token;
+		if (length > bestLength) {
+			bestStart = start;
+			bestLength = length;
+		}
+	}
+
+	if (bestLength >= size)
+		bestLength = size - 1;
+
+	pattern = bestStart;
+	for (int32 i = 0; i < bestLength; i++)
+		literal[i] = next_pattern_literal(pattern);
+	literal[bestLength] = '\0';
+
+	return bestLength;
+}
+
+
+/*!	Returns the number of entries of the \a key in the trigram index the
+	\a iterator belongs to, but counts no further than \a limit.
+*/
+static int32
+count_trigram_entries(TreeIterator& iterator, const uint8* key, int32 limit)
+{
+	if (iterator.Find(key, 3) != B_OK)
+		return 0;
+
+	int32 count = 0;
+	while (count < limit) {
+		uint8 entry[8];
+		uint16 length;
+		off_t value;
+		if (iterator.GetNextEntry(entry, &length, sizeof(entry), &value)
+				!= B_OK
+			|| length != 3 || memcmp(entry, key, 3))
+			break;
+
+		count++;
+	}
+
+	return count;
+}
+
+
+static void
+sift_down(ino_t* ids, int32 start, int32 count)
+{
+	int32 parent = start;
+	while (2 * parent + 1 < count) {
+		int32 child = 2 * parent + 1;
+		if (child + 1 < count && ids[child] < ids[child + 1])
+			child++;
+		if (ids[parent] >= ids[child])
+			return;
+
+		ino_t temp = ids[parent];
+		ids[parent] = ids[child];
+		ids[child] = temp;
+		parent = child;
+	}
+}
+
+
+/*!	Sorts the \a ids in ascending order (heap sort, as qsort() is not
+	available everywhere we run).
+*/
+static void
+sort_ids(ino_t* ids, int32 count)
+{
+	for (int32 start = count / 2 - 1; start >= 0; start--)
+		sift_down(ids, start, count);
+
+	for (int32 end = count - 1; end > 0; end--) {
+		ino_t temp = ids[0];
+		ids[0] = ids[end];
+		ids[end] = temp;
+		sift_down(ids, 0, end);
+	}
+}
+
+
+static const char*
+operator_symbol(int8 op)
+{
+	switch (op) {
+		case OP_EQUAL: return "==";
+		case OP_UNEQUAL: return "!=";
+		case OP_GREATER_THAN: return ">";
+		case OP_GREATER_THAN_OR_EQUAL: return ">=";
+		case OP_LESS_THAN: return "<";
+		case OP_LESS_THAN_OR_EQUAL: return "<=";
+		case OP_AND: return "AND";
+		case OP_OR: return "OR";
+	}
+	return "???";
+}
+
+
+/*!	Returns where to append the next line of the query plan to the
+	\a buffer, and how much space is left there.
+*/
+static char*
+explain_position(char* buffer, size_t size, size_t& left)
+{
+	size_t length = strnlen(buffer, size);
+	left = size - length;
+	return buffer + length;
+}
+
+
+//	#pragma mark -
+
+
 Equation::Equation(char** expr)
 	:
 	Term(OP_EQUATION),
 	fAttribute(NULL),
 	fString(NULL),
 	fType(0),
-	fIsPattern(false)
+	fIsPattern(false),
+	fCost(kUnknownCost),
+	fMatches(kUnknownCost),
+	fUsesIndex(false),
+	fTrigramIndex(NULL),
+	fUsesTrigrams(false),
+	fCandidates(NULL),
+	fCandidateCount(0),
+	fCandidatesCollected(false)
 {
 	char* string = *expr;
 	char* start = string;
@@ -341,6 +581,8 @@ Equation::~Equation()
 {
 	free(fAttribute);
 	free(fString);
+	free(fTrigramIndex);
+	free(fCandidates);
 }
 
 
@@ -634,36 +876,169 @@ Equation::Match(Inode* inode, const char* attributeName, int32 type,
 
 
 void
-Equation::CalculateScore(Index &index)
+Equation::CalculateCost(Index& index)
 {
-	// As always, these values could be tuned and refined.
-	// And the code could also need some real world testing :-)
+	Volume* volume = index.GetVolume();
+
+	fCost = kUnknownCost;
+	fMatches = kUnknownCost;
+	fUsesIndex = false;
+	free(fTrigramIndex);
+	fTrigramIndex = NULL;
 
 	// do we have to operate on a "foreign" index?
-	if (fOp == OP_UNEQUAL || index.SetTo(fAttribute) < B_OK) {
-		fScore = 0;
+	if (fOp == OP_UNEQUAL || index.SetTo(fAttribute) != B_OK) {
+		// all entries of the "name" index will have to be looked at
+		if (index.SetTo("name") == B_OK && index.Node()->Tree() != NULL)
+			fCost = fMatches = index.Node()->Tree()->CountEntries();
 		return;
 	}
 
-	// if we have a pattern, how much does it help our search?
-	if (fIsPattern)
-		fScore = getFirstPatternSymbol(fString) << 3;
-	else {
-		// Score by operator
-		if (fOp == OP_EQUAL)
-			// higher than pattern="255 chars+*"
-			fScore = 2048;
-		else
-			// the pattern search is regarded cheaper when you have at
-			// least one character to set your index to
-			fScore = 5;
+	fUsesIndex = true;
+	_CountIndexEntries(index);
+
+	// A trigram index can do better for patterns that contain a run of
+	// literal characters that is not at their start
+	char literal[INODE_FILE_NAME_LENGTH];
+	if (!fIsPattern || fOp != OP_EQUAL || index.Type() != B_STRING_TYPE
+		|| !volume->HasTrigramIndices()
+		|| get_pattern_literal(fString, literal, sizeof(literal)) < 3)
+		return;
+
+	char name[B_FILE_NAME_LENGTH];
+	Index trigramIndex(volume);
+	if (Index::GetTrigramIndexName(fAttribute, name, sizeof(name)) != B_OK
+		|| trigramIndex.SetTo(name) != B_OK
+		|| trigramIndex.Node()->Tree() == NULL
+		|| Index::IsFillingTrigrams(volume, trigramIndex.Node()->ID()))
+		return;
+
+	TreeIterator iterator(trigramIndex.Node()->Tree());
+	int32 entries = _ChooseTrigram(iterator);
+	if (entries < 0 || entries >= fCost)
+		return;
+
+	fTrigramIndex = strdup(name);
+	if (fTrigramIndex != NULL)
+		fCost = fMatches = entries;
+}
+
+
+/*!	Counts the entries the equation has to read from its \a index, and how
+	many of them match, up to kMaxCountedEntries. If there are more, both
+	values are estimated using the index statistics.
+*/
+void
+Equation::_CountIndexEntries(Index& index)
+{
+	TreeIterator* iterator = NULL;
+	status_t status = PrepareQuery(index.GetVolume(), index, &iterator,
+		false);
+	ObjectDeleter<TreeIterator> iteratorDeleter(iterator);
+	if (iterator == NULL)
+		return;
+	if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+		return;
+
+	int32 entries = 0;
+	int32 matches = 0;
+	while (entries < kMaxCountedEntries) {
+		off_t offset;
+		bool isMatch;
+		status = _NextIndexEntry(iterator, &offset, &isMatch);
+		if (status != B_OK)
+			break;
+
+		entries++;
+		if (isMatch)
+			matches++;
+	}
+
+	if (entries < kMaxCountedEntries) {
+		fCost = entries;
+		fMatches = matches;
+		return;
+	}
+
+	// There are too many entries to count them, ask the tree for the number
+	// of keys in the range of the equation
+
+	union value from;
+	union value to;
+	uint16 fromLength = fSize;
+	uint16 toLength = fSize;
+	bool hasFrom = fOp == OP_EQUAL || fOp == OP_GREATER_THAN
+		|| fOp == OP_GREATER_THAN_OR_EQUAL;
+	bool hasTo = fOp == OP_EQUAL || fOp == OP_LESS_THAN
+		|| fOp == OP_LESS_THAN_OR_EQUAL;
+
+	if (fIsPattern) {
+		// the range of the fixed prefix of the pattern, if there is one
+		int32 prefixLength = getFirstPatternSymbol(fString);
+		hasFrom = hasTo = prefixLength > 0;
+		if (hasFrom) {
+			memcpy(from.String, fValue.String, prefixLength);
+			memcpy(to.String, fValue.String, prefixLength);
+			to.String[prefixLength] = (char)0xff;
+			fromLength = prefixLength;
+			toLength = prefixLength + 1;
+		}
+	} else if (fIsSpecialTime) {
+		from.Int64 = fValue.Int64 << INODE_TIME_SHIFT;
+		to.Int64 = from.Int64 | ((1LL << INODE_TIME_SHIFT) - 1);
+		fromLength = toLength = sizeof(int64);
+	} else {
+		memcpy(&from, Value(), fSize);
+		memcpy(&to, Value(), fSize);
+	}
+
+	off_t estimate = index.Node()->Tree()->EstimateEntries(
+		hasFrom ? (uint8*)&from : NULL, fromLength,
+		hasTo ? (uint8*)&to : NULL, toLength);
+
+	fCost = max_c(estimate, entries);
+	fMatches = matches * fCost / entries;
+}
+
+
+/*!	Chooses the trigram of the pattern with the fewest entries in the trigram
+	index the \a iterator belongs to, and returns their number together with
+	those of the overflow trigram, or -1 if the pattern doesn't contain any
+	trigram.
+*/
+int32
+Equation::_ChooseTrigram(TreeIterator& iterator)
+{
+	char literal[INODE_FILE_NAME_LENGTH];
+	int32 length = get_pattern_literal(fString, literal, sizeof(literal));
+	if (length > kMaxTrigramCandidates + 2)
+		length = kMaxTrigramCandidates + 2;
+
+	uint32 trigrams[kMaxTrigramCandidates + 2];
+	int32 count = Index::GetTrigrams((const uint8*)literal, length, trigrams);
+	if (count == 0)
+		return -1;
+
+	uint8 overflowKey[3];
+	Index::GetTrigramKey(OVERFLOW_TRIGRAM, overflowKey);
+	int32 overflowEntries = count_trigram_entries(iterator, overflowKey,
+		kMaxTrigramEntries);
+
+	fTrigram = trigrams[0];
+	int32 bestEntries = kMaxTrigramEntries - overflowEntries;
+
+	for (int32 i = 0; i < count && bestEntries > 0; i++) {
+		uint8 key[3];
+		Index::GetTrigramKey(trigrams[i], key);
+
+		int32 entries = count_trigram_entries(iterator, key, bestEntries);
+		if (entries < bestEntries) {
+			bestEntries = entries;
+			fTrigram = trigrams[i];
+		}
 	}
 
-	// take index size into account (1024 is the current node size
-	// in our B+trees)
-	// 2048 * 2048 == 4194304 is the maximum score (for an empty
-	// tree, since the header + 1 node are already 2048 bytes)
-	fScore = fScore * ((2048 * 1024LL) / index.Node()->Size());
+	return bestEntries + overflowEntries;
 }
 
 
@@ -671,6 +1046,10 @@ status_t
 Equation::PrepareQuery(Volume* /*volume*/, Index& index,
 	TreeIterator** iterator, bool queryNonIndexed)
 {
+	fUsesTrigrams = false;
+	if (fTrigramIndex != NULL && index.SetTo(fTrigramIndex) == B_OK)
+		return PrepareTrigramQuery(index, iterator);
+
 	status_t status = index.SetTo(fAttribute);
 
 	// if we should query attributes without an index, we can just proceed here
@@ -764,38 +1143,55 @@ Equation::PrepareQuery(Volume* /*volume*/, Index& index,
 }
 
 
+/*!	Sets the iterator to the entries of one of the trigrams of the pattern
+	in the trigram index; they are the candidates that are then matched
+	against the whole pattern. The trigram with the fewest entries is chosen.
+*/
+status_t
+Equation::PrepareTrigramQuery(Index& index, TreeIterator** iterator)
+{
+	fHasIndex = false;
+	fUsesTrigrams = true;
+
+	if (ConvertValue(B_STRING_TYPE) < B_OK)
+		return B_BAD_VALUE;
+
+	BPlusTree* tree = index.Node()->Tree();
+	if (tree == NULL)
+		return B_ERROR;
+
+	*iterator = new(std::nothrow) TreeIterator(tree);
+	if (*iterator == NULL)
+		return B_NO_MEMORY;
+
+	if (_ChooseTrigram(**iterator) < 0)
+		return B_ENTRY_NOT_FOUND;
+
+	uint8 key[3];
+	Index::GetTrigramKey(fTrigram, key);
+
+	status_t status = (*iterator)->Find(key, sizeof(key));
+	if (status == B_ENTRY_NOT_FOUND)
+		return B_OK;
+
+	RETURN_ERROR(status);
+}
+
+
 status_t
 Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
-	struct dirent* dirent, size_t bufferSize)
+	struct dirent* dirent, size_t bufferSize, Equation** previous,
+	int32 previousCount)
 {
 	while (true) {
-		union value indexValue;
-		uint16 keyLength;
-		uint16 duplicate;
 		off_t offset;
-
-		status_t status = iterator->GetNextEntry(&indexValue, &keyLength,
-			(uint16)sizeof(indexValue), &offset, &duplicate);
+		bool isMatch;
+		status_t status = _NextIndexEntry(iterator, &offset, &isMatch);
 		if (status != B_OK)
 			return status;
 
-		// only compare against the index entry when this is the correct
-		// index for the equation
-		if (fHasIndex && duplicate < 2
-			&& !CompareTo((uint8*)&indexValue, keyLength)) {
-			// They aren't equal? Let the operation decide what to do. Since
-			// we always start at the beginning of the index (or the correct
-			// position), only some needs to be stopped if the entry doesn't
-			// fit.
-			if (fOp == OP_LESS_THAN
-				|| fOp == OP_LESS_THAN_OR_EQUAL
-				|| (fOp == OP_EQUAL && !fIsPattern))
-				return B_ENTRY_NOT_FOUND;
-
-			if (duplicate > 0)
-				iterator->SkipDuplicates();
+		if (!isMatch || !_MightMatchPath(volume, offset))
 			continue;
-		}
 
 		Vnode vnode(volume, offset);
 		Inode* inode;
@@ -816,38 +1212,13 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 		// query will do something similar (and we don't have
 		// to do it for root, either).
 
-		// go up in the tree until a &&-operator is found, and check if the
-		// inode matches with the rest of the expression - we don't have to
-		// check ||-operators for that
-		Term* term = this;
-		status = MATCH_OK;
-
-		if (!fHasIndex)
-			status = Match(inode);
+		status = _MatchPath(inode, !fHasIndex);
 
-		while (term != NULL && status == MATCH_OK) {
-			Operator* parent = (Operator*)term->Parent();
-			if (parent == NULL)
-				break;
-
-			if (parent->Op() == OP_AND) {
-				// choose the other child of the parent
-				Term* other = parent->Right();
-				if (other == term)
-					other = parent->Left();
-
-				if (other == NULL) {
-					FATAL(("&&-operator has only one child... (parent = %p)\n",
-						parent));
-					break;
-				}
-				status = other->Match(inode);
-				if (status < 0) {
-					REPORT_ERROR(status);
-					status = NO_MATCH;
-				}
-			}
-			term = (Term*)parent;
+		// The equations of an OR operator are iterated one after the other;
+		// don't return the entries that one of them has returned already
+		for (int32 i = 0; i < previousCount && status == MATCH_OK; i++) {
+			if (previous[i]->_HasReturned(volume, inode))
+				status = NO_MATCH;
 		}
 
 		if (status == MATCH_OK) {
@@ -862,15 +1233,282 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 			}
 
 			dirent->d_reclen = sizeof(struct dirent) + strlen(dirent->d_name);
-		}
-
-		if (status == MATCH_OK)
 			return B_OK;
+		}
 	}
 	RETURN_ERROR(B_ERROR);
 }
 
 
+/*!	Reads the next entry from the \a iterator. If the equation uses the
+	index, \a _isMatch is set to whether or not its key matches; otherwise,
+	the entry is just a candidate that still needs to be matched.
+	Returns B_ENTRY_NOT_FOUND if there are no more entries that could match.
+*/
+status_t
+Equation::_NextIndexEntry(TreeIterator* iterator, off_t* _offset,
+	bool* _isMatch)
+{
+	union value indexValue;
+	uint16 keyLength;
+	uint16 duplicate;
+
+	status_t status = iterator->GetNextEntry(&indexValue, &keyLength,
+		(uint16)sizeof(indexValue), _offset, &duplicate);
+	if (status != B_OK)
+		return status;
+
+	if (fUsesTrigrams) {
+		// all candidates are in the entries of our trigram, followed by
+		// those of the overflow trigram, which sorts last
+		uint8 key[3];
+		Index::GetTrigramKey(fTrigram, key);
+		uint8 overflowKey[3];
+		Index::GetTrigramKey(OVERFLOW_TRIGRAM, overflowKey);
+
+		if (keyLength != sizeof(key))
+			return B_ENTRY_NOT_FOUND;
+		if (memcmp(&indexValue, key, keyLength)
+			&& memcmp(&indexValue, overflowKey, keyLength)) {
+			if (memcmp(&indexValue, overflowKey, keyLength) > 0)
+				return B_ENTRY_NOT_FOUND;
+
+			status = iterator->Find(overflowKey, sizeof(overflowKey));
+			if (status != B_OK)
+				return status;
+
+			return _NextIndexEntry(iterator, _offset, _isMatch);
+		}
+	}
+
+	*_isMatch = true;
+
+	// only compare against the index entry when this is the correct
+	// index for the equation
+	if (fHasIndex && duplicate < 2
+		&& !CompareTo((uint8*)&indexValue, keyLength)) {
+		// They aren't equal? Let the operation decide what to do. Since
+		// we always start at the beginning of the index (or the correct
+		// position), only some needs to be stopped if the entry doesn't
+		// fit.
+		if (fOp == OP_LESS_THAN
+			|| fOp == OP_LESS_THAN_OR_EQUAL
+			|| (fOp == OP_EQUAL && !fIsPattern))
+			return B_ENTRY_NOT_FOUND;
+
+		if (duplicate > 0)
+			iterator->SkipDuplicates();
+		*_isMatch = false;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Checks the other sides of the &&-operators above the equation for
+	whether they can match the inode with the given \a id, without having to
+	load it.
+*/
+bool
+Equation::_MightMatchPath(Volume* volume, ino_t id)
+{
+	for (Term* term = this; term->Parent() != NULL; term = term->Parent()) {
+		Operator* parent = (Operator*)term->Parent();
+		if (parent->Op() != OP_AND)
+			continue;
+
+		Term* other = parent->Right();
+		if (other == term)
+			other = parent->Left();
+
+		if (other != NULL && !other->MightMatch(volume, id))
+			return false;
+	}
+
+	return true;
+}
+
+
+/*!	Matches the \a inode against the rest of the expression, that is, the
+	equation itself if \a matchSelf is true, and the other sides of the
+	&&-operators above it.
+*/
+status_t
+Equation::_MatchPath(Inode* inode, bool matchSelf)
+{
+	// go up in the tree until a &&-operator is found, and check if the
+	// inode matches with the rest of the expression - we don't have to
+	// check ||-operators for that
+	Term* term = this;
+	status_t status = MATCH_OK;
+
+	if (matchSelf)
+		status = Match(inode);
+
+	while (term != NULL && status == MATCH_OK) {
+		Operator* parent = (Operator*)term->Parent();
+		if (parent == NULL)
+			break;
+
+		if (parent->Op() == OP_AND) {
+			// choose the other child of the parent
+			Term* other = parent->Right();
+			if (other == term)
+				other = parent->Left();
+
+			if (other == NULL) {
+				FATAL(("&&-operator has only one child... (parent = %p)\n",
+					parent));
+				break;
+			}
+			status = other->Match(inode);
+			if (status < 0) {
+				REPORT_ERROR(status);
+				status = NO_MATCH;
+			}
+		}
+		term = (Term*)parent;
+	}
+
+	return status;
+}
+
+
+/*!	Returns whether or not the \a inode has been returned by this equation,
+	which has already been iterated completely.
+*/
+bool
+Equation::_HasReturned(Volume* volume, Inode* inode)
+{
+	if ((fHasIndex || fUsesTrigrams) && MatchEmptyString() == MATCH_OK) {
+		// Only inodes that are in the index have been returned, but Match()
+		// also succeeds for those that don't have the attribute at all in
+		// this case. Only the candidates can tell them apart.
+		if (!MightMatch(volume, inode->ID()) || fCandidates == NULL)
+			return false;
+	}
+
+	return _MatchPath(inode, true) == MATCH_OK;
+}
+
+
+/*!	If the equation is cheap enough, collects the IDs of all inodes it could
+	return from its index, so that the other side of an &&-operator can be
+	filtered by them. If not, fCandidates stays NULL.
+*/
+void
+Equation::_CollectCandidates(Volume* volume)
+{
+	fCandidatesCollected = true;
+
+	if (!fUsesIndex || fCost > kMaxIntersectionEntries)
+		return;
+
+	// Don't disturb the state of the equation if it's currently iterated
+	bool hasIndex = fHasIndex;
+	bool usesTrigrams = fUsesTrigrams;
+	uint32 trigram = fTrigram;
+
+	Index index(volume);
+	TreeIterator* iterator = NULL;
+	status_t status = PrepareQuery(volume, index, &iterator, false);
+	ObjectDeleter<TreeIterator> iteratorDeleter(iterator);
+
+	ino_t* candidates = NULL;
+	int32 count = 0;
+
+	if (iterator != NULL && (status == B_OK || status == B_ENTRY_NOT_FOUND)) {
+		candidates = (ino_t*)malloc(kMaxIntersectionEntries * sizeof(ino_t));
+
+		while (candidates != NULL) {
+			off_t offset;
+			bool isMatch;
+			status = _NextIndexEntry(iterator, &offset, &isMatch);
+			if (status != B_OK)
+				break;
+			if (!isMatch)
+				continue;
+
+			if (count == kMaxIntersectionEntries) {
+				// the estimate was too optimistic
+				status = B_BUFFER_OVERFLOW;
+				break;
+			}
+			candidates[count++] = offset;
+		}
+	}
+
+	fHasIndex = hasIndex;
+	fUsesTrigrams = usesTrigrams;
+	fTrigram = trigram;
+
+	if (candidates == NULL || status != B_ENTRY_NOT_FOUND) {
+		free(candidates);
+		return;
+	}
+
+	sort_ids(candidates, count);
+	fCandidates = candidates;
+	fCandidateCount = count;
+}
+
+
+bool
+Equation::MightMatch(Volume* volume, ino_t id)
+{
+	if (!fCandidatesCollected)
+		_CollectCandidates(volume);
+	if (fCandidates == NULL)
+		return true;
+
+	int32 first = 0;
+	int32 last = fCandidateCount - 1;
+	while (first <= last) {
+		int32 middle = (first + last) / 2;
+		if (fCandidates[middle] == id)
+			return true;
+		if (fCandidates[middle] < id)
+			first = middle + 1;
+		else
+			last = middle - 1;
+	}
+
+	return false;
+}
+
+
+void
+Equation::Explain(char* buffer, size_t size, int32 level, bool driving)
+{
+	size_t left;
+	char* position = explain_position(buffer, size, left);
+
+	int length = snprintf(position, left, "%*s\"%s\" %s \"%s\": ",
+		(int)level * 2, "", fAttribute, operator_symbol(fOp), fString);
+	if (length < 0 || (size_t)length >= left)
+		return;
+	position += length;
+	left -= length;
+
+	char index[B_FILE_NAME_LENGTH + 32];
+	if (fTrigramIndex != NULL)
+		snprintf(index, sizeof(index), "trigram index \"%s\"", fTrigramIndex);
+	else if (fUsesIndex)
+		strlcpy(index, "index", sizeof(index));
+	else
+		strlcpy(index, "no index, scans \"name\"", sizeof(index));
+
+	const char* role = "drives";
+	if (!driving) {
+		role = fUsesIndex && fCost <= kMaxIntersectionEntries
+			? "filters by ID" : "filters";
+	}
+
+	snprintf(position, left, "%s, cost %" B_PRIdOFF ", %" B_PRIdOFF
+		" matches, %s\n", index, fCost, fMatches, role);
+}
+
+
 //	#pragma mark -
 
 
@@ -905,10 +1543,10 @@ Operator::Match(Inode* inode, const char* attribute, int32 type,
 
 		return fRight->Match(inode, attribute, type, key, size);
 	} else {
-		// choose the term with the better score for OP_OR
+		// for OP_OR, start with the term that is more likely to match
 		Term* first;
 		Term* second;
-		if (fRight->Score() > fLeft->Score()) {
+		if (fRight->Matches() < fLeft->Matches()) {
 			first = fLeft;
 			second = fRight;
 		} else {
@@ -939,29 +1577,42 @@ Operator::Complement()
 
 
 void
-Operator::CalculateScore(Index &index)
+Operator::CalculateCost(Index& index)
 {
-	fLeft->CalculateScore(index);
-	fRight->CalculateScore(index);
+	fLeft->CalculateCost(index);
+	fRight->CalculateCost(index);
 }
 
 
-int32
-Operator::Score() const
+off_t
+Operator::Cost() const
 {
-	if (fOp == OP_AND) {
-		// return the one with the better score
-		if (fRight->Score() > fLeft->Score())
-			return fRight->Score();
+	// OP_AND only needs to iterate the cheaper side, and match the other,
+	// OP_OR has to iterate both
+	if (fOp == OP_AND)
+		return min_c(fLeft->Cost(), fRight->Cost());
 
-		return fLeft->Score();
-	}
+	return min_c(fLeft->Cost() + fRight->Cost(), kUnknownCost);
+}
+
+
+off_t
+Operator::Matches() const
+{
+	if (fOp == OP_AND)
+		return min_c(fLeft->Matches(), fRight->Matches());
+
+	return min_c(fLeft->Matches() + fRight->Matches(), kUnknownCost);
+}
 
-	// for OP_OR, be honest, and return the one with the worse score
-	if (fRight->Score() < fLeft->Score())
-		return fRight->Score();
 
-	return fLeft->Score();
+bool
+Operator::MightMatch(Volume* volume, ino_t id)
+{
+	if (fOp == OP_AND)
+		return fLeft->MightMatch(volume, id) && fRight->MightMatch(volume, id);
+
+	return fLeft->MightMatch(volume, id) || fRight->MightMatch(volume, id);
 }
 
 
@@ -977,6 +1628,28 @@ Operator::InitCheck()
 }
 
 
+void
+Operator::Explain(char* buffer, size_t size, int32 level, bool driving)
+{
+	size_t left;
+	char* position = explain_position(buffer, size, left);
+	snprintf(position, left, "%*s%s: cost %" B_PRIdOFF ", %" B_PRIdOFF
+		" matches\n", (int)level * 2, "", operator_symbol(fOp), Cost(),
+		Matches());
+
+	// This must choose the same side as Query::Rewind()
+	bool rightDrives = driving;
+	bool leftDrives = driving;
+	if (fOp == OP_AND) {
+		rightDrives = driving && fRight->Cost() < fLeft->Cost();
+		leftDrives = driving && !rightDrives;
+	}
+
+	fLeft->Explain(buffer, size, level + 1, leftDrives);
+	fRight->Explain(buffer, size, level + 1, rightDrives);
+}
+
+
 #if 0
 Term*
 Operator::Copy() const
@@ -1043,16 +1716,7 @@ Operator::PrintToStream()
 void
 Equation::PrintToStream()
 {
-	const char* symbol = "???";
-	switch (fOp) {
-		case OP_EQUAL: symbol = "=="; break;
-		case OP_UNEQUAL: symbol = "!="; break;
-		case OP_GREATER_THAN: symbol = ">"; break;
-		case OP_GREATER_THAN_OR_EQUAL: symbol = ">="; break;
-		case OP_LESS_THAN: symbol = "<"; break;
-		case OP_LESS_THAN_OR_EQUAL: symbol = "<="; break;
-	}
-	__out("[\"%s\" %s \"%s\"]", fAttribute, symbol, fString);
+	__out("[\"%s\" %s \"%s\"]", fAttribute, operator_symbol(fOp), fString);
 }
 
 #endif	// DEBUG
@@ -1228,7 +1892,7 @@ Query::Query(Volume* volume, Expression* expression, uint32 flags)
 		return;
 
 	// create index on the stack and delete it afterwards
-	fExpression->Root()->CalculateScore(fIndex);
+	fExpression->Root()->CalculateCost(fIndex);
 	fIndex.Unset();
 
 	Rewind();
@@ -1251,6 +1915,7 @@ Query::Rewind()
 	// free previous stuff
 
 	fStack.MakeEmpty();
+	fFinished.MakeEmpty();
 
 	delete fIterator;
 	fIterator = NULL;
@@ -1270,9 +1935,9 @@ Query::Rewind()
 				stack.Push(op->Left());
 				stack.Push(op->Right());
 			} else {
-				// For OP_AND, we can use the scoring system to decide which
-				// path to add
-				if (op->Right()->Score() > op->Left()->Score())
+				// For OP_AND, we only need to iterate the cheaper path, the
+				// other one is only matched against its entries
+				if (op->Right()->Cost() < op->Left()->Cost())
 					stack.Push(op->Right());
 				else
 					stack.Push(op->Left());
@@ -1311,8 +1976,9 @@ Query::GetNextEntry(struct dirent* dirent, size_t size)
 			RETURN_ERROR(B_ERROR);
 
 		status_t status = fCurrent->GetNextMatching(fVolume, fIterator, dirent,
-			size);
+			size, fFinished.Array(), fFinished.CountItems());
 		if (status != B_OK) {
+			fFinished.Push(fCurrent);
 			delete fIterator;
 			fIterator = NULL;
 			fCurrent = NULL;
@@ -1324,6 +1990,25 @@ Query::GetNextEntry(struct dirent* dirent, size_t size)
 }
 
 
+/*!	Writes the plan of the query to \a buffer: the tree of its terms, with
+	the index each equation uses, and its estimated cost and number of
+	matches, as well as whether it drives the query, that is, if its index is
+	iterated, or if it filters the entries of another equation.
+*/
+void
+Query::Explain(char* buffer, size_t size)
+{
+	if (size == 0)
+		return;
+
+	buffer[0] = '\0';
+	if (fExpression == NULL || fExpression->Root() == NULL)
+		return;
+
+	fExpression->Root()->Explain(buffer, size, 0, true);
+}
+
+
 void
 Query::SetLiveMode(port_id port, int32 token)
 {
@@ -50,6 +50,7 @@ public:
 
 			status_t		Rewind();
 			status_t		GetNextEntry(struct dirent* , size_t size);
+			void			Explain(char* buffer, size_t size);
 
 			void			SetLiveMode(port_id port, int32 token);
 			void			LiveUpdate(Inode* inode, const char* attribute,
@@ -70,6 +71,7 @@ private:
 			TreeIterator*	fIterator;
 			Index			fIndex;
 			Stack<Equation*> fStack;
+			Stack<Equation*> fFinished;
 
 			uint32			fFlags;
 			port_id			fPort;
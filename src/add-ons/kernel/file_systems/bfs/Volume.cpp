@@ -8,6 +8,7 @@
 
 
 #include "Attribute.h"
+#include "BPlusTree.h"
 #include "Debug.h"
 #include "Inode.h"
 #include "Journal.h"
@@ -194,7 +195,8 @@ disk_super_block::IsValid() const
 {
 	if (Magic1() != (int32)SUPER_BLOCK_MAGIC1
 		|| Magic2() != (int32)SUPER_BLOCK_MAGIC2
-		|| Magic3() != (int32)SUPER_BLOCK_MAGIC3
+		|| (Magic3() != (int32)SUPER_BLOCK_MAGIC3
+			&& Magic3() != (int32)SUPER_BLOCK_MAGIC3_INCOMPATIBLE)
 		|| (int32)block_size != inode_size
 		|| ByteOrder() != SUPER_BLOCK_FS_LENDIAN
 		|| (1UL << BlockShift()) != BlockSize()
@@ -271,6 +273,20 @@ disk_super_block::Initialize(const char* diskName, off_t numBlocks,
 }
 
 
+/*!	Sets the on-disk \a features of the volume, and chooses the magic that
+	keeps drivers which don't know about features from mounting it, if any
+	of them is incompatible.
+*/
+void
+disk_super_block::SetFeatures(uint32 features)
+{
+	this->features = HOST_ENDIAN_TO_BFS_INT32(features);
+	magic3 = HOST_ENDIAN_TO_BFS_INT32(
+		(features & SUPER_BLOCK_INCOMPATIBLE_FEATURES) != 0
+			? SUPER_BLOCK_MAGIC3_INCOMPATIBLE : SUPER_BLOCK_MAGIC3);
+}
+
+
 //	#pragma mark -
 
 
@@ -281,11 +297,16 @@ Volume::Volume(fs_volume* volume)
 	fRootNode(NULL),
 	fIndicesNode(NULL),
 	fDirtyCachedBlocks(0),
+	fTrigramIndices(0),
+	fTrigramFill(NULL),
 	fFlags(0),
-	fCheckingThread(-1)
+	fCheckingThread(-1),
+	fReservedBlocks(0)
 {
 	mutex_init(&fLock, "bfs volume");
 	mutex_init(&fQueryLock, "bfs queries");
+
+	memset(&fAllocationStats, 0, sizeof(fAllocationStats));
 }
 
 
@@ -348,6 +369,19 @@ Volume::Mount(const char* deviceName, uint32 flags)
 		return B_BAD_VALUE;
 	}
 
+	uint32 unknownFeatures
+		= fSuperBlock.Features() & ~SUPER_BLOCK_KNOWN_FEATURES;
+	if ((unknownFeatures & SUPER_BLOCK_INCOMPATIBLE_FEATURES) != 0) {
+		FATAL(("volume uses incompatible features %#" B_PRIx32 "!\n",
+			fSuperBlock.Features()));
+		return B_UNSUPPORTED;
+	}
+	if (unknownFeatures != 0) {
+		FATAL(("volume uses unknown features %#" B_PRIx32 ", mounting "
+			"read-only.\n", fSuperBlock.Features()));
+		fFlags |= VOLUME_READ_ONLY;
+	}
+
 	// initialize short hands to the superblock (to save byte swapping)
 	fBlockSize = fSuperBlock.BlockSize();
 	fBlockShift = fSuperBlock.BlockShift();
@@ -421,6 +455,7 @@ Volume::Mount(const char* deviceName, uint32 flags)
 				}
 			} else {
 				// we don't use the vnode layer to access the indices node
+				_CountTrigramIndices();
 			}
 		} else {
 			FATAL(("could not create root node: publish_vnode() failed!\n"));
@@ -466,6 +501,54 @@ Volume::Sync()
 }
 
 
+/*!	Starts reading the given blocks into the block cache, without waiting
+	for them; blocks that are already cached are skipped.
+*/
+void
+Volume::Prefetch(off_t block, size_t numBlocks)
+{
+	while (numBlocks > 0) {
+		size_t count = numBlocks;
+		if (block_cache_prefetch(fBlockCache, block, &count) != B_OK)
+			return;
+
+		// the prefetch stops at the first cached block
+		if (count == 0)
+			count = 1;
+
+		block += count;
+		numBlocks -= count;
+	}
+}
+
+
+/*!	Reserves \a numBlocks blocks for data whose allocation has been delayed.
+	Reserved blocks are no longer available to other allocations, so that
+	the delayed allocation can't run out of space later on.
+*/
+status_t
+Volume::ReserveBlocks(off_t numBlocks)
+{
+	MutexLocker _(fLock);
+
+	if (numBlocks > AvailableBlocks())
+		return B_DEVICE_FULL;
+
+	fReservedBlocks += numBlocks;
+	return B_OK;
+}
+
+
+void
+Volume::UnreserveBlocks(off_t numBlocks)
+{
+	MutexLocker _(fLock);
+
+	ASSERT(numBlocks <= fReservedBlocks);
+	fReservedBlocks -= numBlocks;
+}
+
+
 status_t
 Volume::ValidateBlockRun(block_run run)
 {
@@ -512,6 +595,22 @@ Volume::CreateIndicesRoot(Transaction& transaction)
 }
 
 
+/*!	Marks the volume as using the given on-disk \a features, so that drivers
+	that don't know them won't misinterpret it. This must be done before
+	anything that depends on them is written.
+	You need to be in a transaction when you call this method.
+*/
+status_t
+Volume::AddFeatures(uint32 features)
+{
+	if ((fSuperBlock.Features() & features) == features)
+		return B_OK;
+
+	fSuperBlock.SetFeatures(fSuperBlock.Features() | features);
+	return WriteSuperBlock();
+}
+
+
 status_t
 Volume::CreateVolumeID(Transaction& transaction)
 {
@@ -695,6 +794,9 @@ Volume::Initialize(int fd, const char* name, uint32 blockSize,
 	// create valid superblock
 
 	fSuperBlock.Initialize(name, numBlocks, blockSize);
+	if ((flags & VOLUME_INLINE_DATA) != 0) {
+		fSuperBlock.SetFeatures(SUPER_BLOCK_FEATURE_INLINE_DATA);
+	}
 
 	// initialize short hands to the superblock (to save byte swapping)
 	fBlockSize = fSuperBlock.BlockSize();
@@ -803,3 +905,33 @@ Volume::_EraseUnusedBootBlock()
 
 	return B_OK;
 }
+
+
+/*!	Counts the trigram indices of the volume, so that we only need to look
+	for them on index updates if there are any.
+*/
+void
+Volume::_CountTrigramIndices()
+{
+	BPlusTree* tree = fIndicesNode->Tree();
+	if (tree == NULL)
+		return;
+
+	size_t prefixLength = strlen(BFS_TRIGRAM_INDEX_PREFIX);
+	TreeIterator iterator(tree);
+	status_t status = iterator.Find((const uint8*)BFS_TRIGRAM_INDEX_PREFIX,
+		prefixLength);
+	if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+		return;
+
+	while (true) {
+		char name[B_FILE_NAME_LENGTH];
+		uint16 length;
+		ino_t id;
+		if (iterator.GetNextEntry(name, &length, sizeof(name), &id) != B_OK
+			|| strncmp(name, BFS_TRIGRAM_INDEX_PREFIX, prefixLength))
+			break;
+
+		fTrigramIndices++;
+	}
+}
@@ -9,12 +9,14 @@
 #include "system_dependencies.h"
 
 #include "bfs.h"
+#include "bfs_control.h"
 #include "BlockAllocator.h"
 
 
 class Journal;
 class Inode;
 class Query;
+struct trigram_fill;
 
 
 enum volume_flags {
@@ -23,6 +25,7 @@ enum volume_flags {
 
 enum volume_initialize_flags {
 	VOLUME_NO_INDICES	= 0x0001,
+	VOLUME_INLINE_DATA	= 0x0002,
 };
 
 typedef DoublyLinkedList<Inode> InodeList;
@@ -65,6 +68,8 @@ public:
 								{ return fSuperBlock.UsedBlocks(); }
 			off_t			FreeBlocks() const
 								{ return NumBlocks() - UsedBlocks(); }
+			off_t			AvailableBlocks() const
+								{ return FreeBlocks() - fReservedBlocks; }
 
 			uint32			DeviceBlockSize() const { return fDeviceBlockSize; }
 			uint32			BlockSize() const { return fBlockSize; }
@@ -110,6 +115,15 @@ public:
 								off_t numBlocks, block_run& run,
 								uint16 minimum = 1);
 			status_t		Free(Transaction& transaction, block_run run);
+
+			// delayed allocation
+			status_t		ReserveBlocks(off_t numBlocks);
+			void			UnreserveBlocks(off_t numBlocks);
+			off_t			ReservedBlocks() const
+								{ return fReservedBlocks; }
+			bfs_allocation_stats& AllocationStats()
+								{ return fAllocationStats; }
+
 			void			SetCheckingThread(thread_id thread)
 								{ fCheckingThread = thread; }
 			bool			IsCheckingThread() const
@@ -129,6 +143,17 @@ public:
 								ino_t newDirectoryID, const char* newName);
 
 			bool			CheckForLiveQuery(const char* attribute);
+			bool			HasInlineData() const
+								{ return (fSuperBlock.Features()
+									& SUPER_BLOCK_FEATURE_INLINE_DATA) != 0; }
+			status_t		AddFeatures(uint32 features);
+			bool			HasTrigramIndices() const
+								{ return fTrigramIndices > 0; }
+			void			AddTrigramIndices(int32 count)
+								{ atomic_add(&fTrigramIndices, count); }
+			trigram_fill*	TrigramFill() const { return fTrigramFill; }
+			void			SetTrigramFill(trigram_fill* fill)
+								{ fTrigramFill = fill; }
 			void			AddQuery(Query* query);
 			void			RemoveQuery(Query* query);
 
@@ -136,6 +161,7 @@ public:
 			Journal*		GetJournal(off_t refBlock) const;
 
 			void*			BlockCache() { return fBlockCache; }
+			void			Prefetch(off_t block, size_t numBlocks);
 
 	static	status_t		CheckSuperBlock(const uint8* data,
 								uint32* _offset = NULL);
@@ -143,6 +169,7 @@ public:
 
 private:
 			status_t		_EraseUnusedBootBlock();
+			void			_CountTrigramIndices();
 
 protected:
 			fs_volume*		fVolume;
@@ -167,6 +194,9 @@ protected:
 
 			mutex			fQueryLock;
 			SinglyLinkedList<Query> fQueries;
+			int32			fTrigramIndices;
+			trigram_fill*	fTrigramFill;
+								// protected by the journal lock
 
 			uint32			fFlags;
 
@@ -174,6 +204,9 @@ protected:
 			thread_id		fCheckingThread;
 
 			InodeList		fRemovedInodes;
+
+			off_t			fReservedBlocks;
+			bfs_allocation_stats fAllocationStats;
 };
 
 
@@ -76,7 +76,8 @@ struct disk_super_block {
 	int32		magic3;
 	inode_addr	root_dir;
 	inode_addr	indices;
-	int32		_reserved[8];
+	uint32		features;
+	int32		_reserved[7];
 	int32		pad_to_block[87];
 		// this also contains parts of the boot block
 
@@ -95,12 +96,14 @@ struct disk_super_block {
 	int32 AllocationGroupShift() const
 		{ return BFS_ENDIAN_TO_HOST_INT32(ag_shift); }
 	int32 Flags() const { return BFS_ENDIAN_TO_HOST_INT32(flags); }
+	uint32 Features() const { return BFS_ENDIAN_TO_HOST_INT32(features); }
 	off_t LogStart() const { return BFS_ENDIAN_TO_HOST_INT64(log_start); }
 	off_t LogEnd() const { return BFS_ENDIAN_TO_HOST_INT64(log_end); }
 
 	// implemented in Volume.cpp:
 	bool IsValid() const;
 	void Initialize(const char *name, off_t numBlocks, uint32 blockSize);
+	void SetFeatures(uint32 features);
 } _PACKED;
 
 #define SUPER_BLOCK_FS_LENDIAN		'BIGE'		/* BIGE */
@@ -108,10 +111,24 @@ struct disk_super_block {
 #define SUPER_BLOCK_MAGIC1			'BFS1'		/* BFS1 */
 #define SUPER_BLOCK_MAGIC2			0xdd121031
 #define SUPER_BLOCK_MAGIC3			0x15b6830e
+#define SUPER_BLOCK_MAGIC3_INCOMPATIBLE	0x15b6830f
 
 #define SUPER_BLOCK_DISK_CLEAN		'CLEN'		/* CLEN */
 #define SUPER_BLOCK_DISK_DIRTY		'DIRT'		/* DIRT */
 
+// Optional on-disk features; a volume that uses a feature this driver
+// does not know about can only be mounted read-only. The incompatible ones
+// change how existing data has to be read, so such a volume cannot be
+// mounted at all. Since drivers that predate the features field ignore it,
+// a volume that uses any incompatible feature carries
+// SUPER_BLOCK_MAGIC3_INCOMPATIBLE instead of SUPER_BLOCK_MAGIC3, which they
+// don't accept.
+#define SUPER_BLOCK_FEATURE_UNWRITTEN_DATA	0x00010000	/* preallocation */
+#define SUPER_BLOCK_FEATURE_INLINE_DATA		0x00020000	/* small files */
+#define SUPER_BLOCK_INCOMPATIBLE_FEATURES	0xffff0000
+#define SUPER_BLOCK_KNOWN_FEATURES \
+	(SUPER_BLOCK_FEATURE_INLINE_DATA | SUPER_BLOCK_FEATURE_UNWRITTEN_DATA)
+
 //**************************************
 
 #define NUM_DIRECT_BLOCKS			12
@@ -171,6 +188,27 @@ struct small_data {
 #define FILE_NAME_NAME			0x13
 #define FILE_NAME_NAME_LENGTH	1
 
+// the contents of small files can live in the small_data area, too
+#define INLINE_DATA_TYPE		'RAWT'
+#define INLINE_DATA_NAME		0x14
+#define INLINE_DATA_NAME_LENGTH	1
+
+// the preallocated, but still unwritten parts of a file, as an array of
+// unwritten_extents
+#define UNWRITTEN_DATA_TYPE			'RAWT'
+#define UNWRITTEN_DATA_NAME			0x15
+#define UNWRITTEN_DATA_NAME_LENGTH	1
+#define MAX_UNWRITTEN_EXTENTS		16
+
+struct unwritten_extent {
+	int64		offset;
+	int64		length;
+
+	off_t Offset() const { return BFS_ENDIAN_TO_HOST_INT64(offset); }
+	off_t Length() const { return BFS_ENDIAN_TO_HOST_INT64(length); }
+	off_t End() const { return Offset() + Length(); }
+} _PACKED;
+
 
 //**************************************
 
@@ -253,6 +291,8 @@ enum inode_flags {
 	INODE_DELETED			= 0x00000010,
 	INODE_NOT_READY			= 0x00000020,	// used during Inode construction
 	INODE_LONG_SYMLINK		= 0x00000040,	// symlink in data stream
+	INODE_INLINE_DATA		= 0x00000080,	// file data in small_data
+	INODE_UNWRITTEN_DATA	= 0x00000100,	// preallocated, unwritten blocks
 
 	INODE_PERMANENT_FLAGS	= 0x0000ffff,
 
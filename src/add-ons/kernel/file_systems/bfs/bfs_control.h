@@ -29,6 +29,95 @@ struct update_boot_block {
 	uint32			length;
 };
 
+/* ioctl to retrieve the block allocation statistics of the volume, and
+ * the fragmentation of the file it is issued on - parameter is a
+ * struct bfs_allocation_stats *
+ */
+#define BFS_IOCTL_GET_ALLOCATION_STATS	14205
+
+struct bfs_allocation_stats {
+	uint32		block_size;
+
+	/* the file the ioctl was issued on */
+	uint32		file_extents;
+	uint64		file_blocks;
+
+	/* block runs allocated for file data since the volume was mounted */
+	uint64		data_runs;
+	uint64		data_blocks;
+
+	/* delayed allocation */
+	uint64		delayed_allocations;
+	uint64		delayed_blocks;
+	uint64		delayed_write_backs;
+		/* write backs that had to be postponed as the journal was busy */
+	uint64		reserved_blocks;
+		/* blocks currently reserved for data not yet allocated */
+};
+
+/* ioctl to retrieve the statistics of the volume's journal - parameter is a
+ * struct bfs_journal_stats *
+ */
+#define BFS_IOCTL_GET_JOURNAL_STATS		14206
+
+struct bfs_journal_stats {
+	bigtime_t	mounted;
+		/* system time the journal was started at */
+	uint32		transactions;
+		/* transactions completed since then */
+	uint32		unwritten_transactions;
+		/* transactions that are not yet in the log */
+
+	/* log entries written, and the transactions and blocks they contained */
+	uint64		log_writes;
+	uint64		logged_transactions;
+	uint64		logged_blocks;
+	bigtime_t	log_write_time;
+
+	/* explicit flushes of the log (fsync()), and how many of them found
+	 * their transactions already written by another flush
+	 */
+	uint64		log_flushes;
+	uint64		merged_log_flushes;
+};
+
+/* ioctl to show how a query would be run, without running it - parameter is
+ * a struct bfs_explain_query *
+ */
+#define BFS_IOCTL_EXPLAIN_QUERY			14207
+
+struct bfs_explain_query {
+	char		query[1024];
+	uint32		flags;
+		/* the query flags, B_QUERY_NON_INDEXED is considered */
+	char		plan[4096];
+		/* one line per term of the query, indented by its depth */
+};
+
+/* ioctl to compact the B+tree of the directory it's issued on, or of the
+ * given index - sparse leaf nodes are merged, and free nodes at the end of
+ * the tree are given back. The parameter is a struct bfs_compact_tree *
+ */
+#define BFS_IOCTL_COMPACT_TREE			14208
+
+struct bfs_compact_tree {
+	char		index[B_FILE_NAME_LENGTH];
+		/* if empty, the directory the ioctl is issued on is compacted */
+	uint32		merged_nodes;
+	uint32		freed_nodes;
+	off_t		size_before;
+	off_t		size_after;
+};
+
+/* A string index whose name consists of this prefix, and the name of another
+ * string index, is a trigram index: it contains every three character
+ * sequence of the keys of that index (folded to lower case), and is used by
+ * queries for patterns that don't start with a fixed prefix, like
+ * name=="*foo*" or name=="*[Ff][Oo][Oo]*".
+ * It is filled when it is created, and removed together with its index.
+ */
+#define BFS_TRIGRAM_INDEX_PREFIX	"bfs:trigrams:"
+
 /* ioctls to use the "chkbfs" feature from the outside
  * all calls use a struct check_result as single parameter
  */
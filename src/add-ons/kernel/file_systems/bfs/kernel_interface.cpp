@@ -26,6 +26,11 @@
 
 #define BFS_IO_SIZE	65536
 
+static const uint32 kMaxPrefetchInodes = 32;
+	// bfs_read_dir() prefetches the inodes of up to that many entries at once
+static const off_t kMaxPrefetchInodeGap = 8;
+	// the number of blocks that may lie between inodes prefetched together
+
 
 struct identify_cookie {
 	disk_super_block super_block;
@@ -216,7 +221,7 @@ bfs_read_fs_stat(fs_volume* _volume, struct fs_info* info)
 
 	info->block_size = volume->BlockSize();
 	info->total_blocks = volume->NumBlocks();
-	info->free_blocks = volume->FreeBlocks();
+	info->free_blocks = volume->AvailableBlocks();
 
 	// Volume name
 	strlcpy(info->volume_name, volume->Name(), sizeof(info->volume_name));
@@ -407,6 +412,9 @@ bfs_read_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 
 	InodeReadLocker _(inode);
 
+	if (inode->HasInlineData())
+		return inode->ReadInlineData(pos, vecs, count, _numBytes);
+
 	uint32 vecIndex = 0;
 	size_t vecOffset = 0;
 	size_t bytesLeft = *_numBytes;
@@ -450,6 +458,32 @@ bfs_write_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	if (inode->FileCache() == NULL)
 		RETURN_ERROR(B_BAD_VALUE);
 
+	if (inode->HasInlineData()) {
+		// The data is part of the inode, and needs a transaction to be
+		// written. Like bfs_io(), this doesn't wait for the journal.
+		return inode->WriteInlineData(pos, vecs, count, _numBytes);
+	}
+
+#ifndef FS_SHELL
+	if (inode->HasDelayedAllocation()
+		&& pos + (off_t)*_numBytes > inode->Node().data.Size()) {
+		// The blocks to write to need to be allocated first. Like in
+		// bfs_io(), we must not wait for the journal.
+		status_t status = inode->AllocateDelayedBlocks(false);
+		if (status != B_OK)
+			return status;
+	}
+#endif
+
+	if (inode->HasUnwrittenData()) {
+		// The blocks must not be reported as sparse anymore once they have
+		// been written to. As above, we must not wait for the journal.
+		status_t status = inode->InitializeUnwritten(pos,
+			pos + (off_t)*_numBytes, false);
+		if (status != B_OK)
+			return status;
+	}
+
 	InodeReadLocker _(inode);
 
 	uint32 vecIndex = 0;
@@ -482,6 +516,77 @@ bfs_write_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 }
 
 
+#ifndef FS_SHELL
+/*!	Copies the data of an inline file from or to the \a request, as there
+	are no blocks to do I/O on. As with delayed allocations, the write-back
+	does not wait for the journal, but leaves its pages modified instead.
+	Returns \c B_UNSUPPORTED without touching the request if the file no
+	longer has inline data.
+*/
+static status_t
+inline_data_io(Volume* volume, Inode* inode, io_request* request)
+{
+	off_t pos = io_request_offset(request);
+	size_t bytesLeft = io_request_length(request);
+	uint8 buffer[256];
+	status_t status = B_OK;
+
+	if (!io_request_is_write(request)) {
+		InodeReadLocker locker(inode);
+		if (!inode->HasInlineData())
+			return B_UNSUPPORTED;
+
+		while (bytesLeft > 0 && status == B_OK) {
+			size_t length = min_c(bytesLeft, sizeof(buffer));
+			iovec vec = {buffer, length};
+			status = inode->ReadInlineData(pos, &vec, 1, &length);
+			if (status == B_OK)
+				status = write_to_io_request(request, buffer, length);
+
+			pos += length;
+			bytesLeft -= length;
+		}
+
+		notify_io_request(request, status);
+		return status;
+	}
+
+	Transaction transaction;
+	status = transaction.TryStart(volume, inode->BlockNumber());
+	if (status != B_OK) {
+		notify_io_request(request, status);
+		return status;
+	}
+
+	inode->WriteLockInTransaction(transaction);
+
+	if (!inode->HasInlineData()) {
+		// the data has just been moved into a data stream of its own
+		transaction.Done();
+		return B_UNSUPPORTED;
+	}
+
+	while (bytesLeft > 0 && status == B_OK) {
+		size_t length = min_c(bytesLeft, sizeof(buffer));
+		status = read_from_io_request(request, buffer, length);
+		if (status == B_OK && pos < inode->Size()) {
+			status = inode->WriteInlineData(transaction, pos, buffer,
+				length);
+		}
+
+		pos += length;
+		bytesLeft -= length;
+	}
+
+	if (status == B_OK)
+		status = transaction.Done();
+
+	notify_io_request(request, status);
+	return status;
+}
+#endif	// !FS_SHELL
+
+
 static status_t
 bfs_io(fs_volume* _volume, fs_vnode* _node, void* _cookie, io_request* request)
 {
@@ -502,6 +607,51 @@ bfs_io(fs_volume* _volume, fs_vnode* _node, void* _cookie, io_request* request)
 		RETURN_ERROR(B_BAD_VALUE);
 	}
 
+	if (inode->HasInlineData()) {
+#ifndef FS_SHELL
+		status_t status = inline_data_io(volume, inode, request);
+		if (status != B_UNSUPPORTED)
+			return status;
+#else
+		// There are no blocks to do I/O on; let the VFS fall back to
+		// bfs_read_pages(), and bfs_write_pages()
+		return B_UNSUPPORTED;
+#endif
+	}
+
+#ifndef FS_SHELL
+	if (io_request_is_write(request) && inode->HasDelayedAllocation()
+		&& io_request_offset(request) + io_request_length(request)
+			> inode->Node().data.Size()) {
+		// The blocks to write to need to be allocated first. We must not
+		// wait for the journal here: its owner could wait for the very
+		// pages that are about to be written. Those just stay modified,
+		// and will be written later; Inode::Sync(), and writes that bypass
+		// the cache, allocate the blocks before they retry.
+		status_t status = inode->AllocateDelayedBlocks(false);
+		if (status != B_OK) {
+			if (status == B_WOULD_BLOCK) {
+				atomic_add64(
+					(int64*)&volume->AllocationStats().delayed_write_backs, 1);
+			}
+			notify_io_request(request, status);
+			return status;
+		}
+	}
+
+	if (io_request_is_write(request) && inode->HasUnwrittenData()) {
+		// The blocks must not be reported as sparse anymore once they have
+		// been written to. Again, we must not wait for the journal.
+		status_t status = inode->InitializeUnwritten(
+			io_request_offset(request),
+			io_request_offset(request) + io_request_length(request), false);
+		if (status != B_OK) {
+			notify_io_request(request, status);
+			return status;
+		}
+	}
+#endif
+
 	// We lock the node here and will unlock it in the "finished" hook.
 	rw_lock_read_lock(&inode->Lock());
 
@@ -522,28 +672,62 @@ bfs_get_file_map(fs_volume* _volume, fs_vnode* _node, off_t offset, size_t size,
 	block_run run;
 	off_t fileOffset;
 
+	if (inode->HasInlineData()) {
+		// the data is stored in the inode, and cannot be mapped
+		return B_UNSUPPORTED;
+	}
+
+	// data beyond the end of the data stream has not been allocated yet
+	off_t allocatedSize = round_up(inode->Node().data.Size(),
+		volume->BlockSize());
+
 	//FUNCTION_START(("offset = %Ld, size = %lu\n", offset, size));
 
 	while (true) {
-		status_t status = inode->FindBlockRun(offset, run, fileOffset);
-		if (status != B_OK)
+		if (offset >= allocatedSize) {
+			// delayed allocation: report a sparse extent
+			vecs[index].offset = -1;
+			vecs[index].length = round_up(inode->Size(), volume->BlockSize())
+				- offset;
+			*_count = index + 1;
+			return B_OK;
+		}
+
+		// unwritten blocks must not be read from disk
+		off_t mappedEnd = allocatedSize;
+		off_t unwrittenStart;
+		off_t unwrittenEnd;
+		status_t status = inode->FindUnwrittenExtent(offset, unwrittenStart,
+			unwrittenEnd);
+		if (status == B_OK)
+			mappedEnd = min_c(mappedEnd, unwrittenStart);
+		else if (status != B_ENTRY_NOT_FOUND)
 			return status;
 
-		vecs[index].offset = volume->ToOffset(run) + offset - fileOffset;
-		vecs[index].length = ((uint32)run.Length() << blockShift)
-			- offset + fileOffset;
+		if (mappedEnd <= offset) {
+			vecs[index].offset = -1;
+			vecs[index].length = min_c(unwrittenEnd, allocatedSize) - offset;
+		} else {
+			status = inode->FindBlockRun(offset, run, fileOffset);
+			if (status != B_OK)
+				return status;
+
+			vecs[index].offset = volume->ToOffset(run) + offset - fileOffset;
+			vecs[index].length = ((uint32)run.Length() << blockShift)
+				- offset + fileOffset;
+
+			if (offset + vecs[index].length > mappedEnd) {
+				// make sure the extent ends with the last official file
+				// block (without taking any preallocations into account),
+				// or in front of unwritten blocks
+				vecs[index].length = mappedEnd - offset;
+			}
+		}
 
 		// are we already done?
 		if ((uint64)size <= (uint64)vecs[index].length
 			|| (uint64)offset + (uint64)vecs[index].length
 				>= (uint64)inode->Size()) {
-			if ((uint64)offset + (uint64)vecs[index].length
-					> (uint64)inode->Size()) {
-				// make sure the extent ends with the last official file
-				// block (without taking any preallocations into account)
-				vecs[index].length = round_up(inode->Size() - offset,
-					volume->BlockSize());
-			}
 			*_count = index + 1;
 			return B_OK;
 		}
@@ -723,6 +907,139 @@ bfs_ioctl(fs_volume* _volume, fs_vnode* _node, void* _cookie, uint32 cmd,
 
 			return volume->WriteSuperBlock();
 		}
+		case BFS_IOCTL_GET_ALLOCATION_STATS:
+		{
+			// the volume's allocation statistics, and the layout of the
+			// file the ioctl was issued on
+			Inode* inode = (Inode*)_node->private_node;
+			if (bufferLength < sizeof(bfs_allocation_stats))
+				return B_BAD_VALUE;
+
+			bfs_allocation_stats& volumeStats = volume->AllocationStats();
+			bfs_allocation_stats stats;
+			stats.data_runs = atomic_get64((int64*)&volumeStats.data_runs);
+			stats.data_blocks = atomic_get64((int64*)&volumeStats.data_blocks);
+			stats.delayed_allocations
+				= atomic_get64((int64*)&volumeStats.delayed_allocations);
+			stats.delayed_blocks
+				= atomic_get64((int64*)&volumeStats.delayed_blocks);
+			stats.delayed_write_backs
+				= atomic_get64((int64*)&volumeStats.delayed_write_backs);
+			{
+				MutexLocker locker(volume->Lock());
+				stats.reserved_blocks = volume->ReservedBlocks();
+			}
+			stats.block_size = volume->BlockSize();
+			stats.file_extents = 0;
+			stats.file_blocks = 0;
+			if (inode->IsFile()) {
+				stats.file_extents = inode->CountFileExtents();
+				stats.file_blocks = inode->AllocatedSize()
+					>> volume->BlockShift();
+			}
+
+			return user_memcpy(buffer, &stats, sizeof(bfs_allocation_stats));
+		}
+		case BFS_IOCTL_GET_JOURNAL_STATS:
+		{
+			if (bufferLength < sizeof(bfs_journal_stats))
+				return B_BAD_VALUE;
+
+			bfs_journal_stats stats;
+			volume->GetJournal(0)->GetStatistics(stats);
+
+			return user_memcpy(buffer, &stats, sizeof(bfs_journal_stats));
+		}
+		case BFS_IOCTL_EXPLAIN_QUERY:
+		{
+			if (bufferLength < sizeof(bfs_explain_query))
+				return B_BAD_VALUE;
+
+			bfs_explain_query* explain
+				= (bfs_explain_query*)malloc(sizeof(bfs_explain_query));
+			if (explain == NULL)
+				return B_NO_MEMORY;
+			MemoryDeleter explainDeleter(explain);
+
+			if (user_memcpy(explain, buffer, sizeof(bfs_explain_query))
+					!= B_OK)
+				return B_BAD_ADDRESS;
+			explain->query[sizeof(explain->query) - 1] = '\0';
+
+			Expression expression(explain->query);
+			if (expression.InitCheck() != B_OK)
+				return B_BAD_VALUE;
+
+			Query query(volume, &expression,
+				explain->flags & B_QUERY_NON_INDEXED);
+			query.Explain(explain->plan, sizeof(explain->plan));
+
+			return user_memcpy(((bfs_explain_query*)buffer)->plan,
+				explain->plan, sizeof(explain->plan));
+		}
+		case BFS_IOCTL_COMPACT_TREE:
+		{
+			if (bufferLength < sizeof(bfs_compact_tree))
+				return B_BAD_VALUE;
+			if (volume->IsReadOnly())
+				return B_READ_ONLY_DEVICE;
+
+			bfs_compact_tree compact;
+			if (user_memcpy(&compact, buffer, sizeof(bfs_compact_tree))
+					!= B_OK)
+				return B_BAD_ADDRESS;
+			compact.index[sizeof(compact.index) - 1] = '\0';
+
+			Inode* inode = (Inode*)_node->private_node;
+			Index index(volume);
+			status_t status;
+			if (compact.index[0] != '\0') {
+				if (geteuid() != 0)
+					return B_NOT_ALLOWED;
+
+				status = index.SetTo(compact.index);
+				if (status != B_OK)
+					return status;
+
+				inode = index.Node();
+			} else {
+				status = inode->CheckPermissions(W_OK);
+				if (status != B_OK)
+					return status;
+			}
+
+			BPlusTree* tree = inode->Tree();
+			if (tree == NULL)
+				return B_BAD_TYPE;
+
+			compact.merged_nodes = 0;
+			compact.freed_nodes = 0;
+			compact.size_before = inode->Size();
+
+			// every step is done in its own transaction, so that the
+			// tree is not locked for too long
+			off_t cookie = 0;
+			while (true) {
+				Transaction transaction(volume, inode->BlockNumber());
+				inode->WriteLockInTransaction(transaction);
+
+				status = tree->Compact(transaction, &cookie,
+					&compact.merged_nodes, &compact.freed_nodes);
+				if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+					return status;
+
+				bool done = status == B_ENTRY_NOT_FOUND;
+				status = transaction.Done();
+				if (status != B_OK)
+					return status;
+				if (done)
+					break;
+			}
+
+			compact.size_after = inode->Size();
+
+			return user_memcpy(buffer, &compact, sizeof(bfs_compact_tree));
+		}
 
 #ifdef DEBUG_FRAGMENTER
 		case 56741:
@@ -781,8 +1098,15 @@ bfs_fsync(fs_volume* _volume, fs_vnode* _node)
 {
 	FUNCTION();
 
+	Volume* volume = (Volume*)_volume->private_volume;
 	Inode* inode = (Inode*)_node->private_node;
-	return inode->Sync();
+
+	status_t status = inode->Sync();
+	if (status != B_OK)
+		return status;
+
+	// make sure the changes to the inode itself are on disk as well
+	return volume->GetJournal(inode->BlockNumber())->FlushLog();
 }
 
 
@@ -930,6 +1254,61 @@ bfs_write_stat(fs_volume* _volume, fs_vnode* _node, const struct stat* stat,
 }
 
 
+static status_t
+bfs_preallocate(fs_volume* _volume, fs_vnode* _node, off_t pos, off_t length)
+{
+	FUNCTION();
+
+	Volume* volume = (Volume*)_volume->private_volume;
+	Inode* inode = (Inode*)_node->private_node;
+
+	if (volume->IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+	if (inode->IsDirectory())
+		return B_IS_A_DIRECTORY;
+	if (!inode->IsFile())
+		return B_BAD_VALUE;
+
+	Transaction transaction(volume, inode->BlockNumber());
+	inode->WriteLockInTransaction(transaction);
+
+	off_t oldSize = inode->Size();
+
+	status_t status = inode->Preallocate(transaction, pos, length);
+	if (status != B_OK)
+		return status;
+	if (inode->Size() == oldSize)
+		return transaction.Done();
+
+	if (!inode->IsDeleted()) {
+		Index index(volume);
+		index.UpdateSize(transaction, inode);
+	}
+
+	inode->Node().status_change_time = HOST_ENDIAN_TO_BFS_INT64(
+		bfs_inode::ToInode(real_time_clock_usecs()));
+
+	// Only the rest of the former last block needs to be cleared; the blocks
+	// behind it are unwritten, and read as zeros without touching the disk
+	off_t zeroSize = inode->Size();
+	if (inode->HasUnwrittenData())
+		zeroSize = min_c(zeroSize, round_up(oldSize, volume->BlockSize()));
+
+	status = inode->WriteBack(transaction);
+	if (status == B_OK)
+		status = transaction.Done();
+	if (status != B_OK)
+		return status;
+
+	// the transaction does not keep the inode locked anymore
+	inode->FillGapWithZeros(oldSize, zeroSize);
+
+	notify_stat_changed(volume->ID(), inode->ParentID(), inode->ID(),
+		B_STAT_SIZE | B_STAT_CHANGE_TIME);
+	return B_OK;
+}
+
+
 status_t
 bfs_create(fs_volume* _volume, fs_vnode* _directory, const char* name,
 	int openMode, int mode, void** _cookie, ino_t* _vnodeID)
@@ -1428,6 +1807,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 
 	Transaction transaction;
 	bool needsTrimming = false;
+	status_t result = B_OK;
 
 	if (!volume->IsReadOnly() && !volume->IsCheckingThread()) {
 		InodeReadLocker locker(inode);
@@ -1435,7 +1815,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 
 		if ((cookie->open_mode & O_RWMASK) != 0
 			&& !inode->IsDeleted()
-			&& (needsTrimming
+			&& (needsTrimming || inode->HasDelayedAllocation()
 				|| inode->OldLastModified() != inode->LastModified()
 				|| (inode->InSizeIndex()
 					// TODO: this can prevent the size update notification
@@ -1451,6 +1831,16 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 	if (status == B_OK) {
 		inode->WriteLockInTransaction(transaction);
 
+		// allocate the blocks of any data written since the file was opened,
+		// so that the file's final size goes into the size index
+		if (inode->HasDelayedAllocation()) {
+			// The blocks stay reserved if this fails, and the data is
+			// written back once they could be allocated. We still update
+			// the rest of the inode, but let the caller know.
+			result = inode->AllocateDelayedBlocks(transaction);
+			needsTrimming = inode->NeedsTrimming();
+		}
+
 		// trim the preallocated blocks and update the size,
 		// and last_modified indices if needed
 		bool changedSize = false, changedTime = false;
@@ -1502,7 +1892,7 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 		file_cache_enable(inode->FileCache());
 
 	delete cookie;
-	return B_OK;
+	return result;
 }
 
 
@@ -1660,6 +2050,45 @@ bfs_open_dir(fs_volume* _volume, fs_vnode* _node, void** _cookie)
 }
 
 
+/*!	Reads the inodes with the given \a ids into the block cache in batches,
+	as far as they lie close together on disk, so that a stat() following
+	the directory iteration will find them there. Inodes that are far away
+	from the others are left alone.
+*/
+static void
+prefetch_inodes(Volume* volume, const ino_t* ids, uint32 count)
+{
+	off_t start = 0;
+	off_t end = 0;
+	uint32 inodes = 0;
+
+	for (uint32 i = 0; i < count; i++) {
+		off_t block = volume->VnodeToBlock(ids[i]);
+		if (!volume->IsValidInodeBlock(block))
+			continue;
+
+		if (inodes > 0 && block + kMaxPrefetchInodeGap >= start
+			&& block <= end + kMaxPrefetchInodeGap
+			&& max_c(end, block) - min_c(start, block)
+				< (off_t)kMaxPrefetchInodes) {
+			start = min_c(start, block);
+			end = max_c(end, block);
+			inodes++;
+			continue;
+		}
+
+		if (inodes > 1)
+			volume->Prefetch(start, end + 1 - start);
+
+		start = end = block;
+		inodes = 1;
+	}
+
+	if (inodes > 1)
+		volume->Prefetch(start, end + 1 - start);
+}
+
+
 static status_t
 bfs_read_dir(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	struct dirent* dirent, size_t bufferSize, uint32* _num)
@@ -1672,6 +2101,9 @@ bfs_read_dir(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	uint32 maxCount = *_num;
 	uint32 count = 0;
 
+	ino_t ids[kMaxPrefetchInodes];
+	uint32 idCount = 0;
+
 	while (count < maxCount && bufferSize > sizeof(struct dirent)) {
 		ino_t id;
 		uint16 length;
@@ -1702,8 +2134,16 @@ bfs_read_dir(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 		bufferSize -= dirent->d_reclen;
 		dirent = (struct dirent*)((uint8*)dirent + dirent->d_reclen);
 		count++;
+
+		ids[idCount++] = id;
+		if (idCount == kMaxPrefetchInodes) {
+			prefetch_inodes(volume, ids, idCount);
+			idCount = 0;
+		}
 	}
 
+	prefetch_inodes(volume, ids, idCount);
+
 	*_num = count;
 	return B_OK;
 }
@@ -1949,6 +2389,12 @@ bfs_remove_attr(fs_volume* _volume, fs_vnode* _node, const char* name)
 	Volume* volume = (Volume*)_volume->private_volume;
 	Inode* inode = (Inode*)_node->private_node;
 
+	// the data of an inline file, and its unwritten extents are not
+	// attributes of it
+	if ((name[0] == INLINE_DATA_NAME || name[0] == UNWRITTEN_DATA_NAME)
+		&& name[1] == '\0')
+		return B_NOT_ALLOWED;
+
 	status_t status = inode->CheckPermissions(W_OK);
 	if (status != B_OK)
 		return status;
@@ -2119,9 +2565,17 @@ bfs_create_index(fs_volume* _volume, const char* name, uint32 type,
 	if (geteuid() != 0)
 		return B_NOT_ALLOWED;
 
+	Index index(volume);
+	if (Index::IsTrigramIndex(name)) {
+		if (type != B_STRING_TYPE)
+			return B_BAD_TYPE;
+
+		// uses transactions of its own
+		return index.CreateTrigrams(name);
+	}
+
 	Transaction transaction(volume, volume->Indices());
 
-	Index index(volume);
 	status_t status = index.Create(transaction, name, type);
 
 	if (status == B_OK)
@@ -2152,8 +2606,21 @@ bfs_remove_index(fs_volume* _volume, const char* name)
 	Transaction transaction(volume, volume->Indices());
 
 	status_t status = indices->Remove(transaction, name);
+
+	// an index takes its trigram index with it, as it won't be updated
+	// anymore
+	int32 trigramIndices = Index::IsTrigramIndex(name) ? 1 : 0;
+	char trigramName[B_FILE_NAME_LENGTH];
+	if (status == B_OK && trigramIndices == 0 && volume->HasTrigramIndices()
+		&& Index::GetTrigramIndexName(name, trigramName, sizeof(trigramName))
+			== B_OK
+		&& indices->Remove(transaction, trigramName) == B_OK)
+		trigramIndices = 1;
+
 	if (status == B_OK)
 		status = transaction.Done();
+	if (status == B_OK && trigramIndices > 0)
+		volume->AddTrigramIndices(-trigramIndices);
 
 	RETURN_ERROR(status);
 }
@@ -2340,6 +2807,8 @@ bfs_initialize(int fd, partition_id partitionID, const char* name,
 		INFORM(("\tallocation group size: %ld blocks\n",
 			1L << super.AllocationGroupShift()));
 		INFORM(("\tlog size: %u blocks\n", super.log_blocks.Length()));
+		if ((super.Features() & SUPER_BLOCK_FEATURE_INLINE_DATA) != 0)
+			INFORM(("\tsmall files are stored inline\n"));
 	}
 
 	return B_OK;
@@ -2450,7 +2919,7 @@ fs_vnode_ops gBFSVnodeOps = {
 	&bfs_access,
 	&bfs_read_stat,
 	&bfs_write_stat,
-	NULL,	// fs_preallocate
+	&bfs_preallocate,
 
 	/* file operations */
 	&bfs_create,
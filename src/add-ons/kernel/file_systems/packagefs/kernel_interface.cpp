@@ -10,6 +10,7 @@
 
 #include <new>
 
+#include <fs_cache.h>
 #include <fs_info.h>
 #include <fs_interface.h>
 #include <KernelExport.h>
@@ -146,8 +147,12 @@ packagefs_lookup(fs_volume* fsVolume, fs_vnode* fsDir, const char* entryName,
 	NodeReadLocker dirLocker(dir);
 	String entryNameString;
 	Node* node = dynamic_cast<Directory*>(dir)->FindChild(StringKey(entryName));
-	if (node == NULL)
+	if (node == NULL) {
+		// Entries can only appear with a notification, which invalidates
+		// the negative entry again.
+		entry_cache_add_missing(volume->ID(), dir->ID(), entryName);
 		return B_ENTRY_NOT_FOUND;
+	}
 	BReference<Node> nodeReference(node);
 	dirLocker.Unlock();
 
@@ -1396,6 +1396,15 @@ ipv4_send_routed_data(net_protocol* _protocol, struct net_route* route,
 	// Add IP header (if needed)
 
 	if (!headerIncluded) {
+		// A buffer that is later split into several TCP segments needs an ID
+		// for each of them; they are numbered starting with the one in its
+		// header
+		int32 idCount = 1;
+		if (buffer->segment_size != 0) {
+			idCount = (buffer->size + buffer->segment_size - 1)
+				/ buffer->segment_size;
+		}
+
 		NetBufferPrepend<ipv4_header> header(buffer);
 		if (header.Status() != B_OK)
 			return header.Status();
@@ -1404,7 +1413,7 @@ ipv4_send_routed_data(net_protocol* _protocol, struct net_route* route,
 		header->header_length = sizeof(ipv4_header) / 4;
 		header->service_type = protocol ? protocol->service_type : 0;
 		header->total_length = htons(buffer->size);
-		header->id = htons(atomic_add(&sPacketID, 1));
+		header->id = htons(atomic_add(&sPacketID, idCount));
 		header->fragment_offset = 0;
 		if (protocol) {
 			header->time_to_live = (buffer->flags & MSG_MCAST) != 0
@@ -1455,8 +1464,9 @@ ipv4_send_routed_data(net_protocol* _protocol, struct net_route* route,
 		ntohl(destination.sin_addr.s_addr));
 
 	uint32 mtu = route->mtu ? route->mtu : interface->mtu;
-	if (buffer->size > mtu) {
-		// we need to fragment the packet
+	if (buffer->size > mtu && buffer->segment_size == 0) {
+		// we need to fragment the packet (TCP segments are split into
+		// packets that fit into the MTU later)
 		return send_fragments(protocol, route, buffer, mtu);
 	}
 
@@ -0,0 +1,575 @@
+/*
+ * Copyright 2016, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "CongestionControl.h"
+
+#include <new>
+#include <string.h>
+
+#include <KernelExport.h>
+
+
+// References:
+//	- RFC 5681 - TCP Congestion Control
+//	- RFC 3465 - TCP Congestion Control with Appropriate Byte Counting
+//	- RFC 8312 - CUBIC for Fast Long-Distance Networks
+//	- L. Brakmo, L. Peterson - TCP Vegas: End to End Congestion Avoidance
+//	  on a Global Internet
+
+
+class RenoCongestionControl : public CongestionControl {
+public:
+	virtual	const char*			Name() const { return "reno"; }
+};
+
+
+class CubicCongestionControl : public CongestionControl {
+public:
+								CubicCongestionControl();
+
+	virtual	const char*			Name() const { return "cubic"; }
+
+	virtual	void				Init(uint32 maxSegmentSize,
+									uint32 slowStartThreshold);
+	virtual	void				Acknowledged(uint32 bytes);
+	virtual	void				RoundTripTimeMeasured(int32 roundTripTime);
+
+protected:
+	virtual	uint32				_ReducedThreshold(uint32 flightSize);
+
+private:
+			void				_StartEpoch(bigtime_t now);
+			void				_Reset();
+
+private:
+			uint32				fMaxWindow;
+			uint32				fOriginWindow;
+			bigtime_t			fEpochStart;
+			int32				fTimeToOrigin;
+			uint32				fEstimatedWindow;
+			uint64				fEstimatedIncrement;
+			int32				fMinRoundTripTime;
+};
+
+
+class VegasCongestionControl : public CongestionControl {
+public:
+								VegasCongestionControl();
+
+	virtual	const char*			Name() const { return "vegas"; }
+
+	virtual	void				Init(uint32 maxSegmentSize,
+									uint32 slowStartThreshold);
+	virtual	void				Acknowledged(uint32 bytes);
+	virtual	void				RoundTripTimeMeasured(int32 roundTripTime);
+
+protected:
+	virtual	uint32				_ReducedThreshold(uint32 flightSize);
+
+private:
+			void				_EndRound();
+			void				_Reset();
+
+private:
+			int32				fBaseRoundTripTime;
+			int32				fRoundMinRoundTripTime;
+			bigtime_t			fRoundStart;
+};
+
+
+struct congestion_control_algorithm {
+	const char*	name;
+	CongestionControl* (*create)();
+};
+
+
+// CUBIC constants: C = 0.4, and the multiplicative decrease factor 0.7
+static const uint32 kCubicBetaNumerator = 7;
+static const uint32 kCubicBetaDenominator = 10;
+
+// the time difference is capped to keep the cubic term from overflowing
+static const int64 kCubicMaxTime = 100000;
+	// in ms
+
+// Vegas keeps between alpha and beta segments queued in the network, and
+// leaves slow start once more than gamma segments are queued
+static const uint32 kVegasAlpha = 2;
+static const uint32 kVegasBeta = 4;
+static const uint32 kVegasGamma = 1;
+
+
+static CongestionControl*
+create_reno()
+{
+	return new(std::nothrow) RenoCongestionControl;
+}
+
+
+static CongestionControl*
+create_cubic()
+{
+	return new(std::nothrow) CubicCongestionControl;
+}
+
+
+static CongestionControl*
+create_vegas()
+{
+	return new(std::nothrow) VegasCongestionControl;
+}
+
+
+static const congestion_control_algorithm kAlgorithms[] = {
+	{"reno", &create_reno},
+	{"cubic", &create_cubic},
+	{"vegas", &create_vegas},
+	{NULL, NULL}
+};
+
+static const congestion_control_algorithm* sDefaultAlgorithm = &kAlgorithms[0];
+
+
+static const congestion_control_algorithm*
+find_algorithm(const char* name)
+{
+	for (int32 i = 0; kAlgorithms[i].name != NULL; i++) {
+		if (!strcmp(kAlgorithms[i].name, name))
+			return &kAlgorithms[i];
+	}
+
+	return NULL;
+}
+
+
+/*!	Returns the integer cube root of \a value, rounded down.
+*/
+static uint32
+cube_root(uint64 value)
+{
+	uint64 root = 0;
+
+	for (int32 shift = 63; shift >= 0; shift -= 3) {
+		root <<= 1;
+		uint64 bit = 3 * root * (root + 1) + 1;
+		if ((value >> shift) >= bit) {
+			value -= bit << shift;
+			root++;
+		}
+	}
+
+	return (uint32)root;
+}
+
+
+//	#pragma mark - CongestionControl
+
+
+CongestionControl::CongestionControl()
+	:
+	fWindow(0),
+	fSlowStartThreshold(0),
+	fMaxSegmentSize(0),
+	fIncrement(0)
+{
+}
+
+
+CongestionControl::~CongestionControl()
+{
+}
+
+
+/*!	Continues with the state of \a other, so that the algorithm of a
+	connection can be changed at any time.
+*/
+void
+CongestionControl::TakeOver(const CongestionControl& other)
+{
+	fWindow = other.fWindow;
+	fSlowStartThreshold = other.fSlowStartThreshold;
+	fMaxSegmentSize = other.fMaxSegmentSize;
+	fIncrement = 0;
+}
+
+
+void
+CongestionControl::Init(uint32 maxSegmentSize, uint32 slowStartThreshold)
+{
+	fMaxSegmentSize = maxSegmentSize;
+	fWindow = 2 * maxSegmentSize;
+	fSlowStartThreshold = slowStartThreshold;
+	fIncrement = 0;
+}
+
+
+/*!	Called whenever new data has been acknowledged by the peer outside of
+	fast recovery.
+	The default implementation does slow start, and increases the window by
+	one segment per round trip during congestion avoidance.
+*/
+void
+CongestionControl::Acknowledged(uint32 bytes)
+{
+	if (fWindow < fSlowStartThreshold)
+		_SlowStart(bytes);
+	else
+		_IncreaseWindow(bytes, fWindow + fMaxSegmentSize);
+}
+
+
+/*!	Is called for each round trip time sample, \a roundTripTime is in
+	milliseconds.
+*/
+void
+CongestionControl::RoundTripTimeMeasured(int32 roundTripTime)
+{
+}
+
+
+/*!	The third duplicate acknowledge has been received; the lost segment is
+	retransmitted, and the window is inflated by the segments that already
+	left the network.
+*/
+void
+CongestionControl::EnterRecovery(uint32 flightSize)
+{
+	fSlowStartThreshold = _ReducedThreshold(flightSize);
+	fWindow = fSlowStartThreshold + 3 * fMaxSegmentSize;
+	fIncrement = 0;
+}
+
+
+void
+CongestionControl::DuplicateAcknowledge()
+{
+	fWindow += fMaxSegmentSize;
+}
+
+
+void
+CongestionControl::ExitRecovery()
+{
+	// deflate the window
+	fWindow = fSlowStartThreshold;
+}
+
+
+void
+CongestionControl::RetransmitTimeout(uint32 flightSize)
+{
+	fSlowStartThreshold = _ReducedThreshold(flightSize);
+	fWindow = fMaxSegmentSize;
+	fIncrement = 0;
+}
+
+
+/*!	Returns the new slow start threshold after a loss has been detected.
+*/
+uint32
+CongestionControl::_ReducedThreshold(uint32 flightSize)
+{
+	return max_c(flightSize / 2, 2 * fMaxSegmentSize);
+}
+
+
+void
+CongestionControl::_SlowStart(uint32 bytes)
+{
+	// Appropriate byte counting, with a limit of two segments per ACK
+	fWindow += min_c(bytes, 2 * fMaxSegmentSize);
+}
+
+
+/*!	Grows the window so that it will have reached \a target after another
+	window of \a bytes has been acknowledged.
+*/
+void
+CongestionControl::_IncreaseWindow(uint32 bytes, uint32 target)
+{
+	if (target <= fWindow)
+		return;
+
+	fIncrement += (uint64)(target - fWindow) * bytes;
+	if (fIncrement >= fWindow) {
+		uint32 increment = fIncrement / fWindow;
+		fIncrement -= (uint64)increment * fWindow;
+		fWindow += increment;
+	}
+}
+
+
+//	#pragma mark - CUBIC
+
+
+CubicCongestionControl::CubicCongestionControl()
+{
+	_Reset();
+}
+
+
+void
+CubicCongestionControl::Init(uint32 maxSegmentSize,
+	uint32 slowStartThreshold)
+{
+	CongestionControl::Init(maxSegmentSize, slowStartThreshold);
+	_Reset();
+}
+
+
+void
+CubicCongestionControl::Acknowledged(uint32 bytes)
+{
+	if (fWindow < fSlowStartThreshold) {
+		_SlowStart(bytes);
+		return;
+	}
+
+	bigtime_t now = system_time();
+	if (fEpochStart == 0)
+		_StartEpoch(now);
+
+	// W_cubic(t + RTT) = C * (t + RTT - K)^3 + W_max, in bytes
+	int64 time = (now - fEpochStart) / 1000 + fTimeToOrigin;
+	if (fMinRoundTripTime > 0)
+		time += fMinRoundTripTime;
+	if (time > kCubicMaxTime)
+		time = kCubicMaxTime;
+	else if (time < -kCubicMaxTime)
+		time = -kCubicMaxTime;
+
+	int64 target = (int64)fOriginWindow
+		+ time * time * time / 1000 * 2 * fMaxSegmentSize / 5000000;
+	if (target < 0)
+		target = 0;
+
+	// never grow by more than half the window per round trip
+	if (target > (int64)fWindow + fWindow / 2)
+		target = (int64)fWindow + fWindow / 2;
+
+	// stay at least as aggressive as Reno would be (TCP friendly region)
+	fEstimatedIncrement += (uint64)9 * fMaxSegmentSize * bytes;
+	uint64 divisor = (uint64)17 * fWindow;
+	if (fEstimatedIncrement >= divisor) {
+		uint32 increment = fEstimatedIncrement / divisor;
+		fEstimatedIncrement -= increment * divisor;
+		fEstimatedWindow += increment;
+	}
+	if (target < (int64)fEstimatedWindow)
+		target = fEstimatedWindow;
+
+	_IncreaseWindow(bytes, (uint32)target);
+}
+
+
+void
+CubicCongestionControl::RoundTripTimeMeasured(int32 roundTripTime)
+{
+	if (fMinRoundTripTime < 0 || roundTripTime < fMinRoundTripTime)
+		fMinRoundTripTime = roundTripTime;
+}
+
+
+uint32
+CubicCongestionControl::_ReducedThreshold(uint32 flightSize)
+{
+	fEpochStart = 0;
+
+	// fast convergence: if the window did not reach its previous maximum,
+	// release some bandwidth for new flows
+	if (fWindow < fMaxWindow) {
+		fMaxWindow = (uint64)fWindow * (kCubicBetaDenominator
+			+ kCubicBetaNumerator) / (2 * kCubicBetaDenominator);
+	} else
+		fMaxWindow = fWindow;
+
+	uint32 threshold = (uint64)fWindow * kCubicBetaNumerator
+		/ kCubicBetaDenominator;
+	return max_c(threshold, 2 * fMaxSegmentSize);
+}
+
+
+void
+CubicCongestionControl::_StartEpoch(bigtime_t now)
+{
+	fEpochStart = now;
+	fEstimatedWindow = fWindow;
+	fEstimatedIncrement = 0;
+
+	if (fWindow < fMaxWindow) {
+		// K = cbrt((W_max - cwnd) / C), in ms
+		fTimeToOrigin = -(int32)cube_root((uint64)(fMaxWindow - fWindow)
+			* 2500000000LL / fMaxSegmentSize);
+		fOriginWindow = fMaxWindow;
+	} else {
+		fTimeToOrigin = 0;
+		fOriginWindow = fWindow;
+	}
+}
+
+
+void
+CubicCongestionControl::_Reset()
+{
+	fMaxWindow = 0;
+	fOriginWindow = 0;
+	fEpochStart = 0;
+	fTimeToOrigin = 0;
+	fEstimatedWindow = 0;
+	fEstimatedIncrement = 0;
+	fMinRoundTripTime = -1;
+}
+
+
+//	#pragma mark - Vegas
+
+
+VegasCongestionControl::VegasCongestionControl()
+{
+	_Reset();
+}
+
+
+void
+VegasCongestionControl::Init(uint32 maxSegmentSize,
+	uint32 slowStartThreshold)
+{
+	CongestionControl::Init(maxSegmentSize, slowStartThreshold);
+	_Reset();
+}
+
+
+void
+VegasCongestionControl::Acknowledged(uint32 bytes)
+{
+	if (fBaseRoundTripTime < 0) {
+		// without any round trip time samples, we can only do Reno
+		CongestionControl::Acknowledged(bytes);
+		return;
+	}
+
+	bigtime_t now = system_time();
+	if (fRoundStart == 0)
+		fRoundStart = now;
+
+	if (fWindow < fSlowStartThreshold)
+		_SlowStart(bytes);
+
+	// the window is adjusted once per round trip
+	bigtime_t roundLength = max_c(fRoundMinRoundTripTime, 1) * 1000LL;
+	if (now - fRoundStart >= roundLength) {
+		_EndRound();
+		fRoundStart = now;
+	}
+}
+
+
+void
+VegasCongestionControl::RoundTripTimeMeasured(int32 roundTripTime)
+{
+	if (fBaseRoundTripTime < 0 || roundTripTime < fBaseRoundTripTime)
+		fBaseRoundTripTime = roundTripTime;
+	if (fRoundMinRoundTripTime < 0
+		|| roundTripTime < fRoundMinRoundTripTime)
+		fRoundMinRoundTripTime = roundTripTime;
+}
+
+
+uint32
+VegasCongestionControl::_ReducedThreshold(uint32 flightSize)
+{
+	fRoundStart = 0;
+	fRoundMinRoundTripTime = -1;
+
+	return CongestionControl::_ReducedThreshold(flightSize);
+}
+
+
+void
+VegasCongestionControl::_EndRound()
+{
+	if (fRoundMinRoundTripTime < 0) {
+		// no samples during this round, fall back to Reno
+		if (fWindow >= fSlowStartThreshold)
+			fWindow += fMaxSegmentSize;
+		return;
+	}
+
+	// The difference between the expected and the actual rate, expressed
+	// as the amount of data that is queued in the network
+	uint32 roundTripTime = fRoundMinRoundTripTime;
+	uint32 queued = 0;
+	if (roundTripTime > 0) {
+		queued = (uint64)fWindow * (roundTripTime - fBaseRoundTripTime)
+			/ roundTripTime;
+	}
+
+	fRoundMinRoundTripTime = -1;
+
+	if (fWindow < fSlowStartThreshold) {
+		if (queued > kVegasGamma * fMaxSegmentSize) {
+			// leave slow start, and shrink the window to what the network
+			// is actually able to carry
+			uint32 expected = (uint64)fWindow * fBaseRoundTripTime
+				/ roundTripTime;
+			fWindow = max_c(min_c(fWindow, expected + fMaxSegmentSize),
+				2 * fMaxSegmentSize);
+			fSlowStartThreshold = fWindow;
+		}
+		return;
+	}
+
+	if (queued > kVegasBeta * fMaxSegmentSize) {
+		if (fWindow > 2 * fMaxSegmentSize)
+			fWindow -= fMaxSegmentSize;
+	} else if (queued < kVegasAlpha * fMaxSegmentSize)
+		fWindow += fMaxSegmentSize;
+}
+
+
+void
+VegasCongestionControl::_Reset()
+{
+	fBaseRoundTripTime = -1;
+	fRoundMinRoundTripTime = -1;
+	fRoundStart = 0;
+}
+
+
+//	#pragma mark -
+
+
+/*!	Creates the congestion control algorithm \a name, or the system default
+	if \a name is \c NULL.
+*/
+status_t
+create_congestion_control(const char* name, CongestionControl** _control)
+{
+	const congestion_control_algorithm* algorithm = sDefaultAlgorithm;
+	if (name != NULL) {
+		algorithm = find_algorithm(name);
+		if (algorithm == NULL)
+			return B_NAME_NOT_FOUND;
+	}
+
+	CongestionControl* control = algorithm->create();
+	if (control == NULL)
+		return B_NO_MEMORY;
+
+	*_control = control;
+	return B_OK;
+}
+
+
+status_t
+set_default_congestion_control(const char* name)
+{
+	const congestion_control_algorithm* algorithm = find_algorithm(name);
+	if (algorithm == NULL)
+		return B_NAME_NOT_FOUND;
+
+	sDefaultAlgorithm = algorithm;
+	return B_OK;
+}
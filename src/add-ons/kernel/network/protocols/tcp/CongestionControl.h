@@ -0,0 +1,53 @@
+/*
+ * Copyright 2016, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef CONGESTION_CONTROL_H
+#define CONGESTION_CONTROL_H
+
+
+#include <SupportDefs.h>
+
+
+class CongestionControl {
+public:
+								CongestionControl();
+	virtual						~CongestionControl();
+
+	virtual	const char*			Name() const = 0;
+
+			uint32				Window() const { return fWindow; }
+			uint32				SlowStartThreshold() const
+									{ return fSlowStartThreshold; }
+
+			void				TakeOver(const CongestionControl& other);
+
+	virtual	void				Init(uint32 maxSegmentSize,
+									uint32 slowStartThreshold);
+	virtual	void				Acknowledged(uint32 bytes);
+	virtual	void				RoundTripTimeMeasured(int32 roundTripTime);
+
+			void				EnterRecovery(uint32 flightSize);
+			void				DuplicateAcknowledge();
+			void				ExitRecovery();
+			void				RetransmitTimeout(uint32 flightSize);
+
+protected:
+	virtual	uint32				_ReducedThreshold(uint32 flightSize);
+			void				_SlowStart(uint32 bytes);
+			void				_IncreaseWindow(uint32 bytes, uint32 target);
+
+protected:
+			uint32				fWindow;
+			uint32				fSlowStartThreshold;
+			uint32				fMaxSegmentSize;
+			uint64				fIncrement;
+};
+
+
+status_t create_congestion_control(const char* name,
+	CongestionControl** _control);
+status_t set_default_congestion_control(const char* name);
+
+
+#endif	// CONGESTION_CONTROL_H
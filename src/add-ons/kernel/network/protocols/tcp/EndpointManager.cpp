@@ -134,6 +134,41 @@ static const uint16 kLastReservedPort = 1023;
 static const uint16 kFirstEphemeralPort = 40000;
 
 
+struct EndpointManager::ConnectionBucket {
+	ConnectionBucket(EndpointManager* manager)
+		:
+		table(manager)
+	{
+		rw_lock_init(&lock, "TCP connection bucket");
+	}
+
+	~ConnectionBucket()
+	{
+		rw_lock_destroy(&lock);
+	}
+
+	rw_lock			lock;
+	ConnectionTable	table;
+};
+
+
+struct EndpointManager::PortBucket {
+	PortBucket()
+	{
+		rw_lock_init(&lock, "TCP port bucket");
+	}
+
+	~PortBucket()
+	{
+		rw_lock_destroy(&lock);
+	}
+
+	rw_lock			lock;
+		// protects the table, and the local addresses of the endpoints in it
+	EndpointTable	table;
+};
+
+
 ConnectionHashDefinition::ConnectionHashDefinition(EndpointManager* manager)
 	:
 	fManager(manager)
@@ -217,41 +252,86 @@ EndpointHashDefinition::GetLink(TCPEndpoint* endpoint) const
 EndpointManager::EndpointManager(net_domain* domain)
 	:
 	fDomain(domain),
-	fConnectionHash(this),
 	fLastPort(kFirstEphemeralPort)
 {
-	rw_lock_init(&fLock, "TCP endpoint manager");
+	for (int32 i = 0; i < CONNECTION_BUCKET_COUNT; i++)
+		fConnectionBuckets[i] = NULL;
+	for (int32 i = 0; i < PORT_BUCKET_COUNT; i++)
+		fPortBuckets[i] = NULL;
 }
 
 
 EndpointManager::~EndpointManager()
 {
-	rw_lock_destroy(&fLock);
+	for (int32 i = 0; i < CONNECTION_BUCKET_COUNT; i++)
+		delete fConnectionBuckets[i];
+	for (int32 i = 0; i < PORT_BUCKET_COUNT; i++)
+		delete fPortBuckets[i];
 }
 
 
 status_t
 EndpointManager::Init()
 {
-	status_t status = fConnectionHash.Init();
-	if (status == B_OK)
-		status = fEndpointHash.Init();
+	for (int32 i = 0; i < CONNECTION_BUCKET_COUNT; i++) {
+		fConnectionBuckets[i] = new(std::nothrow) ConnectionBucket(this);
+		if (fConnectionBuckets[i] == NULL)
+			return B_NO_MEMORY;
 
-	return status;
+		status_t status = fConnectionBuckets[i]->table.Init();
+		if (status != B_OK)
+			return status;
+	}
+
+	for (int32 i = 0; i < PORT_BUCKET_COUNT; i++) {
+		fPortBuckets[i] = new(std::nothrow) PortBucket;
+		if (fPortBuckets[i] == NULL)
+			return B_NO_MEMORY;
+
+		status_t status = fPortBuckets[i]->table.Init();
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
 }
 
 
 //	#pragma mark - connections
 
 
+/*!	Returns the bucket of the connection hash the connection belongs to.
+	The tables in the buckets use the lower bits of the hash, so the bucket
+	is chosen by the upper bits of a multiplicative hash of it.
+*/
+EndpointManager::ConnectionBucket&
+EndpointManager::_BucketFor(const sockaddr* local, const sockaddr* peer) const
+{
+	uint32 hash = ConstSocketAddress(AddressModule(), local).HashPair(peer);
+	return *fConnectionBuckets[(uint32)(hash * 2654435761U)
+		>> (32 - CONNECTION_BUCKET_SHIFT)];
+}
+
+
+/*!	Returns the bucket of the port hash the endpoints using \a port (in
+	network byte order) belong to.
+*/
+EndpointManager::PortBucket&
+EndpointManager::_PortBucketFor(uint16 port) const
+{
+	return *fPortBuckets[(uint32)(port * 2654435761U)
+		>> (32 - PORT_BUCKET_SHIFT)];
+}
+
+
 /*!	Returns the endpoint matching the connection.
-	You must hold the manager's lock when calling this method (either read or
-	write).
+	You must hold the lock of the connection's bucket when calling this method
+	(either read or write).
 */
 TCPEndpoint*
 EndpointManager::_LookupConnection(const sockaddr* local, const sockaddr* peer)
 {
-	return fConnectionHash.Lookup(std::make_pair(local, peer));
+	return _BucketFor(local, peer).table.Lookup(std::make_pair(local, peer));
 }
 
 
@@ -261,8 +341,6 @@ EndpointManager::SetConnection(TCPEndpoint* endpoint, const sockaddr* _local,
 {
 	TRACE(("EndpointManager::SetConnection(%p)\n", endpoint));
 
-	WriteLocker _(fLock);
-
 	SocketAddressStorage local(AddressModule());
 	local.SetTo(_local);
 
@@ -272,14 +350,22 @@ EndpointManager::SetConnection(TCPEndpoint* endpoint, const sockaddr* _local,
 		local.SetPort(port);
 	}
 
+	ConnectionBucket& bucket = _BucketFor(*local, peer);
+	WriteLocker bucketLocker(bucket.lock);
+
 	if (_LookupConnection(*local, peer) != NULL)
 		return EADDRINUSE;
 
-	endpoint->LocalAddress().SetTo(*local);
+	if (!endpoint->LocalAddress().EqualTo(*local, true)) {
+		// Binding looks at the local addresses of all endpoints that use the
+		// same port, so they may only be changed with its bucket locked
+		WriteLocker _(_PortBucketFor(endpoint->LocalAddress().Port()).lock);
+		endpoint->LocalAddress().SetTo(*local);
+	}
 	endpoint->PeerAddress().SetTo(peer);
 	T(Connect(endpoint));
 
-	fConnectionHash.Insert(endpoint);
+	bucket.table.Insert(endpoint);
 	return B_OK;
 }
 
@@ -287,8 +373,6 @@ EndpointManager::SetConnection(TCPEndpoint* endpoint, const sockaddr* _local,
 status_t
 EndpointManager::SetPassive(TCPEndpoint* endpoint)
 {
-	WriteLocker _(fLock);
-
 	if (!endpoint->IsBound()) {
 		// if the socket is unbound first bind it to ephemeral
 		SocketAddressStorage local(AddressModule());
@@ -302,26 +386,43 @@ EndpointManager::SetPassive(TCPEndpoint* endpoint)
 	SocketAddressStorage passive(AddressModule());
 	passive.SetToEmpty();
 
+	ConnectionBucket& bucket = _BucketFor(*endpoint->LocalAddress(), *passive);
+	WriteLocker _(bucket.lock);
+
 	if (_LookupConnection(*endpoint->LocalAddress(), *passive))
 		return EADDRINUSE;
 
 	endpoint->PeerAddress().SetTo(*passive);
-	fConnectionHash.Insert(endpoint);
+	bucket.table.Insert(endpoint);
 	return B_OK;
 }
 
 
+/*!	Looks up the connection, and returns it with a reference to its socket
+	acquired. Only the lock of the connection's bucket is held during the
+	lookup, as that is enough to keep the endpoint from being removed.
+*/
 TCPEndpoint*
-EndpointManager::FindConnection(sockaddr* local, sockaddr* peer)
+EndpointManager::_FindConnection(const sockaddr* local, const sockaddr* peer)
 {
-	ReadLocker _(fLock);
+	ReadLocker _(_BucketFor(local, peer).lock);
+
+	TCPEndpoint* endpoint = _LookupConnection(local, peer);
+	if (endpoint != NULL && gSocketModule->acquire_socket(endpoint->socket))
+		return endpoint;
+
+	return NULL;
+}
+
 
-	TCPEndpoint *endpoint = _LookupConnection(local, peer);
+TCPEndpoint*
+EndpointManager::FindConnection(sockaddr* local, sockaddr* peer)
+{
+	TCPEndpoint *endpoint = _FindConnection(local, peer);
 	if (endpoint != NULL) {
 		TRACE(("TCP: Received packet corresponds to explicit endpoint %p\n",
 			endpoint));
-		if (gSocketModule->acquire_socket(endpoint->socket))
-			return endpoint;
+		return endpoint;
 	}
 
 	// no explicit endpoint exists, check for wildcard endpoints
@@ -329,24 +430,22 @@ EndpointManager::FindConnection(sockaddr* local, sockaddr* peer)
 	SocketAddressStorage wildcard(AddressModule());
 	wildcard.SetToEmpty();
 
-	endpoint = _LookupConnection(local, *wildcard);
+	endpoint = _FindConnection(local, *wildcard);
 	if (endpoint != NULL) {
 		TRACE(("TCP: Received packet corresponds to wildcard endpoint %p\n",
 			endpoint));
-		if (gSocketModule->acquire_socket(endpoint->socket))
-			return endpoint;
+		return endpoint;
 	}
 
 	SocketAddressStorage localWildcard(AddressModule());
 	localWildcard.SetToEmpty();
 	localWildcard.SetPort(AddressModule()->get_port(local));
 
-	endpoint = _LookupConnection(*localWildcard, *wildcard);
+	endpoint = _FindConnection(*localWildcard, *wildcard);
 	if (endpoint != NULL) {
 		TRACE(("TCP: Received packet corresponds to local wildcard endpoint "
 			"%p\n", endpoint));
-		if (gSocketModule->acquire_socket(endpoint->socket))
-			return endpoint;
+		return endpoint;
 	}
 
 	// no matching endpoint exists
@@ -366,27 +465,35 @@ EndpointManager::Bind(TCPEndpoint* endpoint, const sockaddr* address)
 	if (!AddressModule()->is_same_family(address))
 		return EAFNOSUPPORT;
 
-	WriteLocker locker(fLock);
-
-	if (AddressModule()->get_port(address) == 0)
+	uint16 port = AddressModule()->get_port(address);
+	if (port == 0)
 		return _BindToEphemeral(endpoint, address);
 
-	return _BindToAddress(locker, endpoint, address);
+	PortBucket& bucket = _PortBucketFor(port);
+	WriteLocker locker(bucket.lock);
+	return _BindToAddress(locker, bucket, endpoint, address);
 }
 
 
+/*!	Binds the child of a listening endpoint to the port of its parent. This
+	only locks the bucket of that port, so that accepting connections doesn't
+	contend with binding and unbinding endpoints of other ports.
+*/
 status_t
 EndpointManager::BindChild(TCPEndpoint* endpoint)
 {
-	WriteLocker _(fLock);
-	return _Bind(endpoint, *endpoint->LocalAddress());
+	PortBucket& bucket = _PortBucketFor(endpoint->LocalAddress().Port());
+	WriteLocker _(bucket.lock);
+	return _Bind(bucket, endpoint, *endpoint->LocalAddress());
 }
 
 
-/*! You must have fLock write locked when calling this method. */
+/*! You must have the lock of the \a bucket of the port write locked when
+	calling this method.
+*/
 status_t
-EndpointManager::_BindToAddress(WriteLocker& locker, TCPEndpoint* endpoint,
-	const sockaddr* _address)
+EndpointManager::_BindToAddress(WriteLocker& locker, PortBucket& bucket,
+	TCPEndpoint* endpoint, const sockaddr* _address)
 {
 	ConstSocketAddress address(AddressModule(), _address);
 	uint16 port = address.Port();
@@ -402,7 +509,7 @@ EndpointManager::_BindToAddress(WriteLocker& locker, TCPEndpoint* endpoint,
 	bool retrying = false;
 	int32 retry = 0;
 	do {
-		EndpointTable::ValueIterator portUsers = fEndpointHash.Lookup(port);
+		EndpointTable::ValueIterator portUsers = bucket.table.Lookup(port);
 		retry = false;
 
 		while (portUsers.HasNext()) {
@@ -440,33 +547,43 @@ EndpointManager::_BindToAddress(WriteLocker& locker, TCPEndpoint* endpoint,
 		}
 	} while (retry-- > 0);
 
-	return _Bind(endpoint, *address);
+	return _Bind(bucket, endpoint, *address);
 }
 
 
-/*! You must have fLock write locked when calling this method. */
+/*!	The ports are probed with only the read lock of their bucket held, so
+	that other binds and unbinds are not blocked while we're looking for a
+	free port. Every candidate port is taken from fLastPort atomically, so
+	that concurrent callers won't try the same ports.
+	You must not hold any port bucket lock when calling this method.
+*/
 status_t
 EndpointManager::_BindToEphemeral(TCPEndpoint* endpoint,
 	const sockaddr* address)
 {
 	TRACE(("EndpointManager::BindToEphemeral(%p)\n", endpoint));
 
-	uint32 max = fLastPort + 65536;
-
 	for (int32 i = 1; i < 5; i++) {
 		// try to retrieve a more or less random port
-		uint32 step = i == 4 ? 1 : (system_time() & 0x1f) + 1;
-		uint32 counter = fLastPort + step;
+		int32 step = i == 4 ? 1 : (system_time() & 0x1f) + 1;
 
-		while (counter < max) {
-			uint16 port = counter & 0xffff;
+		for (int32 count = 65536 / step; count > 0; count--) {
+			uint16 port = (atomic_add(&fLastPort, step) + step) & 0xffff;
 			if (port <= kLastReservedPort)
 				port += kLastReservedPort;
 
-			fLastPort = port;
 			port = htons(port);
 
-			if (!fEndpointHash.Lookup(port).HasNext()) {
+			PortBucket& bucket = _PortBucketFor(port);
+			ReadLocker readLocker(bucket.lock);
+			if (bucket.table.Lookup(port).HasNext())
+				continue;
+
+			// the port looks free, take it unless someone else was faster
+			readLocker.Unlock();
+			WriteLocker writeLocker(bucket.lock);
+
+			if (!bucket.table.Lookup(port).HasNext()) {
 				// found a port
 				SocketAddressStorage newAddress(AddressModule());
 				newAddress.SetTo(address);
@@ -477,10 +594,8 @@ EndpointManager::_BindToEphemeral(TCPEndpoint* endpoint,
 					true).Data()));
 				T(Bind(endpoint, newAddress, true));
 
-				return _Bind(endpoint, *newAddress);
+				return _Bind(bucket, endpoint, *newAddress);
 			}
-
-			counter += step;
 		}
 	}
 
@@ -489,8 +604,12 @@ EndpointManager::_BindToEphemeral(TCPEndpoint* endpoint,
 }
 
 
+/*!	You must have the lock of the \a bucket of the port write locked when
+	calling this method.
+*/
 status_t
-EndpointManager::_Bind(TCPEndpoint* endpoint, const sockaddr* address)
+EndpointManager::_Bind(PortBucket& bucket, TCPEndpoint* endpoint,
+	const sockaddr* address)
 {
 	// Thus far we have checked if the Bind() is allowed
 
@@ -498,7 +617,7 @@ EndpointManager::_Bind(TCPEndpoint* endpoint, const sockaddr* address)
 	if (status < B_OK)
 		return status;
 
-	fEndpointHash.Insert(endpoint);
+	bucket.table.Insert(endpoint);
 
 	return B_OK;
 }
@@ -515,12 +634,19 @@ EndpointManager::Unbind(TCPEndpoint* endpoint)
 		return B_BAD_VALUE;
 	}
 
-	WriteLocker _(fLock);
+	PortBucket& portBucket = _PortBucketFor(endpoint->LocalAddress().Port());
+	WriteLocker locker(portBucket.lock);
 
-	if (!fEndpointHash.Remove(endpoint))
+	if (!portBucket.table.Remove(endpoint))
 		panic("bound endpoint %p not in hash!", endpoint);
 
-	fConnectionHash.Remove(endpoint);
+	locker.Unlock();
+
+	ConnectionBucket& bucket = _BucketFor(*endpoint->LocalAddress(),
+		*endpoint->PeerAddress());
+	WriteLocker bucketLocker(bucket.lock);
+
+	bucket.table.Remove(endpoint);
 
 	(*endpoint->LocalAddress())->sa_len = 0;
 
@@ -573,18 +699,24 @@ EndpointManager::Dump() const
 	kprintf("%10s %21s %21s %8s %8s %12s\n", "address", "local", "peer",
 		"recv-q", "send-q", "state");
 
-	ConnectionTable::Iterator iterator = fConnectionHash.GetIterator();
+	for (int32 i = 0; i < CONNECTION_BUCKET_COUNT; i++) {
+		if (fConnectionBuckets[i] == NULL)
+			continue;
 
-	while (iterator.HasNext()) {
-		TCPEndpoint *endpoint = iterator.Next();
+		ConnectionTable::Iterator iterator
+			= fConnectionBuckets[i]->table.GetIterator();
 
-		char localBuf[64], peerBuf[64];
-		endpoint->LocalAddress().AsString(localBuf, sizeof(localBuf), true);
-		endpoint->PeerAddress().AsString(peerBuf, sizeof(peerBuf), true);
+		while (iterator.HasNext()) {
+			TCPEndpoint *endpoint = iterator.Next();
 
-		kprintf("%p %21s %21s %8lu %8lu %12s\n", endpoint, localBuf, peerBuf,
-			endpoint->fReceiveQueue.Available(), endpoint->fSendQueue.Used(),
-			name_for_state(endpoint->State()));
+			char localBuf[64], peerBuf[64];
+			endpoint->LocalAddress().AsString(localBuf, sizeof(localBuf), true);
+			endpoint->PeerAddress().AsString(peerBuf, sizeof(peerBuf), true);
+
+			kprintf("%p %21s %21s %8lu %8lu %12s\n", endpoint, localBuf,
+				peerBuf, endpoint->fReceiveQueue.Available(),
+				endpoint->fSendQueue.Used(), name_for_state(endpoint->State()));
+		}
 	}
 }
 
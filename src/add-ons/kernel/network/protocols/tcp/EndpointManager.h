@@ -29,6 +29,19 @@ class EndpointManager;
 class TCPEndpoint;
 
 
+// The connection hash is split into several buckets that each have their own
+// lock, so that looking up connections on the receive path does not contend
+// on a single lock, and connections can be added and removed concurrently.
+#define CONNECTION_BUCKET_SHIFT		5
+#define CONNECTION_BUCKET_COUNT		(1 << CONNECTION_BUCKET_SHIFT)
+
+// The same goes for the port hash, so that binding, and unbinding endpoints
+// that use different ports, like the children of different listening
+// sockets, doesn't serialize on a single lock either.
+#define PORT_BUCKET_SHIFT			5
+#define PORT_BUCKET_COUNT			(1 << PORT_BUCKET_SHIFT)
+
+
 struct ConnectionHashDefinition {
 public:
 	typedef std::pair<const sockaddr*, const sockaddr*> KeyType;
@@ -95,23 +108,31 @@ public:
 			void			Dump() const;
 
 private:
+			struct ConnectionBucket;
+			struct PortBucket;
+
+			ConnectionBucket& _BucketFor(const sockaddr* local,
+								const sockaddr* peer) const;
+			PortBucket&		_PortBucketFor(uint16 port) const;
 			TCPEndpoint*	_LookupConnection(const sockaddr* local,
 								const sockaddr* peer);
-			status_t		_Bind(TCPEndpoint* endpoint,
+			TCPEndpoint*	_FindConnection(const sockaddr* local,
+								const sockaddr* peer);
+			status_t		_Bind(PortBucket& bucket, TCPEndpoint* endpoint,
 								const sockaddr* address);
 			status_t		_BindToAddress(WriteLocker& locker,
-								TCPEndpoint* endpoint, const sockaddr* address);
+								PortBucket& bucket, TCPEndpoint* endpoint,
+								const sockaddr* address);
 			status_t		_BindToEphemeral(TCPEndpoint* endpoint,
 								const sockaddr* address);
 
 	typedef BOpenHashTable<ConnectionHashDefinition> ConnectionTable;
 	typedef MultiHashTable<EndpointHashDefinition> EndpointTable;
 
-	rw_lock					fLock;
 	net_domain*				fDomain;
-	ConnectionTable			fConnectionHash;
-	EndpointTable			fEndpointHash;
-	uint16					fLastPort;
+	ConnectionBucket*		fConnectionBuckets[CONNECTION_BUCKET_COUNT];
+	PortBucket*				fPortBuckets[PORT_BUCKET_COUNT];
+	int32					fLastPort;
 };
 
 #endif	// ENDPOINT_MANAGER_H
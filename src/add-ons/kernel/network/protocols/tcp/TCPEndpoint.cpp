@@ -77,8 +77,9 @@
 		B_PRIuSIZE " sqused %" B_PRIuSIZE " rto %" B_PRIdBIGTIME "\n", \
 		system_time(), PrintAddress(buffer->source), \
 		PrintAddress(buffer->destination), buffer->size, fSendNext.Number(), \
-		fSendUnacknowledged.Number(), fCongestionWindow, fSlowStartThreshold, \
-		window, fSendWindow, (fSendMax - fSendUnacknowledged).Number(), \
+		fSendUnacknowledged.Number(), fCongestionControl->Window(), \
+		fCongestionControl->SlowStartThreshold(), window, fSendWindow, \
+		(fSendMax - fSendUnacknowledged).Number(), \
 		fSendQueue.Available(fSendNext), fSendQueue.Used(), fRetransmitTimeout)
 #else
 #	define PROBE(buffer, window)	do { } while (0)
@@ -440,8 +441,7 @@ TCPEndpoint::TCPEndpoint(net_socket* socket)
 	fRoundTripDeviation(TCP_INITIAL_RTT / kTimestampFactor),
 	fRetransmitTimeout(TCP_INITIAL_RTT),
 	fReceivedTimestamp(0),
-	fCongestionWindow(0),
-	fSlowStartThreshold(0),
+	fCongestionControl(NULL),
 	fState(CLOSED),
 	fFlags(FLAG_OPTION_WINDOW_SCALE | FLAG_OPTION_TIMESTAMP)
 {
@@ -459,6 +459,8 @@ TCPEndpoint::TCPEndpoint(net_socket* socket)
 	gStackModule->init_timer(&fTimeWaitTimer, TCPEndpoint::_TimeWaitTimer,
 		this);
 
+	create_congestion_control(NULL, &fCongestionControl);
+
 	T(APICall(this, "constructor"));
 }
 
@@ -487,12 +489,17 @@ TCPEndpoint::~TCPEndpoint()
 	gStackModule->wait_for_timer(&fTimeWaitTimer);
 
 	gDatalinkModule->put_route(Domain(), fRoute);
+
+	delete fCongestionControl;
 }
 
 
 status_t
 TCPEndpoint::InitCheck() const
 {
+	if (fCongestionControl == NULL)
+		return B_NO_MEMORY;
+
 	return B_OK;
 }
 
@@ -909,6 +916,12 @@ TCPEndpoint::FillStat(net_stat *stat)
 	stat->receive_queue_size = fReceiveQueue.Available();
 	stat->send_queue_size = fSendQueue.Used();
 
+	strlcpy(stat->congestion_control, fCongestionControl->Name(),
+		sizeof(stat->congestion_control));
+	stat->congestion_window = fCongestionControl->Window();
+	stat->slow_start_threshold = fCongestionControl->SlowStartThreshold();
+	stat->round_trip_time = fRoundTripTime / 8 * kTimestampFactor;
+
 	return B_OK;
 }
 
@@ -1043,6 +1056,17 @@ TCPEndpoint::SetReceiveBufferSize(size_t length)
 status_t
 TCPEndpoint::GetOption(int option, void* _value, int* _length)
 {
+	if (option == TCP_CONGESTION) {
+		if (*_length <= 0)
+			return B_BAD_VALUE;
+
+		MutexLocker _(fLock);
+		const char* name = fCongestionControl->Name();
+		strlcpy((char*)_value, name, *_length);
+		*_length = min_c((int)strlen(name) + 1, *_length);
+		return B_OK;
+	}
+
 	if (*_length != sizeof(int))
 		return B_BAD_VALUE;
 
@@ -1069,6 +1093,29 @@ TCPEndpoint::GetOption(int option, void* _value, int* _length)
 status_t
 TCPEndpoint::SetOption(int option, const void* _value, int length)
 {
+	if (option == TCP_CONGESTION) {
+		if (length <= 0)
+			return B_BAD_VALUE;
+
+		// the name does not need to be null terminated
+		char name[TCP_CA_NAME_MAX];
+		size_t nameLength = strnlen((const char*)_value,
+			min_c((size_t)length, sizeof(name) - 1));
+		memcpy(name, _value, nameLength);
+		name[nameLength] = '\0';
+
+		CongestionControl* congestionControl;
+		status_t status = create_congestion_control(name, &congestionControl);
+		if (status != B_OK)
+			return status;
+
+		MutexLocker _(fLock);
+		congestionControl->TakeOver(*fCongestionControl);
+		delete fCongestionControl;
+		fCongestionControl = congestionControl;
+		return B_OK;
+	}
+
 	if (option != TCP_NODELAY)
 		return B_BAD_VALUE;
 
@@ -1279,11 +1326,11 @@ TCPEndpoint::_DuplicateAcknowledge(tcp_segment_header &segment)
 		return;
 
 	if (fDuplicateAcknowledgeCount == 3) {
-		_ResetSlowStart();
-		fCongestionWindow = fSlowStartThreshold + 3 * fSendMaxSegmentSize;
+		fCongestionControl->EnterRecovery(
+			(fSendMax - fSendUnacknowledged).Number());
 		fSendNext = segment.acknowledge;
 	} else if (fDuplicateAcknowledgeCount > 3)
-		fCongestionWindow += fSendMaxSegmentSize;
+		fCongestionControl->DuplicateAcknowledge();
 
 	_SendQueued();
 }
@@ -1392,8 +1439,8 @@ TCPEndpoint::_PrepareReceivePath(tcp_segment_header& segment)
 			fFlags &= ~FLAG_OPTION_TIMESTAMP;
 	}
 
-	fCongestionWindow = 2 * fSendMaxSegmentSize;
-	fSlowStartThreshold = (uint32)segment.advertised_window << fSendWindowShift;
+	fCongestionControl->Init(fSendMaxSegmentSize,
+		(uint32)segment.advertised_window << fSendWindowShift);
 }
 
 
@@ -1440,6 +1487,15 @@ TCPEndpoint::_Spawn(TCPEndpoint* parent, tcp_segment_header& segment,
 	fOptions = parent->fOptions;
 	fAcceptSemaphore = parent->fAcceptSemaphore;
 
+	// inherit the congestion control algorithm of the listening socket
+	const char* algorithm = parent->fCongestionControl->Name();
+	CongestionControl* congestionControl;
+	if (strcmp(algorithm, fCongestionControl->Name()) != 0
+		&& create_congestion_control(algorithm, &congestionControl) == B_OK) {
+		delete fCongestionControl;
+		fCongestionControl = congestionControl;
+	}
+
 	_PrepareReceivePath(segment);
 
 	// send SYN+ACK
@@ -1688,10 +1744,8 @@ TCPEndpoint::_Receive(tcp_segment_header& segment, net_buffer* buffer)
 		} else {
 			// this segment acknowledges in flight data
 
-			if (fDuplicateAcknowledgeCount >= 3) {
-				// deflate the window.
-				fCongestionWindow = fSlowStartThreshold;
-			}
+			if (fDuplicateAcknowledgeCount >= 3)
+				fCongestionControl->ExitRecovery();
 
 			fDuplicateAcknowledgeCount = 0;
 
@@ -1797,6 +1851,11 @@ TCPEndpoint::_Receive(tcp_segment_header& segment, net_buffer* buffer)
 
 	if (bufferSize > 0 || (segment.flags & TCP_FLAG_SYNCHRONIZE) != 0)
 		action |= ACKNOWLEDGE;
+	if (bufferSize > fReceiveMaxSegmentSize) {
+		// Segments that were merged on receive are acknowledged right away,
+		// as every other one of the original segments would have been
+		action |= IMMEDIATE_ACKNOWLEDGE;
+	}
 
 	_UpdateTimestamps(segment, segmentLength);
 
@@ -1996,8 +2055,9 @@ TCPEndpoint::_SendQueued(bool force, uint32 sendWindow)
 		segment.urgent_offset = 0;
 	}
 
-	if (fCongestionWindow > 0 && fCongestionWindow < sendWindow)
-		sendWindow = fCongestionWindow;
+	uint32 congestionWindow = fCongestionControl->Window();
+	if (congestionWindow > 0 && congestionWindow < sendWindow)
+		sendWindow = congestionWindow;
 
 	// fSendUnacknowledged
 	//  |    fSendNext      fSendMax
@@ -2037,6 +2097,16 @@ TCPEndpoint::_SendQueued(bool force, uint32 sendWindow)
 			- tcp_options_length(segment);
 		uint32 segmentLength = min_c(length, segmentMaxSize);
 
+		if (length >= 2 * segmentMaxSize && !retransmit && !IsLocal()
+			&& Domain()->family == AF_INET
+			&& (segment.flags
+				& (TCP_FLAG_SYNCHRONIZE | TCP_FLAG_URGENT)) == 0) {
+			// Send as many full segments as possible at once, they will be
+			// split by the datalink layer, or the device
+			segmentLength = min_c(length, TCP_MAX_SEGMENT_OFFLOAD_SIZE)
+				/ segmentMaxSize * segmentMaxSize;
+		}
+
 		if (fSendNext + segmentLength == fSendQueue.LastSequence()) {
 			if (state_needs_finish(fState))
 				segment.flags |= TCP_FLAG_FINISH;
@@ -2069,6 +2139,9 @@ TCPEndpoint::_SendQueued(bool force, uint32 sendWindow)
 		LocalAddress().CopyTo(buffer->source);
 		PeerAddress().CopyTo(buffer->destination);
 
+		if (segmentLength > segmentMaxSize)
+			buffer->segment_size = segmentMaxSize;
+
 		uint32 size = buffer->size;
 		segment.sequence = fSendNext.Number();
 
@@ -2079,7 +2152,8 @@ TCPEndpoint::_SendQueued(bool force, uint32 sendWindow)
 			buffer, buffer->size, PrintAddress(buffer->source),
 			PrintAddress(buffer->destination), segment.flags, segment.sequence,
 			segment.acknowledge, segment.advertised_window,
-			fCongestionWindow, fSlowStartThreshold, segmentLength,
+			fCongestionControl->Window(),
+			fCongestionControl->SlowStartThreshold(), segmentLength,
 			fSendQueue.FirstSequence().Number(),
 			fSendQueue.LastSequence().Number());
 		T(Send(this, segment, buffer, fSendQueue.FirstSequence(),
@@ -2206,6 +2280,9 @@ TCPEndpoint::_Acknowledged(tcp_segment_header& segment)
 	ASSERT(fSendUnacknowledged <= segment.acknowledge);
 
 	if (fSendUnacknowledged < segment.acknowledge) {
+		uint32 bytesAcknowledged
+			= (segment.acknowledge - fSendUnacknowledged).Number();
+
 		fSendQueue.RemoveUntil(segment.acknowledge);
 		fSendUnacknowledged = segment.acknowledge;
 		if (fSendNext < fSendUnacknowledged)
@@ -2237,19 +2314,7 @@ TCPEndpoint::_Acknowledged(tcp_segment_header& segment)
 			gSocketModule->notify(socket, B_SELECT_WRITE, fSendQueue.Free());
 		}
 
-		if (fCongestionWindow < fSlowStartThreshold)
-			fCongestionWindow += fSendMaxSegmentSize;
-	}
-
-	if (fCongestionWindow >= fSlowStartThreshold) {
-		uint32 increment = fSendMaxSegmentSize * fSendMaxSegmentSize;
-
-		if (increment < fCongestionWindow)
-			increment = 1;
-		else
-			increment /= fCongestionWindow;
-
-		fCongestionWindow += increment;
+		fCongestionControl->Acknowledged(bytesAcknowledged);
 	}
 
 	// if there is data left to be sent, send it now
@@ -2263,7 +2328,8 @@ TCPEndpoint::_Retransmit()
 {
 	TRACE("Retransmit()");
 
-	_ResetSlowStart();
+	fCongestionControl->RetransmitTimeout(
+		(fSendMax - fSendUnacknowledged).Number());
 	fSendNext = fSendUnacknowledged;
 
 	// Do exponential back off of the retransmit timeout
@@ -2295,15 +2361,8 @@ TCPEndpoint::_UpdateRoundTripTime(int32 roundTripTime)
 
 	TRACE("  RTO is now %" B_PRIdBIGTIME " (after rtt %" B_PRId32 "ms)",
 		fRetransmitTimeout, roundTripTime);
-}
-
 
-void
-TCPEndpoint::_ResetSlowStart()
-{
-	fSlowStartThreshold = max_c((fSendMax - fSendUnacknowledged).Number() / 2,
-		2 * fSendMaxSegmentSize);
-	fCongestionWindow = fSendMaxSegmentSize;
+	fCongestionControl->RoundTripTimeMeasured(roundTripTime);
 }
 
 
@@ -2448,7 +2507,10 @@ TCPEndpoint::Dump() const
 	kprintf("  round trip time: %" B_PRId32 " (deviation %" B_PRId32 ")\n",
 		fRoundTripTime, fRoundTripDeviation);
 	kprintf("  retransmit timeout: %" B_PRId64 "\n", fRetransmitTimeout);
-	kprintf("  congestion window: %" B_PRIu32 "\n", fCongestionWindow);
-	kprintf("  slow start threshold: %" B_PRIu32 "\n", fSlowStartThreshold);
+	kprintf("  congestion control: %s\n", fCongestionControl->Name());
+	kprintf("  congestion window: %" B_PRIu32 "\n",
+		fCongestionControl->Window());
+	kprintf("  slow start threshold: %" B_PRIu32 "\n",
+		fCongestionControl->SlowStartThreshold());
 }
 
@@ -12,6 +12,7 @@
 
 
 #include "BufferQueue.h"
+#include "CongestionControl.h"
 #include "EndpointManager.h"
 #include "tcp.h"
 
@@ -107,7 +108,6 @@ private:
 			void		_Acknowledged(tcp_segment_header& segment);
 			void		_Retransmit();
 			void		_UpdateRoundTripTime(int32 roundTripTime);
-			void		_ResetSlowStart();
 			void		_DuplicateAcknowledge(tcp_segment_header& segment);
 
 	static	void		_TimeWaitTimer(net_timer* timer, void* _endpoint);
@@ -170,8 +170,7 @@ private:
 
 	uint32			fReceivedTimestamp;
 
-	uint32			fCongestionWindow;
-	uint32			fSlowStartThreshold;
+	CongestionControl* fCongestionControl;
 
 	tcp_state		fState;
 	uint32			fFlags;
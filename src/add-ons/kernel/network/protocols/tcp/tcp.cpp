@@ -9,6 +9,7 @@
  */
 
 
+#include "CongestionControl.h"
 #include "EndpointManager.h"
 #include "TCPEndpoint.h"
 
@@ -16,6 +17,7 @@
 #include <net_stat.h>
 
 #include <KernelExport.h>
+#include <driver_settings.h>
 #include <util/list.h>
 
 #include <netinet/in.h>
@@ -409,8 +411,12 @@ add_tcp_header(net_address_module_info* addressModule,
 		"win %u\n", buffer, segment.flags, segment.sequence,
 		segment.acknowledge, segment.urgent_offset, segment.advertised_window));
 
-	*TCPChecksumField(buffer) = Checksum::PseudoHeader(addressModule,
-		gBufferModule, buffer, IPPROTO_TCP);
+	// If the buffer is going to be split into several segments, the checksums
+	// are computed for each of them then
+	if (buffer->segment_size == 0) {
+		*TCPChecksumField(buffer) = Checksum::PseudoHeader(addressModule,
+			gBufferModule, buffer, IPPROTO_TCP);
+	}
 
 	return B_OK;
 }
@@ -790,6 +796,20 @@ tcp_init()
 	if (status < B_OK)
 		return status;
 
+	// the system wide default congestion control algorithm can be set in
+	// the "tcp" driver settings file
+	void* settings = load_driver_settings("tcp");
+	if (settings != NULL) {
+		const char* algorithm = get_driver_parameter(settings,
+			"congestion_control", NULL, NULL);
+		if (algorithm != NULL
+			&& set_default_congestion_control(algorithm) != B_OK) {
+			dprintf("tcp: unknown congestion control algorithm \"%s\"\n",
+				algorithm);
+		}
+		unload_driver_settings(settings);
+	}
+
 	add_debugger_command("tcp_endpoints", dump_endpoints,
 		"lists all open TCP endpoints");
 	add_debugger_command("tcp_endpoint", dump_endpoint,
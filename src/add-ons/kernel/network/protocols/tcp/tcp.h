@@ -184,6 +184,8 @@ operator==(tcp_sequence a, tcp_sequence b)
 #define TCP_DELAYED_ACKNOWLEDGE_TIMEOUT	100000		// 100 msecs
 #define TCP_DEFAULT_MAX_SEGMENT_SIZE	536
 #define TCP_MAX_WINDOW					65535
+#define TCP_MAX_SEGMENT_OFFLOAD_SIZE	(65535 - 20 - 60)
+	// the maximum IP packet size minus the IPv4, and TCP header
 #define TCP_MAX_SEGMENT_LIFETIME		60000000	// 60 secs
 #define TCP_PERSIST_TIMEOUT				1000000		// 1 sec
 
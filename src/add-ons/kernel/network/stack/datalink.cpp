@@ -27,6 +27,7 @@
 #include "device_interfaces.h"
 #include "domains.h"
 #include "interfaces.h"
+#include "offload.h"
 #include "routes.h"
 #include "stack_private.h"
 #include "utility.h"
@@ -114,6 +115,7 @@ option_to_string(int32 option)
 		CODE(B_SOCKET_SET_ALIAS)		/* set interface alias, ifaliasreq */
 		CODE(B_SOCKET_GET_ALIAS)		/* get interface alias, ifaliasreq */
 		CODE(B_SOCKET_COUNT_ALIASES)	/* count interface aliases */
+		CODE(B_SOCKET_GET_RECEIVE_QUEUES)	/* get receive queue stats */
 
 		default:
 			static char buffer[24];
@@ -345,6 +347,38 @@ datalink_control(net_domain* _domain, int32 option, void* value,
 }
 
 
+/*!	Splits the \a buffer into TCP segments, and sends each of them through
+	the datalink protocols. If this succeeds, the \a buffer is freed.
+*/
+static status_t
+send_segments(domain_datalink* datalink, net_buffer* buffer)
+{
+	struct list segments;
+	list_init(&segments);
+
+	status_t status = split_tcp_segments(buffer, &segments);
+	if (status != B_OK)
+		return status;
+
+	while (net_buffer* segment
+			= (net_buffer*)list_remove_head_item(&segments)) {
+		if (status == B_OK) {
+			status = datalink->first_info->send_data(datalink->first_protocol,
+				segment);
+			if (status == B_OK)
+				continue;
+		}
+
+		gNetBufferModule.free(segment);
+	}
+
+	if (status == B_OK)
+		gNetBufferModule.free(buffer);
+
+	return status;
+}
+
+
 static status_t
 datalink_send_routed_data(struct net_route* route, net_buffer* buffer)
 {
@@ -370,8 +404,8 @@ datalink_send_routed_data(struct net_route* route, net_buffer* buffer)
 		set_interface_address(buffer->interface_address, address);
 
 		// this one goes back to the domain directly
-		return fifo_enqueue_buffer(
-			&interface->DeviceInterface()->receive_queue, buffer);
+		return device_interface_enqueue_buffer(interface->DeviceInterface(),
+			buffer);
 	}
 
 	if ((route->flags & RTF_GATEWAY) != 0) {
@@ -387,6 +421,12 @@ datalink_send_routed_data(struct net_route* route, net_buffer* buffer)
 	// this goes out to the datalink protocols
 	domain_datalink* datalink
 		= interface->DomainDatalink(address->domain->family);
+
+	if (buffer->segment_size != 0) {
+		// no device can split the buffer into segments by itself yet
+		return send_segments(datalink, buffer);
+	}
+
 	return datalink->first_info->send_data(datalink->first_protocol, buffer);
 }
 
@@ -860,6 +900,22 @@ interface_protocol_control(net_datalink_protocol* _protocol, int32 option,
 				sizeof(struct ifreq_stats));
 		}
 
+		case B_SOCKET_GET_RECEIVE_QUEUES:
+		{
+			// get receive queue stats
+			if (length < sizeof(ifreceivequeuereq))
+				return B_BAD_VALUE;
+
+			struct ifreceivequeuereq request;
+			memset(&request, 0, sizeof(request));
+			get_device_interface_receive_queues(interface->DeviceInterface(),
+				request);
+
+			return user_memcpy(&((struct ifreceivequeuereq*)argument)
+					->ifrq_count, &request.ifrq_count,
+				sizeof(request) - offsetof(ifreceivequeuereq, ifrq_count));
+		}
+
 		case SIOCGIFTYPE:
 		{
 			// get type
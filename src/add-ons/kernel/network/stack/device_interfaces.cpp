@@ -10,6 +10,7 @@
 #include "device_interfaces.h"
 #include "domains.h"
 #include "interfaces.h"
+#include "offload.h"
 #include "stack_private.h"
 #include "utility.h"
 
@@ -19,9 +20,12 @@
 #include <util/AutoLock.h>
 
 #include <KernelExport.h>
+#include <smp.h>
 
 #include <net/if_dl.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <new>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,14 +40,107 @@
 #endif
 
 
+struct flow_ports {
+	uint16	source;
+	uint16	destination;
+};
+
+
 static mutex sLock;
 static DeviceInterfaceList sInterfaces;
 static uint32 sDeviceIndex;
 
 
+static inline uint32
+hash_flow_data(uint32 hash, const void* _data, size_t length)
+{
+	const uint8* data = (const uint8*)_data;
+	for (size_t i = 0; i < length; i++)
+		hash = hash * 31 + data[i];
+
+	return hash;
+}
+
+
+/*!	Computes a hash over the addresses and ports of the flow the \a buffer
+	belongs to. Since all packets of a flow end up in the same receive queue,
+	they are still processed in order, while different flows can be processed
+	in parallel.
+	Only TCP uses the ports; UDP datagrams may be fragmented, and fragments
+	don't have them, so UDP is only hashed by addresses and protocol.
+	Anything that isn't IP is always put into the first queue.
+*/
+static uint32
+flow_hash(net_buffer* buffer)
+{
+	int family;
+	if (buffer->interface_address != NULL) {
+		// locally delivered, the buffer starts with the network header
+		family = buffer->interface_address->domain->family;
+	} else if (buffer->type == B_NET_FRAME_TYPE_IPV4)
+		family = AF_INET;
+	else if (buffer->type == B_NET_FRAME_TYPE_IPV6)
+		family = AF_INET6;
+	else
+		return 0;
+
+	uint32 hash = 0;
+	size_t headerLength;
+	uint8 protocol;
+	bool fragment;
+
+	if (family == AF_INET) {
+		ip header;
+		if (gNetBufferModule.read(buffer, 0, &header, sizeof(ip)) != B_OK)
+			return 0;
+
+		hash = hash_flow_data(hash, &header.ip_src, sizeof(in_addr));
+		hash = hash_flow_data(hash, &header.ip_dst, sizeof(in_addr));
+
+		headerLength = header.ip_hl << 2;
+		protocol = header.ip_p;
+		fragment = (ntohs(header.ip_off) & (IP_MF | IP_OFFMASK)) != 0;
+	} else if (family == AF_INET6) {
+		ip6_hdr header;
+		if (gNetBufferModule.read(buffer, 0, &header, sizeof(ip6_hdr))
+				!= B_OK)
+			return 0;
+
+		hash = hash_flow_data(hash, &header.ip6_src, sizeof(in6_addr));
+		hash = hash_flow_data(hash, &header.ip6_dst, sizeof(in6_addr));
+
+		headerLength = sizeof(ip6_hdr);
+		protocol = header.ip6_nxt;
+		fragment = protocol == IPPROTO_FRAGMENT;
+
+		if (fragment) {
+			// the fragment header tells us the actual protocol
+			ip6_frag fragmentHeader;
+			if (gNetBufferModule.read(buffer, headerLength, &fragmentHeader,
+					sizeof(ip6_frag)) == B_OK)
+				protocol = fragmentHeader.ip6f_nxt;
+		}
+	} else
+		return 0;
+
+	hash = hash_flow_data(hash, &protocol, sizeof(protocol));
+
+	// only unfragmented TCP segments are spread by their ports
+	if (protocol != IPPROTO_TCP || fragment)
+		return hash;
+
+	flow_ports ports;
+	if (gNetBufferModule.read(buffer, headerLength, &ports, sizeof(ports))
+			== B_OK)
+		hash = hash_flow_data(hash, &ports, sizeof(ports));
+
+	return hash;
+}
+
+
 /*!	A service thread for each device interface. It just reads as many packets
 	as availabe, deframes them, and puts them into the receive queue of the
-	device interface.
+	device interface their flow belongs to.
 */
 static status_t
 device_reader_thread(void* _interface)
@@ -67,7 +164,8 @@ device_reader_thread(void* _interface)
 				continue;
 			}
 
-			fifo_enqueue_buffer(&interface->receive_queue, buffer);
+			if (device_interface_enqueue_buffer(interface, buffer) != B_OK)
+				gNetBufferModule.free(buffer);
 		} else if (status == B_DEVICE_NOT_FOUND) {
 				device_removed(device);
 		} else {
@@ -82,19 +180,38 @@ device_reader_thread(void* _interface)
 
 
 static status_t
-device_consumer_thread(void* _interface)
+device_consumer_thread(void* _queue)
 {
-	net_device_interface* interface = (net_device_interface*)_interface;
+	net_receive_queue* queue = (net_receive_queue*)_queue;
+	net_device_interface* interface = queue->interface;
 	net_device* device = interface->device;
 	net_buffer* buffer;
+	net_buffer* next = NULL;
 
 	while (true) {
-		ssize_t status = fifo_dequeue_buffer(&interface->receive_queue, 0,
-			B_INFINITE_TIMEOUT, &buffer);
-		if (status != B_OK) {
-			if (status == B_INTERRUPTED)
-				continue;
-			break;
+		if (next != NULL) {
+			buffer = next;
+			next = NULL;
+		} else {
+			ssize_t status = fifo_dequeue_buffer(&queue->fifo, 0,
+				B_INFINITE_TIMEOUT, &buffer);
+			if (status != B_OK) {
+				if (status == B_INTERRUPTED)
+					continue;
+				break;
+			}
+		}
+
+		if (is_mergeable_tcp_segment(buffer)) {
+			// Append the segments of the same connection that directly
+			// follow in the queue, so that the protocols only need to
+			// process them once
+			while (fifo_dequeue_buffer(&queue->fifo, MSG_DONTWAIT, 0, &next)
+					== B_OK) {
+				if (merge_tcp_segment(buffer, next) != B_OK)
+					break;
+				next = NULL;
+			}
 		}
 
 		if (buffer->interface_address != NULL) {
@@ -113,7 +230,7 @@ device_consumer_thread(void* _interface)
 
 			// Find handler for this packet
 
-			RecursiveLocker locker(interface->receive_lock);
+			ReadLocker locker(interface->receive_funcs_lock);
 
 			DeviceHandlerList::Iterator iterator
 				= interface->receive_funcs.GetIterator();
@@ -172,12 +289,8 @@ allocate_device_interface(net_device* device, net_device_module_info* module)
 
 	recursive_lock_init(&interface->receive_lock, "device interface receive");
 	recursive_lock_init(&interface->monitor_lock, "device interface monitors");
-
-	char name[128];
-	snprintf(name, sizeof(name), "%s receive queue", device->name);
-
-	if (init_fifo(&interface->receive_queue, name, 16 * 1024 * 1024) < B_OK)
-		goto error1;
+	rw_lock_init(&interface->receive_funcs_lock,
+		"device interface receive funcs");
 
 	interface->device = device;
 	interface->up_count = 0;
@@ -185,15 +298,52 @@ allocate_device_interface(net_device* device, net_device_module_info* module)
 	interface->monitor_count = 0;
 	interface->deframe_func = NULL;
 	interface->deframe_ref_count = 0;
+	interface->reader_thread = -1;
+	interface->receive_queue_count = 0;
+
+	// Use one receive queue per CPU, so that the flows can be processed
+	// in parallel
+	uint32 queueCount = smp_get_num_cpus();
+	if (queueCount > IF_MAX_RECEIVE_QUEUES)
+		queueCount = IF_MAX_RECEIVE_QUEUES;
+
+	for (uint32 i = 0; i < queueCount; i++) {
+		net_receive_queue& queue = interface->receive_queues[i];
+		queue.interface = interface;
+		queue.packets = 0;
+		queue.bytes = 0;
+		queue.dropped = 0;
+
+		char name[128];
+		snprintf(name, sizeof(name), "%s receive queue %" B_PRIu32,
+			device->name, i);
+
+		if (init_fifo(&queue.fifo, name, 16 * 1024 * 1024) < B_OK)
+			break;
+
+		snprintf(name, sizeof(name), "%s consumer %" B_PRIu32, device->name,
+			i);
+
+		queue.consumer_thread = spawn_kernel_thread(device_consumer_thread,
+			name, B_DISPLAY_PRIORITY, &queue);
+		if (queue.consumer_thread < B_OK) {
+			uninit_fifo(&queue.fifo);
+			break;
+		}
+
+		interface->receive_queue_count = i + 1;
+	}
 
-	snprintf(name, sizeof(name), "%s consumer", device->name);
+	if (interface->receive_queue_count == 0) {
+		recursive_lock_destroy(&interface->receive_lock);
+		recursive_lock_destroy(&interface->monitor_lock);
+		rw_lock_destroy(&interface->receive_funcs_lock);
+		delete interface;
+		return NULL;
+	}
 
-	interface->reader_thread   = -1;
-	interface->consumer_thread = spawn_kernel_thread(device_consumer_thread,
-		name, B_DISPLAY_PRIORITY, interface);
-	if (interface->consumer_thread < B_OK)
-		goto error2;
-	resume_thread(interface->consumer_thread);
+	for (uint32 i = 0; i < interface->receive_queue_count; i++)
+		resume_thread(interface->receive_queues[i].consumer_thread);
 
 	// TODO: proper interface index allocation
 	device->index = ++sDeviceIndex;
@@ -201,15 +351,6 @@ allocate_device_interface(net_device* device, net_device_module_info* module)
 
 	sInterfaces.Add(interface);
 	return interface;
-
-error2:
-	uninit_fifo(&interface->receive_queue);
-error1:
-	recursive_lock_destroy(&interface->receive_lock);
-	recursive_lock_destroy(&interface->monitor_lock);
-	delete interface;
-
-	return NULL;
 }
 
 
@@ -247,7 +388,6 @@ dump_device_interface(int argc, char** argv)
 	kprintf("ref_count:         %" B_PRId32 "\n", interface->ref_count);
 	kprintf("deframe_func:      %p\n", interface->deframe_func);
 	kprintf("deframe_ref_count: %" B_PRId32 "\n", interface->ref_count);
-	kprintf("consumer_thread:   %" B_PRId32 "\n", interface->consumer_thread);
 
 	kprintf("monitor_count:     %" B_PRId32 "\n", interface->monitor_count);
 	kprintf("monitor_lock:      %p\n", &interface->monitor_lock);
@@ -258,7 +398,14 @@ dump_device_interface(int argc, char** argv)
 		kprintf("  %p\n", monitorIterator.Next());
 
 	kprintf("receive_lock:      %p\n", &interface->receive_lock);
-	kprintf("receive_queue:     %p\n", &interface->receive_queue);
+	kprintf("receive_queues:\n");
+	for (uint32 i = 0; i < interface->receive_queue_count; i++) {
+		net_receive_queue& queue = interface->receive_queues[i];
+		kprintf("  %p  consumer %" B_PRId32 ", %" B_PRId64 " packets, %"
+			B_PRId64 " bytes, %" B_PRId32 " dropped\n", &queue.fifo,
+			queue.consumer_thread, queue.packets, queue.bytes, queue.dropped);
+	}
+	kprintf("receive_funcs_lock: %p\n", &interface->receive_funcs_lock);
 	kprintf("receive_funcs:\n");
 	DeviceHandlerList::Iterator handlerIterator
 		= interface->receive_funcs.GetIterator();
@@ -382,9 +529,12 @@ put_device_interface(struct net_device_interface* interface)
 	sInterfaces.Remove(interface);
 	locker.Unlock();
 
-	uninit_fifo(&interface->receive_queue);
-	status_t status;
-	wait_for_thread(interface->consumer_thread, &status);
+	for (uint32 i = 0; i < interface->receive_queue_count; i++)
+		uninit_fifo(&interface->receive_queues[i].fifo);
+	for (uint32 i = 0; i < interface->receive_queue_count; i++) {
+		status_t status;
+		wait_for_thread(interface->receive_queues[i].consumer_thread, &status);
+	}
 
 	net_device* device = interface->device;
 	const char* moduleName = device->module->info.name;
@@ -394,6 +544,7 @@ put_device_interface(struct net_device_interface* interface)
 
 	recursive_lock_destroy(&interface->monitor_lock);
 	recursive_lock_destroy(&interface->receive_lock);
+	rw_lock_destroy(&interface->receive_funcs_lock);
 	delete interface;
 }
 
@@ -489,6 +640,45 @@ device_interface_monitor_receive(net_device_interface* interface,
 }
 
 
+/*!	Puts the \a buffer into the receive queue of the \a interface that is
+	responsible for its flow. If this fails, the buffer is counted as dropped,
+	but the caller retains ownership of it.
+*/
+status_t
+device_interface_enqueue_buffer(net_device_interface* interface,
+	net_buffer* buffer)
+{
+	net_receive_queue& queue = interface->receive_queues[
+		flow_hash(buffer) % interface->receive_queue_count];
+
+	size_t size = buffer->size;
+	status_t status = fifo_enqueue_buffer(&queue.fifo, buffer);
+	if (status != B_OK) {
+		atomic_add(&queue.dropped, 1);
+		return status;
+	}
+
+	atomic_add64(&queue.packets, 1);
+	atomic_add64(&queue.bytes, size);
+	return B_OK;
+}
+
+
+void
+get_device_interface_receive_queues(net_device_interface* interface,
+	ifreceivequeuereq& request)
+{
+	request.ifrq_count = interface->receive_queue_count;
+
+	for (uint32 i = 0; i < interface->receive_queue_count; i++) {
+		net_receive_queue& queue = interface->receive_queues[i];
+		request.ifrq_queues[i].packets = atomic_get64(&queue.packets);
+		request.ifrq_queues[i].bytes = atomic_get64(&queue.bytes);
+		request.ifrq_queues[i].dropped = atomic_get(&queue.dropped);
+	}
+}
+
+
 status_t
 up_device_interface(net_device_interface* interface)
 {
@@ -657,6 +847,8 @@ register_device_handler(struct net_device* device, int32 type,
 	handler->func = receiveFunc;
 	handler->type = type;
 	handler->cookie = cookie;
+
+	WriteLocker funcsLocker(interface->receive_funcs_lock);
 	interface->receive_funcs.Add(handler);
 	return B_OK;
 }
@@ -682,7 +874,10 @@ unregister_device_handler(struct net_device* device, int32 type)
 	while (net_device_handler* handler = iterator.Next()) {
 		if (handler->type == type) {
 			// found it
+			WriteLocker funcsLocker(interface->receive_funcs_lock);
 			iterator.Remove();
+			funcsLocker.Unlock();
+
 			delete handler;
 			return B_OK;
 		}
@@ -796,7 +991,7 @@ device_enqueue_buffer(net_device* device, net_buffer* buffer)
 	if (interface == NULL)
 		return B_DEVICE_NOT_FOUND;
 
-	status_t status = fifo_enqueue_buffer(&interface->receive_queue, buffer);
+	status_t status = device_interface_enqueue_buffer(interface, buffer);
 
 	put_device_interface(interface);
 	return status;
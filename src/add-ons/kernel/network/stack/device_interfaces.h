@@ -12,6 +12,7 @@
 #include <net_datalink.h>
 #include <net_stack.h>
 
+#include <lock.h>
 #include <util/DoublyLinkedList.h>
 
 
@@ -26,6 +27,16 @@ typedef DoublyLinkedList<net_device_handler> DeviceHandlerList;
 typedef DoublyLinkedList<net_device_monitor,
 	DoublyLinkedListCLink<net_device_monitor> > DeviceMonitorList;
 
+struct net_receive_queue {
+	struct net_device_interface* interface;
+	thread_id			consumer_thread;
+	net_fifo			fifo;
+
+	int64				packets;
+	int64				bytes;
+	int32				dropped;
+};
+
 struct net_device_interface : DoublyLinkedListLinkImpl<net_device_interface> {
 	struct net_device*	device;
 	thread_id			reader_thread;
@@ -42,9 +53,11 @@ struct net_device_interface : DoublyLinkedListLinkImpl<net_device_interface> {
 
 	DeviceHandlerList	receive_funcs;
 	recursive_lock		receive_lock;
+	rw_lock				receive_funcs_lock;
+		// protects receive_funcs against the consumer threads
 
-	thread_id			consumer_thread;
-	net_fifo			receive_queue;
+	uint32				receive_queue_count;
+	net_receive_queue	receive_queues[IF_MAX_RECEIVE_QUEUES];
 };
 
 typedef DoublyLinkedList<net_device_interface> DeviceInterfaceList;
@@ -62,6 +75,10 @@ struct net_device_interface* get_device_interface(const char* name,
 	bool create = true);
 void device_interface_monitor_receive(net_device_interface* interface,
 	net_buffer* buffer);
+status_t device_interface_enqueue_buffer(net_device_interface* interface,
+	net_buffer* buffer);
+void get_device_interface_receive_queues(net_device_interface* interface,
+	struct ifreceivequeuereq& request);
 status_t up_device_interface(net_device_interface* interface);
 void down_device_interface(net_device_interface* interface);
 
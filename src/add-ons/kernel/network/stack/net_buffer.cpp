@@ -53,6 +53,8 @@
 #define DATA_NODE_READ_ONLY		0x1
 #define DATA_NODE_STORED_HEADER	0x2
 
+#define DATA_HEADER_EXTERNAL	0x1
+
 struct header_space {
 	uint16	size;
 	uint16	free;
@@ -70,6 +72,14 @@ struct data_header {
 	uint8*			data_end;
 	header_space	space;
 	uint16			tail_space;
+	uint16			flags;
+};
+
+// Stored right after the data_header of an external header, ie. one that
+// only refers to memory owned by someone else (see append_external_data()).
+struct external_data {
+	void			(*free_function)(void* cookie);
+	void*			cookie;
 };
 
 struct data_node {
@@ -149,6 +159,7 @@ struct net_buffer_private : net_buffer {
 #define DATA_HEADER_SIZE				_ALIGN(sizeof(data_header))
 #define DATA_NODE_SIZE					_ALIGN(sizeof(data_node))
 #define MAX_FREE_BUFFER_SIZE			(BUFFER_SIZE - DATA_HEADER_SIZE)
+#define MAX_EXTERNAL_NODE_SIZE			32768
 
 
 static object_cache* sNetBufferCache;
@@ -813,6 +824,7 @@ create_data_header(size_t headerSpace)
 	header->tail_space = (uint8*)header + BUFFER_SIZE - header->data_end
 		- headerSpace;
 	header->first_free = NULL;
+	header->flags = 0;
 
 	TRACE(("%ld:   create new data header %p\n", find_thread(NULL), header));
 	T2(CreateDataHeader(header));
@@ -820,6 +832,13 @@ create_data_header(size_t headerSpace)
 }
 
 
+static inline external_data*
+get_external_data(data_header* header)
+{
+	return (external_data*)((uint8*)header + DATA_HEADER_SIZE);
+}
+
+
 static void
 release_data_header(data_header* header)
 {
@@ -829,6 +848,13 @@ release_data_header(data_header* header)
 		return;
 
 	TRACE(("%ld:   free header %p\n", find_thread(NULL), header));
+
+	if ((header->flags & DATA_HEADER_EXTERNAL) != 0) {
+		external_data* external = get_external_data(header);
+		if (external->free_function != NULL)
+			external->free_function(external->cookie);
+	}
+
 	free_data_header(header);
 }
 
@@ -935,6 +961,31 @@ alloc_data_header_space(net_buffer_private* buffer, size_t size,
 }
 
 
+/*!	Creates a header that does not contain any data itself, but only keeps
+	track of the memory owned by the caller: \a freeFunction is called with
+	\a cookie once the last reference to the header is gone.
+	Nodes referring to the external memory are always read-only, and since
+	the header has no tail space, nothing can be appended to it either.
+*/
+static data_header*
+create_external_data_header(void (*freeFunction)(void* cookie), void* cookie)
+{
+	data_header* header = create_data_header(_ALIGN(sizeof(external_data)));
+	if (header == NULL)
+		return NULL;
+
+	external_data* external = (external_data*)alloc_data_header_space(header,
+		sizeof(external_data));
+	external->free_function = freeFunction;
+	external->cookie = cookie;
+
+	header->flags |= DATA_HEADER_EXTERNAL;
+	header->tail_space = 0;
+
+	return header;
+}
+
+
 static data_node*
 add_first_data_node(data_header* header)
 {
@@ -1081,6 +1132,7 @@ copy_metadata(net_buffer* destination, const net_buffer* source)
 	destination->offset = source->offset;
 	destination->protocol = source->protocol;
 	destination->type = source->type;
+	destination->segment_size = source->segment_size;
 }
 
 
@@ -1128,6 +1180,7 @@ create_buffer(size_t headerSpace)
 	buffer->offset = 0;
 	buffer->flags = 0;
 	buffer->size = 0;
+	buffer->segment_size = 0;
 
 	CHECK_BUFFER(buffer);
 	CREATE_PARANOIA_CHECK_SET(buffer, "net_buffer");
@@ -2008,6 +2061,65 @@ append_cloned_data(net_buffer* _buffer, net_buffer* _source, uint32 offset,
 }
 
 
+/*!	Appends \a bytes of \a data to the buffer without copying them. The data
+	is only referenced, and must stay valid until \a freeFunction has been
+	called with \a cookie; this happens as soon as no buffer refers to the
+	data anymore.
+	If this function fails, the data has not been taken over, and it's the
+	caller's responsibility to free it.
+*/
+static status_t
+append_external_data(net_buffer* _buffer, const void* data, size_t bytes,
+	void (*freeFunction)(void* cookie), void* cookie)
+{
+	net_buffer_private* buffer = (net_buffer_private*)_buffer;
+	TRACE(("%ld: append_external_data(buffer %p, data %p, bytes = %ld)\n",
+		find_thread(NULL), buffer, data, bytes));
+
+	if (bytes == 0)
+		return B_BAD_VALUE;
+
+	ParanoiaChecker _(buffer);
+
+	data_header* header = create_external_data_header(freeFunction, cookie);
+	if (header == NULL)
+		return ENOBUFS;
+
+	size_t sizeAppended = 0;
+
+	while (sizeAppended < bytes) {
+		data_node* node = add_data_node(buffer, header);
+		if (node == NULL) {
+			remove_trailer(buffer, sizeAppended);
+
+			// the caller still owns the data
+			get_external_data(header)->free_function = NULL;
+			release_data_header(header);
+			return ENOBUFS;
+		}
+
+		node->offset = buffer->size;
+		node->start = (uint8*)data + sizeAppended;
+		node->used = min_c(bytes - sizeAppended, MAX_EXTERNAL_NODE_SIZE);
+		node->flags = DATA_NODE_READ_ONLY;
+
+		list_add_item(&buffer->buffers, node);
+
+		buffer->size += node->used;
+		sizeAppended += node->used;
+	}
+
+	// the nodes keep their own references to the header
+	release_data_header(header);
+
+	CHECK_BUFFER(buffer);
+	SET_PARANOIA_CHECK(PARANOIA_SUSPICIOUS, buffer, &buffer->size,
+		sizeof(buffer->size));
+
+	return B_OK;
+}
+
+
 void
 set_ancillary_data(net_buffer* buffer, ancillary_data_container* container)
 {
@@ -2402,5 +2514,7 @@ net_buffer_module_info gNetBufferModule = {
 	swap_addresses,
 
 	dump_buffer,	// dump
+
+	append_external_data,
 };
 
@@ -21,6 +21,7 @@
 #include <Select.h>
 
 #include <AutoDeleter.h>
+#include <syscall_restart.h>
 #include <team.h>
 #include <util/AutoLock.h>
 #include <util/list.h>
@@ -659,6 +660,10 @@ socket_get_next_stat(uint32* _cookie, int family, struct net_stat* stat)
 	memcpy(&stat->peer, &socket->peer, sizeof(struct sockaddr_storage));
 	stat->receive_queue_size = 0;
 	stat->send_queue_size = 0;
+	stat->congestion_control[0] = '\0';
+	stat->congestion_window = 0;
+	stat->slow_start_threshold = 0;
+	stat->round_trip_time = 0;
 
 	// fill in protocol specific data (if supported by the protocol)
 	size_t length = sizeof(net_stat);
@@ -1494,6 +1499,82 @@ socket_send(net_socket* socket, msghdr* header, const void* data, size_t length,
 }
 
 
+/*!	Sends \a length bytes of \a data over the connected \a socket without
+	copying them into the buffer: the data is only referenced by the
+	net_buffer, and \a freeFunction is called with \a cookie once the stack
+	is done with it.
+	The data is always taken over, even if sending it fails; the caller must
+	not touch it after this call anymore.
+*/
+ssize_t
+socket_send_external(net_socket* socket, const void* data, size_t length,
+	void (*freeFunction)(void* cookie), void* cookie, int flags)
+{
+	if (length == 0 || length > SSIZE_MAX) {
+		freeFunction(cookie);
+		return B_BAD_VALUE;
+	}
+
+	if (socket->peer.ss_len == 0) {
+		freeFunction(cookie);
+		return ENOTCONN;
+	}
+
+	if ((socket->first_info->flags & NET_PROTOCOL_ATOMIC_MESSAGES) != 0
+		&& length > socket->send.buffer_size) {
+		freeFunction(cookie);
+		return EMSGSIZE;
+	}
+
+	// Protocols that don't use buffers need their own copy anyway
+	if (socket->first_info->send_data_no_buffer != NULL) {
+		// The data always lives in the kernel, even if we have been called
+		// via a syscall; the protocol must not treat it as userland memory.
+		SyscallFlagUnsetter _;
+
+		iovec vec = { (void*)data, length };
+		ssize_t written = socket->first_info->send_data_no_buffer(
+			socket->first_protocol, &vec, 1, NULL,
+			(struct sockaddr*)&socket->peer, socket->peer.ss_len);
+		freeFunction(cookie);
+		return written;
+	}
+
+	net_buffer* buffer = gNetBufferModule.create(256);
+	if (buffer == NULL) {
+		freeFunction(cookie);
+		return ENOBUFS;
+	}
+
+	status_t status = gNetBufferModule.append_external(buffer, data, length,
+		freeFunction, cookie);
+	if (status != B_OK) {
+		gNetBufferModule.free(buffer);
+		freeFunction(cookie);
+		return status;
+	}
+
+	buffer->flags = flags;
+	memcpy(buffer->source, &socket->address, socket->address.ss_len);
+	memcpy(buffer->destination, &socket->peer, socket->peer.ss_len);
+
+	status = socket->first_info->send_data(socket->first_protocol, buffer);
+	if (status != B_OK) {
+		size_t sizeAfterSend = buffer->size;
+		gNetBufferModule.free(buffer);
+
+		if (sizeAfterSend != length
+			&& (status == B_INTERRUPTED || status == B_WOULD_BLOCK)) {
+			// this appears to be a partial write
+			return length - sizeAfterSend;
+		}
+		return status;
+	}
+
+	return length;
+}
+
+
 status_t
 socket_set_option(net_socket* socket, int level, int option, const void* value,
 	int length)
@@ -1773,6 +1854,8 @@ net_socket_module_info gNetSocketModule = {
 	socket_send,
 	socket_setsockopt,
 	socket_shutdown,
-	socket_socketpair
+	socket_socketpair,
+
+	socket_send_external
 };
 
@@ -0,0 +1,355 @@
+/*
+ * Copyright 2016, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	Generic receive and segmentation offload for TCP over IPv4.
+
+	On receive, consecutive in-order segments of a TCP connection are merged
+	into a single buffer before they are passed to the protocols, so that IP,
+	and TCP only need to process them once.
+	On send, TCP may pass a buffer containing several segments worth of data
+	down to the datalink layer. It is then split into segments right before it
+	goes out to the device.
+*/
+
+
+#include "offload.h"
+#include "stack_private.h"
+#include "utility.h"
+
+#include <net_stack.h>
+
+#include <ByteOrder.h>
+#include <KernelExport.h>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <string.h>
+
+
+//#define TRACE_OFFLOAD
+#ifdef TRACE_OFFLOAD
+#	define TRACE(x...) dprintf("offload: " x)
+#else
+#	define TRACE(x...) ;
+#endif
+
+
+#define TCP_FLAG_FINISH			0x01
+#define TCP_FLAG_PUSH			0x08
+#define TCP_FLAG_ACKNOWLEDGE	0x10
+#define TCP_FLAG_CONGESTION_WINDOW_REDUCED	0x80
+
+#define TCP_MAX_HEADER_LENGTH	60
+
+struct tcp_headers {
+	struct ip		ip;
+	struct tcphdr	tcp;
+	uint8			options[TCP_MAX_HEADER_LENGTH - sizeof(tcphdr)];
+} _PACKED;
+
+
+static inline size_t
+tcp_header_length(const tcphdr& header)
+{
+	// the data offset lives in the upper four bits of the 13th byte
+	return (((const uint8*)&header)[12] >> 4) << 2;
+}
+
+
+/*!	Returns the 16 bit word of the TCP header that contains the flags. */
+static inline uint16
+tcp_flags_word(const tcphdr& header)
+{
+	uint16 word;
+	memcpy(&word, (const uint8*)&header + 12, sizeof(word));
+	return word;
+}
+
+
+static inline uint32
+fold_checksum(uint32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+
+/*!	Computes the unfinalized checksum of the TCP pseudo header for a segment
+	of \a length bytes with the given \a headers.
+*/
+static inline uint32
+pseudo_header_checksum(const tcp_headers& headers, uint16 length)
+{
+	uint32 source = headers.ip.ip_src.s_addr;
+	uint32 destination = headers.ip.ip_dst.s_addr;
+
+	return (source & 0xffff) + (source >> 16) + (destination & 0xffff)
+		+ (destination >> 16) + htons(IPPROTO_TCP) + htons(length);
+}
+
+
+/*!	Reads the IPv4, and TCP headers of the \a buffer, and makes sure the
+	buffer contains a single, unfragmented TCP segment without IP options.
+*/
+static status_t
+read_tcp_headers(net_buffer* buffer, tcp_headers& headers,
+	size_t& _headerLength)
+{
+	if (buffer->size < sizeof(ip) + sizeof(tcphdr)
+		|| gNetBufferModule.read(buffer, 0, &headers,
+			sizeof(ip) + sizeof(tcphdr)) != B_OK)
+		return B_BAD_DATA;
+
+	if (headers.ip.ip_v != IPVERSION || headers.ip.ip_hl != sizeof(ip) / 4
+		|| headers.ip.ip_p != IPPROTO_TCP
+		|| (ntohs(headers.ip.ip_off) & (IP_MF | IP_OFFMASK)) != 0
+		|| ntohs(headers.ip.ip_len) != buffer->size)
+		return B_BAD_DATA;
+
+	size_t tcpHeaderLength = tcp_header_length(headers.tcp);
+	if (tcpHeaderLength < sizeof(tcphdr)
+		|| sizeof(ip) + tcpHeaderLength > buffer->size)
+		return B_BAD_DATA;
+
+	if (tcpHeaderLength > sizeof(tcphdr)
+		&& gNetBufferModule.read(buffer, sizeof(ip) + sizeof(tcphdr),
+			headers.options, tcpHeaderLength - sizeof(tcphdr)) != B_OK)
+		return B_BAD_DATA;
+
+	_headerLength = sizeof(ip) + tcpHeaderLength;
+	return B_OK;
+}
+
+
+/*!	Returns whether or not the received \a buffer is a TCP segment that other
+	segments can be appended to.
+*/
+static bool
+is_mergeable_tcp_segment(net_buffer* buffer, tcp_headers& headers,
+	size_t& headerLength)
+{
+	if (buffer->interface_address != NULL
+		|| buffer->type != B_NET_FRAME_TYPE_IPV4
+		|| (buffer->flags & (MSG_BCAST | MSG_MCAST)) != 0
+		|| read_tcp_headers(buffer, headers, headerLength) != B_OK)
+		return false;
+
+	// only plain data segments are merged, anything else is left to TCP
+	uint8 flags = headers.tcp.th_flags & ~TCP_FLAG_PUSH;
+	return flags == TCP_FLAG_ACKNOWLEDGE && buffer->size > headerLength
+		&& checksum((uint8*)&headers.ip, sizeof(ip)) == 0;
+}
+
+
+//	#pragma mark - generic receive offload
+
+
+bool
+is_mergeable_tcp_segment(net_buffer* buffer)
+{
+	tcp_headers headers;
+	size_t headerLength;
+	return is_mergeable_tcp_segment(buffer, headers, headerLength)
+		&& (headers.tcp.th_flags & TCP_FLAG_PUSH) == 0;
+}
+
+
+/*!	Appends the data of the TCP segment in \a next to the one in \a buffer,
+	if \a next directly follows \a buffer in the same connection, and both
+	can be merged.
+	The TCP checksums are not verified here. Instead, the checksum of the
+	merged segment is computed from the checksums of the original segments,
+	so that it will only be valid if both of them were, and TCP will detect
+	any corruption as usual.
+	If this function succeeds, \a next has been freed, otherwise it was not
+	touched.
+*/
+status_t
+merge_tcp_segment(net_buffer* buffer, net_buffer* next)
+{
+	tcp_headers headers;
+	tcp_headers nextHeaders;
+	size_t headerLength;
+	size_t nextHeaderLength;
+	if (!is_mergeable_tcp_segment(buffer, headers, headerLength)
+		|| !is_mergeable_tcp_segment(next, nextHeaders, nextHeaderLength))
+		return B_BAD_TYPE;
+
+	uint32 dataLength = buffer->size - headerLength;
+	uint32 nextDataLength = next->size - nextHeaderLength;
+
+	// Both must belong to the same connection, next must follow immediately,
+	// and all other header fields must be the same
+	if ((headers.tcp.th_flags & TCP_FLAG_PUSH) != 0
+		|| headerLength != nextHeaderLength
+		|| headers.ip.ip_src.s_addr != nextHeaders.ip.ip_src.s_addr
+		|| headers.ip.ip_dst.s_addr != nextHeaders.ip.ip_dst.s_addr
+		|| headers.ip.ip_tos != nextHeaders.ip.ip_tos
+		|| headers.tcp.th_sport != nextHeaders.tcp.th_sport
+		|| headers.tcp.th_dport != nextHeaders.tcp.th_dport
+		|| headers.tcp.th_ack != nextHeaders.tcp.th_ack
+		|| headers.tcp.th_win != nextHeaders.tcp.th_win
+		|| headers.tcp.th_urp != nextHeaders.tcp.th_urp
+		|| memcmp(headers.options, nextHeaders.options,
+			headerLength - sizeof(ip) - sizeof(tcphdr)) != 0
+		|| ntohl(headers.tcp.th_seq) + dataLength
+			!= ntohl(nextHeaders.tcp.th_seq)
+		|| buffer->size + nextDataLength > IP_MAXPACKET)
+		return B_MISMATCHED_VALUES;
+
+	uint16 tcpLength = buffer->size - sizeof(ip);
+	uint16 nextTCPLength = next->size - sizeof(ip);
+	uint16 mergedTCPLength = tcpLength + nextDataLength;
+
+	// The data of a valid segment sums up to the complement of its pseudo
+	// header, and TCP header sum
+	int32 nextHeaderSum = gNetBufferModule.checksum(next, sizeof(ip),
+		nextHeaderLength - sizeof(ip), false);
+	if (nextHeaderSum < 0)
+		return nextHeaderSum;
+
+	uint16 nextDataSum = ~fold_checksum(
+		pseudo_header_checksum(nextHeaders, nextTCPLength) + nextHeaderSum);
+	if ((dataLength & 1) != 0) {
+		// the data will end up at an odd offset
+		nextDataSum = __swap_int16(nextDataSum);
+	}
+
+	uint16 oldFlags = tcp_flags_word(headers.tcp);
+	headers.tcp.th_flags |= nextHeaders.tcp.th_flags & TCP_FLAG_PUSH;
+	uint16 newFlags = tcp_flags_word(headers.tcp);
+
+	// Update the checksum: exchange the length in the pseudo header, and the
+	// flags, and add the data of the next segment
+	uint32 sum = (uint16)~headers.tcp.th_sum;
+	sum += (uint16)~htons(tcpLength) + htons(mergedTCPLength);
+	sum += (uint16)~oldFlags + newFlags;
+	sum += nextDataSum;
+	headers.tcp.th_sum = ~fold_checksum(sum);
+
+	headers.ip.ip_len = htons(buffer->size + nextDataLength);
+	headers.ip.ip_sum = 0;
+	headers.ip.ip_sum = checksum((uint8*)&headers.ip, sizeof(ip));
+
+	// Cut off the headers of the next segment, and append its data. If this
+	// fails, the next segment is lost, and will have to be retransmitted
+	status_t status = gNetBufferModule.remove_header(next, nextHeaderLength);
+	if (status == B_OK)
+		status = gNetBufferModule.merge(buffer, next, true);
+	if (status != B_OK) {
+		TRACE("merging failed: %s\n", strerror(status));
+		gNetBufferModule.free(next);
+		return B_OK;
+	}
+
+	return gNetBufferModule.write(buffer, 0, &headers,
+		sizeof(ip) + sizeof(tcphdr));
+}
+
+
+//	#pragma mark - generic segmentation offload
+
+
+/*!	Splits the TCP segment in \a buffer into segments with at most
+	net_buffer::segment_size bytes of data each, and adds them to the
+	\a segments list.
+	The segments only reference the data of the \a buffer, they do not copy
+	it. The \a buffer itself is left untouched; if this function fails, none
+	of the segments are left in the list.
+*/
+status_t
+split_tcp_segments(net_buffer* buffer, struct list* segments)
+{
+	tcp_headers headers;
+	size_t headerLength;
+	status_t status = read_tcp_headers(buffer, headers, headerLength);
+	if (status != B_OK)
+		return status;
+
+	uint32 segmentSize = buffer->segment_size;
+	uint32 dataLength = buffer->size - headerLength;
+	if (segmentSize == 0)
+		return B_BAD_VALUE;
+
+	uint8 flags = headers.tcp.th_flags;
+	uint32 sequence = ntohl(headers.tcp.th_seq);
+	uint16 id = ntohs(headers.ip.ip_id);
+		// the IPv4 module reserved the IDs following this one for us
+
+	TRACE("split %" B_PRIu32 " bytes into segments of %" B_PRIu32 "\n",
+		dataLength, segmentSize);
+
+	for (uint32 offset = 0; offset < dataLength; offset += segmentSize) {
+		uint32 length = min_c(segmentSize, dataLength - offset);
+		bool last = offset + length == dataLength;
+
+		// Only the last segment gets FIN, and PUSH, only the first one CWR
+		headers.tcp.th_flags = flags;
+		if (!last)
+			headers.tcp.th_flags &= ~(TCP_FLAG_FINISH | TCP_FLAG_PUSH);
+		if (offset != 0)
+			headers.tcp.th_flags &= ~TCP_FLAG_CONGESTION_WINDOW_REDUCED;
+		headers.tcp.th_seq = htonl(sequence + offset);
+		headers.tcp.th_sum = 0;
+
+		headers.ip.ip_len = htons(headerLength + length);
+		headers.ip.ip_id = htons(id++);
+		headers.ip.ip_sum = 0;
+		headers.ip.ip_sum = checksum((uint8*)&headers.ip, sizeof(ip));
+
+		net_buffer* segment = gNetBufferModule.create(256);
+		if (segment == NULL) {
+			status = B_NO_MEMORY;
+			break;
+		}
+
+		memcpy(segment->source, buffer->source, buffer->source->sa_len);
+		memcpy(segment->destination, buffer->destination,
+			buffer->destination->sa_len);
+		segment->flags = buffer->flags;
+		segment->protocol = buffer->protocol;
+		segment->type = buffer->type;
+
+		status = gNetBufferModule.append(segment, &headers, headerLength);
+		if (status == B_OK) {
+			status = gNetBufferModule.append_cloned(segment, buffer,
+				headerLength + offset, length);
+		}
+		if (status == B_OK) {
+			int32 sum = gNetBufferModule.checksum(segment, sizeof(ip),
+				segment->size - sizeof(ip), false);
+			if (sum < 0)
+				status = sum;
+			else {
+				uint16 tcpChecksum = ~fold_checksum(sum
+					+ pseudo_header_checksum(headers,
+						segment->size - sizeof(ip)));
+				status = gNetBufferModule.write(segment,
+					sizeof(ip) + offsetof(tcphdr, th_sum), &tcpChecksum,
+					sizeof(tcpChecksum));
+			}
+		}
+		if (status != B_OK) {
+			gNetBufferModule.free(segment);
+			break;
+		}
+
+		list_add_item(segments, segment);
+	}
+
+	if (status != B_OK) {
+		while (net_buffer* segment
+				= (net_buffer*)list_remove_head_item(segments)) {
+			gNetBufferModule.free(segment);
+		}
+	}
+
+	return status;
+}
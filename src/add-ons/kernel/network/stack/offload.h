@@ -0,0 +1,20 @@
+/*
+ * Copyright 2016, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+
+#include <net_buffer.h>
+
+
+// generic receive offload
+bool is_mergeable_tcp_segment(net_buffer* buffer);
+status_t merge_tcp_segment(net_buffer* buffer, net_buffer* next);
+
+// generic segmentation offload
+status_t split_tcp_segments(net_buffer* buffer, struct list* segments);
+
+
+#endif	// OFFLOAD_H
@@ -83,6 +83,7 @@ copy_metadata(net_buffer *destination, const net_buffer *source)
 	destination->size = source->size;
 	destination->protocol = source->protocol;
 	destination->type = source->type;
+	destination->segment_size = source->segment_size;
 }
 
 
@@ -111,6 +112,7 @@ create_buffer(size_t headerSpace)
 	buffer->offset = 0;
 	buffer->flags = 0;
 	buffer->size = 0;
+	buffer->segment_size = 0;
 
 	buffer->type = -1;
 
@@ -723,5 +725,7 @@ net_buffer_module_info gSimpleNetBufferModule = {
 	swap_addresses,
 
 	dump_buffer,	// dump
+
+	NULL,	// append_external
 };
 
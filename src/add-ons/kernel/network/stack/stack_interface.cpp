@@ -161,6 +161,15 @@ stack_interface_sendmsg(net_socket* socket, const struct msghdr* message,
 }
 
 
+static ssize_t
+stack_interface_send_external(net_socket* socket, const void* data,
+	size_t length, void (*freeFunction)(void* cookie), void* cookie, int flags)
+{
+	return gNetSocketModule.send_external(socket, data, length, freeFunction,
+		cookie, flags);
+}
+
+
 static status_t
 stack_interface_getsockopt(net_socket* socket, int level, int option,
 	void* value, socklen_t* _length)
@@ -298,5 +307,7 @@ net_stack_interface_module_info gNetStackInterfaceModule = {
 	&stack_interface_select,
 	&stack_interface_deselect,
 
-	&stack_interface_get_next_socket_stat
+	&stack_interface_get_next_socket_stat,
+
+	&stack_interface_send_external
 };
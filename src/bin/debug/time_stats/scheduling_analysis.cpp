@@ -226,6 +226,7 @@ do_scheduling_analysis(bigtime_t startTime, bigtime_t endTime,
 		printf("  preemptions: %lld us (%lld)\n", thread->total_rerun_time,
 			thread->reruns);
 		printf("  unspecified: %lld us\n", thread->unspecified_wait_time);
+		printf("  migrations:  %lld\n", thread->migrations);
 
 		printf("  waited on:\n");
 		for (int32 i = 0; i < groupCount; i++) {
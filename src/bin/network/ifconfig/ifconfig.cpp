@@ -438,6 +438,31 @@ configure_wireless(const char* name, char* const* args, int32 argCount)
 //	#pragma mark -
 
 
+void
+list_receive_queues(const char* name)
+{
+	int socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if (socket < 0)
+		return;
+
+	ifreceivequeuereq request;
+	memset(&request, 0, sizeof(request));
+	strlcpy(request.ifrq_name, name, IF_NAMESIZE);
+
+	if (ioctl(socket, B_SOCKET_GET_RECEIVE_QUEUES, &request,
+			sizeof(request)) == 0 && request.ifrq_count > 1) {
+		for (int i = 0; i < request.ifrq_count; i++) {
+			const ifreq_queue_stats& queue = request.ifrq_queues[i];
+			printf("\tReceive queue %d: %" B_PRIu64 " packets, %" B_PRIu64
+				" bytes, %" B_PRIu32 " dropped\n", i, queue.packets,
+				queue.bytes, queue.dropped);
+		}
+	}
+
+	close(socket);
+}
+
+
 void
 list_interface_addresses(BNetworkInterface& interface, uint32 flags)
 {
@@ -600,6 +625,8 @@ list_interface(const char* name)
 		printf("\tCollisions: %d\n", stats.collisions);
 	}
 
+	list_receive_queues(name);
+
 	putchar('\n');
 	return true;
 }
@@ -28,6 +28,7 @@ extern const char* __progname;
 const char* kProgramName = __progname;
 
 static int sResolveNames = 1;
+static int sPrintCongestion = 0;
 
 struct address_family {
 	int			family;
@@ -99,9 +100,10 @@ inet_print_address(sockaddr* _address)
 void
 usage(int status)
 {
-	printf("usage: %s [-nh]\n", kProgramName);
+	printf("usage: %s [-nch]\n", kProgramName);
 	printf("options:\n");
 	printf("	-n	don't resolve names\n");
+	printf("	-c	show congestion control state of connections\n");
 	printf("	-h	this help\n");
 
 	exit(status);
@@ -138,11 +140,12 @@ main(int argc, char** argv)
 	static struct option longOptions[] = {
 		{"help", no_argument, 0, 'h'},
 		{"numeric", no_argument, 0, 'n'},
+		{"congestion", no_argument, 0, 'c'},
 		{0, 0, 0, 0}
 	};
 
 	do {
-		opt = getopt_long(argc, argv, "hn", longOptions, &optionIndex);
+		opt = getopt_long(argc, argv, "hnc", longOptions, &optionIndex);
 		switch (opt) {
 			case -1:
 				// end of arguments, do nothing
@@ -152,6 +155,10 @@ main(int argc, char** argv)
 				sResolveNames = 0;
 				break;
 
+			case 'c':
+				sPrintCongestion = 1;
+				break;
+
 			case 'h':
 			default:
 				usage(0);
@@ -199,6 +206,13 @@ main(int argc, char** argv)
 			printf("%ld/%s\n", stat.owner, name);
 		} else
 			printf("%ld\n", stat.owner);
+
+		if (sPrintCongestion && stat.congestion_control[0] != '\0') {
+			printf("       %s: cwnd %" B_PRIu32 ", ssthresh %" B_PRIu32
+				", rtt %.3f ms\n", stat.congestion_control,
+				stat.congestion_window, stat.slow_start_threshold,
+				stat.round_trip_time / 1000.0);
+		}
 	}
 
 	return 0;
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <OS.h>
+
+#include <scheduler_defs.h>
+#include <syscalls.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+extern const char* __progname;
+
+static const int32 kBarWidth = 40;
+
+
+static void
+usage(bool failure)
+{
+	printf("Usage: %s [-c] [-r] [-t [<team>]]\n"
+		"  Shows the scheduling latency statistics of the system.\n\n"
+		"  -c\tShows the histograms of each CPU instead of the sum of all\n"
+		"  -r\tResets the CPU statistics after showing them\n"
+		"  -t\tAlso lists the threads that have been woken up, optionally\n"
+		"    \tonly those of the given team\n", __progname);
+
+	exit(failure ? 1 : 0);
+}
+
+
+static void
+print_bar(int64 count, int64 total)
+{
+	int32 width = total > 0 ? int32(count * kBarWidth / total) : 0;
+	for (int32 i = 0; i < width; i++)
+		putchar('#');
+}
+
+
+static void
+print_latency_histogram(const int64* histogram)
+{
+	int64 total = 0;
+	for (int32 i = 0; i < SCHEDULER_LATENCY_BUCKETS; i++)
+		total += histogram[i];
+
+	for (int32 i = 0; i < SCHEDULER_LATENCY_BUCKETS; i++) {
+		if (i == 0)
+			printf("  %7s < %6d us", "", 2);
+		else if (i == SCHEDULER_LATENCY_BUCKETS - 1)
+			printf("  %7s >= %5d us", "", 1 << i);
+		else
+			printf("  %7d - %6d us", 1 << i, 1 << (i + 1));
+
+		printf(" %10" B_PRId64 " %5.1f%% ", histogram[i],
+			total > 0 ? 100.0 * histogram[i] / total : 0.0);
+		print_bar(histogram[i], total);
+		putchar('\n');
+	}
+}
+
+
+static void
+print_run_queue_histogram(const int64* histogram)
+{
+	int64 total = 0;
+	for (int32 i = 0; i < SCHEDULER_RUN_QUEUE_BUCKETS; i++)
+		total += histogram[i];
+
+	for (int32 i = 0; i < SCHEDULER_RUN_QUEUE_BUCKETS; i++) {
+		printf("  %5d%s threads", i,
+			i == SCHEDULER_RUN_QUEUE_BUCKETS - 1 ? "+" : " ");
+		printf(" %10" B_PRId64 " %5.1f%% ", histogram[i],
+			total > 0 ? 100.0 * histogram[i] / total : 0.0);
+		print_bar(histogram[i], total);
+		putchar('\n');
+	}
+}
+
+
+static void
+print_cpu_stats(bool perCPU)
+{
+	system_info info;
+	get_system_info(&info);
+
+	scheduler_cpu_latency_stats sum;
+	memset(&sum, 0, sizeof(sum));
+
+	printf("cpu core   switches preemptions    wakeups avg latency"
+		" max latency\n");
+
+	for (uint32 cpu = 0; cpu < info.cpu_count; cpu++) {
+		scheduler_cpu_latency_stats stats;
+		status_t status = _kern_get_scheduler_cpu_latency_stats(cpu, &stats,
+			sizeof(stats));
+		if (status != B_OK) {
+			fprintf(stderr, "%s: could not get statistics of CPU %" B_PRIu32
+				": %s\n", __progname, cpu, strerror(status));
+			exit(1);
+		}
+
+		printf("%3" B_PRId32 " %4" B_PRId32 " %10" B_PRId64 " %11" B_PRId64
+			" %10" B_PRId64 " %8" B_PRId64 " us %8" B_PRId64 " us\n",
+			stats.cpu, stats.core, stats.context_switches, stats.preemptions,
+			stats.wakeups,
+			stats.wakeups > 0 ? stats.total_latency / stats.wakeups : 0,
+			stats.max_latency);
+
+		if (perCPU) {
+			printf("\n  Wake-up latency:\n");
+			print_latency_histogram(stats.latency_histogram);
+			printf("\n  Run queue length:\n");
+			print_run_queue_histogram(stats.run_queue_histogram);
+			putchar('\n');
+		}
+
+		sum.context_switches += stats.context_switches;
+		sum.preemptions += stats.preemptions;
+		sum.wakeups += stats.wakeups;
+		for (int32 i = 0; i < SCHEDULER_LATENCY_BUCKETS; i++)
+			sum.latency_histogram[i] += stats.latency_histogram[i];
+		for (int32 i = 0; i < SCHEDULER_RUN_QUEUE_BUCKETS; i++)
+			sum.run_queue_histogram[i] += stats.run_queue_histogram[i];
+	}
+
+	if (!perCPU) {
+		printf("\nWake-up latency:\n");
+		print_latency_histogram(sum.latency_histogram);
+		printf("\nRun queue length:\n");
+		print_run_queue_histogram(sum.run_queue_histogram);
+	}
+}
+
+
+static void
+print_thread_stats(team_id team)
+{
+	printf("\n%6s %-32s %10s %11s %8s %8s\n", "thread", "name", "wakeups",
+		"preemptions", "avg", "max");
+
+	team_info teamInfo;
+	int32 teamCookie = 0;
+
+	while (get_next_team_info(&teamCookie, &teamInfo) == B_OK) {
+		if (team >= 0 && teamInfo.team != team)
+			continue;
+
+		thread_info threadInfo;
+		int32 threadCookie = 0;
+
+		while (get_next_thread_info(teamInfo.team, &threadCookie, &threadInfo)
+				== B_OK) {
+			scheduler_thread_latency_stats stats;
+			if (_kern_get_scheduler_thread_latency_stats(threadInfo.thread,
+					&stats, sizeof(stats)) != B_OK || stats.wakeups == 0) {
+				continue;
+			}
+
+			printf("%6" B_PRId32 " %-32.32s %10" B_PRId64 " %11" B_PRId64
+				" %5" B_PRId64 " us %5" B_PRId64 " us\n", threadInfo.thread,
+				threadInfo.name, stats.wakeups, stats.preemptions,
+				stats.total_latency / stats.wakeups, stats.max_latency);
+		}
+	}
+}
+
+
+int
+main(int argc, char** argv)
+{
+	bool perCPU = false;
+	bool reset = false;
+	bool threads = false;
+	team_id team = -1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c"))
+			perCPU = true;
+		else if (!strcmp(argv[i], "-r"))
+			reset = true;
+		else if (!strcmp(argv[i], "-t")) {
+			threads = true;
+			if (i + 1 < argc && isdigit(argv[i + 1][0]))
+				team = atol(argv[++i]);
+		} else
+			usage(strcmp(argv[i], "--help") != 0);
+	}
+
+	print_cpu_stats(perCPU);
+
+	if (threads)
+		print_thread_stats(team);
+
+	if (reset) {
+		status_t status = _kern_reset_scheduler_latency_stats();
+		if (status != B_OK) {
+			fprintf(stderr, "%s: could not reset the statistics: %s\n",
+				__progname, strerror(status));
+			return 1;
+		}
+	}
+
+	return 0;
+}
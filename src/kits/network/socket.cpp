@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 
 #include <syscall_utils.h>
@@ -310,6 +311,13 @@ sendmsg(int socket, const struct msghdr *message, int flags)
 }
 
 
+extern "C" ssize_t
+sendfile(int socket, int fd, off_t *offset, size_t count)
+{
+	RETURN_AND_SET_ERRNO_TEST_CANCEL(_kern_sendfile(socket, fd, offset, count));
+}
+
+
 extern "C" int
 getsockopt(int socket, int level, int option, void *value, socklen_t *_length)
 {
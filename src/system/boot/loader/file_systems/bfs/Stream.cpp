@@ -292,6 +292,80 @@ Stream::FindBlockRun(off_t pos, block_run& run, off_t& offset)
 }
 
 
+/*!	Returns the small data item of the \a node with the given name, or
+	\c NULL if there is none.
+*/
+static const small_data*
+find_small_data(const bfs_inode* node, char name, uint16 nameLength)
+{
+	const small_data* item = ((bfs_inode*)node)->SmallDataStart();
+	for (; !item->IsLast(node); item = item->Next()) {
+		if (*item->Name() == name && item->NameSize() == nameLength)
+			return item;
+	}
+
+	return NULL;
+}
+
+
+/*!	Reads from a file whose data is stored in the small data section of its
+	inode; since that section is not part of the Stream, the whole inode
+	block has to be read for this.
+*/
+status_t
+Stream::ReadInlineData(off_t pos, uint8* buffer, size_t length,
+	size_t* _length)
+{
+	*_length = 0;
+
+	CachedBlock cached(fVolume, inode_num);
+	const bfs_inode* node = (const bfs_inode*)cached.Block();
+	if (node == NULL)
+		return B_IO_ERROR;
+
+	const small_data* item = find_small_data(node, INLINE_DATA_NAME,
+		INLINE_DATA_NAME_LENGTH);
+	if (item == NULL || pos + (off_t)length > item->DataSize())
+		return B_BAD_DATA;
+
+	memcpy(buffer, item->Data() + pos, length);
+	*_length = length;
+	return B_OK;
+}
+
+
+/*!	Clears the parts of the \a buffer read from \a pos that belong to
+	preallocated blocks which have not been written to yet; they may still
+	contain the data of a file that used them before.
+*/
+status_t
+Stream::ClearUnwrittenData(off_t pos, uint8* buffer, size_t length)
+{
+	CachedBlock cached(fVolume, inode_num);
+	const bfs_inode* node = (const bfs_inode*)cached.Block();
+	if (node == NULL)
+		return B_IO_ERROR;
+
+	const small_data* item = find_small_data(node, UNWRITTEN_DATA_NAME,
+		UNWRITTEN_DATA_NAME_LENGTH);
+	if (item == NULL)
+		return B_OK;
+
+	const unwritten_extent* extents = (const unwritten_extent*)item->Data();
+	int32 count = item->DataSize() / sizeof(unwritten_extent);
+	off_t end = pos + (off_t)length;
+
+	for (int32 i = 0; i < count; i++) {
+		off_t start = max_c(extents[i].Offset(), pos);
+		off_t extentEnd = min_c(extents[i].End(), end);
+		if (start < extentEnd)
+			memset(buffer + (start - pos), 0, extentEnd - start);
+	}
+
+	return B_OK;
+}
+
+
 status_t
 Stream::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 {
@@ -309,6 +383,20 @@ Stream::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 	if (pos + (off_t)length > data.Size())
 		length = data.Size() - pos;
 
+	if ((Flags() & INODE_INLINE_DATA) != 0)
+		return ReadInlineData(pos, buffer, length, _length);
+
+	status_t status = ReadBlocks(pos, buffer, length, _length);
+	if (status == B_OK && (Flags() & INODE_UNWRITTEN_DATA) != 0)
+		status = ClearUnwrittenData(pos, buffer, *_length);
+
+	return status;
+}
+
+
+status_t
+Stream::ReadBlocks(off_t pos, uint8* buffer, size_t length, size_t* _length)
+{
 	block_run run;
 	off_t offset;
 	if (FindBlockRun(pos, run, offset) < B_OK) {
@@ -41,6 +41,11 @@ class Stream : public bfs_inode {
 
 	private:
 		status_t GetNextSmallData(const small_data **_smallData) const;
+		status_t ReadInlineData(off_t pos, uint8 *buffer, size_t length,
+			size_t *_length);
+		status_t ReadBlocks(off_t pos, uint8 *buffer, size_t length,
+			size_t *_length);
+		status_t ClearUnwrittenData(off_t pos, uint8 *buffer, size_t length);
 
 		Volume	&fVolume;
 };
@@ -90,7 +90,8 @@ Volume::IsValidSuperBlock()
 {
 	if (fSuperBlock.Magic1() != (int32)SUPER_BLOCK_MAGIC1
 		|| fSuperBlock.Magic2() != (int32)SUPER_BLOCK_MAGIC2
-		|| fSuperBlock.Magic3() != (int32)SUPER_BLOCK_MAGIC3
+		|| (fSuperBlock.Magic3() != (int32)SUPER_BLOCK_MAGIC3
+			&& fSuperBlock.Magic3() != (int32)SUPER_BLOCK_MAGIC3_INCOMPATIBLE)
 		|| (int32)fSuperBlock.block_size != fSuperBlock.inode_size
 		|| fSuperBlock.ByteOrder() != SUPER_BLOCK_FS_LENDIAN
 		|| (1UL << fSuperBlock.BlockShift()) != fSuperBlock.BlockSize()
@@ -101,6 +102,15 @@ Volume::IsValidSuperBlock()
 		|| fSuperBlock.AllocationGroups() != divide_roundup(fSuperBlock.NumBlocks(), 1L << fSuperBlock.AllocationGroupShift()))
 		return false;
 
+	// we can't read volumes that use features we don't know about, and that
+	// change how existing data has to be read
+	if ((fSuperBlock.Features() & ~SUPER_BLOCK_KNOWN_FEATURES
+			& SUPER_BLOCK_INCOMPATIBLE_FEATURES) != 0) {
+		dprintf("bfs: volume uses incompatible features %#" B_PRIx32 "\n",
+			fSuperBlock.Features());
+		return false;
+	}
+
 	return true;
 }
 
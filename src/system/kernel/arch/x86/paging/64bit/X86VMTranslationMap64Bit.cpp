@@ -15,6 +15,7 @@
 #include <slab/Slab.h>
 #include <thread.h>
 #include <util/AutoLock.h>
+#include <vm/vm.h>
 #include <vm/vm_page.h>
 #include <vm/VMAddressSpace.h>
 #include <vm/VMCache.h>
@@ -32,12 +33,47 @@
 #endif
 
 
+// The large page directory entry bits that carry over to the page table
+// entries when a large page is split.
+static const uint64 kLargePageEntryFlags = X86_64_PDE_PRESENT
+	| X86_64_PDE_WRITABLE | X86_64_PDE_USER | X86_64_PDE_WRITE_THROUGH
+	| X86_64_PDE_CACHING_DISABLED | X86_64_PDE_ACCESSED | X86_64_PDE_DIRTY
+	| X86_64_PDE_GLOBAL | X86_64_PDE_NOT_EXECUTABLE;
+
+// A bit the CPU ignores, set in the entries of the large pages MapLargePage()
+// created, so that only those are taken into account in fLargePageCount, and
+// not the ones the boot loader might have set up.
+static const uint64 kMappedLargePageFlag = 1LL << 9;
+
+
+static inline bool
+is_large_page_entry(uint64 entry)
+{
+	return (entry & (X86_64_PDE_PRESENT | X86_64_PDE_LARGE_PAGE))
+		== (X86_64_PDE_PRESENT | X86_64_PDE_LARGE_PAGE);
+}
+
+
+/*!	Returns the page table entry equivalent to the mapping of the \a index th
+	page of the large page \a largeEntry maps.
+*/
+static inline uint64
+large_page_table_entry(uint64 largeEntry, uint32 index)
+{
+	return ((largeEntry & X86_64_PDE_LARGE_ADDRESS_MASK)
+			+ (uint64)index * B_PAGE_SIZE)
+		| (largeEntry & kLargePageEntryFlags);
+}
+
+
 // #pragma mark - X86VMTranslationMap64Bit
 
 
 X86VMTranslationMap64Bit::X86VMTranslationMap64Bit()
 	:
-	fPagingStructures(NULL)
+	fPagingStructures(NULL),
+	fSplitPageTableCount(0),
+	fLargePageCount(0)
 {
 }
 
@@ -49,6 +85,11 @@ X86VMTranslationMap64Bit::~X86VMTranslationMap64Bit()
 	if (fPagingStructures == NULL)
 		return;
 
+	while (vm_page* page = fSplitPageTables.RemoveHead()) {
+		DEBUG_PAGE_ACCESS_START(page);
+		vm_page_set_state(page, PAGE_STATE_FREE);
+	}
+
 	if (fPageMapper != NULL) {
 		phys_addr_t address;
 		vm_page* page;
@@ -71,6 +112,11 @@ X86VMTranslationMap64Bit::~X86VMTranslationMap64Bit()
 					if ((virtualPageDir[k] & X86_64_PDE_PRESENT) == 0)
 						continue;
 
+					// The pages of a large page belong to the area's cache,
+					// there is no page table to free.
+					if ((virtualPageDir[k] & X86_64_PDE_LARGE_PAGE) != 0)
+						continue;
+
 					address = virtualPageDir[k] & X86_64_PDE_ADDRESS_MASK;
 					page = vm_lookup_page(address / B_PAGE_SIZE);
 					if (page == NULL) {
@@ -197,6 +243,17 @@ X86VMTranslationMap64Bit::Map(addr_t virtualAddress, phys_addr_t physicalAddress
 
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
+	// A large page covering the address has to be split first, or we would
+	// take the large page itself for the page table.
+	uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+		fPagingStructures->VirtualPML4(), virtualAddress, fIsKernelMap,
+		false, NULL, fPageMapper, fMapCount);
+	if (pde != NULL && is_large_page_entry(*pde)) {
+		status_t error = _SplitLargePage(pde, virtualAddress);
+		if (error != B_OK)
+			return error;
+	}
+
 	// Look up the page table for the virtual address, allocating new tables
 	// if required. Shouldn't fail.
 	uint64* entry = X86PagingMethod64Bit::PageTableEntryForAddress(
@@ -222,6 +279,69 @@ X86VMTranslationMap64Bit::Map(addr_t virtualAddress, phys_addr_t physicalAddress
 }
 
 
+size_t
+X86VMTranslationMap64Bit::LargePageSize() const
+{
+	return k64BitPageTableRange;
+}
+
+
+status_t
+X86VMTranslationMap64Bit::MapLargePage(addr_t virtualAddress,
+	phys_addr_t physicalAddress, uint32 attributes, uint32 memoryType,
+	vm_page_reservation* reservation)
+{
+	TRACE("X86VMTranslationMap64Bit::MapLargePage(%#" B_PRIxADDR ", %#"
+		B_PRIxPHYSADDR ")\n", virtualAddress, physicalAddress);
+
+	if (virtualAddress % k64BitPageTableRange != 0
+		|| physicalAddress % k64BitPageTableRange != 0) {
+		return B_BAD_VALUE;
+	}
+
+	ThreadCPUPinner pinner(thread_get_current_thread());
+
+	// Look up the page directory entry for the virtual address, allocating
+	// new tables if required.
+	uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+		fPagingStructures->VirtualPML4(), virtualAddress, fIsKernelMap,
+		true, reservation, fPageMapper, fMapCount);
+	ASSERT(pde != NULL);
+
+	// If there is a page table already, parts of the range might still be
+	// in use. Leave it to the caller to map the pages individually then.
+	if ((*pde & X86_64_PDE_PRESENT) != 0)
+		return B_BUSY;
+
+	// Set aside a page for the page table needed when the large page has to
+	// be split, as that happens with the map locked, when we can't wait for
+	// memory anymore. The reservation covers the page table the range would
+	// need otherwise.
+	if (fSplitPageTableCount <= fLargePageCount) {
+		vm_page* page = vm_page_allocate_page(reservation, PAGE_STATE_WIRED);
+		DEBUG_PAGE_ACCESS_END(page);
+		fSplitPageTables.Add(page);
+		fSplitPageTableCount++;
+	}
+	fLargePageCount++;
+
+	// The PAT bit is at a different position in large page entries, but since
+	// we never use it, the page table entry flags can be used as they are.
+	uint64 entry;
+	X86PagingMethod64Bit::PutPageTableEntryInTable(&entry, physicalAddress,
+		attributes, memoryType, fIsKernelMap);
+	X86PagingMethod64Bit::SetTableEntry(pde,
+		entry | X86_64_PDE_LARGE_PAGE | kMappedLargePageFlag);
+
+	// Note: As in Map(), we don't need to invalidate the TLB, since the entry
+	// was not present before.
+
+	fMapCount += k64BitTableEntryCount;
+
+	return B_OK;
+}
+
+
 status_t
 X86VMTranslationMap64Bit::Unmap(addr_t start, addr_t end)
 {
@@ -235,6 +355,30 @@ X86VMTranslationMap64Bit::Unmap(addr_t start, addr_t end)
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
 	do {
+		uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
+			NULL, fPageMapper, fMapCount);
+		if (pde != NULL && is_large_page_entry(*pde)) {
+			if (start % k64BitPageTableRange == 0
+				&& end - start >= k64BitPageTableRange - 1) {
+				// The whole large page goes away.
+				uint64 oldEntry = X86PagingMethod64Bit::ClearTableEntry(pde);
+				fMapCount -= k64BitTableEntryCount;
+				if ((oldEntry & kMappedLargePageFlag) != 0)
+					fLargePageCount--;
+
+				if ((oldEntry & X86_64_PDE_ACCESSED) != 0)
+					InvalidatePage(start);
+
+				start += k64BitPageTableRange;
+				continue;
+			}
+
+			status_t error = _SplitLargePage(pde, start);
+			if (error != B_OK)
+				return error;
+		}
+
 		uint64* pageTable = X86PagingMethod64Bit::PageTableForAddress(
 			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
 			NULL, fPageMapper, fMapCount);
@@ -285,6 +429,15 @@ X86VMTranslationMap64Bit::DebugMarkRangePresent(addr_t start, addr_t end,
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
 	do {
+		uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
+			NULL, fPageMapper, fMapCount);
+		if (pde != NULL && is_large_page_entry(*pde)) {
+			status_t error = _SplitLargePage(pde, start);
+			if (error != B_OK)
+				return error;
+		}
+
 		uint64* pageTable = X86PagingMethod64Bit::PageTableForAddress(
 			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
 			NULL, fPageMapper, fMapCount);
@@ -332,16 +485,14 @@ X86VMTranslationMap64Bit::UnmapPage(VMArea* area, addr_t address,
 
 	TRACE("X86VMTranslationMap64Bit::UnmapPage(%#" B_PRIxADDR ")\n", address);
 
+	RecursiveLocker locker(fLock);
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
 	// Look up the page table for the virtual address.
-	uint64* entry = X86PagingMethod64Bit::PageTableEntryForAddress(
-		fPagingStructures->VirtualPML4(), address, fIsKernelMap,
-		false, NULL, fPageMapper, fMapCount);
-	if (entry == NULL)
-		return B_ENTRY_NOT_FOUND;
-
-	RecursiveLocker locker(fLock);
+	uint64* entry;
+	status_t error = _PageTableEntryForAddress(address, &entry);
+	if (error != B_OK)
+		return error;
 
 	uint64 oldEntry = X86PagingMethod64Bit::ClearTableEntry(entry);
 
@@ -402,26 +553,53 @@ X86VMTranslationMap64Bit::UnmapPages(VMArea* area, addr_t base, size_t size,
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
 	do {
-		uint64* pageTable = X86PagingMethod64Bit::PageTableForAddress(
+		// A large page that is unmapped as a whole is processed like a page
+		// table whose entries have all been cleared at once.
+		uint64 largeEntry = 0;
+		uint64* pageTable = NULL;
+
+		uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
 			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
 			NULL, fPageMapper, fMapCount);
-		if (pageTable == NULL) {
-			// Move on to the next page table.
-			start = ROUNDUP(start + 1, k64BitPageTableRange);
-			continue;
+		if (pde != NULL && is_large_page_entry(*pde)) {
+			if (start % k64BitPageTableRange == 0
+				&& end - start >= k64BitPageTableRange - 1) {
+				largeEntry = X86PagingMethod64Bit::ClearTableEntry(pde);
+				if ((largeEntry & kMappedLargePageFlag) != 0)
+					fLargePageCount--;
+				if ((largeEntry & X86_64_PDE_ACCESSED) != 0)
+					InvalidatePage(start);
+			} else if (_SplitLargePage(pde, start) != B_OK) {
+				// Can't happen, MapLargePage() has set aside a page table
+				// for every large page.
+				panic("X86VMTranslationMap64Bit::UnmapPages(): failed to "
+					"split the large page at %#" B_PRIxADDR, start);
+			}
+		}
+
+		if (largeEntry == 0) {
+			pageTable = X86PagingMethod64Bit::PageTableForAddress(
+				fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
+				NULL, fPageMapper, fMapCount);
+			if (pageTable == NULL) {
+				// Move on to the next page table.
+				start = ROUNDUP(start + 1, k64BitPageTableRange);
+				continue;
+			}
 		}
 
 		for (uint32 index = start / B_PAGE_SIZE % k64BitTableEntryCount;
 				index < k64BitTableEntryCount && start < end;
 				index++, start += B_PAGE_SIZE) {
-			uint64 oldEntry = X86PagingMethod64Bit::ClearTableEntry(
-				&pageTable[index]);
+			uint64 oldEntry = largeEntry != 0
+				? large_page_table_entry(largeEntry, index)
+				: X86PagingMethod64Bit::ClearTableEntry(&pageTable[index]);
 			if ((oldEntry & X86_64_PTE_PRESENT) == 0)
 				continue;
 
 			fMapCount--;
 
-			if ((oldEntry & X86_64_PTE_ACCESSED) != 0) {
+			if (largeEntry == 0 && (oldEntry & X86_64_PTE_ACCESSED) != 0) {
 				// Note, that we only need to invalidate the address, if the
 				// accessed flags was set, since only then the entry could have
 				// been in any TLB.
@@ -680,9 +858,44 @@ X86VMTranslationMap64Bit::Protect(addr_t start, addr_t end, uint32 attributes,
 	} else if ((attributes & B_KERNEL_WRITE_AREA) != 0)
 		newProtectionFlags = X86_64_PTE_WRITABLE;
 
+	uint64 newMemoryTypeFlags
+		= X86PagingMethod64Bit::MemoryTypeToPageTableEntryFlags(memoryType);
+
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
 	do {
+		uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
+			NULL, fPageMapper, fMapCount);
+		if (pde != NULL && is_large_page_entry(*pde)) {
+			if (start % k64BitPageTableRange == 0
+				&& end - start >= k64BitPageTableRange - 1) {
+				// The whole large page is affected, just update its entry.
+				uint64 entry = *pde;
+				uint64 oldEntry;
+				while (true) {
+					oldEntry = X86PagingMethod64Bit::TestAndSetTableEntry(pde,
+						(entry & ~(X86_64_PTE_PROTECTION_MASK
+								| X86_64_PTE_MEMORY_TYPE_MASK))
+							| newProtectionFlags | newMemoryTypeFlags,
+						entry);
+					if (oldEntry == entry)
+						break;
+					entry = oldEntry;
+				}
+
+				if ((oldEntry & X86_64_PDE_ACCESSED) != 0)
+					InvalidatePage(start);
+
+				start += k64BitPageTableRange;
+				continue;
+			}
+
+			status_t error = _SplitLargePage(pde, start);
+			if (error != B_OK)
+				return error;
+		}
+
 		uint64* pageTable = X86PagingMethod64Bit::PageTableForAddress(
 			fPagingStructures->VirtualPML4(), start, fIsKernelMap, false,
 			NULL, fPageMapper, fMapCount);
@@ -710,9 +923,7 @@ X86VMTranslationMap64Bit::Protect(addr_t start, addr_t end, uint32 attributes,
 					&pageTable[index],
 					(entry & ~(X86_64_PTE_PROTECTION_MASK
 							| X86_64_PTE_MEMORY_TYPE_MASK))
-						| newProtectionFlags
-						| X86PagingMethod64Bit::MemoryTypeToPageTableEntryFlags(
-							memoryType),
+						| newProtectionFlags | newMemoryTypeFlags,
 					entry);
 				if (oldEntry == entry)
 					break;
@@ -740,11 +951,10 @@ X86VMTranslationMap64Bit::ClearFlags(addr_t address, uint32 flags)
 
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
-	uint64* entry = X86PagingMethod64Bit::PageTableEntryForAddress(
-		fPagingStructures->VirtualPML4(), address, fIsKernelMap,
-		false, NULL, fPageMapper, fMapCount);
-	if (entry == NULL)
-		return B_OK;
+	uint64* entry;
+	status_t error = _PageTableEntryForAddress(address, &entry);
+	if (error != B_OK)
+		return error == B_ENTRY_NOT_FOUND ? B_OK : error;
 
 	uint64 flagsToClear = ((flags & PAGE_MODIFIED) ? X86_64_PTE_DIRTY : 0)
 		| ((flags & PAGE_ACCESSED) ? X86_64_PTE_ACCESSED : 0);
@@ -771,10 +981,8 @@ X86VMTranslationMap64Bit::ClearAccessedAndModified(VMArea* area, addr_t address,
 	RecursiveLocker locker(fLock);
 	ThreadCPUPinner pinner(thread_get_current_thread());
 
-	uint64* entry = X86PagingMethod64Bit::PageTableEntryForAddress(
-		fPagingStructures->VirtualPML4(), address, fIsKernelMap,
-		false, NULL, fPageMapper, fMapCount);
-	if (entry == NULL)
+	uint64* entry;
+	if (_PageTableEntryForAddress(address, &entry) != B_OK)
 		return false;
 
 	uint64 oldEntry;
@@ -843,3 +1051,94 @@ X86VMTranslationMap64Bit::PagingStructures() const
 {
 	return fPagingStructures;
 }
+
+
+/*!	Replaces the large page mapping \a pde by a page table mapping the same
+	range with regular pages, so that parts of it can be changed individually.
+	The page table is the one MapLargePage() has set aside for it.
+	The map must be locked and the thread pinned.
+*/
+status_t
+X86VMTranslationMap64Bit::_SplitLargePage(uint64* pde, addr_t address)
+{
+	TRACE("X86VMTranslationMap64Bit::_SplitLargePage(%#" B_PRIxADDR ")\n",
+		address);
+
+	vm_page* page = fSplitPageTables.RemoveHead();
+	if (page == NULL) {
+		// We can't wait for memory while holding the map lock, but may tap
+		// the VIP reserve for the single page.
+		vm_page_reservation reservation;
+		if (!vm_page_try_reserve_pages(&reservation, 1, VM_PRIORITY_VIP))
+			return B_NO_MEMORY;
+
+		page = vm_page_allocate_page(&reservation, PAGE_STATE_WIRED);
+		vm_page_unreserve_pages(&reservation);
+
+		DEBUG_PAGE_ACCESS_END(page);
+	} else
+		fSplitPageTableCount--;
+
+	phys_addr_t physicalPageTable
+		= (phys_addr_t)page->physical_page_number * B_PAGE_SIZE;
+	uint64* pageTable = (uint64*)fPageMapper->GetPageTableAt(
+		physicalPageTable);
+
+	// Fill in the page table and replace the large page with it. Other CPUs
+	// may set the accessed or dirty flag of the large page meanwhile, in which
+	// case we have to start over, lest they get lost.
+	uint64 largeEntry = *pde;
+	while (true) {
+		for (uint32 index = 0; index < k64BitTableEntryCount; index++) {
+			X86PagingMethod64Bit::SetTableEntry(&pageTable[index],
+				large_page_table_entry(largeEntry, index));
+		}
+
+		uint64 oldEntry = X86PagingMethod64Bit::TestAndSetTableEntry(pde,
+			(physicalPageTable & X86_64_PDE_ADDRESS_MASK)
+				| X86_64_PDE_PRESENT
+				| X86_64_PDE_WRITABLE
+				| X86_64_PDE_USER,
+			largeEntry);
+		if (oldEntry == largeEntry)
+			break;
+		largeEntry = oldEntry;
+	}
+
+	fMapCount++;
+	if ((largeEntry & kMappedLargePageFlag) != 0)
+		fLargePageCount--;
+
+	// Invalidating any address within the large page drops it from the TLB.
+	InvalidatePage(ROUNDDOWN(address, k64BitPageTableRange));
+
+	return B_OK;
+}
+
+
+/*!	Returns the page table entry for \a address in \a _entry, splitting the
+	large page mapping it first, if necessary.
+	Returns \c B_ENTRY_NOT_FOUND, if there is no page table for the address.
+	The map must be locked and the thread pinned.
+*/
+status_t
+X86VMTranslationMap64Bit::_PageTableEntryForAddress(addr_t address,
+	uint64** _entry)
+{
+	uint64* pde = X86PagingMethod64Bit::PageDirectoryEntryForAddress(
+		fPagingStructures->VirtualPML4(), address, fIsKernelMap, false, NULL,
+		fPageMapper, fMapCount);
+	if (pde == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	if (is_large_page_entry(*pde)) {
+		status_t error = _SplitLargePage(pde, address);
+		if (error != B_OK)
+			return error;
+	}
+
+	*_entry = X86PagingMethod64Bit::PageTableEntryForAddress(
+		fPagingStructures->VirtualPML4(), address, fIsKernelMap, false, NULL,
+		fPageMapper, fMapCount);
+	return *_entry != NULL ? B_OK : B_ENTRY_NOT_FOUND;
+}
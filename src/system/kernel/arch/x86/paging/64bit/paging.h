@@ -46,6 +46,7 @@
 #define X86_64_PDE_PAT					(1LL << 12)
 #define X86_64_PDE_NOT_EXECUTABLE		(1LL << 63)
 #define X86_64_PDE_ADDRESS_MASK			0x000ffffffffff000L
+#define X86_64_PDE_LARGE_ADDRESS_MASK	0x000fffffffe00000L
 
 // Page table entry bits.
 #define X86_64_PTE_PRESENT				(1LL << 0)
@@ -27,7 +27,9 @@
 X86VMTranslationMap::X86VMTranslationMap()
 	:
 	fPageMapper(NULL),
-	fInvalidPagesCount(0)
+	fInvalidPagesCount(0),
+	fBatchOwner(NULL),
+	fBatchDepth(0)
 {
 }
 
@@ -46,7 +48,8 @@ X86VMTranslationMap::Init(bool kernel)
 
 
 /*!	Acquires the map's recursive lock, and resets the invalidate pages counter
-	in case it's the first locking recursion.
+	in case it's the first locking recursion and no batch has left deferred
+	invalidations behind.
 */
 bool
 X86VMTranslationMap::Lock()
@@ -54,7 +57,7 @@ X86VMTranslationMap::Lock()
 	TRACE("%p->X86VMTranslationMap::Lock()\n", this);
 
 	recursive_lock_lock(&fLock);
-	if (recursive_lock_get_recursion(&fLock) == 1) {
+	if (recursive_lock_get_recursion(&fLock) == 1 && fBatchOwner == NULL) {
 		// we were the first one to grab the lock
 		TRACE("clearing invalidated page count\n");
 		fInvalidPagesCount = 0;
@@ -66,14 +69,15 @@ X86VMTranslationMap::Lock()
 
 /*!	Unlocks the map, and, if we are actually losing the recursive lock,
 	flush all pending changes of this map (ie. flush TLB caches as
-	needed).
+	needed), unless the calling thread is in the middle of a batch.
 */
 void
 X86VMTranslationMap::Unlock()
 {
 	TRACE("%p->X86VMTranslationMap::Unlock()\n", this);
 
-	if (recursive_lock_get_recursion(&fLock) == 1) {
+	if (recursive_lock_get_recursion(&fLock) == 1
+		&& fBatchOwner != thread_get_current_thread()) {
 		// we're about to release it for the last time
 		Flush();
 	}
@@ -82,6 +86,39 @@ X86VMTranslationMap::Unlock()
 }
 
 
+/*!	Only one thread at a time can batch operations on a map. If another one
+	does already, the calling thread's operations are simply flushed
+	individually.
+*/
+void
+X86VMTranslationMap::BeginBatch()
+{
+	Thread* thread = thread_get_current_thread();
+
+	Lock();
+
+	if (fBatchOwner == NULL)
+		fBatchOwner = thread;
+	if (fBatchOwner == thread)
+		fBatchDepth++;
+
+	Unlock();
+}
+
+
+void
+X86VMTranslationMap::EndBatch()
+{
+	Lock();
+
+	if (fBatchOwner == thread_get_current_thread() && --fBatchDepth == 0)
+		fBatchOwner = NULL;
+
+	Unlock();
+		// flushes the deferred invalidations, if the batch is over
+}
+
+
 addr_t
 X86VMTranslationMap::MappedSize() const
 {
@@ -17,6 +17,12 @@
 #define PAGE_INVALIDATE_CACHE_SIZE 64
 
 
+namespace BKernel {
+	struct Thread;
+}
+
+using BKernel::Thread;
+
 struct X86PagingStructures;
 class TranslationMapPhysicalPageMapper;
 
@@ -34,6 +40,9 @@ struct X86VMTranslationMap : VMTranslationMap {
 
 	virtual	void				Flush() final;
 
+	virtual	void				BeginBatch() final;
+	virtual	void				EndBatch() final;
+
 	virtual	X86PagingStructures* PagingStructures() const = 0;
 
 	inline	void				InvalidatePage(addr_t address);
@@ -43,6 +52,8 @@ protected:
 			int					fInvalidPagesCount;
 			addr_t				fInvalidPages[PAGE_INVALIDATE_CACHE_SIZE];
 			bool				fIsKernelMap;
+			Thread*				fBatchOwner;
+			int32				fBatchDepth;
 };
 
 
@@ -26,6 +26,10 @@
 
 #include "kernel_debug_config.h"
 
+#ifndef BUILDING_USERLAND_FS_SERVER
+#	include "IORequest.h"
+#endif
+
 
 // TODO: this is a naive but growing implementation to test the API:
 //	block reading/writing is not at all optimized for speed, it will
@@ -49,6 +53,10 @@
 static const bigtime_t kTransactionIdleTime = 2000000LL;
 	// a transaction is considered idle after 2 seconds of inactivity
 
+static const uint32 kBlockHashShardShift = 4;
+static const uint32 kBlockHashShards = 1 << kBlockHashShardShift;
+	// the block hash is split into this many shards, each with its own lock
+
 
 namespace {
 
@@ -130,12 +138,14 @@ struct BlockHash {
 
 	size_t HashKey(KeyType key) const
 	{
-		return key;
+		// the lower bits select the shard, and are the same for all blocks
+		// in a table
+		return key >> kBlockHashShardShift;
 	}
 
 	size_t Hash(ValueType* block) const
 	{
-		return block->block_number;
+		return HashKey(block->block_number);
 	}
 
 	bool Compare(KeyType key, ValueType* block) const
@@ -152,6 +162,82 @@ struct BlockHash {
 typedef BOpenHashTable<BlockHash> BlockTable;
 
 
+/*!	The block hash, split into shards with their own locks.
+	Every change of a shard is done with both the cache lock and the shard's
+	lock held (for writing), so that lookups with the cache lock held don't
+	need to lock the shard at all. Lookups without the cache lock (the fast
+	paths of block_cache_get_etc() and block_cache_put()) must hold the
+	shard's lock for reading instead.
+*/
+class ShardedBlockTable {
+public:
+	class Iterator {
+	public:
+		Iterator(const ShardedBlockTable* table)
+			:
+			fTable(table),
+			fShard(0),
+			fIterator(&table->fShards[0].table)
+		{
+			_Skip();
+		}
+
+		bool HasNext() const
+		{
+			return fIterator.HasNext();
+		}
+
+		cached_block* Next()
+		{
+			cached_block* block = fIterator.Next();
+			_Skip();
+			return block;
+		}
+
+	private:
+		void _Skip()
+		{
+			while (!fIterator.HasNext() && ++fShard < kBlockHashShards)
+				fIterator = BlockTable::Iterator(&fTable->fShards[fShard].table);
+		}
+
+		const ShardedBlockTable* fTable;
+		uint32				fShard;
+		BlockTable::Iterator fIterator;
+	};
+
+								ShardedBlockTable();
+								~ShardedBlockTable();
+
+			status_t			Init(size_t initialSize);
+
+			cached_block*		Lookup(off_t blockNumber) const
+									{ return _ShardFor(blockNumber)
+										.table.Lookup(blockNumber); }
+			void				Insert(cached_block* block);
+			void				Remove(cached_block* block);
+			cached_block*		Clear();
+
+			rw_lock&			ShardLock(off_t blockNumber)
+									{ return _ShardFor(blockNumber).lock; }
+
+private:
+	struct Shard {
+		BlockTable			table;
+		rw_lock				lock;
+	};
+
+			Shard&				_ShardFor(off_t blockNumber)
+									{ return fShards[blockNumber
+										& (kBlockHashShards - 1)]; }
+			const Shard&		_ShardFor(off_t blockNumber) const
+									{ return fShards[blockNumber
+										& (kBlockHashShards - 1)]; }
+
+			Shard				fShards[kBlockHashShards];
+};
+
+
 struct TransactionHash {
 	typedef int32				KeyType;
 	typedef	cache_transaction	ValueType;
@@ -170,7 +256,7 @@ typedef BOpenHashTable<TransactionHash> TransactionTable;
 
 
 struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
-	BlockTable*		hash;
+	ShardedBlockTable* hash;
 	mutex			lock;
 	int				fd;
 	off_t			max_blocks;
@@ -212,11 +298,14 @@ struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
 	void			RemoveUnusedBlocks(int32 count, int32 minSecondsOld = 0);
 	void			RemoveBlock(cached_block* block);
 	void			DiscardBlock(cached_block* block);
+	bool			MarkUsed(cached_block* block);
 
 private:
 	static void		_LowMemoryHandler(void* data, uint32 resources,
 						int32 level);
 	cached_block*	_GetUnusedBlock();
+	bool			_ReclaimUnusedBlock(block_list::Iterator& iterator,
+						cached_block* block);
 };
 
 struct cache_listener;
@@ -294,6 +383,36 @@ private:
 };
 
 
+class BlockPrefetcher {
+public:
+								BlockPrefetcher(block_cache* cache,
+									off_t blockNumber, size_t numBlocks);
+								~BlockPrefetcher();
+
+			status_t			Allocate();
+			void				ReadAsync();
+
+			size_t				NumAllocated() const { return fNumAllocated; }
+
+private:
+#ifndef BUILDING_USERLAND_FS_SERVER
+	static	status_t			_IOFinishedCallback(void* cookie,
+									io_request* request, status_t status,
+									bool partialTransfer,
+									generic_size_t bytesTransferred);
+#endif
+			void				_IOFinished(status_t status,
+									size_t bytesTransferred);
+
+private:
+			block_cache*		fCache;
+			off_t				fBlockNumber;
+			size_t				fNumRequested;
+			size_t				fNumAllocated;
+			cached_block**		fBlocks;
+};
+
+
 class TransactionLocking {
 public:
 	inline bool Lock(block_cache* cache)
@@ -1350,6 +1469,86 @@ BlockWriter::_CompareBlocks(const void* _blockA, const void* _blockB)
 }
 
 
+//	#pragma mark - ShardedBlockTable
+
+
+ShardedBlockTable::ShardedBlockTable()
+{
+	for (uint32 i = 0; i < kBlockHashShards; i++)
+		rw_lock_init(&fShards[i].lock, "block cache shard");
+}
+
+
+ShardedBlockTable::~ShardedBlockTable()
+{
+	for (uint32 i = 0; i < kBlockHashShards; i++)
+		rw_lock_destroy(&fShards[i].lock);
+}
+
+
+status_t
+ShardedBlockTable::Init(size_t initialSize)
+{
+	size_t shardSize = max_c(initialSize / kBlockHashShards,
+		BlockTable::kMinimumSize);
+
+	for (uint32 i = 0; i < kBlockHashShards; i++) {
+		status_t status = fShards[i].table.Init(shardSize);
+		if (status != B_OK)
+			return status;
+	}
+
+	return B_OK;
+}
+
+
+/*!	The cache must be locked. */
+void
+ShardedBlockTable::Insert(cached_block* block)
+{
+	Shard& shard = _ShardFor(block->block_number);
+
+	WriteLocker _(shard.lock);
+	shard.table.Insert(block);
+}
+
+
+/*!	The cache must be locked. */
+void
+ShardedBlockTable::Remove(cached_block* block)
+{
+	Shard& shard = _ShardFor(block->block_number);
+
+	WriteLocker _(shard.lock);
+	shard.table.Remove(block);
+}
+
+
+/*!	Removes all blocks from the table, and returns them as a list linked
+	via cached_block::next.
+	The cache must be locked.
+*/
+cached_block*
+ShardedBlockTable::Clear()
+{
+	cached_block* first = NULL;
+
+	for (uint32 i = 0; i < kBlockHashShards; i++) {
+		WriteLocker _(fShards[i].lock);
+
+		cached_block* block = fShards[i].table.Clear(true);
+		while (block != NULL) {
+			cached_block* next = block->next;
+			block->next = first;
+			first = block;
+			block = next;
+		}
+	}
+
+	return first;
+}
+
+
 //	#pragma mark - block_cache
 
 
@@ -1402,7 +1601,7 @@ block_cache::Init()
 	if (buffer_cache == NULL)
 		return B_NO_MEMORY;
 
-	hash = new BlockTable();
+	hash = new(std::nothrow) ShardedBlockTable();
 	if (hash == NULL || hash->Init(1024) != B_OK)
 		return B_NO_MEMORY;
 
@@ -1550,9 +1749,10 @@ block_cache::RemoveUnusedBlocks(int32 count, int32 minSecondsOld)
 		}
 
 		// remove block from lists
-		iterator.Remove();
-		unused_block_count--;
-		RemoveBlock(block);
+		if (!_ReclaimUnusedBlock(iterator, block))
+			continue;
+
+		FreeBlock(block);
 
 		if (--count <= 0)
 			break;
@@ -1650,12 +1850,10 @@ block_cache::_GetUnusedBlock()
 			BlockWriter::WriteBlock(this, block);
 
 		// remove block from lists
-		iterator.Remove();
-		unused_block_count--;
-		hash->Remove(block);
+		if (!_ReclaimUnusedBlock(iterator, block))
+			continue;
 
 		ASSERT(block->original_data == NULL && block->parent_data == NULL);
-		block->unused = false;
 
 		// TODO: see if compare data is handled correctly here!
 #if BLOCK_CACHE_DEBUG_CHANGED
@@ -1669,6 +1867,45 @@ block_cache::_GetUnusedBlock()
 }
 
 
+/*!	Removes the unused \a block the \a iterator points to from the unused
+	list and the hash, so that it can be freed or reused.
+	Since blocks in the unused list can be referenced without holding the
+	cache lock (see block_cache_get_etc()), this can fail; in that case the
+	block is only removed from the unused list, and put_cached_block() will
+	put it back once its last reference is gone.
+	The cache must be locked.
+*/
+bool
+block_cache::_ReclaimUnusedBlock(block_list::Iterator& iterator,
+	cached_block* block)
+{
+	iterator.Remove();
+	unused_block_count--;
+
+	if (!MarkUsed(block))
+		return false;
+
+	hash->Remove(block);
+	return true;
+}
+
+
+/*!	Clears the \a block's unused flag. Once this is done, no lockless
+	lookup can acquire a reference to the block anymore.
+	Returns \c true if the block wasn't referenced at that point.
+	The cache must be locked, and the caller is responsible for removing
+	the block from the unused list.
+*/
+bool
+block_cache::MarkUsed(cached_block* block)
+{
+	WriteLocker _(hash->ShardLock(block->block_number));
+
+	block->unused = false;
+	return block->ref_count == 0;
+}
+
+
 //	#pragma mark - private block functions
 
 
@@ -1699,23 +1936,43 @@ mark_block_unbusy_reading(block_cache* cache, cached_block* block)
 }
 
 
-/*!	Cache must be locked.
+/*!	Removes a busy_reading block that could not be read from the cache.
+	The block is gone from the hash before anyone waiting for it can run, so
+	they will look it up, and read it again.
+	Cache must be locked.
+*/
+static void
+remove_busy_reading_block(block_cache* cache, cached_block* block)
+{
+	bool notify = block->busy_reading_waiters;
+	cache->busy_reading_count--;
+	cache->RemoveBlock(block);
+
+	if (notify || (cache->busy_reading_waiters
+			&& cache->busy_reading_count == 0)) {
+		cache->busy_reading_waiters = false;
+		cache->busy_reading_condition.NotifyAll();
+	}
+}
+
+
+/*!	Waits until the busy_reading \a block has been read in.
+	If reading it failed, the block is removed from the cache, so the caller
+	must not access \a block anymore, but look it up again.
+	Cache must be locked.
 */
 static void
 wait_for_busy_reading_block(block_cache* cache, cached_block* block)
 {
-	while (block->busy_reading) {
-		// wait for at least the specified block to be read in
-		ConditionVariableEntry entry;
-		cache->busy_reading_condition.Add(&entry);
-		block->busy_reading_waiters = true;
+	ConditionVariableEntry entry;
+	cache->busy_reading_condition.Add(&entry);
+	block->busy_reading_waiters = true;
 
-		mutex_unlock(&cache->lock);
+	mutex_unlock(&cache->lock);
 
-		entry.Wait();
+	entry.Wait();
 
-		mutex_lock(&cache->lock);
-	}
+	mutex_lock(&cache->lock);
 }
 
 
@@ -1808,21 +2065,28 @@ put_cached_block(block_cache* cache, cached_block* block)
 		return;
 	}
 
-	if (--block->ref_count == 0
+	if (atomic_add(&block->ref_count, -1) == 1
 		&& block->transaction == NULL && block->previous_transaction == NULL) {
 		// This block is not used anymore, and not part of any transaction
 		block->is_writing = false;
 
 		if (block->discard) {
+			ASSERT(!block->unused);
 			cache->RemoveBlock(block);
 		} else {
-			// put this block in the list of unused blocks
-			ASSERT(!block->unused);
-			block->unused = true;
+			if (block->unused) {
+				// The block has been referenced from the unused list without
+				// the cache lock (see block_cache_get_etc()); requeue it to
+				// keep the list sorted by last access.
+				cache->unused_blocks.Remove(block);
+			} else {
+				block->unused = true;
+				cache->unused_block_count++;
+			}
 
+			// put this block in the list of unused blocks
 			ASSERT(block->original_data == NULL && block->parent_data == NULL);
 			cache->unused_blocks.Add(block);
-			cache->unused_block_count++;
 		}
 	}
 }
@@ -1878,6 +2142,9 @@ retry:
 		if (block == NULL)
 			return NULL;
 
+		if (readBlock)
+			mark_block_busy_reading(cache, block);
+
 		cache->hash->Insert(block);
 		*_allocated = true;
 	} else if (block->busy_reading) {
@@ -1888,7 +2155,7 @@ retry:
 
 	if (block->unused) {
 		//TRACE(("remove block %" B_PRIdOFF " from unused\n", blockNumber));
-		block->unused = false;
+		cache->MarkUsed(block);
 		cache->unused_blocks.Remove(block);
 		cache->unused_block_count--;
 	}
@@ -1897,7 +2164,6 @@ retry:
 		// read block into cache
 		int32 blockSize = cache->block_size;
 
-		mark_block_busy_reading(cache, block);
 		mutex_unlock(&cache->lock);
 
 		ssize_t bytesRead = read_pos(cache->fd, blockNumber * blockSize,
@@ -1905,7 +2171,7 @@ retry:
 
 		mutex_lock(&cache->lock);
 		if (bytesRead < blockSize) {
-			cache->RemoveBlock(block);
+			remove_busy_reading_block(cache, block);
 			TB(Error(cache, blockNumber, "read failed", bytesRead));
 
 			TRACE_ALWAYS(("could not read block %" B_PRIdOFF ": bytesRead: %zd, error: %s\n",
@@ -1917,13 +2183,78 @@ retry:
 		mark_block_unbusy_reading(cache, block);
 	}
 
-	block->ref_count++;
+	atomic_add(&block->ref_count, 1);
 	block->last_accessed = system_time() / 1000000L;
 
 	return block;
 }
 
 
+#if !BLOCK_CACHE_DEBUG_CHANGED
+
+/*!	Tries to acquire a reference to the block \a blockNumber without locking
+	the cache. This only works for blocks that are currently in the unused
+	list, and that are clean; the block stays in that list until its last
+	reference is released via put_cached_block().
+	Returns \c NULL if the slow path has to be taken.
+*/
+static cached_block*
+get_unused_cached_block_lockless(block_cache* cache, off_t blockNumber)
+{
+	if (blockNumber < 0 || blockNumber >= cache->max_blocks)
+		return NULL;
+
+	ReadLocker _(cache->hash->ShardLock(blockNumber));
+
+	// All of the flags tested here can only be changed while the block is
+	// not in the unused list, and the unused flag itself is only cleared with
+	// the shard lock held for writing.
+	cached_block* block = cache->hash->Lookup(blockNumber);
+	if (block == NULL || !block->unused || block->is_dirty || block->discard
+		|| block->busy_reading || block->busy_writing) {
+		return NULL;
+	}
+
+	atomic_add(&block->ref_count, 1);
+	block->last_accessed = system_time() / 1000000L;
+
+	TB(Get(cache, block));
+	return block;
+}
+
+
+/*!	Releases a reference to the block \a blockNumber without locking the
+	cache, as long as it's not the last one.
+	Returns \c false if the slow path has to be taken.
+*/
+static bool
+put_cached_block_lockless(block_cache* cache, off_t blockNumber)
+{
+	if (blockNumber < 0 || blockNumber >= cache->max_blocks)
+		return false;
+
+	ReadLocker _(cache->hash->ShardLock(blockNumber));
+
+	cached_block* block = cache->hash->Lookup(blockNumber);
+	if (block == NULL)
+		return false;
+
+	while (true) {
+		int32 refCount = block->ref_count;
+		if (refCount <= 1)
+			return false;
+
+		if (atomic_test_and_set(&block->ref_count, refCount - 1, refCount)
+				== refCount) {
+			TB(Put(cache, block));
+			return true;
+		}
+	}
+}
+
+#endif	// !BLOCK_CACHE_DEBUG_CHANGED
+
+
 /*!	Returns the writable block data for the requested blockNumber.
 	If \a cleared is true, the block is not read from disk; an empty block
 	is returned.
@@ -2077,6 +2408,162 @@ get_writable_cached_block(block_cache* cache, off_t blockNumber, off_t base,
 }
 
 
+//	#pragma mark - BlockPrefetcher
+
+
+BlockPrefetcher::BlockPrefetcher(block_cache* cache, off_t blockNumber,
+		size_t numBlocks)
+	:
+	fCache(cache),
+	fBlockNumber(blockNumber),
+	fNumRequested(numBlocks),
+	fNumAllocated(0),
+	fBlocks(NULL)
+{
+}
+
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+	delete[] fBlocks;
+}
+
+
+/*!	Inserts busy blocks for the blocks to read into the cache, beginning with
+	the first one, and stopping at the first block that is already there.
+	The cache must be locked.
+*/
+status_t
+BlockPrefetcher::Allocate()
+{
+	ASSERT_LOCKED_MUTEX(&fCache->lock);
+
+	fBlocks = new(std::nothrow) cached_block*[fNumRequested];
+	if (fBlocks == NULL)
+		return B_NO_MEMORY;
+
+	for (size_t i = 0; i < fNumRequested; i++) {
+		off_t blockNumber = fBlockNumber + i;
+		if (blockNumber >= fCache->max_blocks
+			|| fCache->hash->Lookup(blockNumber) != NULL)
+			break;
+
+		cached_block* block = fCache->NewBlock(blockNumber);
+		if (block == NULL)
+			break;
+
+		mark_block_busy_reading(fCache, block);
+		fCache->hash->Insert(block);
+
+		fBlocks[fNumAllocated++] = block;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Reads the allocated blocks with a single request; the cache must not be
+	locked. The prefetcher deletes itself when the blocks have been read.
+*/
+void
+BlockPrefetcher::ReadAsync()
+{
+	size_t blockSize = fCache->block_size;
+
+#ifndef BUILDING_USERLAND_FS_SERVER
+	IORequest* request = IORequest::Create(false);
+	generic_io_vec* vecs = new(std::nothrow) generic_io_vec[fNumAllocated];
+	if (request == NULL || vecs == NULL) {
+		delete request;
+		delete[] vecs;
+		_IOFinished(B_NO_MEMORY, 0);
+		return;
+	}
+
+	for (size_t i = 0; i < fNumAllocated; i++) {
+		vecs[i].base = (generic_addr_t)fBlocks[i]->current_data;
+		vecs[i].length = blockSize;
+	}
+
+	// the request has its own copy of the vecs
+	status_t status = request->Init(fBlockNumber * blockSize, vecs,
+		fNumAllocated, fNumAllocated * blockSize, false, B_DELETE_IO_REQUEST);
+	delete[] vecs;
+	if (status != B_OK) {
+		delete request;
+		_IOFinished(status, 0);
+		return;
+	}
+
+	request->SetFinishedCallback(&_IOFinishedCallback, this);
+
+	do_fd_io(fCache->fd, request);
+		// the callback is also invoked on failure
+#else
+	// there is no asynchronous I/O in userland
+	status_t status = B_OK;
+	size_t bytesRead = 0;
+	for (size_t i = 0; i < fNumAllocated; i++) {
+		ssize_t bytes = read_pos(fCache->fd, (fBlockNumber + i) * blockSize,
+			fBlocks[i]->current_data, blockSize);
+		if (bytes < (ssize_t)blockSize) {
+			status = bytes < 0 ? errno : B_IO_ERROR;
+			break;
+		}
+		bytesRead += blockSize;
+	}
+
+	_IOFinished(status, bytesRead);
+#endif
+}
+
+
+#ifndef BUILDING_USERLAND_FS_SERVER
+/*static*/ status_t
+BlockPrefetcher::_IOFinishedCallback(void* cookie, io_request* request,
+	status_t status, bool partialTransfer, generic_size_t bytesTransferred)
+{
+	((BlockPrefetcher*)cookie)->_IOFinished(status, bytesTransferred);
+	return B_OK;
+}
+#endif
+
+
+void
+BlockPrefetcher::_IOFinished(status_t status, size_t bytesTransferred)
+{
+	MutexLocker locker(&fCache->lock);
+
+	size_t blocksRead = status == B_OK
+		? bytesTransferred / fCache->block_size : 0;
+
+	for (size_t i = 0; i < fNumAllocated; i++) {
+		cached_block* block = fBlocks[i];
+
+		if (i >= blocksRead) {
+			// Anyone waiting for the block will look it up, and read it
+			// again; the block must be gone from the hash before they run.
+			TB(Error(fCache, block->block_number, "prefetch failed", status));
+			remove_busy_reading_block(fCache, block);
+			continue;
+		}
+
+		mark_block_unbusy_reading(fCache, block);
+
+		TB(Read(fCache, block));
+
+		// nobody could have gotten a reference to the block yet
+		block->last_accessed = system_time() / 1000000L;
+		block->unused = true;
+		fCache->unused_block_count++;
+		fCache->unused_blocks.Add(block);
+	}
+
+	locker.Unlock();
+	delete this;
+}
+
+
 #if DEBUG_BLOCK_CACHE
 
 
@@ -2252,7 +2739,7 @@ dump_cache(int argc, char** argv)
 	uint32 count = 0;
 	uint32 dirty = 0;
 	uint32 discarded = 0;
-	BlockTable::Iterator iterator(cache->hash);
+	ShardedBlockTable::Iterator iterator(cache->hash);
 	while (iterator.HasNext()) {
 		cached_block* block = iterator.Next();
 		if (showBlocks)
@@ -2543,7 +3030,7 @@ block_notifier_and_writer(void* /*data*/)
 			if (cache->num_dirty_blocks) {
 				// This cache is not using transactions, we'll scan the blocks
 				// directly
-				BlockTable::Iterator iterator(cache->hash);
+				ShardedBlockTable::Iterator iterator(cache->hash);
 
 				while (iterator.HasNext()) {
 					cached_block* block = iterator.Next();
@@ -3324,7 +3811,7 @@ block_cache_delete(void* _cache, bool allowWrites)
 
 	// free all blocks
 
-	cached_block* block = cache->hash->Clear(true);
+	cached_block* block = cache->hash->Clear();
 	while (block != NULL) {
 		cached_block* next = block->next;
 		cache->FreeBlock(block);
@@ -3375,7 +3862,7 @@ block_cache_sync(void* _cache)
 	MutexLocker locker(&cache->lock);
 
 	BlockWriter writer(cache);
-	BlockTable::Iterator iterator(cache->hash);
+	ShardedBlockTable::Iterator iterator(cache->hash);
 
 	while (iterator.HasNext()) {
 		cached_block* block = iterator.Next();
@@ -3432,6 +3919,49 @@ block_cache_sync_etc(void* _cache, off_t blockNumber, size_t numBlocks)
 }
 
 
+/*!	Starts reading up to \a _numBlocks blocks beginning with \a blockNumber
+	into the cache, without waiting for them. It stops at the first block that
+	is already cached; \a _numBlocks is set to the number of blocks that are
+	actually read.
+	This is only a hint, and nothing is read when memory is getting low.
+*/
+status_t
+block_cache_prefetch(void* _cache, off_t blockNumber, size_t* _numBlocks)
+{
+	block_cache* cache = (block_cache*)_cache;
+	size_t numBlocks = *_numBlocks;
+	*_numBlocks = 0;
+
+	if (blockNumber < 0 || blockNumber >= cache->max_blocks)
+		return B_BAD_VALUE;
+	if (numBlocks == 0
+		|| low_resource_state(B_KERNEL_RESOURCE_PAGES
+			| B_KERNEL_RESOURCE_MEMORY | B_KERNEL_RESOURCE_ADDRESS_SPACE)
+				!= B_NO_LOW_RESOURCE) {
+		return B_OK;
+	}
+
+	BlockPrefetcher* prefetcher = new(std::nothrow) BlockPrefetcher(cache,
+		blockNumber, numBlocks);
+	if (prefetcher == NULL)
+		return B_NO_MEMORY;
+
+	MutexLocker locker(&cache->lock);
+
+	status_t status = prefetcher->Allocate();
+	if (status != B_OK || prefetcher->NumAllocated() == 0) {
+		delete prefetcher;
+		return status;
+	}
+
+	*_numBlocks = prefetcher->NumAllocated();
+	locker.Unlock();
+
+	prefetcher->ReadAsync();
+	return B_OK;
+}
+
+
 /*!	Discards a block from the current transaction or from the cache.
 	You have to call this function when you no longer use a block, ie. when it
 	might be reclaimed by the file cache in order to make sure they won't
@@ -3468,7 +3998,15 @@ block_cache_discard(void* _cache, off_t blockNumber, size_t numBlocks)
 		if (block->unused) {
 			cache->unused_blocks.Remove(block);
 			cache->unused_block_count--;
-			cache->RemoveBlock(block);
+
+			if (cache->MarkUsed(block)) {
+				cache->RemoveBlock(block);
+				continue;
+			}
+
+			// The block is still referenced, and will be removed when its
+			// last reference is gone.
+			block->discard = true;
 		} else {
 			if (block->transaction != NULL && block->parent_data != NULL
 				&& block->parent_data != block->current_data) {
@@ -3551,6 +4089,14 @@ const void*
 block_cache_get_etc(void* _cache, off_t blockNumber, off_t base, off_t length)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	cached_block* cachedBlock = get_unused_cached_block_lockless(cache,
+		blockNumber);
+	if (cachedBlock != NULL)
+		return cachedBlock->current_data;
+#endif
+
 	MutexLocker locker(&cache->lock);
 	bool allocated;
 
@@ -3611,6 +4157,12 @@ void
 block_cache_put(void* _cache, off_t blockNumber)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	if (put_cached_block_lockless(cache, blockNumber))
+		return;
+#endif
+
 	MutexLocker locker(&cache->lock);
 
 	put_cached_block(cache, blockNumber);
@@ -14,6 +14,7 @@
 #include <fs_cache.h>
 
 #include <condition_variable.h>
+#include <debug.h>
 #include <file_cache.h>
 #include <generic_syscall.h>
 #include <low_resource_manager.h>
@@ -42,6 +43,22 @@
 #define BYPASS_IO_SIZE		65536
 #define LAST_ACCESSES		3
 
+// readahead engine
+#define READAHEAD_STREAMS		4
+#define READAHEAD_MIN_PAGES		4	// 16 kB
+#define READAHEAD_MAX_PAGES		256	// 1 MB
+
+struct readahead_stream {
+	off_t			next_offset;
+		// where we expect the next read of this stream to start
+	off_t			ahead_end;
+		// end of the range that has been read ahead already
+	uint32			window;
+		// current readahead window in pages, 0 until the stream has been
+		// detected as sequential
+	bigtime_t		last_used;
+};
+
 struct file_cache_ref {
 	VMCache			*cache;
 	struct vnode	*vnode;
@@ -52,6 +69,10 @@ struct file_cache_ref {
 	int32			last_access_index;
 	uint16			disabled_count;
 
+	// the readahead state is protected by the cache lock
+	readahead_stream streams[READAHEAD_STREAMS];
+	file_cache_readahead_stats readahead_stats;
+
 	inline void SetLastAccess(int32 index, off_t access, bool isWrite)
 	{
 		// we remember writes as negative offsets
@@ -113,6 +134,8 @@ static const size_t kZeroVecSize = kZeroVecCount * B_PAGE_SIZE;
 static phys_addr_t sZeroPage;	// physical address
 static generic_io_vec sZeroVecs[kZeroVecCount];
 
+static file_cache_readahead_stats sReadaheadStats;
+
 
 //	#pragma mark -
 
@@ -282,6 +305,232 @@ push_access(file_cache_ref* ref, off_t offset, generic_size_t bytes,
 }
 
 
+/*!	Starts asynchronous reads for all pages in the given range that are not
+	yet in the cache.
+	The caller must hold a reference to the cache, and must not have it
+	locked. The pages needed must already have been reserved.
+	Returns the number of pages for which I/O has been started.
+*/
+static size_t
+precache_range(file_cache_ref* ref, off_t offset, size_t size,
+	vm_page_reservation* reservation)
+{
+	VMCache* cache = ref->cache;
+	size_t bytesToRead = 0;
+	size_t pagesRead = 0;
+	off_t lastOffset = offset;
+
+	cache->Lock();
+
+	while (true) {
+		// check if this page is already in memory
+		if (size > 0) {
+			vm_page* page = cache->LookupPage(offset);
+
+			offset += B_PAGE_SIZE;
+			size -= B_PAGE_SIZE;
+
+			if (page == NULL) {
+				bytesToRead += B_PAGE_SIZE;
+				continue;
+			}
+		}
+		if (bytesToRead != 0) {
+			// read the part before the current page (or the end of the request)
+			PrecacheIO* io = new(std::nothrow) PrecacheIO(ref, lastOffset,
+				bytesToRead);
+			if (io == NULL || io->Prepare(reservation) != B_OK) {
+				delete io;
+				break;
+			}
+
+			// we must not have the cache locked during I/O
+			cache->Unlock();
+			io->ReadAsync();
+			cache->Lock();
+
+			pagesRead += bytesToRead / B_PAGE_SIZE;
+			bytesToRead = 0;
+		}
+
+		if (size == 0) {
+			// we have reached the end of the request
+			break;
+		}
+
+		lastOffset = offset;
+	}
+
+	cache->Unlock();
+	return pagesRead;
+}
+
+
+static inline void
+readahead_count_wasted(file_cache_ref* ref, readahead_stream& stream)
+{
+	if (stream.ahead_end <= stream.next_offset)
+		return;
+
+	uint64 wasted = (PAGE_ALIGN(stream.ahead_end)
+		- PAGE_ALIGN(stream.next_offset)) / B_PAGE_SIZE;
+	ref->readahead_stats.pages_wasted += wasted;
+	atomic_add64((int64*)&sReadaheadStats.pages_wasted, wasted);
+}
+
+
+/*!	Finds the stream the read access at \a offset belongs to. If there is
+	none, the least recently used stream is recycled for it.
+	The cache must be locked.
+*/
+static readahead_stream&
+readahead_find_stream(file_cache_ref* ref, off_t offset, bool& _isNew)
+{
+	readahead_stream* oldest = &ref->streams[0];
+
+	for (int32 i = 0; i < READAHEAD_STREAMS; i++) {
+		readahead_stream& stream = ref->streams[i];
+		if (stream.last_used == 0) {
+			oldest = &stream;
+			continue;
+		}
+
+		// Accept accesses that continue the stream, even if they skip
+		// a bit of it (as long as they stay in the window we've read ahead).
+		off_t windowEnd = max_c(stream.ahead_end, stream.next_offset
+			+ (off_t)max_c(stream.window, READAHEAD_MIN_PAGES) * B_PAGE_SIZE);
+		if (offset >= ROUNDDOWN(stream.next_offset, B_PAGE_SIZE)
+			&& offset <= windowEnd) {
+			_isNew = false;
+			return stream;
+		}
+
+		if (oldest->last_used != 0 && stream.last_used < oldest->last_used)
+			oldest = &stream;
+	}
+
+	// recycle the oldest stream
+	if (oldest->last_used != 0)
+		readahead_count_wasted(ref, *oldest);
+
+	oldest->next_offset = offset;
+	oldest->ahead_end = offset;
+	oldest->window = 0;
+
+	ref->readahead_stats.streams++;
+	atomic_add64((int64*)&sReadaheadStats.streams, 1);
+
+	_isNew = true;
+	return *oldest;
+}
+
+
+/*!	Feeds a read access into the readahead engine of the file cache ref, and
+	starts asynchronous reads ahead of the stream the access belongs to, if
+	that stream looks sequential.
+	The readahead window of a stream grows every time it is continued, and
+	shrinks again when memory gets tight, or when the read ahead pages could
+	not be reserved.
+	The cache must not be locked when calling this function.
+*/
+static void
+readahead_access(file_cache_ref* ref, off_t offset, size_t size)
+{
+	VMCache* cache = ref->cache;
+	off_t fileSize;
+	off_t readOffset = 0;
+	size_t readSize = 0;
+	readahead_stream* stream;
+
+	{
+		AutoLocker<VMCache> locker(cache);
+		fileSize = cache->virtual_end;
+
+		bool isNew;
+		stream = &readahead_find_stream(ref, offset, isNew);
+
+		off_t end = offset + size;
+		stream->last_used = system_time();
+
+		if (!isNew) {
+			// count the pages that have been read ahead for this access
+			off_t hitStart = max_c(ROUNDDOWN(offset, B_PAGE_SIZE),
+				PAGE_ALIGN(stream->next_offset));
+			off_t hitEnd = min_c(PAGE_ALIGN(end), stream->ahead_end);
+			if (hitEnd > hitStart && stream->window > 0) {
+				uint64 hits = (hitEnd - hitStart) / B_PAGE_SIZE;
+				ref->readahead_stats.pages_hit += hits;
+				atomic_add64((int64*)&sReadaheadStats.pages_hit, hits);
+			}
+
+			// ramp up the window
+			uint32 requestPages = PAGE_ALIGN(size) / B_PAGE_SIZE;
+			if (stream->window == 0)
+				stream->window = max_c(READAHEAD_MIN_PAGES, 2 * requestPages);
+			else
+				stream->window = min_c(2 * stream->window, READAHEAD_MAX_PAGES);
+		}
+
+		if (low_resource_state(B_KERNEL_RESOURCE_PAGES)
+				!= B_NO_LOW_RESOURCE) {
+			// ramp down the window
+			stream->window /= 2;
+		}
+
+		stream->next_offset = end;
+		if (stream->ahead_end < end)
+			stream->ahead_end = end;
+
+		// Only read ahead when the stream is about to run out of data that
+		// has already been read ahead (asynchronous trigger point).
+		off_t windowSize = (off_t)stream->window * B_PAGE_SIZE;
+		if (stream->window == 0 || stream->ahead_end >= fileSize
+			|| stream->ahead_end - end >= windowSize / 2) {
+			return;
+		}
+
+		readOffset = PAGE_ALIGN(stream->ahead_end);
+		off_t readEnd = min_c(readOffset + windowSize, fileSize);
+		if (readEnd <= readOffset)
+			return;
+
+		readSize = PAGE_ALIGN(readEnd - readOffset);
+		stream->ahead_end = readOffset + readSize;
+
+		// we hold a reference to the cache on behalf of the I/O below
+		cache->AcquireRefLocked();
+	}
+
+	size_t reservePages = readSize / B_PAGE_SIZE;
+	vm_page_reservation reservation;
+	size_t pagesRead = 0;
+	if (vm_page_try_reserve_pages(&reservation, reservePages,
+			VM_PRIORITY_USER)) {
+		pagesRead = precache_range(ref, readOffset, readSize, &reservation);
+		vm_page_unreserve_pages(&reservation);
+	}
+
+	AutoLocker<VMCache> locker(cache);
+
+	if (pagesRead == 0 && stream->ahead_end == readOffset + (off_t)readSize) {
+		// We could not read anything ahead, either because there was no
+		// memory, or because the pages were already cached. In the former
+		// case, back off a bit.
+		if (cache->LookupPage(readOffset) == NULL) {
+			stream->ahead_end = readOffset;
+			stream->window /= 2;
+		}
+	} else if (pagesRead > 0) {
+		ref->readahead_stats.requests++;
+		ref->readahead_stats.pages_read_ahead += pagesRead;
+		atomic_add64((int64*)&sReadaheadStats.requests, 1);
+		atomic_add64((int64*)&sReadaheadStats.pages_read_ahead, pagesRead);
+	}
+
+	cache->ReleaseRefLocked();
+}
+
+
 static void
 reserve_pages(file_cache_ref* ref, vm_page_reservation* reservation,
 	size_t reservePages, bool isWrite)
@@ -930,12 +1179,72 @@ file_cache_control(const char* subsystem, uint32 function, void* buffer,
 
 			return status;
 		}
+
+		case CACHE_GET_READAHEAD_STATS:
+		{
+			if (buffer == NULL || !IS_USER_ADDRESS(buffer)
+				|| bufferSize != sizeof(file_cache_readahead_stats))
+				return B_BAD_VALUE;
+
+			return user_memcpy(buffer, &sReadaheadStats,
+				sizeof(file_cache_readahead_stats));
+		}
 	}
 
 	return B_BAD_HANDLER;
 }
 
 
+static void
+print_readahead_stats(const file_cache_readahead_stats& stats)
+{
+	kprintf("  streams:           %" B_PRIu64 "\n", stats.streams);
+	kprintf("  requests:          %" B_PRIu64 "\n", stats.requests);
+	kprintf("  pages read ahead:  %" B_PRIu64 "\n", stats.pages_read_ahead);
+	kprintf("  pages hit:         %" B_PRIu64 "\n", stats.pages_hit);
+	kprintf("  pages wasted:      %" B_PRIu64 "\n", stats.pages_wasted);
+}
+
+
+static int
+dump_readahead(int argc, char** argv)
+{
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "--help"))) {
+		print_debugger_command_usage(argv[0]);
+		return 0;
+	}
+
+	if (argc == 1) {
+		kprintf("file cache readahead, all files:\n");
+		print_readahead_stats(sReadaheadStats);
+		return 0;
+	}
+
+	file_cache_ref* ref = (file_cache_ref*)parse_expression(argv[1]);
+	if (ref == NULL) {
+		kprintf("invalid file cache ref!\n");
+		return 0;
+	}
+
+	kprintf("file cache ref %p, cache %p, vnode %p\n", ref, ref->cache,
+		ref->vnode);
+	print_readahead_stats(ref->readahead_stats);
+
+	for (int32 i = 0; i < READAHEAD_STREAMS; i++) {
+		readahead_stream& stream = ref->streams[i];
+		if (stream.last_used == 0)
+			continue;
+
+		kprintf("  stream %" B_PRId32 ": next %" B_PRIdOFF ", ahead end %"
+			B_PRIdOFF ", window %" B_PRIu32 " pages, last used %" B_PRId64
+			"\n", i, stream.next_offset, stream.ahead_end, stream.window,
+			stream.last_used);
+	}
+
+	return 0;
+}
+
+
 //	#pragma mark - private kernel API
 
 
@@ -969,53 +1278,12 @@ cache_prefetch_vnode(struct vnode* vnode, off_t offset, size_t size)
 		return;
 	}
 
-	size_t bytesToRead = 0;
-	off_t lastOffset = offset;
-
 	vm_page_reservation reservation;
 	vm_page_reserve_pages(&reservation, reservePages, VM_PRIORITY_USER);
 
-	cache->Lock();
-
-	while (true) {
-		// check if this page is already in memory
-		if (size > 0) {
-			vm_page* page = cache->LookupPage(offset);
-
-			offset += B_PAGE_SIZE;
-			size -= B_PAGE_SIZE;
-
-			if (page == NULL) {
-				bytesToRead += B_PAGE_SIZE;
-				continue;
-			}
-		}
-		if (bytesToRead != 0) {
-			// read the part before the current page (or the end of the request)
-			PrecacheIO* io = new(std::nothrow) PrecacheIO(ref, lastOffset,
-				bytesToRead);
-			if (io == NULL || io->Prepare(&reservation) != B_OK) {
-				delete io;
-				break;
-			}
-
-			// we must not have the cache locked during I/O
-			cache->Unlock();
-			io->ReadAsync();
-			cache->Lock();
-
-			bytesToRead = 0;
-		}
+	precache_range(ref, offset, size, &reservation);
 
-		if (size == 0) {
-			// we have reached the end of the request
-			break;
-		}
-
-		lastOffset = offset;
-	}
-
-	cache->ReleaseRefAndUnlock();
+	cache->ReleaseRef();
 	vm_page_unreserve_pages(&reservation);
 }
 
@@ -1037,6 +1305,21 @@ cache_prefetch(dev_t mountID, ino_t vnodeID, off_t offset, size_t size)
 }
 
 
+/*!	Called by the vnode cache after a page fault has read \a size bytes at
+	\a offset into the cache. Accesses through file mappings don't go through
+	file_cache_read(), so this feeds them into the readahead engine instead.
+	The cache must not be locked.
+*/
+extern "C" void
+file_cache_fault_read(file_cache_ref* ref, off_t offset, size_t size)
+{
+	if (ref->disabled_count > 0)
+		return;
+
+	readahead_access(ref, offset, size);
+}
+
+
 extern "C" void
 cache_node_opened(struct vnode* vnode, int32 fdType, VMCache* cache,
 	dev_t mountID, ino_t parentID, ino_t vnodeID, const char* name)
@@ -1113,6 +1396,13 @@ file_cache_init(void)
 	}
 
 	register_generic_syscall(CACHE_SYSCALLS, file_cache_control, 1, 0);
+
+	add_debugger_command_etc("readahead", &dump_readahead,
+		"Dumps file cache readahead statistics.",
+		"[<file-cache-ref>]\n"
+		"Prints the readahead statistics of all files, or the statistics\n"
+		"and access streams of the specified file cache.\n"
+		"  <file-cache-ref>  - pointer to the file_cache_ref.\n", 0);
 	return B_OK;
 }
 
@@ -1133,6 +1423,8 @@ file_cache_create(dev_t mountID, ino_t vnodeID, off_t size)
 	memset(ref->last_access, 0, sizeof(ref->last_access));
 	ref->last_access_index = 0;
 	ref->disabled_count = 0;
+	memset(ref->streams, 0, sizeof(ref->streams));
+	memset(&ref->readahead_stats, 0, sizeof(ref->readahead_stats));
 
 	// TODO: delay VMCache creation until data is
 	//	requested/written for the first time? Listing lots of
@@ -1173,6 +1465,14 @@ file_cache_delete(void* _cacheRef)
 
 	TRACE(("file_cache_delete(ref = %p)\n", ref));
 
+	ref->cache->Lock();
+	for (int32 i = 0; i < READAHEAD_STREAMS; i++) {
+		if (ref->streams[i].last_used != 0)
+			readahead_count_wasted(ref, ref->streams[i]);
+	}
+	((VMVnodeCache*)ref->cache)->SetFileCacheRef(NULL);
+	ref->cache->Unlock();
+
 	ref->cache->ReleaseRef();
 	delete ref;
 }
@@ -1299,7 +1599,12 @@ file_cache_read(void* _cacheRef, void* cookie, off_t offset, void* buffer,
 		return error;
 	}
 
-	return cache_io(ref, cookie, offset, (addr_t)buffer, _size, false);
+	status_t status = cache_io(ref, cookie, offset, (addr_t)buffer, _size,
+		false);
+	if (status == B_OK && *_size > 0)
+		readahead_access(ref, offset, *_size);
+
+	return status;
 }
 
 
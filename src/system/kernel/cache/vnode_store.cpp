@@ -56,11 +56,18 @@ VMVnodeCache::Read(off_t offset, const generic_io_vec* vecs, size_t count,
 	if (offset + (off_t)bytesEnd > virtual_end)
 		bytesEnd = virtual_end - offset;
 
-	// If the request could be filled completely, or an error occured,
-	// we're done here
-	if (status != B_OK || bytesUntouched == bytesEnd)
+	if (status != B_OK)
 		return status;
 
+	// We're only asked to read pages in on page faults, which bypass the
+	// file cache's read path, so let its readahead know about them here.
+	if (fFileCacheRef != NULL)
+		file_cache_fault_read(fFileCacheRef, offset, bytesEnd);
+
+	// If the request could be filled completely, we're done here
+	if (bytesUntouched == bytesEnd)
+		return B_OK;
+
 	bytesUntouched -= bytesEnd;
 
 	// Clear out any leftovers that were not touched by the above read - we're
@@ -55,6 +55,8 @@ EntryCache::EntryCache()
 	rw_lock_init(&fLock, "entry cache");
 
 	new(&fEntries) EntryTable;
+
+	memset(&fStats, 0, sizeof(fStats));
 }
 
 
@@ -96,6 +98,11 @@ EntryCache::Add(ino_t dirID, const char* name, ino_t nodeID, bool missing)
 
 	WriteLocker _(fLock);
 
+	if (missing)
+		fStats.negative_additions++;
+	else
+		fStats.additions++;
+
 	EntryCacheEntry* entry = fEntries.Lookup(key);
 	if (entry != NULL) {
 		entry->node_id = nodeID;
@@ -139,18 +146,31 @@ EntryCache::Remove(ino_t dirID, const char* name)
 	if (entry == NULL)
 		return B_ENTRY_NOT_FOUND;
 
-	fEntries.Remove(entry);
+	fStats.removals++;
+	_Remove(entry);
 
-	if (entry->index >= 0) {
-		// remove the entry from its generation and delete it
-		fGenerations[entry->generation].entries[entry->index] = NULL;
-		free(entry);
-	} else {
-		// We can't free it, since another thread is about to try to move it
-		// to another generation. We mark it removed and the other thread will
-		// take care of deleting it.
-		entry->index = kEntryRemoved;
-	}
+	return B_OK;
+}
+
+
+/*!	Removes the entry for \a name in the directory \a dirID, but only if it
+	is a negative one. This is used to invalidate negative entries when
+	the entry is created, or renamed to, while the file system does not
+	necessarily update the cache itself.
+*/
+status_t
+EntryCache::RemoveMissing(ino_t dirID, const char* name)
+{
+	EntryCacheKey key(dirID, name);
+
+	WriteLocker writeLocker(fLock);
+
+	EntryCacheEntry* entry = fEntries.Lookup(key);
+	if (entry == NULL || !entry->missing)
+		return B_ENTRY_NOT_FOUND;
+
+	fStats.invalidations++;
+	_Remove(entry);
 
 	return B_OK;
 }
@@ -164,10 +184,15 @@ EntryCache::Lookup(ino_t dirID, const char* name, ino_t& _nodeID,
 
 	ReadLocker readLocker(fLock);
 
+	atomic_add64((int64*)&fStats.lookups, 1);
+
 	EntryCacheEntry* entry = fEntries.Lookup(key);
 	if (entry == NULL)
 		return false;
 
+	atomic_add64(entry->missing
+		? (int64*)&fStats.negative_hits : (int64*)&fStats.hits, 1);
+
 	int32 oldGeneration = atomic_get_and_set(&entry->generation,
 			fCurrentGeneration);
 	if (oldGeneration == fCurrentGeneration || entry->index < 0) {
@@ -211,6 +236,18 @@ EntryCache::Lookup(ino_t dirID, const char* name, ino_t& _nodeID,
 }
 
 
+/*!	Returns a snapshot of the cache's statistics. Since these are just
+	counters, this doesn't lock the cache, and can be used from the kernel
+	debugger, too.
+*/
+void
+EntryCache::GetStats(entry_cache_stats& stats)
+{
+	stats = fStats;
+	stats.entries = fEntries.CountElements();
+}
+
+
 const char*
 EntryCache::DebugReverseLookup(ino_t nodeID, ino_t& _dirID)
 {
@@ -227,6 +264,24 @@ EntryCache::DebugReverseLookup(ino_t nodeID, ino_t& _dirID)
 }
 
 
+void
+EntryCache::_Remove(EntryCacheEntry* entry)
+{
+	fEntries.Remove(entry);
+
+	if (entry->index >= 0) {
+		// remove the entry from its generation and delete it
+		fGenerations[entry->generation].entries[entry->index] = NULL;
+		free(entry);
+	} else {
+		// We can't free it, since another thread is about to try to move it
+		// to another generation. We mark it removed and the other thread will
+		// take care of deleting it.
+		entry->index = kEntryRemoved;
+	}
+}
+
+
 void
 EntryCache::_AddEntryToCurrentGeneration(EntryCacheEntry* entry)
 {
@@ -11,6 +11,7 @@
 #include <util/AutoLock.h>
 #include <util/OpenHashTable.h>
 #include <util/StringHash.h>
+#include <vfs_defs.h>
 
 
 struct EntryCacheKey {
@@ -91,10 +92,13 @@ public:
 									ino_t nodeID, bool missing);
 
 			status_t			Remove(ino_t dirID, const char* name);
+			status_t			RemoveMissing(ino_t dirID, const char* name);
 
 			bool				Lookup(ino_t dirID, const char* name,
 									ino_t& nodeID, bool& missing);
 
+			void				GetStats(entry_cache_stats& stats);
+
 			const char*			DebugReverseLookup(ino_t nodeID, ino_t& _dirID);
 
 private:
@@ -106,12 +110,16 @@ private:
 private:
 			void				_AddEntryToCurrentGeneration(
 									EntryCacheEntry* entry);
+			void				_Remove(EntryCacheEntry* entry);
 
 private:
 			rw_lock				fLock;
 			EntryTable			fEntries;
 			EntryCacheGeneration fGenerations[kGenerationCount];
 			int32				fCurrentGeneration;
+			entry_cache_stats	fStats;
+				// the lookup counters are updated atomically, all others
+				// are protected by the write lock
 };
 
 
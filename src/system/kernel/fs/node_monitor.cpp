@@ -1152,6 +1152,8 @@ status_t
 notify_entry_created(dev_t device, ino_t directory, const char *name,
 	ino_t node)
 {
+	vfs_entry_cache_invalidate_missing(device, directory, name);
+
 	return sNodeMonitorService.NotifyEntryCreatedOrRemoved(B_ENTRY_CREATED,
 		device, directory, name, node);
 }
@@ -1191,6 +1193,8 @@ notify_entry_moved(dev_t device, ino_t fromDirectory,
 	const char *fromName, ino_t toDirectory, const char *toName,
 	ino_t node)
 {
+	vfs_entry_cache_invalidate_missing(device, toDirectory, toName);
+
 	return sNodeMonitorService.NotifyEntryMoved(device, fromDirectory,
 		fromName, toDirectory, toName, node);
 }
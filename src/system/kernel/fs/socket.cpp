@@ -17,12 +17,14 @@
 
 #include <syscall_utils.h>
 
+#include <DPC.h>
 #include <fd.h>
 #include <kernel.h>
 #include <lock.h>
 #include <syscall_restart.h>
 #include <util/AutoLock.h>
 #include <vfs.h>
+#include <vm/vm.h>
 
 #include <net_stack_interface.h>
 #include <net_stat.h>
@@ -31,6 +33,8 @@
 #define MAX_SOCKET_ADDRESS_LENGTH	(sizeof(sockaddr_storage))
 #define MAX_SOCKET_OPTION_LENGTH	128
 #define MAX_ANCILLARY_DATA_LENGTH	1024
+#define SENDFILE_CHUNK_SIZE			65536
+#define SENDFILE_MAPPING_SIZE		(16 * 1024 * 1024)
 
 #define GET_SOCKET_FD_OR_RETURN(fd, kernel, descriptor)	\
 	do {												\
@@ -542,6 +546,254 @@ common_sendmsg(int fd, const struct msghdr *message, int flags, bool kernel)
 }
 
 
+using BKernel::DPCCallback;
+using BKernel::DPCQueue;
+
+
+/*!	A part of a file that sendfile() mapped into the kernel. It stays mapped
+	until neither the sendfile() call, nor any of its chunks the stack still
+	references, need it anymore.
+*/
+struct SendfileMapping {
+	area_id		area;
+	uint8*		address;
+	off_t		offset;
+	size_t		size;
+	int32		reference_count;
+
+	void ReleaseReference()
+	{
+		if (atomic_add(&reference_count, -1) == 1) {
+			delete_area(area);
+			delete this;
+		}
+	}
+};
+
+
+/*!	A part of a SendfileMapping the stack references; its file cache pages
+	stay wired as long as it does.
+*/
+struct SendfileChunk : public DPCCallback {
+	SendfileMapping* mapping;
+	void*		address;
+	size_t		size;
+
+	virtual void DoDPC(DPCQueue* queue)
+	{
+		unlock_memory_etc(B_SYSTEM_TEAM, address, size, 0);
+		mapping->ReleaseReference();
+		delete this;
+	}
+};
+
+
+static void
+free_sendfile_chunk(void* chunk)
+{
+	free(chunk);
+}
+
+
+static void
+put_sendfile_chunk(void* chunk)
+{
+	// The stack may still hold its own locks when it frees the data, so
+	// unmapping the pages is left to the DPC thread.
+	DPCQueue::DefaultQueue(B_NORMAL_PRIORITY)->Add((SendfileChunk*)chunk);
+}
+
+
+/*!	Maps the part of the file \a vnode from \a pos to \a end into the
+	kernel, or at most SENDFILE_MAPPING_SIZE bytes of it. Returns \c NULL if
+	the file cannot be mapped, in which case the caller has to copy the data
+	instead.
+*/
+static SendfileMapping*
+map_sendfile_range(struct vnode* vnode, off_t pos, off_t end)
+{
+	SendfileMapping* mapping = new(std::nothrow) SendfileMapping;
+	if (mapping == NULL)
+		return NULL;
+
+	mapping->offset = ROUNDDOWN(pos, B_PAGE_SIZE);
+	mapping->size = PAGE_ALIGN(
+		min_c(end - mapping->offset, (off_t)SENDFILE_MAPPING_SIZE));
+	mapping->reference_count = 1;
+
+	void* address;
+	mapping->area = vm_map_vnode_into_kernel("sendfile", &address,
+		mapping->size, vnode, mapping->offset);
+	if (mapping->area < 0) {
+		delete mapping;
+		return NULL;
+	}
+
+	mapping->address = (uint8*)address;
+	return mapping;
+}
+
+
+/*!	Wires the pages of the \a mapping that contain the \a length bytes
+	starting at \a pos, and returns a chunk referencing them. Returns \c NULL
+	if that fails, for example, because the file has been truncated.
+*/
+static SendfileChunk*
+get_sendfile_chunk(SendfileMapping* mapping, off_t pos, size_t length,
+	void** _data)
+{
+	off_t chunkOffset = ROUNDDOWN(pos, B_PAGE_SIZE);
+
+	SendfileChunk* chunk = new(std::nothrow) SendfileChunk;
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->mapping = mapping;
+	chunk->address = mapping->address + (chunkOffset - mapping->offset);
+	chunk->size = PAGE_ALIGN(pos - chunkOffset + length);
+
+	// fault in the file cache pages, and keep them from being stolen
+	if (lock_memory_etc(B_SYSTEM_TEAM, chunk->address, chunk->size, 0)
+			!= B_OK) {
+		delete chunk;
+		return NULL;
+	}
+
+	atomic_add(&mapping->reference_count, 1);
+
+	*_data = mapping->address + (pos - mapping->offset);
+	return chunk;
+}
+
+
+/*!	Sends up to \a count bytes of the file \a fd starting at \a pos to the
+	connected \a socket. If \a pos is -1, the file position is used, and
+	moved forward.
+	Regular files are mapped into the kernel, and the stack references their
+	file cache pages directly, so that the data is neither copied through
+	userland, nor into the socket's buffers. Files that cannot be mapped are
+	read into kernel memory instead.
+*/
+static ssize_t
+common_sendfile(int socket, int fd, off_t pos, size_t count, bool kernel)
+{
+	if (pos < -1)
+		return B_BAD_VALUE;
+
+	file_descriptor* socketDescriptor;
+	GET_SOCKET_FD_OR_RETURN(socket, kernel, socketDescriptor);
+	FDPutter _(socketDescriptor);
+
+	file_descriptor* descriptor = get_fd(get_current_io_context(kernel), fd);
+	if (descriptor == NULL)
+		return B_FILE_ERROR;
+	FDPutter _2(descriptor);
+
+	if ((descriptor->open_mode & O_DISCONNECTED) != 0
+		|| (descriptor->open_mode & O_RWMASK) == O_WRONLY) {
+		return B_FILE_ERROR;
+	}
+	if (descriptor->ops->fd_read == NULL)
+		return B_BAD_VALUE;
+
+	bool movePosition = false;
+	if (pos == -1) {
+		pos = descriptor->pos;
+		movePosition = true;
+	}
+
+	if (count > SSIZE_MAX)
+		count = SSIZE_MAX;
+
+	// only the data of regular files lives in the file cache
+	off_t fileSize = -1;
+	struct stat stat;
+	if (descriptor->type == FDTYPE_FILE && descriptor->ops->fd_read_stat != NULL
+		&& descriptor->ops->fd_read_stat(descriptor, &stat) == B_OK
+		&& S_ISREG(stat.st_mode)) {
+		fileSize = stat.st_size;
+	}
+
+	status_t status = B_OK;
+	size_t bytesSent = 0;
+	SendfileMapping* mapping = NULL;
+	bool canMap = fileSize > pos;
+
+	while (bytesSent < count) {
+		size_t length = min_c(count - bytesSent, SENDFILE_CHUNK_SIZE);
+		void* data;
+		void* cookie;
+		void (*freeFunction)(void*);
+
+		if (mapping != NULL
+			&& pos >= mapping->offset + (off_t)mapping->size) {
+			mapping->ReleaseReference();
+			mapping = NULL;
+		}
+		if (mapping == NULL && canMap && fileSize > pos) {
+			// The file is mapped via the vnode of the descriptor we hold, so
+			// that it cannot be replaced by another file meanwhile
+			mapping = map_sendfile_range(descriptor->u.vnode, pos,
+				min_c(fileSize, pos + (off_t)(count - bytesSent)));
+			canMap = mapping != NULL;
+		}
+
+		SendfileChunk* mappedChunk = NULL;
+		if (mapping != NULL && fileSize > pos) {
+			length = min_c(length, (size_t)(fileSize - pos));
+			length = min_c(length,
+				(size_t)(mapping->offset + mapping->size - pos));
+			mappedChunk = get_sendfile_chunk(mapping, pos, length, &data);
+		}
+
+		if (mappedChunk != NULL) {
+			cookie = mappedChunk;
+			freeFunction = &put_sendfile_chunk;
+		} else {
+			data = malloc(length);
+			if (data == NULL) {
+				status = B_NO_MEMORY;
+				break;
+			}
+
+			status = descriptor->ops->fd_read(descriptor, pos, data, &length);
+			if (status != B_OK || length == 0) {
+				free(data);
+				break;
+			}
+
+			cookie = data;
+			freeFunction = &free_sendfile_chunk;
+		}
+
+		// the stack owns the chunk from here on
+		ssize_t sent = sStackInterface->send_external(
+			socketDescriptor->u.socket, data, length, freeFunction, cookie, 0);
+		if (sent < 0) {
+			status = sent;
+			break;
+		}
+
+		pos += sent;
+		bytesSent += sent;
+
+		if ((size_t)sent < length)
+			break;
+	}
+
+	if (mapping != NULL)
+		mapping->ReleaseReference();
+
+	if (movePosition)
+		descriptor->pos = pos;
+
+	if (bytesSent == 0 && status != B_OK)
+		return status;
+
+	return bytesSent;
+}
+
+
 static status_t
 common_getsockopt(int fd, int level, int option, void *value,
 	socklen_t *_length, bool kernel)
@@ -1106,6 +1358,32 @@ _user_sendmsg(int socket, const struct msghdr *userMessage, int flags)
 }
 
 
+ssize_t
+_user_sendfile(int socket, int fd, off_t *userOffset, size_t count)
+{
+	off_t offset = -1;
+	if (userOffset != NULL) {
+		if (!IS_USER_ADDRESS(userOffset)
+			|| user_memcpy(&offset, userOffset, sizeof(off_t)) != B_OK) {
+			return B_BAD_ADDRESS;
+		}
+		if (offset < 0)
+			return B_BAD_VALUE;
+	}
+
+	SyscallRestartWrapper<ssize_t> result;
+	result = common_sendfile(socket, fd, offset, count, false);
+
+	if (result > 0 && userOffset != NULL) {
+		offset += result;
+		if (user_memcpy(userOffset, &offset, sizeof(off_t)) != B_OK)
+			return B_BAD_ADDRESS;
+	}
+
+	return result;
+}
+
+
 status_t
 _user_getsockopt(int socket, int level, int option, void *userValue,
 	socklen_t *_length)
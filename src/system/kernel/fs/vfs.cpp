@@ -3388,6 +3388,53 @@ dump_vnode_usage(int argc, char** argv)
 	return 0;
 }
 
+
+static void
+_dump_entry_cache_stats(struct fs_mount* mount)
+{
+	entry_cache_stats stats;
+	mount->entry_cache.GetStats(stats);
+
+	uint64 misses = stats.lookups - stats.hits - stats.negative_hits;
+
+	kprintf("%4" B_PRIdDEV " %-16s %8" B_PRIu32 " %10" B_PRIu64 " %10"
+		B_PRIu64 " %10" B_PRIu64 " %10" B_PRIu64 " %8" B_PRIu64 "\n",
+		mount->id, mount->volume->file_system_name, stats.entries,
+		stats.lookups, stats.hits, stats.negative_hits, misses,
+		stats.invalidations);
+}
+
+
+static int
+dump_entry_cache_stats(int argc, char** argv)
+{
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "--help"))) {
+		kprintf("usage: %s [id]\n", argv[0]);
+		return 0;
+	}
+
+	kprintf("  id fs_name           entries    lookups       hits   neg hits"
+		"     misses  invalid\n");
+
+	if (argc == 2) {
+		struct fs_mount* mount = sMountsTable->Lookup(
+			parse_expression(argv[1]));
+		if (mount == NULL) {
+			kprintf("fs_mount not found\n");
+			return 0;
+		}
+
+		_dump_entry_cache_stats(mount);
+		return 0;
+	}
+
+	MountTable::Iterator iterator(sMountsTable);
+	while (iterator.HasNext())
+		_dump_entry_cache_stats(iterator.Next());
+
+	return 0;
+}
+
 #endif	// ADD_DEBUGGER_COMMANDS
 
 
@@ -5086,6 +5133,27 @@ vfs_resolve_vnode_to_covering_vnode(dev_t mountID, ino_t nodeID,
 }
 
 
+/*!	Invalidates a negative entry cache entry for \a name in the directory
+	\a dirID, if there is one. This is called by the node monitor when an
+	entry is created or moved, so that file systems don't have to remove
+	negative entries themselves.
+*/
+void
+vfs_entry_cache_invalidate_missing(dev_t mountID, ino_t dirID,
+	const char* name)
+{
+	// lookup mount -- the caller is required to make sure that the mount
+	// won't go away
+	MutexLocker locker(sMountMutex);
+	struct fs_mount* mount = find_mount(mountID);
+	if (mount == NULL)
+		return;
+	locker.Unlock();
+
+	mount->entry_cache.RemoveMissing(dirID, name);
+}
+
+
 status_t
 vfs_get_mount_point(dev_t mountID, dev_t* _mountPointMountID,
 	ino_t* _mountPointNodeID)
@@ -5258,6 +5326,8 @@ vfs_init(kernel_args* args)
 		"info about the I/O context");
 	add_debugger_command("vnode_usage", &dump_vnode_usage,
 		"info about vnode usage");
+	add_debugger_command("entry_cache", &dump_entry_cache_stats,
+		"entry cache statistics of all, or the specified fs_mount");
 #endif
 
 	register_low_resource_handler(&vnode_low_resource_handler, NULL,
@@ -6222,6 +6292,42 @@ common_sync(int fd, bool kernel)
 }
 
 
+static status_t
+common_preallocate(int fd, off_t offset, off_t length, bool kernel)
+{
+	struct file_descriptor* descriptor;
+	struct vnode* vnode;
+
+	FUNCTION(("common_preallocate: fd %d, offset %" B_PRIdOFF ", length %"
+		B_PRIdOFF ", kernel %d\n", fd, offset, length, kernel));
+
+	if (offset < 0 || length <= 0)
+		return B_BAD_VALUE;
+	if (offset + length < offset)
+		return B_FILE_TOO_LARGE;
+
+	descriptor = get_fd_and_vnode(fd, &vnode, kernel);
+	if (descriptor == NULL)
+		return B_FILE_ERROR;
+
+	status_t status;
+	if (descriptor->type != FDTYPE_FILE
+		|| (descriptor->open_mode & O_RWMASK) == O_RDONLY) {
+		status = B_FILE_ERROR;
+	} else if (S_ISFIFO(vnode->Type()))
+		status = ESPIPE;
+	else if (!S_ISREG(vnode->Type()))
+		status = B_DEVICE_NOT_FOUND;
+	else if (!HAS_FS_CALL(vnode, preallocate))
+		status = B_UNSUPPORTED;
+	else
+		status = FS_CALL(vnode, preallocate, offset, length);
+
+	put_fd(descriptor);
+	return status;
+}
+
+
 static status_t
 common_lock_node(int fd, bool kernel)
 {
@@ -8233,6 +8339,13 @@ _kern_fsync(int fd)
 }
 
 
+status_t
+_kern_preallocate(int fd, off_t offset, off_t length)
+{
+	return common_preallocate(fd, offset, length, true);
+}
+
+
 status_t
 _kern_lock_node(int fd)
 {
@@ -8820,6 +8933,33 @@ _user_get_next_fd_info(team_id team, uint32* userCookie, fd_info* userInfo,
 }
 
 
+status_t
+_user_get_entry_cache_stats(dev_t device, entry_cache_stats* userStats,
+	size_t statsSize)
+{
+	if (statsSize != sizeof(entry_cache_stats))
+		return B_BAD_VALUE;
+
+	if (userStats == NULL || !IS_USER_ADDRESS(userStats))
+		return B_BAD_ADDRESS;
+
+	struct fs_mount* mount;
+	status_t status = get_mount(device, &mount);
+	if (status != B_OK)
+		return status;
+
+	entry_cache_stats stats;
+	mount->entry_cache.GetStats(stats);
+
+	put_mount(mount);
+
+	if (user_memcpy(userStats, &stats, sizeof(entry_cache_stats)) != B_OK)
+		return B_BAD_ADDRESS;
+
+	return B_OK;
+}
+
+
 status_t
 _user_entry_ref_to_path(dev_t device, ino_t inode, const char* leaf,
 	char* userPath, size_t pathLength)
@@ -9051,6 +9191,13 @@ _user_fsync(int fd)
 }
 
 
+status_t
+_user_preallocate(int fd, off_t offset, off_t length)
+{
+	return common_preallocate(fd, offset, length, false);
+}
+
+
 status_t
 _user_flock(int fd, int operation)
 {
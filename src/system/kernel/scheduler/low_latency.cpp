@@ -152,6 +152,20 @@ rebalance_irqs(bool idle)
 }
 
 
+static CoreEntry*
+choose_victim_core(const CoreEntry* core)
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	// Prefer the cores sharing this package's caches. Migrating a thread to
+	// another package is only worth it if more than one thread is waiting.
+	CoreEntry* victim = core->GetBusiestCore(true, 1);
+	if (victim == NULL)
+		victim = core->GetBusiestCore(false, 2);
+	return victim;
+}
+
+
 scheduler_mode_operations gSchedulerLowLatencyMode = {
 	"low latency",
 
@@ -167,5 +181,6 @@ scheduler_mode_operations gSchedulerLowLatencyMode = {
 	choose_core,
 	rebalance,
 	rebalance_irqs,
+	choose_victim_core,
 };
 
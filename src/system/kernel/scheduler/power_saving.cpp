@@ -236,6 +236,20 @@ rebalance_irqs(bool idle)
 }
 
 
+static CoreEntry*
+choose_victim_core(const CoreEntry* core)
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	// Threads are packed on as few cores as possible on purpose, so only
+	// help out cores in the same package that are overloaded anyway.
+	CoreEntry* victim = core->GetBusiestCore(true, 1);
+	if (victim == NULL || victim->GetLoad() < kHighLoad)
+		return NULL;
+	return victim;
+}
+
+
 scheduler_mode_operations gSchedulerPowerSavingMode = {
 	"power saving",
 
@@ -251,5 +265,6 @@ scheduler_mode_operations gSchedulerPowerSavingMode = {
 	choose_core,
 	rebalance,
 	rebalance_irqs,
+	choose_victim_core,
 };
 
@@ -372,6 +372,10 @@ reschedule(int32 nextState)
 			break;
 	}
 
+	// the old thread would continue to run if it wasn't for another thread
+	bool preempted = enqueueOldThread && !oldThreadData->IsIdle()
+		&& !oldThread->has_yielded;
+
 	oldThread->has_yielded = false;
 
 	// select thread with the biggest priority and enqueue back the old thread
@@ -387,6 +391,10 @@ reschedule(int32 nextState)
 		} else
 			nextThreadData = oldThreadData;
 	} else {
+		// if this CPU would go idle otherwise, look for work on other cores
+		if (!enqueueOldThread || oldThreadData->IsIdle())
+			cpu->StealThread();
+
 		nextThreadData
 			= cpu->ChooseNextThread(enqueueOldThread ? oldThreadData : NULL,
 				putOldThreadAtBack);
@@ -425,6 +433,7 @@ reschedule(int32 nextState)
 
 	// track CPU activity
 	cpu->TrackActivity(oldThreadData, nextThreadData);
+	cpu->TrackLatency(oldThreadData, nextThreadData, preempted);
 
 	if (nextThread != oldThread || oldThread->cpu->preempted) {
 		cpu->StartQuantumTimer(nextThreadData, oldThread->cpu->preempted);
@@ -832,3 +841,85 @@ _user_get_scheduler_mode()
 	return gCurrentModeID;
 }
 
+
+status_t
+_user_get_scheduler_cpu_latency_stats(int32 cpu,
+	scheduler_cpu_latency_stats* userStats, size_t size)
+{
+	if (cpu < 0 || cpu >= smp_get_num_cpus())
+		return B_BAD_VALUE;
+	if (userStats == NULL || !IS_USER_ADDRESS(userStats)
+		|| size != sizeof(scheduler_cpu_latency_stats)) {
+		return B_BAD_VALUE;
+	}
+
+	// The CPU updates its statistics without locking, so the snapshot may be
+	// slightly inconsistent; that's fine for what it's used for.
+	scheduler_cpu_latency_stats stats = gCPUEntries[cpu].LatencyStats();
+
+	if (user_memcpy(userStats, &stats, sizeof(stats)) != B_OK)
+		return B_BAD_ADDRESS;
+
+	return B_OK;
+}
+
+
+status_t
+_user_get_scheduler_thread_latency_stats(thread_id id,
+	scheduler_thread_latency_stats* userStats, size_t size)
+{
+	if (userStats == NULL || !IS_USER_ADDRESS(userStats)
+		|| size != sizeof(scheduler_thread_latency_stats)) {
+		return B_BAD_VALUE;
+	}
+
+	Thread* thread;
+	if (id < 0) {
+		thread = thread_get_current_thread();
+		thread->AcquireReference();
+	} else {
+		thread = Thread::Get(id);
+		if (thread == NULL)
+			return B_BAD_THREAD_ID;
+	}
+	BReference<Thread> threadReference(thread, true);
+
+	// only threads of the same team can be inspected, unless we're root
+	ThreadLocker threadLocker(thread);
+	bool allowed = thread->team == thread_get_current_thread()->team
+		|| geteuid() == 0;
+	threadLocker.Unlock();
+
+	if (!allowed)
+		return B_NOT_ALLOWED;
+
+	InterruptsSpinLocker locker(thread->scheduler_lock);
+	scheduler_thread_latency_stats stats
+		= thread->scheduler_data->LatencyStats();
+	locker.Unlock();
+
+	if (user_memcpy(userStats, &stats, sizeof(stats)) != B_OK)
+		return B_BAD_ADDRESS;
+
+	return B_OK;
+}
+
+
+static void
+reset_latency_stats(void* /* cookie */, int cpu)
+{
+	CPUEntry::GetCPU(cpu)->ResetLatencyStats();
+}
+
+
+status_t
+_user_reset_scheduler_latency_stats()
+{
+	if (geteuid() != 0)
+		return B_NOT_ALLOWED;
+
+	// let every CPU reset its own statistics
+	call_all_cpus_sync(&reset_latency_stats, NULL);
+	return B_OK;
+}
+
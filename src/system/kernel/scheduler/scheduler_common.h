@@ -12,6 +12,7 @@
 #include <debug.h>
 #include <kscheduler.h>
 #include <load_tracking.h>
+#include <scheduler_defs.h>
 #include <smp.h>
 #include <thread.h>
 #include <user_debugger.h>
@@ -50,6 +51,33 @@ extern bool gTrackCPULoad;
 void init_debug_commands();
 
 
+static inline int32
+latency_histogram_bucket(bigtime_t latency)
+{
+	int32 bucket = 0;
+	while (latency >= 2 && bucket < SCHEDULER_LATENCY_BUCKETS - 1) {
+		latency /= 2;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+
+/*!	Accounts a wake-up latency in the given scheduler_cpu_latency_stats or
+	scheduler_thread_latency_stats.
+*/
+template<typename Stats>
+static inline void
+record_latency(Stats& stats, bigtime_t latency)
+{
+	stats.wakeups++;
+	stats.total_latency += latency;
+	stats.max_latency = std::max(stats.max_latency, latency);
+	stats.latency_histogram[latency_histogram_bucket(latency)]++;
+}
+
+
 }	// namespace Scheduler
 
 
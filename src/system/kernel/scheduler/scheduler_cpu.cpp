@@ -11,6 +11,7 @@
 #include <algorithm>
 
 #include "scheduler_thread.h"
+#include "scheduler_tracing.h"
 
 
 namespace Scheduler {
@@ -82,7 +83,9 @@ CPUEntry::CPUEntry()
 	fLoad(0),
 	fMeasureActiveTime(0),
 	fMeasureTime(0),
-	fUpdateLoadEvent(false)
+	fUpdateLoadEvent(false),
+	fLocalSteals(0),
+	fRemoteSteals(0)
 {
 	B_INITIALIZE_RW_SPINLOCK(&fSchedulerModeLock);
 	B_INITIALIZE_SPINLOCK(&fQueueLock);
@@ -94,6 +97,8 @@ CPUEntry::Init(int32 id, CoreEntry* core)
 {
 	fCPUNumber = id;
 	fCore = core;
+
+	ResetLatencyStats();
 }
 
 
@@ -294,6 +299,48 @@ CPUEntry::TrackActivity(ThreadData* oldThreadData, ThreadData* nextThreadData)
 }
 
 
+/*!	Updates the latency statistics of this CPU, and those of the threads
+	involved. Since only the CPU itself ever writes its statistics, and does
+	so with interrupts disabled, no locking is needed.
+	\a preempted tells whether the old thread would have continued to run.
+*/
+void
+CPUEntry::TrackLatency(ThreadData* oldThreadData, ThreadData* nextThreadData,
+	bool preempted)
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	int32 queued = std::min(fCore->QueuedThreadCount(),
+		int32(SCHEDULER_RUN_QUEUE_BUCKETS - 1));
+	fLatencyStats.run_queue_histogram[std::max(queued, int32(0))]++;
+
+	if (oldThreadData == nextThreadData)
+		return;
+
+	fLatencyStats.context_switches++;
+	if (preempted) {
+		fLatencyStats.preemptions++;
+		oldThreadData->Preempted();
+	}
+
+	bigtime_t latency = nextThreadData->Scheduled();
+	if (latency >= 0)
+		record_latency(fLatencyStats, latency);
+}
+
+
+/*!	Must be called on the CPU itself with interrupts disabled, or before the
+	CPU is started.
+*/
+void
+CPUEntry::ResetLatencyStats()
+{
+	memset(&fLatencyStats, 0, sizeof(fLatencyStats));
+	fLatencyStats.cpu = fCPUNumber;
+	fLatencyStats.core = fCore->ID();
+}
+
+
 void
 CPUEntry::StartQuantumTimer(ThreadData* thread, bool wasPreempted)
 {
@@ -315,6 +362,69 @@ CPUEntry::StartQuantumTimer(ThreadData* thread, bool wasPreempted)
 }
 
 
+/*!	Called by the scheduler when this CPU is about to go idle. Tries to pull
+	a thread waiting in the run queue of a busier core into the run queue of
+	this CPU's core, so that it can be run here instead. The CPUs of a core
+	(i.e. SMT siblings) share its run queue already; the current scheduler
+	mode chooses which of the other cores, if any, to steal from.
+	Returns whether a thread has been moved.
+*/
+bool
+CPUEntry::StealThread()
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	if (gSingleCore || fCore->QueuedThreadCount() > 0)
+		return false;
+
+	CPURunQueueLocker cpuLocker(this);
+	ThreadData* pinnedThread = fRunQueue.PeekMaximum();
+	if (pinnedThread != NULL && !pinnedThread->IsIdle())
+		return false;
+	cpuLocker.Unlock();
+
+	CoreEntry* victim = gCurrentMode->choose_victim_core(fCore);
+	if (victim == NULL)
+		return false;
+
+	// The lock order is the other way around everywhere else, so we can only
+	// try to acquire the run queue and thread locks here.
+	if (!victim->TryLockRunQueue())
+		return false;
+
+	ThreadData* threadData = victim->PeekThread();
+	if (threadData == NULL) {
+		victim->UnlockRunQueue();
+		return false;
+	}
+
+	Thread* thread = threadData->GetThread();
+	if (!try_acquire_spinlock(&thread->scheduler_lock)) {
+		victim->UnlockRunQueue();
+		return false;
+	}
+
+	victim->Remove(threadData);
+	victim->UnlockRunQueue();
+
+	T(MigrateThread(thread, victim->ID(), fCore->ID(), fCPUNumber));
+
+	CoreEntry* targetCore = fCore;
+	CPUEntry* targetCPU = this;
+	threadData->ChooseCoreAndCPU(targetCore, targetCPU);
+	threadData->Enqueue();
+
+	release_spinlock(&thread->scheduler_lock);
+
+	if (victim->Package() == fCore->Package())
+		fLocalSteals++;
+	else
+		fRemoteSteals++;
+
+	return true;
+}
+
+
 void
 CPUEntry::_RequestPerformanceLevel(ThreadData* threadData)
 {
@@ -357,8 +467,18 @@ CPUEntry::_RescheduleEvent(timer* /* unused */)
 /* static */ int32
 CPUEntry::_UpdateLoadEvent(timer* /* unused */)
 {
-	CoreEntry::GetCore(smp_get_current_cpu())->ChangeLoad(0);
+	CoreEntry* core = CoreEntry::GetCore(smp_get_current_cpu());
+	core->ChangeLoad(0);
 	CPUEntry::GetCPU(smp_get_current_cpu())->fUpdateLoadEvent = false;
+
+	// This CPU is idle; if there is work waiting elsewhere, let the scheduler
+	// try to steal it. Pretending a preemption will make it check again in a
+	// while, in case it doesn't succeed.
+	if (!gSingleCore && gCurrentMode->choose_victim_core(core) != NULL) {
+		get_cpu_struct()->invoke_scheduler = true;
+		get_cpu_struct()->preempted = true;
+	}
+
 	return B_HANDLED_INTERRUPT;
 }
 
@@ -597,6 +717,39 @@ CoreEntry::_UpdateLoad(bool forceUpdate)
 }
 
 
+/*!	Returns the core with the most threads waiting in its run queue, but
+	at least \a minimumQueued of them. Only cores in the same package as this
+	one are considered if \a samePackage is \c true, only the other ones
+	otherwise. Cores that have idle CPUs will run their threads soon enough
+	on their own, and are ignored.
+	The result is only a hint, as no locks are held.
+*/
+CoreEntry*
+CoreEntry::GetBusiestCore(bool samePackage, int32 minimumQueued) const
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	CoreEntry* busiest = NULL;
+	int32 busiestQueued = minimumQueued - 1;
+
+	for (int32 i = 0; i < gCoreCount; i++) {
+		CoreEntry* core = &gCoreEntries[i];
+		if (core == this || core->fCPUCount == 0 || core->fIdleCPUCount > 0)
+			continue;
+		if ((core->fPackage == fPackage) != samePackage)
+			continue;
+
+		int32 queued = core->fThreadCount;
+		if (queued > busiestQueued) {
+			busiest = core;
+			busiestQueued = queued;
+		}
+	}
+
+	return busiest;
+}
+
+
 /* static */ void
 CoreEntry::_UnassignThread(Thread* thread, void* data)
 {
@@ -800,6 +953,44 @@ dump_idle_cores(int /* argc */, char** /* argv */)
 }
 
 
+static int
+dump_work_stealing(int /* argc */, char** /* argv */)
+{
+	kprintf("cpu core package   local  remote\n");
+
+	int32 cpuCount = smp_get_num_cpus();
+	for (int32 i = 0; i < cpuCount; i++) {
+		CPUEntry* cpu = &gCPUEntries[i];
+		kprintf("%3" B_PRId32 " %4" B_PRId32 " %7" B_PRId32 " %7" B_PRIu32
+			" %7" B_PRIu32 "\n", cpu->ID(), cpu->Core()->ID(),
+			gCPU[i].topology_id[CPU_TOPOLOGY_PACKAGE], cpu->LocalSteals(),
+			cpu->RemoteSteals());
+	}
+
+	return 0;
+}
+
+
+static int
+dump_latency_stats(int /* argc */, char** /* argv */)
+{
+	kprintf("cpu   switches preemptions    wakeups avg latency max latency\n");
+
+	int32 cpuCount = smp_get_num_cpus();
+	for (int32 i = 0; i < cpuCount; i++) {
+		const scheduler_cpu_latency_stats& stats
+			= gCPUEntries[i].LatencyStats();
+		kprintf("%3" B_PRId32 " %10" B_PRId64 " %11" B_PRId64 " %10" B_PRId64
+			" %8" B_PRId64 " us %8" B_PRId64 " us\n", i,
+			stats.context_switches, stats.preemptions, stats.wakeups,
+			stats.wakeups > 0 ? stats.total_latency / stats.wakeups : 0,
+			stats.max_latency);
+	}
+
+	return 0;
+}
+
+
 void Scheduler::init_debug_commands()
 {
 	new(&sDebugCPUHeap) CPUPriorityHeap(smp_get_num_cpus());
@@ -807,12 +998,20 @@ void Scheduler::init_debug_commands()
 
 	add_debugger_command_etc("run_queue", &dump_run_queue,
 		"List threads in run queue", "\nLists threads in run queue", 0);
+	add_debugger_command_etc("scheduler_latency", &dump_latency_stats,
+		"List scheduling latency statistics of each CPU",
+		"\nLists the context switches, preemptions, and wake-up latencies\n"
+		"of each CPU\n", 0);
 	if (!gSingleCore) {
 		add_debugger_command_etc("cpu_heap", &dump_cpu_heap,
 			"List CPUs in CPU priority heap",
 			"\nList CPUs in CPU priority heap", 0);
 		add_debugger_command_etc("idle_cores", &dump_idle_cores,
 			"List idle cores", "\nList idle cores", 0);
+		add_debugger_command_etc("work_stealing", &dump_work_stealing,
+			"List threads stolen by each CPU",
+			"\nList how many threads each CPU has stolen from other cores in\n"
+			"the same package (local) and from other packages (remote)\n", 0);
 	}
 }
 
@@ -81,10 +81,24 @@ public:
 
 						void			TrackActivity(ThreadData* oldThreadData,
 											ThreadData* nextThreadData);
+						void			TrackLatency(ThreadData* oldThreadData,
+											ThreadData* nextThreadData,
+											bool preempted);
+
+	inline				const scheduler_cpu_latency_stats& LatencyStats() const
+											{ return fLatencyStats; }
+						void			ResetLatencyStats();
 
 						void			StartQuantumTimer(ThreadData* thread,
 											bool wasPreempted);
 
+						bool			StealThread();
+
+	inline				uint32			LocalSteals() const
+											{ return fLocalSteals; }
+	inline				uint32			RemoteSteals() const
+											{ return fRemoteSteals; }
+
 	static inline		CPUEntry*		GetCPU(int32 cpu);
 
 private:
@@ -109,6 +123,11 @@ private:
 
 						bool			fUpdateLoadEvent;
 
+						uint32			fLocalSteals;
+						uint32			fRemoteSteals;
+
+						scheduler_cpu_latency_stats fLatencyStats;
+
 						friend class DebugDumper;
 } CACHE_LINE_ALIGN;
 
@@ -140,6 +159,7 @@ public:
 	inline				int32			ThreadCount() const;
 
 	inline				void			LockRunQueue();
+	inline				bool			TryLockRunQueue();
 	inline				void			UnlockRunQueue();
 
 						void			PushFront(ThreadData* thread,
@@ -148,6 +168,11 @@ public:
 											int32 priority);
 						void			Remove(ThreadData* thread);
 	inline				ThreadData*		PeekThread() const;
+	inline				int32			QueuedThreadCount() const
+											{ return fThreadCount; }
+
+						CoreEntry*		GetBusiestCore(bool samePackage,
+											int32 minimumQueued) const;
 
 	inline				bigtime_t		GetActiveTime() const;
 	inline				void			IncreaseActiveTime(
@@ -359,6 +384,14 @@ CoreEntry::LockRunQueue()
 }
 
 
+inline bool
+CoreEntry::TryLockRunQueue()
+{
+	SCHEDULER_ENTER_FUNCTION();
+	return try_acquire_spinlock(&fQueueLock);
+}
+
+
 inline void
 CoreEntry::UnlockRunQueue()
 {
@@ -28,6 +28,8 @@ struct scheduler_mode_operations {
 	Scheduler::CoreEntry*	(*rebalance)(
 								const Scheduler::ThreadData* threadData);
 	void					(*rebalance_irqs)(bool idle);
+	Scheduler::CoreEntry*	(*choose_victim_core)(
+								const Scheduler::CoreEntry* core);
 };
 
 extern struct scheduler_mode_operations gSchedulerLowLatencyMode;
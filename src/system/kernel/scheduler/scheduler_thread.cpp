@@ -33,6 +33,10 @@ ThreadData::_InitBase()
 	fWentSleep = 0;
 	fWentSleepActive = 0;
 
+	fWokenUp = 0;
+	memset(&fLatencyStats, 0, sizeof(fLatencyStats));
+	fLatencyStats.id = fThread->id;
+
 	fEnqueued = false;
 	fReady = false;
 }
@@ -138,6 +142,9 @@ ThreadData::Dump() const
 	kprintf("\tneeded_load:\t\t%" B_PRId32 "%%\n", fNeededLoad / 10);
 	kprintf("\twent_sleep:\t\t%" B_PRId64 "\n", fWentSleep);
 	kprintf("\twent_sleep_active:\t%" B_PRId64 "\n", fWentSleepActive);
+	kprintf("\twakeups:\t\t%" B_PRId64 " (max latency: %" B_PRId64 " us)\n",
+		fLatencyStats.wakeups, fLatencyStats.max_latency);
+	kprintf("\tpreemptions:\t\t%" B_PRId64 "\n", fLatencyStats.preemptions);
 	kprintf("\tcore:\t\t\t%" B_PRId32 "\n",
 		fCore != NULL ? fCore->ID() : -1);
 	if (fCore != NULL && HasCacheExpired())
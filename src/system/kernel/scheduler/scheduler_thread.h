@@ -82,6 +82,12 @@ public:
 	inline	bool		IsEnqueued() const	{ return fEnqueued; }
 	inline	void		SetDequeued()	{ fEnqueued = false; }
 
+	inline	void		Preempted()	{ fLatencyStats.preemptions++; }
+	inline	bigtime_t	Scheduled();
+
+	inline	const scheduler_thread_latency_stats& LatencyStats() const
+							{ return fLatencyStats; }
+
 	inline	int32		GetLoad() const	{ return fNeededLoad; }
 
 	inline	CoreEntry*	Core() const	{ return fCore; }
@@ -108,6 +114,9 @@ private:
 			bigtime_t	fWentSleep;
 			bigtime_t	fWentSleepActive;
 
+			bigtime_t	fWokenUp;
+			scheduler_thread_latency_stats fLatencyStats;
+
 			bool		fEnqueued;
 			bool		fReady;
 
@@ -411,8 +420,10 @@ ThreadData::Enqueue()
 	SCHEDULER_ENTER_FUNCTION();
 
 	if (!fReady) {
+		fWokenUp = system_time();
+
 		if (gTrackCoreLoad) {
-			bigtime_t timeSlept = system_time() - fWentSleep;
+			bigtime_t timeSlept = fWokenUp - fWentSleep;
 			bool updateLoad = timeSlept > 0;
 
 			fCore->AddLoad(fNeededLoad, fLoadMeasurementEpoch, !updateLoad);
@@ -475,6 +486,27 @@ ThreadData::Dequeue()
 }
 
 
+/*!	Called by the scheduler when the thread is about to run. Returns the time
+	it has been waiting since it has been woken up, or -1 when it has been
+	preempted instead.
+	The caller must hold the thread's scheduler_lock.
+*/
+inline bigtime_t
+ThreadData::Scheduled()
+{
+	SCHEDULER_ENTER_FUNCTION();
+
+	if (fWokenUp == 0)
+		return -1;
+
+	bigtime_t latency = system_time() - fWokenUp;
+	fWokenUp = 0;
+
+	record_latency(fLatencyStats, latency);
+	return latency;
+}
+
+
 inline void
 ThreadData::UpdateActivity(bigtime_t active)
 {
@@ -101,6 +101,24 @@ ScheduleThread::Name() const
 	return fName;
 }
 
+
+// #pragma mark - MigrateThread
+
+
+void
+MigrateThread::AddDump(TraceOutput& out)
+{
+	out.Print("scheduler migrate %ld from core %ld to core %ld (CPU %ld)",
+		fID, fFromCore, fToCore, fCPU);
+}
+
+
+const char*
+MigrateThread::Name() const
+{
+	return NULL;
+}
+
 }	// namespace SchedulerTracing
 
 
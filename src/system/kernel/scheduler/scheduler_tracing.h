@@ -123,6 +123,29 @@ private:
 	};
 };
 
+
+class MigrateThread : public SchedulerTraceEntry {
+public:
+	MigrateThread(Thread* thread, int32 fromCore, int32 toCore, int32 cpu)
+		:
+		SchedulerTraceEntry(thread),
+		fFromCore(fromCore),
+		fToCore(toCore),
+		fCPU(cpu)
+	{
+		Initialized();
+	}
+
+	virtual void AddDump(TraceOutput& out);
+
+	virtual const char* Name() const;
+
+private:
+	int32				fFromCore;
+	int32				fToCore;
+	int32				fCPU;
+};
+
 }	// namespace SchedulerTracing
 
 #	define T(x) new(std::nothrow) SchedulerTracing::x;
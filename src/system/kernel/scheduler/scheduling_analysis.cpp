@@ -97,6 +97,7 @@ struct Thread : HashObject, scheduling_analysis_thread {
 		unspecified_wait_time = 0;
 
 		preemptions = 0;
+		migrations = 0;
 
 		wait_objects = NULL;
 	}
@@ -788,6 +789,11 @@ analyze_scheduling(bigtime_t from, bigtime_t until,
 
 			thread->lastTime = entry->Time();
 			thread->state = WAITING;
+		} else if (MigrateThread* entry
+				= dynamic_cast<MigrateThread*>(_entry)) {
+			// thread stolen from the run queue of another core; it stays
+			// ready, so there's no state change
+			manager.ThreadFor(entry->ThreadID())->migrations++;
 		}
 	}
 
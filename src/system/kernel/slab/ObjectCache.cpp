@@ -72,6 +72,10 @@ ObjectCache::Init(const char* name, size_t objectSize, size_t alignment,
 	pressure = 0;
 	min_object_reserve = 0;
 
+	slab_allocs = 0;
+	slab_frees = 0;
+	slab_refills = 0;
+
 	maintenance_pending = false;
 	maintenance_in_progress = false;
 	maintenance_resize = false;
@@ -224,6 +228,7 @@ ObjectCache::ReturnObjectToSlab(slab* source, void* object, uint32 flags)
 	_push(source->free, link);
 	source->count++;
 	used_count--;
+	slab_frees++;
 
 	ADD_PARANOIA_CHECK(PARANOIA_SUSPICIOUS, source, &link->next, sizeof(void*));
 
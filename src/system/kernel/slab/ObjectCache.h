@@ -60,6 +60,11 @@ struct ObjectCache : DoublyLinkedListLinkImpl<ObjectCache> {
 			size_t				min_object_reserve;
 									// minimum number of free objects
 
+			// statistics, protected by the cache lock
+			uint64				slab_allocs;		// allocated from slabs
+			uint64				slab_frees;			// returned to slabs
+			uint64				slab_refills;		// slabs created
+
 			size_t				slab_size;
 			size_t				usage;
 			size_t				maximum;
@@ -42,9 +42,26 @@ public:
 struct depot_cpu_store {
 	DepotMagazine*	loaded;
 	DepotMagazine*	previous;
+	uint64			alloc_hits;
+	uint64			free_hits;
 };
 
 
+struct DepotLocking {
+	inline bool Lock(object_depot* depot);
+	inline void Unlock(object_depot* depot);
+};
+
+typedef AutoLocker<object_depot, DepotLocking> DepotLocker;
+
+
+static const size_t kMaxMagazineCapacity = 128;
+static const uint32 kMagazineResizeInterval = 512;
+	// number of depot lock acquisitions between two resize decisions
+static const uint32 kMagazineContentionShift = 4;
+	// grow when more than 1/16 of the acquisitions were contended
+
+
 RANGE_MARKER_FUNCTION_BEGIN(SlabObjectDepot)
 
 
@@ -99,6 +116,47 @@ DepotMagazine::ContainsObject(void* object) const
 // #pragma mark -
 
 
+/*!	Acquires the depot's inner lock, and keeps track of how often it was
+	contended. Every kMagazineResizeInterval acquisitions, the magazine
+	capacity is raised if the contention rate was too high: larger magazines
+	mean that the CPUs need to go to the depot less often.
+*/
+bool
+DepotLocking::Lock(object_depot* depot)
+{
+	if (!try_acquire_spinlock(&depot->inner_lock)) {
+		acquire_spinlock(&depot->inner_lock);
+		depot->contentions++;
+		depot->interval_contentions++;
+	}
+
+	if (++depot->interval_acquisitions < kMagazineResizeInterval)
+		return true;
+
+	if ((depot->interval_contentions << kMagazineContentionShift)
+			> depot->interval_acquisitions
+		&& depot->magazine_capacity < depot->max_capacity) {
+		depot->magazine_capacity = std::min(depot->max_capacity,
+			depot->magazine_capacity + depot->magazine_capacity / 2);
+		depot->resizes++;
+	}
+
+	depot->interval_acquisitions = 0;
+	depot->interval_contentions = 0;
+	return true;
+}
+
+
+void
+DepotLocking::Unlock(object_depot* depot)
+{
+	release_spinlock(&depot->inner_lock);
+}
+
+
+// #pragma mark -
+
+
 static DepotMagazine*
 alloc_magazine(object_depot* depot, uint32 flags)
 {
@@ -136,13 +194,14 @@ exchange_with_full(object_depot* depot, DepotMagazine*& magazine)
 {
 	ASSERT(magazine->IsEmpty());
 
-	SpinLocker _(depot->inner_lock);
+	DepotLocker _(depot);
 
 	if (depot->full == NULL)
 		return false;
 
 	depot->full_count--;
 	depot->empty_count++;
+	depot->exchanges++;
 
 	_push(depot->empty, magazine);
 	magazine = _pop(depot->full);
@@ -152,24 +211,32 @@ exchange_with_full(object_depot* depot, DepotMagazine*& magazine)
 
 static bool
 exchange_with_empty(object_depot* depot, DepotMagazine*& magazine,
-	DepotMagazine*& freeMagazine)
+	DepotMagazine*& freeMagazines)
 {
 	ASSERT(magazine == NULL || magazine->IsFull());
 
-	SpinLocker _(depot->inner_lock);
+	DepotLocker _(depot);
+
+	// Empty magazines allocated before the capacity was last raised are
+	// not handed out anymore, so that they are phased out over time.
+	while (depot->empty != NULL
+		&& depot->empty->round_count < depot->magazine_capacity) {
+		_push(freeMagazines, _pop(depot->empty));
+		depot->empty_count--;
+	}
 
 	if (depot->empty == NULL)
 		return false;
 
 	depot->empty_count--;
+	depot->exchanges++;
 
 	if (magazine != NULL) {
 		if (depot->full_count < depot->max_count) {
 			_push(depot->full, magazine);
 			depot->full_count++;
-			freeMagazine = NULL;
 		} else
-			freeMagazine = magazine;
+			_push(freeMagazines, magazine);
 	}
 
 	magazine = _pop(depot->empty);
@@ -180,7 +247,7 @@ exchange_with_empty(object_depot* depot, DepotMagazine*& magazine,
 static void
 push_empty_magazine(object_depot* depot, DepotMagazine* magazine)
 {
-	SpinLocker _(depot->inner_lock);
+	DepotLocker _(depot);
 
 	_push(depot->empty, magazine);
 	depot->empty_count++;
@@ -207,6 +274,15 @@ object_depot_init(object_depot* depot, size_t capacity, size_t maxCount,
 	depot->full_count = depot->empty_count = 0;
 	depot->max_count = maxCount;
 	depot->magazine_capacity = capacity;
+	depot->min_capacity = capacity;
+	depot->max_capacity = std::max(capacity,
+		std::min(capacity * 4, kMaxMagazineCapacity));
+
+	depot->exchanges = 0;
+	depot->contentions = 0;
+	depot->resizes = 0;
+	depot->interval_acquisitions = 0;
+	depot->interval_contentions = 0;
 
 	rw_lock_init(&depot->outer_lock, "object depot");
 	B_INITIALIZE_SPINLOCK(&depot->inner_lock);
@@ -222,6 +298,8 @@ object_depot_init(object_depot* depot, size_t capacity, size_t maxCount,
 	for (int i = 0; i < cpuCount; i++) {
 		depot->stores[i].loaded = NULL;
 		depot->stores[i].previous = NULL;
+		depot->stores[i].alloc_hits = 0;
+		depot->stores[i].free_hits = 0;
 	}
 
 	depot->cookie = cookie;
@@ -260,6 +338,11 @@ object_depot_obtain(object_depot* depot)
 	if (store->loaded == NULL)
 		return NULL;
 
+	if (!store->loaded->IsEmpty()) {
+		store->alloc_hits++;
+		return store->loaded->Pop();
+	}
+
 	while (true) {
 		if (!store->loaded->IsEmpty())
 			return store->loaded->Pop();
@@ -287,28 +370,37 @@ object_depot_store(object_depot* depot, void* object, uint32 flags)
 	// the magazine depot doesn't provide us with a new empty magazine
 	// we return the object directly to the slab.
 
+	if (store->loaded != NULL && store->loaded->Push(object)) {
+		store->free_hits++;
+		return;
+	}
+
 	while (true) {
 		if (store->loaded != NULL && store->loaded->Push(object))
 			return;
 
-		DepotMagazine* freeMagazine = NULL;
-		if ((store->previous != NULL && store->previous->IsEmpty())
-			|| exchange_with_empty(depot, store->previous, freeMagazine)) {
+		DepotMagazine* freeMagazines = NULL;
+		bool exchanged = (store->previous != NULL && store->previous->IsEmpty())
+			|| exchange_with_empty(depot, store->previous, freeMagazines);
+		if (exchanged)
 			std::swap(store->loaded, store->previous);
 
-			if (freeMagazine != NULL) {
-				// Free the magazine that didn't have space in the list
-				interruptsLocker.Unlock();
-				readLocker.Unlock();
+		if (freeMagazines != NULL) {
+			// Free the magazines that didn't have space in the list, or
+			// that are too small for the current capacity
+			interruptsLocker.Unlock();
+			readLocker.Unlock();
 
-				empty_magazine(depot, freeMagazine, flags);
+			while (freeMagazines != NULL)
+				empty_magazine(depot, _pop(freeMagazines), flags);
 
-				readLocker.Lock();
-				interruptsLocker.Lock();
+			readLocker.Lock();
+			interruptsLocker.Lock();
 
-				store = object_depot_cpu(depot);
-			}
-		} else {
+			store = object_depot_cpu(depot);
+		}
+
+		if (!exchanged) {
 			// allocate a new empty magazine
 			interruptsLocker.Unlock();
 			readLocker.Unlock();
@@ -361,6 +453,18 @@ object_depot_make_empty(object_depot* depot, uint32 flags)
 	DepotMagazine* emptyMagazines = depot->empty;
 	depot->empty = NULL;
 
+	depot->full_count = 0;
+	depot->empty_count = 0;
+
+	// We're usually called when memory is low, so start over with the
+	// smallest magazines; contention will grow them again if needed.
+	if (depot->magazine_capacity != depot->min_capacity) {
+		depot->magazine_capacity = depot->min_capacity;
+		depot->resizes++;
+	}
+	depot->interval_acquisitions = 0;
+	depot->interval_contentions = 0;
+
 	writeLocker.Unlock();
 
 	// free all magazines
@@ -376,6 +480,27 @@ object_depot_make_empty(object_depot* depot, uint32 flags)
 }
 
 
+void
+object_depot_get_stats(object_depot* depot, object_depot_stats* stats)
+{
+	// This is a snapshot only; the per CPU counters are read without locking
+	// so that it can be used from the kernel debugger as well.
+	stats->alloc_hits = 0;
+	stats->free_hits = 0;
+
+	int cpuCount = smp_get_num_cpus();
+	for (int i = 0; i < cpuCount; i++) {
+		stats->alloc_hits += depot->stores[i].alloc_hits;
+		stats->free_hits += depot->stores[i].free_hits;
+	}
+
+	stats->exchanges = depot->exchanges;
+	stats->contentions = depot->contentions;
+	stats->resizes = depot->resizes;
+	stats->magazine_capacity = depot->magazine_capacity;
+}
+
+
 #if PARANOID_KERNEL_FREE
 
 bool
@@ -419,7 +544,11 @@ dump_object_depot(object_depot* depot)
 	kprintf("  full:     %p, count %lu\n", depot->full, depot->full_count);
 	kprintf("  empty:    %p, count %lu\n", depot->empty, depot->empty_count);
 	kprintf("  max full: %lu\n", depot->max_count);
-	kprintf("  capacity: %lu\n", depot->magazine_capacity);
+	kprintf("  capacity: %lu (%lu - %lu, %" B_PRIu32 " resizes)\n",
+		depot->magazine_capacity, depot->min_capacity, depot->max_capacity,
+		depot->resizes);
+	kprintf("  exchanges: %" B_PRIu64 ", contended: %" B_PRIu64 "\n",
+		depot->exchanges, depot->contentions);
 	kprintf("  stores:\n");
 
 	int cpuCount = smp_get_num_cpus();
@@ -427,6 +556,8 @@ dump_object_depot(object_depot* depot)
 	for (int i = 0; i < cpuCount; i++) {
 		kprintf("  [%d] loaded:   %p\n", i, depot->stores[i].loaded);
 		kprintf("      previous: %p\n", depot->stores[i].previous);
+		kprintf("      hits:     %" B_PRIu64 " alloc, %" B_PRIu64 " free\n",
+			depot->stores[i].alloc_hits, depot->stores[i].free_hits);
 	}
 }
 
@@ -18,9 +18,11 @@
 
 #include <condition_variable.h>
 #include <elf.h>
+#include <generic_syscall.h>
 #include <kernel.h>
 #include <low_resource_manager.h>
 #include <slab/ObjectDepot.h>
+#include <slab_statistics.h>
 #include <smp.h>
 #include <tracing.h>
 #include <util/AutoLock.h>
@@ -246,6 +248,79 @@ class Reserve : public ObjectCacheTraceEntry {
 // #pragma mark -
 
 
+static void
+get_object_cache_stats(ObjectCache* cache, object_cache_stats* stats)
+{
+	// Note, this is also used from the kernel debugger, and thus doesn't lock
+	// anything; the counters are only meant as a snapshot anyway.
+	memset(stats, 0, sizeof(object_cache_stats));
+
+	strlcpy(stats->name, cache->name, sizeof(stats->name));
+	stats->object_size = cache->object_size;
+	stats->usage = cache->usage;
+	stats->used_count = cache->used_count;
+	stats->total_objects = cache->total_objects;
+	stats->flags = cache->flags;
+
+	if ((cache->flags & CACHE_NO_DEPOT) == 0) {
+		object_depot_stats depotStats;
+		object_depot_get_stats(&cache->depot, &depotStats);
+
+		stats->magazine_capacity = depotStats.magazine_capacity;
+		stats->magazine_resizes = depotStats.resizes;
+		stats->alloc_hits = depotStats.alloc_hits;
+		stats->free_hits = depotStats.free_hits;
+		stats->depot_exchanges = depotStats.exchanges;
+		stats->depot_contentions = depotStats.contentions;
+	}
+
+	stats->slab_allocs = cache->slab_allocs;
+	stats->slab_frees = cache->slab_frees;
+	stats->slab_refills = cache->slab_refills;
+}
+
+
+static status_t
+slab_statistics_syscall(const char* subsystem, uint32 function,
+	void* buffer, size_t bufferSize)
+{
+	if (function != GET_NEXT_OBJECT_CACHE_STATS)
+		return B_BAD_VALUE;
+
+	object_cache_stats_args args;
+	if (bufferSize != sizeof(args))
+		return B_BAD_VALUE;
+	if (!IS_USER_ADDRESS(buffer)
+		|| user_memcpy(&args, buffer, sizeof(args)) != B_OK) {
+		return B_BAD_ADDRESS;
+	}
+
+	if (args.cookie < 0)
+		return B_BAD_VALUE;
+
+	MutexLocker cacheListLocker(sObjectCacheListLock);
+
+	// the cookie is the index of the next cache in the list
+	ObjectCacheList::Iterator it = sObjectCaches.GetIterator();
+	ObjectCache* cache = it.Next();
+	for (int32 i = 0; cache != NULL && i < args.cookie; i++)
+		cache = it.Next();
+
+	if (cache == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	get_object_cache_stats(cache, &args.stats);
+	cacheListLocker.Unlock();
+
+	args.cookie++;
+
+	if (user_memcpy(buffer, &args, sizeof(args)) != B_OK)
+		return B_BAD_ADDRESS;
+
+	return B_OK;
+}
+
+
 static void
 dump_slab(::slab* slab)
 {
@@ -254,9 +329,44 @@ dump_slab(::slab* slab)
 }
 
 
+static void
+dump_slab_statistics()
+{
+	kprintf("%*s %22s %4s %10s %10s %8s %8s %10s %10s %6s\n",
+		B_PRINTF_POINTER_WIDTH + 2, "address", "name", "mag", "allochit",
+		"freehit", "exchange", "contend", "slaballoc", "slabfree", "refill");
+
+	ObjectCacheList::Iterator it = sObjectCaches.GetIterator();
+
+	while (it.HasNext()) {
+		ObjectCache* cache = it.Next();
+
+		object_cache_stats stats;
+		get_object_cache_stats(cache, &stats);
+
+		kprintf("%p %22s %4" B_PRIu32 " %10" B_PRIu64 " %10" B_PRIu64 " %8"
+			B_PRIu64 " %8" B_PRIu64 " %10" B_PRIu64 " %10" B_PRIu64 " %6"
+			B_PRIu64 "\n", cache, cache->name, stats.magazine_capacity,
+			stats.alloc_hits, stats.free_hits, stats.depot_exchanges,
+			stats.depot_contentions, stats.slab_allocs, stats.slab_frees,
+			stats.slab_refills);
+	}
+}
+
+
 static int
 dump_slabs(int argc, char* argv[])
 {
+	if (argc > 1) {
+		if (argc == 2 && strcmp(argv[1], "-s") == 0) {
+			dump_slab_statistics();
+			return 0;
+		}
+
+		print_debugger_command_usage(argv[0]);
+		return 0;
+	}
+
 	kprintf("%*s %22s %8s %8s %8s %6s %8s %8s %8s\n",
 		B_PRINTF_POINTER_WIDTH + 2, "address", "name", "objsize", "align",
 		"usage", "empty", "usedobj", "total", "flags");
@@ -302,6 +412,9 @@ dump_cache_info(int argc, char* argv[])
 	kprintf("cookie:            %p\n", cache->cookie);
 	kprintf("resize entry don't wait: %p\n", cache->resize_entry_dont_wait);
 	kprintf("resize entry can wait:   %p\n", cache->resize_entry_can_wait);
+	kprintf("slab allocs:       %" B_PRIu64 "\n", cache->slab_allocs);
+	kprintf("slab frees:        %" B_PRIu64 "\n", cache->slab_frees);
+	kprintf("slab refills:      %" B_PRIu64 "\n", cache->slab_refills);
 
 	kprintf("  %-*s    %-*s      size   used offset  free\n",
 		B_PRINTF_POINTER_WIDTH, "slab", B_PRINTF_POINTER_WIDTH, "chunk");
@@ -948,6 +1061,7 @@ object_cache_reserve_internal(ObjectCache* cache, size_t objectCount,
 
 		cache->usage += cache->slab_size;
 		cache->total_objects += newSlab->size;
+		cache->slab_refills++;
 
 		cache->empty.Add(newSlab);
 		cache->empty_count++;
@@ -1254,6 +1368,7 @@ object_cache_alloc(object_cache* cache, uint32 flags)
 	object_link* link = _pop(source->free);
 	source->count--;
 	cache->used_count++;
+	cache->slab_allocs++;
 
 	if (cache->total_objects - cache->used_count < cache->min_object_reserve)
 		increase_object_reserve(cache);
@@ -1355,7 +1470,14 @@ slab_init_post_area()
 {
 	MemoryManager::InitPostArea();
 
-	add_debugger_command("slabs", dump_slabs, "list all object caches");
+	add_debugger_command_etc("slabs", dump_slabs, "list all object caches",
+		"[ -s ]\n"
+		"Lists all object caches. If \"-s\" is given, the magazine layer\n"
+		"and slab statistics of each cache are printed instead: the magazine\n"
+		"capacity, the allocations and frees served by the per CPU\n"
+		"magazines, magazine exchanges with the depot, how often the depot\n"
+		"lock was contended, objects allocated from and returned to the\n"
+		"slabs, and the number of slabs created.\n", 0);
 	add_debugger_command("slab_cache", dump_cache_info,
 		"dump information about a specific object cache");
 	add_debugger_command("slab_depot", dump_object_depot,
@@ -1422,6 +1544,8 @@ slab_init_post_thread()
 	}
 
 	resume_thread(objectCacheResizer);
+
+	register_generic_syscall(SLAB_STATISTICS, slab_statistics_syscall, 1, 0);
 }
 
 
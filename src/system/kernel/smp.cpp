@@ -25,6 +25,7 @@
 #include <boot/kernel_args.h>
 #include <cpu.h>
 #include <generic_syscall.h>
+#include <ici_statistics.h>
 #include <int.h>
 #include <spinlock_contention.h>
 #include <thread.h>
@@ -109,6 +110,13 @@ static int32 sBroadcastMessageCounter;
 static bool sICIEnabled = false;
 static int32 sNumCPUs = 1;
 
+// Each CPU only updates its own statistics. They are padded to a cache line to
+// keep that from causing false sharing.
+static union {
+	ici_statistics	statistics;
+	uint8			padding[CACHE_LINE_SIZE];
+} sICIStatistics[SMP_MAX_CPUS] CACHE_LINE_ALIGN;
+
 static int32 process_pending_ici(int32 currentCPU);
 
 
@@ -924,6 +932,29 @@ finish_message_processing(int currentCPU, struct smp_msg* msg,
 }
 
 
+static inline bool
+is_tlb_invalidation_message(int32 message)
+{
+	return message == SMP_MSG_INVALIDATE_PAGE_RANGE
+		|| message == SMP_MSG_INVALIDATE_PAGE_LIST
+		|| message == SMP_MSG_USER_INVALIDATE_PAGES
+		|| message == SMP_MSG_GLOBAL_INVALIDATE_PAGES;
+}
+
+
+/*!	Accounts for \a message being sent to \a targetCPUs other CPUs.
+	Interrupts must be disabled.
+*/
+static inline void
+count_sent_ici(int32 currentCPU, int32 message, int32 targetCPUs)
+{
+	ici_statistics& statistics = sICIStatistics[currentCPU].statistics;
+	statistics.sent += targetCPUs;
+	if (is_tlb_invalidation_message(message))
+		statistics.tlb_shootdowns_sent++;
+}
+
+
 static status_t
 process_pending_ici(int32 currentCPU)
 {
@@ -934,6 +965,11 @@ process_pending_ici(int32 currentCPU)
 
 	TRACE("  cpu %ld message = %ld\n", currentCPU, msg->message);
 
+	ici_statistics& statistics = sICIStatistics[currentCPU].statistics;
+	statistics.received++;
+	if (is_tlb_invalidation_message(msg->message))
+		statistics.tlb_shootdowns_received++;
+
 	bool haltCPU = false;
 
 	switch (msg->message) {
@@ -1023,6 +1059,49 @@ spinlock_contention_syscall(const char* subsystem, uint32 function,
 #endif	// B_DEBUG_SPINLOCK_CONTENTION
 
 
+static int
+dump_ici_statistics(int argc, char** argv)
+{
+	kprintf("cpu %12s %12s %12s %12s\n", "sent", "received", "tlb sent",
+		"tlb received");
+
+	for (int32 i = 0; i < sNumCPUs; i++) {
+		const ici_statistics& statistics = sICIStatistics[i].statistics;
+		kprintf("%3" B_PRId32 " %12" B_PRIu64 " %12" B_PRIu64 " %12" B_PRIu64
+			" %12" B_PRIu64 "\n", i, statistics.sent, statistics.received,
+			statistics.tlb_shootdowns_sent,
+			statistics.tlb_shootdowns_received);
+	}
+
+	return 0;
+}
+
+
+static status_t
+ici_statistics_syscall(const char* subsystem, uint32 function,
+	void* buffer, size_t bufferSize)
+{
+	if (function != GET_ICI_STATISTICS)
+		return B_BAD_VALUE;
+
+	if (bufferSize < sNumCPUs * sizeof(ici_statistics))
+		return B_BUFFER_OVERFLOW;
+
+	if (!IS_USER_ADDRESS(buffer))
+		return B_BAD_ADDRESS;
+
+	for (int32 i = 0; i < sNumCPUs; i++) {
+		if (user_memcpy((ici_statistics*)buffer + i,
+				&sICIStatistics[i].statistics, sizeof(ici_statistics))
+					!= B_OK) {
+			return B_BAD_ADDRESS;
+		}
+	}
+
+	return B_OK;
+}
+
+
 static void
 process_early_cpu_call(int32 cpu)
 {
@@ -1102,6 +1181,8 @@ smp_send_ici(int32 targetCPU, int32 message, addr_t data, addr_t data2,
 		msg->flags = flags;
 		msg->done = 0;
 
+		count_sent_ici(currentCPU, message, 1);
+
 		// stick it in the appropriate cpu's mailbox
 		struct smp_msg* next;
 		do {
@@ -1169,6 +1250,8 @@ smp_send_multicast_ici(CPUSet& cpuMask, int32 message, addr_t data,
 
 	bool broadcast = targetCPUs == sNumCPUs - 1;
 
+	count_sent_ici(currentCPU, message, targetCPUs);
+
 	// stick it in the broadcast mailbox
 	acquire_spinlock_nocheck(&sBroadcastMessageSpinlock);
 	msg->next = sBroadcastMessages;
@@ -1237,6 +1320,8 @@ smp_send_broadcast_ici(int32 message, addr_t data, addr_t data2, addr_t data3,
 		TRACE("smp_send_broadcast_ici%d: inserting msg %p into broadcast "
 			"mbox\n", currentCPU, msg);
 
+		count_sent_ici(currentCPU, message, sNumCPUs - 1);
+
 		// stick it in the appropriate cpu's mailbox
 		acquire_spinlock_nocheck(&sBroadcastMessageSpinlock);
 		msg->next = sBroadcastMessages;
@@ -1303,6 +1388,8 @@ smp_send_broadcast_ici_interrupts_disabled(int32 currentCPU, int32 message,
 	TRACE("smp_send_broadcast_ici_interrupts_disabled %ld: inserting msg %p "
 		"into broadcast mbox\n", currentCPU, msg);
 
+	count_sent_ici(currentCPU, message, sNumCPUs - 1);
+
 	// stick it in the appropriate cpu's mailbox
 	acquire_spinlock_nocheck(&sBroadcastMessageSpinlock);
 	msg->next = sBroadcastMessages;
@@ -1425,6 +1512,11 @@ smp_init(kernel_args* args)
 		"Dump info on an ICI message",
 		"\n"
 		"Dumps info on an ICI message.\n", 0);
+	add_debugger_command_etc("ici_stats", &dump_ici_statistics,
+		"Dump ICI statistics",
+		"\n"
+		"Dumps the number of ICI messages and TLB shootdowns each CPU has\n"
+		"sent and received.\n", 0);
 
 	if (args->num_cpus > 1) {
 		sFreeMessages = NULL;
@@ -1459,6 +1551,11 @@ smp_per_cpu_init(kernel_args* args, int32 cpu)
 status_t
 smp_init_post_generic_syscalls(void)
 {
+	status_t status = register_generic_syscall(ICI_STATISTICS,
+		&ici_statistics_syscall, 0, 0);
+	if (status != B_OK)
+		return status;
+
 #if B_DEBUG_SPINLOCK_CONTENTION
 	return register_generic_syscall(SPINLOCK_CONTENTION,
 		&spinlock_contention_syscall, 0, 0);
@@ -24,6 +24,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <FindDirectory.h>
 #include <KernelExport.h>
 #include <NodeMonitor.h>
@@ -82,6 +84,15 @@
 #define SWAP_BLOCK_SHIFT 5		/* 1 << SWAP_BLOCK_SHIFT == SWAP_BLOCK_PAGES */
 #define SWAP_BLOCK_MASK  (SWAP_BLOCK_PAGES - 1)
 
+// maximum number of adjacent pages written to contiguous swap slots with one
+// request; must not exceed BITMAP_RADIX, as radix_bitmap_alloc() can't
+// allocate more slots at once
+#define SWAP_CLUSTER_PAGES 32
+
+// maximum number of pages read in before and after a faulted page, if they
+// are in the adjacent swap slots
+#define SWAP_READ_AHEAD_PAGES 8
+
 
 static const char* const kDefaultSwapPath = "/var/swap";
 
@@ -155,6 +166,11 @@ static mutex sAvailSwapSpaceLock;
 
 static object_cache* sSwapBlockCache;
 
+static int64 sClusterWrites;
+static int64 sClusterPagesWritten;
+static int64 sSplitClusterWrites;
+static int64 sPagesReadAhead;
+
 
 #if SWAP_TRACING
 namespace SwapTracing {
@@ -254,6 +270,11 @@ dump_swap_info(int argc, char** argv)
 	kprintf("used:      %9" B_PRIu32 "\n", totalSwapPages - freeSwapPages);
 	kprintf("free:      %9" B_PRIu32 "\n", freeSwapPages);
 
+	kprintf("\n");
+	kprintf("clustered writes: %" B_PRId64 " (%" B_PRId64 " pages, %" B_PRId64
+		" split)\n", sClusterWrites, sClusterPagesWritten, sSplitClusterWrites);
+	kprintf("pages read ahead: %" B_PRId64 "\n", sPagesReadAhead);
+
 	return 0;
 }
 
@@ -293,7 +314,10 @@ swap_slot_alloc(uint32 count)
 
 	if (j == sSwapFileCount) {
 		mutex_unlock(&sSwapFileListLock);
-		panic("swap_slot_alloc: swap space exhausted!\n");
+		// Larger runs can also fail due to fragmentation; the callers retry
+		// with fewer slots then.
+		if (count == 1)
+			panic("swap_slot_alloc: swap space exhausted!\n");
 		return SWAP_SLOT_NONE;
 	}
 
@@ -403,25 +427,27 @@ public:
 	{
 	}
 
-	void SetTo(page_num_t pageIndex, swap_addr_t slotIndex, bool newSlot)
+	void SetTo(page_num_t pageIndex, swap_addr_t slotIndex, uint32 pageCount,
+		bool newSlots)
 	{
 		fPageIndex = pageIndex;
 		fSlotIndex = slotIndex;
-		fNewSlot = newSlot;
+		fPageCount = pageCount;
+		fNewSlots = newSlots;
 	}
 
 	virtual void IOFinished(status_t status, bool partialTransfer,
 		generic_size_t bytesTransferred)
 	{
-		if (fNewSlot) {
+		if (fNewSlots) {
 			if (status == B_OK) {
-				fCache->_SwapBlockBuild(fPageIndex, fSlotIndex, 1);
+				fCache->_SwapBlockBuild(fPageIndex, fSlotIndex, fPageCount);
 			} else {
 				AutoLocker<VMCache> locker(fCache);
-				fCache->fAllocatedSwapSize -= B_PAGE_SIZE;
+				fCache->fAllocatedSwapSize -= (off_t)fPageCount * B_PAGE_SIZE;
 				locker.Unlock();
 
-				swap_slot_dealloc(fSlotIndex, 1);
+				swap_slot_dealloc(fSlotIndex, fPageCount);
 			}
 		}
 
@@ -434,10 +460,79 @@ private:
 	VMAnonymousCache*	fCache;
 	page_num_t			fPageIndex;
 	swap_addr_t			fSlotIndex;
-	bool				fNewSlot;
+	uint32				fPageCount;
+	bool				fNewSlots;
+};
+
+
+/*!	Collects the results of the requests a cluster had to be split into, when
+	there was no contiguous swap space for all of it, and passes them on as
+	one.
+*/
+class ClusterWriteCallback : public StackableAsyncIOCallback {
+public:
+	ClusterWriteCallback(AsyncIOCallback* callback, int32 requestCount)
+		:
+		StackableAsyncIOCallback(callback),
+		fPendingRequests(requestCount),
+		fStatus(B_OK),
+		fPartialTransfer(0),
+		fBytesTransferred(0)
+	{
+	}
+
+	virtual void IOFinished(status_t status, bool partialTransfer,
+		generic_size_t bytesTransferred)
+	{
+		if (status != B_OK)
+			atomic_test_and_set(&fStatus, status, B_OK);
+		if (partialTransfer)
+			atomic_set(&fPartialTransfer, 1);
+		atomic_add64(&fBytesTransferred, bytesTransferred);
+
+		if (atomic_add(&fPendingRequests, -1) != 1)
+			return;
+
+		fNextCallback->IOFinished(fStatus, fPartialTransfer != 0,
+			fBytesTransferred);
+
+		delete this;
+	}
+
+private:
+	int32				fPendingRequests;
+	int32				fStatus;
+	int32				fPartialTransfer;
+	int64				fBytesTransferred;
 };
 
 
+/*!	Copies the part of the \a count \a vecs that starts \a offset bytes into
+	them to \a offsetVecs, which must have room for \a count vecs.
+	\return The number of vecs copied.
+*/
+static uint32
+get_io_vecs_from_offset(const generic_io_vec* vecs, size_t count,
+	generic_size_t offset, generic_io_vec* offsetVecs)
+{
+	uint32 index = 0;
+	while (index < count && offset >= vecs[index].length) {
+		offset -= vecs[index].length;
+		index++;
+	}
+
+	uint32 offsetCount = 0;
+	for (; index < count; index++) {
+		offsetVecs[offsetCount].base = vecs[index].base + offset;
+		offsetVecs[offsetCount].length = vecs[index].length - offset;
+		offsetCount++;
+		offset = 0;
+	}
+
+	return offsetCount;
+}
+
+
 // #pragma mark -
 
 
@@ -589,12 +684,21 @@ VMAnonymousCache::DebugHasPage(off_t offset)
 }
 
 
+/*!	The cache must not be locked.
+*/
 status_t
 VMAnonymousCache::Read(off_t offset, const generic_io_vec* vecs, size_t count,
 	uint32 flags, generic_size_t* _numBytes)
 {
 	off_t pageIndex = offset >> PAGE_SHIFT;
 
+	// Page faults read in single pages. Since adjacent pages are usually
+	// written to swap together, read their neighbours in along with them.
+	if (count == 1 && vecs[0].length == B_PAGE_SIZE
+		&& (flags & B_PHYSICAL_IO_REQUEST) != 0) {
+		return _ReadCluster(pageIndex, vecs[0], flags, _numBytes);
+	}
+
 	for (uint32 i = 0, j = 0; i < count; i = j) {
 		swap_addr_t startSlotIndex = _SwapBlockGetAddress(pageIndex + i);
 		for (j = i + 1; j < count; j++) {
@@ -708,62 +812,164 @@ VMAnonymousCache::Write(off_t offset, const generic_io_vec* vecs, size_t count,
 }
 
 
+/*!	Writes a run of pages that are adjacent in the cache, as the page writer
+	collects them, to contiguous swap slots, so that they can be read in
+	together again later.
+*/
 status_t
 VMAnonymousCache::WriteAsync(off_t offset, const generic_io_vec* vecs,
 	size_t count, generic_size_t numBytes, uint32 flags,
 	AsyncIOCallback* _callback)
 {
-	// TODO: Currently this method is only used for single pages. Either make
-	// more flexible use of it or change the interface!
-	// This implementation relies on the current usage!
-	ASSERT(count == 1);
-	ASSERT(numBytes <= B_PAGE_SIZE);
-
 	page_num_t pageIndex = offset >> PAGE_SHIFT;
+	uint32 pageCount = (numBytes + B_PAGE_SIZE - 1) >> PAGE_SHIFT;
+	ASSERT(pageCount > 0 && pageCount <= SWAP_CLUSTER_PAGES);
+	ASSERT(count <= pageCount);
+
+	// If the pages already have contiguous swap space, we simply overwrite it.
 	swap_addr_t slotIndex = _SwapBlockGetAddress(pageIndex);
-	bool newSlot = slotIndex == SWAP_SLOT_NONE;
+	bool newSlots = slotIndex == SWAP_SLOT_NONE;
+	for (uint32 i = 1; !newSlots && i < pageCount; i++) {
+		if (_SwapBlockGetAddress(pageIndex + i) != slotIndex + i)
+			newSlots = true;
+	}
 
-	// If the page doesn't have any swap space yet, allocate it.
-	if (newSlot) {
+	struct {
+		swap_addr_t	slotIndex;
+		uint32		pageCount;
+	} runs[SWAP_CLUSTER_PAGES];
+	uint32 runCount = 0;
+	off_t clusterSize = (off_t)pageCount * B_PAGE_SIZE;
+
+	if (newSlots) {
+		// Otherwise free the swap space some of them might have, and allocate
+		// new slots for all of them.
 		AutoLocker<VMCache> locker(this);
-		if (fAllocatedSwapSize + B_PAGE_SIZE > fCommittedSwapSize) {
+
+		for (uint32 i = 0; i < pageCount; i++) {
+			swap_addr_t oldSlotIndex = _SwapBlockGetAddress(pageIndex + i);
+			if (oldSlotIndex != SWAP_SLOT_NONE) {
+				swap_slot_dealloc(oldSlotIndex, 1);
+				_SwapBlockFree(pageIndex + i, 1);
+				fAllocatedSwapSize -= B_PAGE_SIZE;
+			}
+		}
+
+		if (fAllocatedSwapSize + clusterSize > fCommittedSwapSize) {
 			_callback->IOFinished(B_ERROR, true, 0);
 			return B_ERROR;
 		}
 
-		fAllocatedSwapSize += B_PAGE_SIZE;
+		fAllocatedSwapSize += clusterSize;
+		locker.Unlock();
+
+		// try to allocate all slots at once, and split the cluster only if
+		// that fails
+		for (uint32 i = 0; i < pageCount;) {
+			uint32 n = pageCount - i;
+			while ((slotIndex = swap_slot_alloc(n)) == SWAP_SLOT_NONE && n >= 2)
+				n >>= 1;
+
+			if (slotIndex == SWAP_SLOT_NONE) {
+				panic("VMAnonymousCache::WriteAsync(): can't allocate swap "
+					"space\n");
+			}
+
+			runs[runCount].slotIndex = slotIndex;
+			runs[runCount].pageCount = n;
+			runCount++;
+			i += n;
+		}
+	} else {
+		runs[0].slotIndex = slotIndex;
+		runs[0].pageCount = pageCount;
+		runCount = 1;
+	}
+
+	// create our callbacks, one per request, and one that collects their
+	// results, if we need more than one request
+	bool vip = (flags & B_VIP_IO_REQUEST) != 0;
+	AsyncIOCallback* clusterCallback = _callback;
+	if (runCount > 1) {
+		clusterCallback = vip
+			? new(malloc_flags(HEAP_PRIORITY_VIP))
+				ClusterWriteCallback(_callback, runCount)
+			: new(std::nothrow) ClusterWriteCallback(_callback, runCount);
+	}
+
+	WriteCallback* callbacks[SWAP_CLUSTER_PAGES];
+	uint32 callbackCount = 0;
+	if (clusterCallback != NULL) {
+		for (; callbackCount < runCount; callbackCount++) {
+			WriteCallback* callback = vip
+				? new(malloc_flags(HEAP_PRIORITY_VIP))
+					WriteCallback(this, clusterCallback)
+				: new(std::nothrow) WriteCallback(this, clusterCallback);
+			if (callback == NULL)
+				break;
 
-		slotIndex = swap_slot_alloc(1);
+			callbacks[callbackCount] = callback;
+		}
 	}
 
-	// create our callback
-	WriteCallback* callback = (flags & B_VIP_IO_REQUEST) != 0
-		? new(malloc_flags(HEAP_PRIORITY_VIP)) WriteCallback(this, _callback)
-		: new(std::nothrow) WriteCallback(this, _callback);
-	if (callback == NULL) {
-		if (newSlot) {
+	if (callbackCount < runCount) {
+		for (uint32 i = 0; i < callbackCount; i++)
+			delete callbacks[i];
+		if (clusterCallback != _callback)
+			delete clusterCallback;
+
+		if (newSlots) {
 			AutoLocker<VMCache> locker(this);
-			fAllocatedSwapSize -= B_PAGE_SIZE;
+			fAllocatedSwapSize -= clusterSize;
 			locker.Unlock();
 
-			swap_slot_dealloc(slotIndex, 1);
+			for (uint32 i = 0; i < runCount; i++)
+				swap_slot_dealloc(runs[i].slotIndex, runs[i].pageCount);
 		}
 		_callback->IOFinished(B_NO_MEMORY, true, 0);
 		return B_NO_MEMORY;
 	}
-	// TODO: If the page already had swap space assigned, we don't need an own
-	// callback.
+	// TODO: If the pages already had swap space assigned, we don't need our
+	// own callback.
+
+	if (pageCount > 1) {
+		atomic_add64(&sClusterWrites, 1);
+		atomic_add64(&sClusterPagesWritten, pageCount);
+		if (runCount > 1)
+			atomic_add64(&sSplitClusterWrites, 1);
+	}
 
-	callback->SetTo(pageIndex, slotIndex, newSlot);
+	// write the pages asynchronously
+	status_t status = B_OK;
+	generic_size_t runOffset = 0;
 
-	T(WritePage(this, pageIndex, slotIndex));
+	for (uint32 i = 0; i < runCount; i++) {
+		callbacks[i]->SetTo(pageIndex, runs[i].slotIndex, runs[i].pageCount,
+			newSlots);
 
-	// write the page asynchrounously
-	swap_file* swapFile = find_swap_file(slotIndex);
-	off_t pos = (off_t)(slotIndex - swapFile->first_slot) * B_PAGE_SIZE;
+		T(WritePage(this, pageIndex, runs[i].slotIndex));
+
+		generic_io_vec runVecs[SWAP_CLUSTER_PAGES];
+		uint32 runVecCount = get_io_vecs_from_offset(vecs, count, runOffset,
+			runVecs);
+		generic_size_t runLength = std::min(numBytes - runOffset,
+			(generic_size_t)runs[i].pageCount * B_PAGE_SIZE);
+
+		swap_file* swapFile = find_swap_file(runs[i].slotIndex);
+		off_t pos = (off_t)(runs[i].slotIndex - swapFile->first_slot)
+			* B_PAGE_SIZE;
+
+		status_t runStatus = vfs_asynchronous_write_pages(swapFile->vnode,
+			swapFile->cookie, pos, runVecs, runVecCount, runLength, flags,
+			callbacks[i]);
+		if (status == B_OK)
+			status = runStatus;
 
-	return vfs_asynchronous_write_pages(swapFile->vnode, swapFile->cookie, pos,
-		vecs, 1, numBytes, flags, callback);
+		pageIndex += runs[i].pageCount;
+		runOffset += runLength;
+	}
+
+	return status;
 }
 
 
@@ -780,7 +986,7 @@ VMAnonymousCache::CanWritePage(off_t offset)
 int32
 VMAnonymousCache::MaxPagesPerAsyncWrite() const
 {
-	return 1;
+	return SWAP_CLUSTER_PAGES;
 }
 
 
@@ -947,6 +1153,123 @@ VMAnonymousCache::_SwapBlockFree(off_t startPageIndex, uint32 count)
 }
 
 
+/*!	Reads in the page at \a pageIndex into \a vec, together with the pages
+	around it that are in the adjacent swap slots, and that are not in the
+	cache yet. The latter are inserted into the cache.
+	The cache must not be locked.
+*/
+status_t
+VMAnonymousCache::_ReadCluster(off_t pageIndex, const generic_io_vec& vec,
+	uint32 flags, generic_size_t* _numBytes)
+{
+	swap_addr_t slotIndex = _SwapBlockGetAddress(pageIndex);
+	swap_file* swapFile = find_swap_file(slotIndex);
+
+	AutoLocker<VMCache> locker(this);
+
+	// find the neighbours we can read in as well
+	off_t firstPageIndex = virtual_base >> PAGE_SHIFT;
+	off_t endPageIndex = (virtual_end + B_PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	uint32 before = 0;
+	while (before < SWAP_READ_AHEAD_PAGES) {
+		off_t index = pageIndex - before - 1;
+		if (index < firstPageIndex
+			|| slotIndex - before <= swapFile->first_slot
+			|| _SwapBlockGetAddress(index) != slotIndex - before - 1
+			|| LookupPage(index << PAGE_SHIFT) != NULL) {
+			break;
+		}
+		before++;
+	}
+
+	uint32 after = 0;
+	while (after < SWAP_READ_AHEAD_PAGES) {
+		off_t index = pageIndex + after + 1;
+		if (index >= endPageIndex
+			|| slotIndex + after + 1 >= swapFile->last_slot
+			|| _SwapBlockGetAddress(index) != slotIndex + after + 1
+			|| LookupPage(index << PAGE_SHIFT) != NULL) {
+			break;
+		}
+		after++;
+	}
+
+	// Don't wait for memory just to read ahead.
+	vm_page_reservation reservation;
+	if (before + after > 0 && !vm_page_try_reserve_pages(&reservation,
+			before + after, VM_PRIORITY_USER)) {
+		before = after = 0;
+	}
+
+	uint32 pageCount = before + 1 + after;
+	vm_page* pages[2 * SWAP_READ_AHEAD_PAGES + 1];
+	generic_io_vec vecs[2 * SWAP_READ_AHEAD_PAGES + 1];
+
+	for (uint32 i = 0; i < pageCount; i++) {
+		if (i == before) {
+			pages[i] = NULL;
+			vecs[i] = vec;
+			continue;
+		}
+
+		vm_page* page = vm_page_allocate_page(&reservation,
+			PAGE_STATE_ACTIVE | VM_PAGE_ALLOC_BUSY);
+		InsertPage(page, (pageIndex - before + i) << PAGE_SHIFT);
+
+		pages[i] = page;
+		vecs[i].base = (phys_addr_t)page->physical_page_number * B_PAGE_SIZE;
+		vecs[i].length = B_PAGE_SIZE;
+	}
+
+	if (pageCount > 1)
+		vm_page_unreserve_pages(&reservation);
+
+	locker.Unlock();
+
+	T(ReadPage(this, pageIndex, slotIndex));
+
+	off_t pos = (off_t)(slotIndex - before - swapFile->first_slot)
+		* B_PAGE_SIZE;
+	generic_size_t bytesRead = (generic_size_t)pageCount * B_PAGE_SIZE;
+
+	status_t status = vfs_read_pages(swapFile->vnode, swapFile->cookie, pos,
+		vecs, pageCount, flags, &bytesRead);
+
+	if (pageCount > 1) {
+		locker.Lock();
+
+		for (uint32 i = 0; i < pageCount; i++) {
+			vm_page* page = pages[i];
+			if (page == NULL)
+				continue;
+
+			if (status == B_OK
+				&& bytesRead >= (generic_size_t)(i + 1) * B_PAGE_SIZE) {
+				MarkPageUnbusy(page);
+				DEBUG_PAGE_ACCESS_END(page);
+			} else {
+				NotifyPageEvents(page, PAGE_EVENT_NOT_BUSY);
+				RemovePage(page);
+				vm_page_set_state(page, PAGE_STATE_FREE);
+			}
+		}
+
+		locker.Unlock();
+
+		atomic_add64(&sPagesReadAhead, pageCount - 1);
+	}
+
+	if (status != B_OK)
+		return status;
+
+	generic_size_t skipped = (generic_size_t)before * B_PAGE_SIZE;
+	*_numBytes = bytesRead > skipped
+		? std::min(bytesRead - skipped, vec.length) : 0;
+	return B_OK;
+}
+
+
 swap_addr_t
 VMAnonymousCache::_SwapBlockGetAddress(off_t pageIndex)
 {
@@ -77,6 +77,9 @@ private:
 									swap_addr_t slotIndex, uint32 count);
 			void        		_SwapBlockFree(off_t pageIndex, uint32 count);
 			swap_addr_t			_SwapBlockGetAddress(off_t pageIndex);
+			status_t			_ReadCluster(off_t pageIndex,
+									const generic_io_vec& vec, uint32 flags,
+									generic_size_t* _numBytes);
 			status_t			_Commit(off_t size, int priority);
 
 			void				_MergePagesSmallerSource(
@@ -31,6 +31,39 @@ VMTranslationMap::~VMTranslationMap()
 }
 
 
+/*!	Returns the size of the large pages MapLargePage() can map, or \c 0, if
+	the translation map doesn't support large pages.
+
+	The default implementation returns \c 0.
+*/
+size_t
+VMTranslationMap::LargePageSize() const
+{
+	return 0;
+}
+
+
+/*!	Maps a physically contiguous, LargePageSize() sized and aligned range at
+	the equally aligned \a virtualAddress with a single large page.
+
+	The map must be locked. Fails when the range is already partially mapped;
+	the caller is expected to fall back to Map() for the individual pages
+	then. Large page mappings are transparent to the caller: they are split
+	as needed when only a part of them is unmapped or protected later on.
+	\a reservation must cover the page table needed to map the range with
+	regular pages, so that the implementation can set it aside for that.
+
+	The default implementation returns \c B_NOT_SUPPORTED.
+*/
+status_t
+VMTranslationMap::MapLargePage(addr_t virtualAddress,
+	phys_addr_t physicalAddress, uint32 attributes, uint32 memoryType,
+	vm_page_reservation* reservation)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
 status_t
 VMTranslationMap::DebugMarkRangePresent(addr_t start, addr_t end,
 	bool markPresent)
@@ -39,6 +72,39 @@ VMTranslationMap::DebugMarkRangePresent(addr_t start, addr_t end,
 }
 
 
+/*!	Starts a batch of operations on the map by the calling thread.
+
+	Until the matching EndBatch(), unlocking the map won't flush the TLB
+	invalidations the thread's operations have queued; they are flushed all at
+	once when the batch ends instead. Explicit Flush() calls, as well as
+	unlocking the map by other threads, still flush everything that is
+	pending. Batches may be nested.
+
+	Since invalidations are deferred, the caller must make sure that nothing
+	depends on them before the batch ends. In particular, pages unmapped
+	during the batch must not be reused before, and nothing may copy pages
+	whose mappings have been write protected.
+
+	The default implementation does nothing, i.e. operations are flushed
+	individually as usual.
+*/
+void
+VMTranslationMap::BeginBatch()
+{
+}
+
+
+/*!	Ends a batch of operations started with BeginBatch() and flushes all
+	pending TLB invalidations, if it was the outermost batch.
+
+	The default implementation does nothing.
+*/
+void
+VMTranslationMap::EndBatch()
+{
+}
+
+
 /*!	Unmaps a range of pages of an area.
 
 	The default implementation just iterates over all virtual pages of the
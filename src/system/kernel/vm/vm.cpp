@@ -251,6 +251,11 @@ static off_t sNeededMemory;
 static mutex sAvailableMemoryLock = MUTEX_INITIALIZER("available memory lock");
 static uint32 sPageFaults;
 
+// large page statistics
+static int32 sLargePageAreas;
+static int32 sLargePageMappings;
+static int32 sLargePageFallbacks;
+
 static VMPhysicalPageMapper* sPhysicalPageMapper;
 
 #if DEBUG_CACHE_LIST
@@ -585,6 +590,60 @@ map_page(VMArea* area, vm_page* page, addr_t address, uint32 protection,
 }
 
 
+/*!	Tries to back the range of the wired \a area starting at \a address with
+	a single large page, allocating its pages from \a reservation.
+	Returns \c false, if no suitable physical page run was available; the
+	caller has to allocate and map the pages of the range individually then.
+	The area's top cache must be locked.
+*/
+static bool
+map_large_page(VMArea* area, addr_t address, uint32 protection,
+	uint32 pageAllocFlags, vm_page_reservation* reservation)
+{
+	VMTranslationMap* map = area->address_space->TranslationMap();
+	page_num_t pageCount = map->LargePageSize() / B_PAGE_SIZE;
+
+	vm_page* page = vm_page_allocate_aligned_page_run(reservation,
+		PAGE_STATE_WIRED | pageAllocFlags, pageCount);
+	if (page == NULL) {
+		atomic_add(&sLargePageFallbacks, 1);
+		return false;
+	}
+
+	phys_addr_t physicalAddress
+		= (phys_addr_t)page->physical_page_number * B_PAGE_SIZE;
+
+	map->Lock();
+
+	if (map->MapLargePage(address, physicalAddress, protection,
+			area->MemoryType(), reservation) == B_OK) {
+		atomic_add(&sLargePageMappings, 1);
+	} else {
+		// There's a page table in the way already. We have the pages anyway,
+		// so just map them individually.
+		atomic_add(&sLargePageFallbacks, 1);
+
+		for (page_num_t i = 0; i < pageCount; i++) {
+			map->Map(address + i * B_PAGE_SIZE,
+				physicalAddress + i * B_PAGE_SIZE, protection,
+				area->MemoryType(), reservation);
+		}
+	}
+
+	map->Unlock();
+
+	off_t offset = address - area->Base() + area->cache_offset;
+	for (page_num_t i = 0; i < pageCount; i++, offset += B_PAGE_SIZE) {
+		area->cache->InsertPage(&page[i], offset);
+		increment_page_wired_count(&page[i]);
+
+		DEBUG_PAGE_ACCESS_END(&page[i]);
+	}
+
+	return true;
+}
+
+
 /*!	If \a preserveModified is \c true, the caller must hold the lock of the
 	page's cache.
 */
@@ -1299,6 +1358,7 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 	// For full lock or contiguous areas we're also going to map the pages and
 	// thus need to reserve pages for the mapping backend upfront.
 	addr_t reservedMapPages = 0;
+	size_t largePageSize = 0;
 	if (wiring == B_FULL_LOCK || wiring == B_CONTIGUOUS) {
 		AddressSpaceWriteLocker locker;
 		status_t status = locker.SetTo(team);
@@ -1307,6 +1367,22 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 
 		VMTranslationMap* map = locker.AddressSpace()->TranslationMap();
 		reservedMapPages = map->MaxPagesNeededToMap(0, size - 1);
+		if (!isStack)
+			largePageSize = map->LargePageSize();
+	}
+
+	// Large pages can only be used where the area's virtual addresses are
+	// suitably aligned. If the caller doesn't care where the area goes, align
+	// it, so that it can be backed by large pages entirely.
+	virtual_address_restrictions largePageAddressRestrictions;
+	if (largePageSize != 0 && size >= largePageSize
+		&& virtualAddressRestrictions->alignment < largePageSize
+		&& (virtualAddressRestrictions->address_specification == B_ANY_ADDRESS
+			|| virtualAddressRestrictions->address_specification
+				== B_ANY_KERNEL_ADDRESS)) {
+		largePageAddressRestrictions = *virtualAddressRestrictions;
+		largePageAddressRestrictions.alignment = largePageSize;
+		virtualAddressRestrictions = &largePageAddressRestrictions;
 	}
 
 	int priority;
@@ -1419,8 +1495,10 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 
 		case B_FULL_LOCK:
 		{
-			// Allocate and map all pages for this area
+			// Allocate and map all pages for this area, using large pages
+			// where possible
 
+			uint32 largePages = 0;
 			off_t offset = 0;
 			for (addr_t address = area->Base();
 					address < area->Base() + (area->Size() - 1);
@@ -1435,6 +1513,21 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 #	endif
 					continue;
 #endif
+				if (largePageSize != 0 && address % largePageSize == 0
+					&& area->Base() + area->Size() - address >= largePageSize) {
+					if (map_large_page(area, address, protection,
+							pageAllocFlags, &reservation)) {
+						largePages++;
+						address += largePageSize - B_PAGE_SIZE;
+						offset += largePageSize - B_PAGE_SIZE;
+						continue;
+					}
+
+					// Physical memory is too fragmented; don't search for
+					// another page run for the rest of the area
+					largePageSize = 0;
+				}
+
 				vm_page* page = vm_page_allocate_page(&reservation,
 					PAGE_STATE_WIRED | pageAllocFlags);
 				cache->InsertPage(page, offset);
@@ -1443,6 +1536,8 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 				DEBUG_PAGE_ACCESS_END(page);
 			}
 
+			if (largePages > 0)
+				atomic_add(&sLargePageAreas, 1);
 			break;
 		}
 
@@ -1499,6 +1594,11 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 			addr_t virtualAddress = area->Base();
 			off_t offset = 0;
 
+			// The run isn't necessarily aligned, but where its physical and
+			// virtual addresses happen to be, we can use large pages.
+			addr_t largePageEnd = 0;
+			uint32 largePages = 0;
+
 			map->Lock();
 
 			for (virtualAddress = area->Base(); virtualAddress < area->Base()
@@ -1508,10 +1608,23 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 				if (page == NULL)
 					panic("couldn't lookup physical page just allocated\n");
 
-				status = map->Map(virtualAddress, physicalAddress, protection,
-					area->MemoryType(), &reservation);
-				if (status < B_OK)
-					panic("couldn't map physical page in page run\n");
+				if (largePageSize != 0 && virtualAddress >= largePageEnd
+					&& virtualAddress % largePageSize == 0
+					&& physicalAddress % largePageSize == 0
+					&& area->Base() + area->Size() - virtualAddress
+						>= largePageSize
+					&& map->MapLargePage(virtualAddress, physicalAddress,
+						protection, area->MemoryType(), &reservation) == B_OK) {
+					largePageEnd = virtualAddress + largePageSize;
+					largePages++;
+				}
+
+				if (virtualAddress >= largePageEnd) {
+					status = map->Map(virtualAddress, physicalAddress,
+						protection, area->MemoryType(), &reservation);
+					if (status < B_OK)
+						panic("couldn't map physical page in page run\n");
+				}
 
 				cache->InsertPage(page, offset);
 				increment_page_wired_count(page);
@@ -1520,6 +1633,11 @@ vm_create_anonymous_area(team_id team, const char *name, addr_t size,
 			}
 
 			map->Unlock();
+
+			if (largePages > 0) {
+				atomic_add(&sLargePageAreas, 1);
+				atomic_add(&sLargePageMappings, largePages);
+			}
 			break;
 		}
 
@@ -1859,63 +1977,18 @@ pre_map_area_pages(VMArea* area, VMCache* cache,
 }
 
 
-/*!	Will map the file specified by \a fd to an area in memory.
-	The file will be mirrored beginning at the specified \a offset. The
-	\a offset and \a size arguments have to be page aligned.
+/*!	Maps the file \a vnode to an area in memory; the caller must hold a
+	reference to it, and have checked the access permissions.
+	The \a offset and \a size arguments have to be page aligned already, and
+	the \a protection must already contain \c B_SHARED_AREA for a shared
+	\a mapping.
 */
 static area_id
-_vm_map_file(team_id team, const char* name, void** _address,
+_vm_map_vnode(team_id team, const char* name, void** _address,
 	uint32 addressSpec, size_t size, uint32 protection, uint32 mapping,
-	bool unmapAddressRange, int fd, off_t offset, bool kernel)
+	bool unmapAddressRange, struct vnode* vnode, off_t offset, bool kernel)
 {
-	// TODO: for binary files, we want to make sure that they get the
-	//	copy of a file at a given time, ie. later changes should not
-	//	make it into the mapped copy -- this will need quite some changes
-	//	to be done in a nice way
-	TRACE(("_vm_map_file(fd = %d, offset = %" B_PRIdOFF ", size = %lu, mapping "
-		"%" B_PRIu32 ")\n", fd, offset, size, mapping));
-
-	offset = ROUNDDOWN(offset, B_PAGE_SIZE);
-	size = PAGE_ALIGN(size);
-
-	if (mapping == REGION_NO_PRIVATE_MAP)
-		protection |= B_SHARED_AREA;
-	if (addressSpec != B_EXACT_ADDRESS)
-		unmapAddressRange = false;
-
-	if (fd < 0) {
-		uint32 flags = unmapAddressRange ? CREATE_AREA_UNMAP_ADDRESS_RANGE : 0;
-		virtual_address_restrictions virtualRestrictions = {};
-		virtualRestrictions.address = *_address;
-		virtualRestrictions.address_specification = addressSpec;
-		physical_address_restrictions physicalRestrictions = {};
-		return vm_create_anonymous_area(team, name, size, B_NO_LOCK, protection,
-			flags, 0, &virtualRestrictions, &physicalRestrictions, kernel,
-			_address);
-	}
-
-	// get the open flags of the FD
-	file_descriptor* descriptor = get_fd(get_current_io_context(kernel), fd);
-	if (descriptor == NULL)
-		return EBADF;
-	int32 openMode = descriptor->open_mode;
-	put_fd(descriptor);
-
-	// The FD must open for reading at any rate. For shared mapping with write
-	// access, additionally the FD must be open for writing.
-	if ((openMode & O_ACCMODE) == O_WRONLY
-		|| (mapping == REGION_NO_PRIVATE_MAP
-			&& (protection & (B_WRITE_AREA | B_KERNEL_WRITE_AREA)) != 0
-			&& (openMode & O_ACCMODE) == O_RDONLY)) {
-		return EACCES;
-	}
-
-	// get the vnode for the object, this also grabs a ref to it
-	struct vnode* vnode = NULL;
-	status_t status = vfs_get_vnode_from_fd(fd, kernel, &vnode);
-	if (status < B_OK)
-		return status;
-	CObjectDeleter<struct vnode> vnodePutter(vnode, vfs_put_vnode);
+	status_t status;
 
 	// If we're going to pre-map pages, we need to reserve the pages needed by
 	// the mapping backend upfront.
@@ -2005,6 +2078,69 @@ _vm_map_file(team_id team, const char* name, void** _address,
 }
 
 
+/*!	Will map the file specified by \a fd to an area in memory.
+	The file will be mirrored beginning at the specified \a offset. The
+	\a offset and \a size arguments have to be page aligned.
+*/
+static area_id
+_vm_map_file(team_id team, const char* name, void** _address,
+	uint32 addressSpec, size_t size, uint32 protection, uint32 mapping,
+	bool unmapAddressRange, int fd, off_t offset, bool kernel)
+{
+	// TODO: for binary files, we want to make sure that they get the
+	//	copy of a file at a given time, ie. later changes should not
+	//	make it into the mapped copy -- this will need quite some changes
+	//	to be done in a nice way
+	TRACE(("_vm_map_file(fd = %d, offset = %" B_PRIdOFF ", size = %lu, mapping "
+		"%" B_PRIu32 ")\n", fd, offset, size, mapping));
+
+	offset = ROUNDDOWN(offset, B_PAGE_SIZE);
+	size = PAGE_ALIGN(size);
+
+	if (mapping == REGION_NO_PRIVATE_MAP)
+		protection |= B_SHARED_AREA;
+	if (addressSpec != B_EXACT_ADDRESS)
+		unmapAddressRange = false;
+
+	if (fd < 0) {
+		uint32 flags = unmapAddressRange ? CREATE_AREA_UNMAP_ADDRESS_RANGE : 0;
+		virtual_address_restrictions virtualRestrictions = {};
+		virtualRestrictions.address = *_address;
+		virtualRestrictions.address_specification = addressSpec;
+		physical_address_restrictions physicalRestrictions = {};
+		return vm_create_anonymous_area(team, name, size, B_NO_LOCK, protection,
+			flags, 0, &virtualRestrictions, &physicalRestrictions, kernel,
+			_address);
+	}
+
+	// get the open flags of the FD
+	file_descriptor* descriptor = get_fd(get_current_io_context(kernel), fd);
+	if (descriptor == NULL)
+		return EBADF;
+	int32 openMode = descriptor->open_mode;
+	put_fd(descriptor);
+
+	// The FD must open for reading at any rate. For shared mapping with write
+	// access, additionally the FD must be open for writing.
+	if ((openMode & O_ACCMODE) == O_WRONLY
+		|| (mapping == REGION_NO_PRIVATE_MAP
+			&& (protection & (B_WRITE_AREA | B_KERNEL_WRITE_AREA)) != 0
+			&& (openMode & O_ACCMODE) == O_RDONLY)) {
+		return EACCES;
+	}
+
+	// get the vnode for the object, this also grabs a ref to it
+	struct vnode* vnode = NULL;
+	status_t status = vfs_get_vnode_from_fd(fd, kernel, &vnode);
+	if (status < B_OK)
+		return status;
+	CObjectDeleter<struct vnode> vnodePutter(vnode, vfs_put_vnode);
+
+	return _vm_map_vnode(team, name, _address, addressSpec, size, protection,
+		mapping, unmapAddressRange, vnode, offset, kernel);
+}
+
+
 area_id
 vm_map_file(team_id aid, const char* name, void** address, uint32 addressSpec,
 	addr_t size, uint32 protection, uint32 mapping, bool unmapAddressRange,
@@ -2018,6 +2154,22 @@ vm_map_file(team_id aid, const char* name, void** address, uint32 addressSpec,
 }
 
 
+/*!	Maps the file \a vnode read-only into the kernel address space, sharing
+	the pages of its file cache. The caller must hold a reference to the
+	\a vnode, and have made sure it may be read.
+*/
+area_id
+vm_map_vnode_into_kernel(const char* name, void** _address, addr_t size,
+	struct vnode* vnode, off_t offset)
+{
+	*_address = NULL;
+	return _vm_map_vnode(VMAddressSpace::KernelID(), name, _address,
+		B_ANY_KERNEL_ADDRESS, PAGE_ALIGN(size),
+		B_KERNEL_READ_AREA | B_SHARED_AREA, REGION_NO_PRIVATE_MAP, false,
+		vnode, ROUNDDOWN(offset, B_PAGE_SIZE), true);
+}
+
+
 VMCache*
 vm_area_get_locked_cache(VMArea* area)
 {
@@ -3413,6 +3565,18 @@ dump_available_memory(int argc, char** argv)
 }
 
 
+static int
+dump_large_pages(int argc, char** argv)
+{
+	kprintf("large page size:     %" B_PRIuSIZE " KiB\n",
+		VMAddressSpace::Kernel()->TranslationMap()->LargePageSize() / 1024);
+	kprintf("areas:               %" B_PRId32 "\n", sLargePageAreas);
+	kprintf("large page mappings: %" B_PRId32 "\n", sLargePageMappings);
+	kprintf("fallbacks:           %" B_PRId32 "\n", sLargePageFallbacks);
+	return 0;
+}
+
+
 static int
 dump_mapping_info(int argc, char** argv)
 {
@@ -4096,6 +4260,14 @@ vm_init(kernel_args* args)
 #endif
 	add_debugger_command("avail", &dump_available_memory,
 		"Dump available memory");
+	add_debugger_command_etc("large_pages", &dump_large_pages,
+		"Print large page statistics",
+		"\n"
+		"Prints how many areas have been backed by large pages, how many\n"
+		"large page mappings have been created for them, and how often no\n"
+		"suitable physical page run was available, so that regular pages had\n"
+		"to be used instead.\n",
+		0);
 	add_debugger_command("dl", &display_mem, "dump memory long words (64-bit)");
 	add_debugger_command("dw", &display_mem, "dump memory words (32-bit)");
 	add_debugger_command("ds", &display_mem, "dump memory shorts (16-bit)");
@@ -6519,6 +6691,12 @@ _user_set_memory_protection(void* _address, size_t size, uint32 protection)
 	// Second round: If the protections differ from that of the area, create a
 	// page protection array and re-map mapped pages.
 	VMTranslationMap* map = locker.AddressSpace()->TranslationMap();
+
+	// Let the TLB invalidations be done once for the whole range instead of for
+	// every single page. Nothing copies the pages we write protect here, and
+	// unmap_page() still flushes right away.
+	VMTranslationMapBatch batch(map);
+
 	addr_t currentAddress = address;
 	size_t sizeLeft = size;
 	while (sizeLeft > 0) {
@@ -24,9 +24,11 @@
 #include <boot/kernel_args.h>
 #include <condition_variable.h>
 #include <elf.h>
+#include <generic_syscall.h>
 #include <heap.h>
 #include <kernel.h>
 #include <low_resource_manager.h>
+#include <page_daemon_tuning.h>
 #include <thread.h>
 #include <tracing.h>
 #include <util/AutoLock.h>
@@ -80,25 +82,48 @@ static const size_t kPageReserveForPriority[] = {
 	0							// VIP
 };
 
+// The page daemon and page scrubber variables below can be tuned at runtime
+// via the "page daemon" generic syscall, or the "page_daemon" KDL command.
+
 // Minimum number of free pages the page daemon will try to achieve.
 static uint32 sFreePagesTarget;
 static uint32 sFreeOrCachedPagesTarget;
 static uint32 sInactivePagesTarget;
 
 // Wait interval between page daemon runs.
-static const bigtime_t kIdleScanWaitInterval = 1000000LL;	// 1 sec
-static const bigtime_t kBusyScanWaitInterval = 500000LL;	// 0.5 sec
+static bigtime_t sIdleScanWaitInterval = 1000000LL;	// 1 sec
+static bigtime_t sBusyScanWaitInterval = 500000LL;	// 0.5 sec
 
 // Number of idle runs after which we want to have processed the full active
 // queue.
-static const uint32 kIdleRunsForFullQueue = 20;
+static uint32 sIdleRunsForFullQueue = 20;
 
 // Maximum limit for the vm_page::usage_count.
 static const int32 kPageUsageMax = 64;
 // vm_page::usage_count buff an accessed page receives in a scan.
-static const int32 kPageUsageAdvance = 3;
+static int32 sPageUsageAdvance = 3;
 // vm_page::usage_count debuff an unaccessed page receives in a scan.
-static const int32 kPageUsageDecline = 1;
+static int32 sPageUsageDecline = 1;
+
+// Wait interval between page scrubber runs.
+static const bigtime_t kScrubberWaitInterval = 100000LL;	// 100 ms
+// The page scrubber keeps enough clear pages around to satisfy the demand of
+// the last run for this many runs.
+static const uint32 kScrubberRunsAhead = 10;
+
+// Maximum number of candidate runs vm_page_allocate_aligned_page_run() looks
+// at in one call.
+static const uint32 kMaxAlignedPageRunCandidates = 64;
+
+// Bounds of the number of clear pages the page scrubber tries to keep around.
+static uint32 sMinClearPagesTarget = SCRUB_SIZE;
+static uint32 sMaxClearPagesTarget;
+// The current target, adapted to the demand by the page scrubber.
+static uint32 sClearPagesTarget;
+
+static int64 sClearPageAllocations;
+static int64 sClearPageMisses;
+static int64 sPagesScrubbed;
 
 int32 gMappedPagesCount;
 
@@ -122,10 +147,21 @@ static uint64 sIgnoredPages;
 static int32 sUnreservedFreePages;
 static int32 sUnsatisfiedPageReservations;
 static int32 sModifiedTemporaryPages;
+static page_num_t sNextAlignedPageRun;
+	// where vm_page_allocate_aligned_page_run() continues searching
 
 static ConditionVariable sFreePageCondition;
 static mutex sPageDeficitLock = MUTEX_INITIALIZER("page deficit");
 
+// serializes changes to the page daemon tuning parameters
+static mutex sPageDaemonTuningLock = MUTEX_INITIALIZER("page daemon tuning");
+
+// statistics of vm_page_reserve_pages() waits, protected by sPageDeficitLock
+static uint64 sReserveWaits;
+static bigtime_t sReserveWaitTime;
+static bigtime_t sMaxReserveWaitTime;
+static uint64 sReserveWaitHistogram[PAGE_RESERVE_WAIT_BUCKETS];
+
 // This lock must be used whenever the free or clear page queues are changed.
 // If you need to work on both queues at the same time, you need to hold a write
 // lock, otherwise, a read lock suffices (each queue still has a spinlock to
@@ -255,6 +291,7 @@ private:
 
 static DaemonCondition sPageWriterCondition;
 static DaemonCondition sPageDaemonCondition;
+static DaemonCondition sPageScrubberCondition;
 
 
 #if PAGE_ALLOCATION_TRACING
@@ -1725,83 +1762,128 @@ mark_page_range_in_use(page_num_t startPage, page_num_t length, bool wired)
 }
 
 
-/*!
-	This is a background thread that wakes up every now and then (every 100ms)
-	and moves some pages from the free queue over to the clear queue.
-	Given enough time, it will clear out all pages from the free queue - we
-	could probably slow it down after having reached a certain threshold.
+/*!	Moves up to SCRUB_SIZE pages from the free queue over to the clear queue,
+	unless free pages are getting scarce.
+	\return The number of pages that have been cleared.
 */
 static int32
-page_scrubber(void *unused)
+scrub_pages()
 {
-	(void)(unused);
+	if (sFreePageQueue.Count() == 0
+		|| atomic_get(&sUnreservedFreePages) < (int32)sFreePagesTarget) {
+		return 0;
+	}
 
-	TRACE(("page_scrubber starting...\n"));
+	// Since we temporarily remove pages from the free pages reserve,
+	// we must make sure we don't cause a violation of the page
+	// reservation warranty. The following is usually stricter than
+	// necessary, because we don't have information on how many of the
+	// reserved pages have already been allocated.
+	int32 reserved = reserve_some_pages(SCRUB_SIZE,
+		kPageReserveForPriority[VM_PRIORITY_USER]);
+	if (reserved == 0)
+		return 0;
 
-	for (;;) {
-		snooze(100000); // 100ms
+	// get some pages from the free queue
+	ReadLocker locker(sFreePageQueuesLock);
 
-		if (sFreePageQueue.Count() == 0
-				|| atomic_get(&sUnreservedFreePages)
-					< (int32)sFreePagesTarget) {
-			continue;
-		}
+	vm_page *page[SCRUB_SIZE];
+	int32 scrubCount = 0;
+	for (int32 i = 0; i < reserved; i++) {
+		page[i] = sFreePageQueue.RemoveHeadUnlocked();
+		if (page[i] == NULL)
+			break;
 
-		// Since we temporarily remove pages from the free pages reserve,
-		// we must make sure we don't cause a violation of the page
-		// reservation warranty. The following is usually stricter than
-		// necessary, because we don't have information on how many of the
-		// reserved pages have already been allocated.
-		int32 reserved = reserve_some_pages(SCRUB_SIZE,
-			kPageReserveForPriority[VM_PRIORITY_USER]);
-		if (reserved == 0)
-			continue;
+		DEBUG_PAGE_ACCESS_START(page[i]);
 
-		// get some pages from the free queue
-		ReadLocker locker(sFreePageQueuesLock);
+		page[i]->SetState(PAGE_STATE_ACTIVE);
+		page[i]->busy = true;
+		scrubCount++;
+	}
 
-		vm_page *page[SCRUB_SIZE];
-		int32 scrubCount = 0;
-		for (int32 i = 0; i < reserved; i++) {
-			page[i] = sFreePageQueue.RemoveHeadUnlocked();
-			if (page[i] == NULL)
-				break;
+	locker.Unlock();
 
-			DEBUG_PAGE_ACCESS_START(page[i]);
+	if (scrubCount == 0) {
+		unreserve_pages(reserved);
+		return 0;
+	}
 
-			page[i]->SetState(PAGE_STATE_ACTIVE);
-			page[i]->busy = true;
-			scrubCount++;
-		}
+	TA(ScrubbingPages(scrubCount));
 
-		locker.Unlock();
+	// clear them
+	for (int32 i = 0; i < scrubCount; i++)
+		clear_page(page[i]);
 
-		if (scrubCount == 0) {
-			unreserve_pages(reserved);
-			continue;
-		}
+	locker.Lock();
 
-		TA(ScrubbingPages(scrubCount));
+	// and put them into the clear queue
+	for (int32 i = 0; i < scrubCount; i++) {
+		page[i]->SetState(PAGE_STATE_CLEAR);
+		page[i]->busy = false;
+		DEBUG_PAGE_ACCESS_END(page[i]);
+		sClearPageQueue.PrependUnlocked(page[i]);
+	}
 
-		// clear them
-		for (int32 i = 0; i < scrubCount; i++)
-			clear_page(page[i]);
+	locker.Unlock();
 
-		locker.Lock();
+	unreserve_pages(reserved);
 
-		// and put them into the clear queue
-		for (int32 i = 0; i < scrubCount; i++) {
-			page[i]->SetState(PAGE_STATE_CLEAR);
-			page[i]->busy = false;
-			DEBUG_PAGE_ACCESS_END(page[i]);
-			sClearPageQueue.PrependUnlocked(page[i]);
-		}
+	TA(ScrubbedPages(scrubCount));
 
-		locker.Unlock();
+	atomic_add64(&sPagesScrubbed, scrubCount);
+	return scrubCount;
+}
 
-		unreserve_pages(reserved);
 
-		TA(ScrubbedPages(scrubCount));
+/*!	Adapts the number of clear pages the page scrubber tries to keep around to
+	the \a demand, the number of clear pages allocated since its last run.
+	A burst of allocations immediately raises the target, which then decays
+	slowly again.
+*/
+static void
+update_clear_pages_target(uint64 demand)
+{
+	uint64 target = sClearPagesTarget - sClearPagesTarget / 8;
+	target = std::max(target, demand * kScrubberRunsAhead);
+	target = std::min(target, (uint64)sMaxClearPagesTarget);
+	target = std::max(target, (uint64)sMinClearPagesTarget);
+
+	sClearPagesTarget = target;
+}
+
+
+/*!
+	This is a background thread that wakes up every now and then (every 100ms)
+	and moves some pages from the free queue over to the clear queue.
+	It fills up the clear queue to a target that follows the recent demand for
+	clear pages, so that allocation bursts don't need to clear their pages
+	themselves; when clear pages run short, the allocating threads wake it up
+	early. Beyond the target, only a few pages are cleared per run, but given
+	enough time, it will still clear out all pages from the free queue.
+*/
+static int32
+page_scrubber(void *unused)
+{
+	(void)(unused);
+
+	TRACE(("page_scrubber starting...\n"));
+
+	int64 lastAllocations = 0;
+
+	for (;;) {
+		sPageScrubberCondition.ClearActivated();
+
+		int64 allocations = atomic_get64(&sClearPageAllocations);
+		update_clear_pages_target(allocations - lastAllocations);
+		lastAllocations = allocations;
+
+		// fill up the clear queue to the target, but clear at least a few
+		// pages per run
+		while (scrub_pages() > 0
+			&& sClearPageQueue.Count() < sClearPagesTarget) {
+		}
+
+		sPageScrubberCondition.Wait(kScrubberWaitInterval, false);
 	}
 
 	return 0;
@@ -2263,6 +2345,50 @@ PageWriterRun::PageWritten(PageWriteTransfer* transfer, status_t status,
 }
 
 
+#if ENABLE_SWAP_SUPPORT
+/*!	Adds the modified pages that directly follow \a page in its temporary
+	cache to \a run, up to the cache's maximum asynchronous write size. Since
+	swap space is allocated contiguously per write, this keeps neighbouring
+	pages together in swap, and lets them be read in together later.
+	The cache must be locked, and \a page must have been added to \a run.
+	\return The number of pages that have been added.
+*/
+static uint32
+add_swap_cluster_pages(PageWriterRun& run, VMCache* cache, vm_page* page,
+	uint32 maxPages)
+{
+	int32 maxClusterPages = cache->MaxPagesPerAsyncWrite();
+	if (maxClusterPages >= 0)
+		maxPages = std::min(maxPages, (uint32)std::max(maxClusterPages - 1, 0));
+
+	uint32 added = 0;
+	off_t offset = (off_t)(page->cache_offset + 1) << PAGE_SHIFT;
+
+	for (; added < maxPages; added++, offset += B_PAGE_SIZE) {
+		vm_page* nextPage = cache->LookupPage(offset);
+		if (nextPage == NULL || nextPage->busy
+			|| nextPage->State() != PAGE_STATE_MODIFIED
+			|| nextPage->WiredCount() > 0 || !cache->CanWritePage(offset)) {
+			break;
+		}
+
+		DEBUG_PAGE_ACCESS_START(nextPage);
+
+		cache->AcquireStoreRef();
+		run.AddPage(nextPage);
+
+		DEBUG_PAGE_ACCESS_END(nextPage);
+
+		TPW(WritePage(nextPage));
+
+		cache->AcquireRefLocked();
+	}
+
+	return added;
+}
+#endif	// ENABLE_SWAP_SUPPORT
+
+
 /*!	The page writer continuously takes some pages from the modified
 	queue, writes them back, and moves them back to the active queue.
 	It runs in its own thread, and is only there to keep the number
@@ -2407,6 +2533,15 @@ page_writer(void* /*unused*/)
 
 			cache->AcquireRefLocked();
 			numPages++;
+
+#if ENABLE_SWAP_SUPPORT
+			// write the following pages of the cache along, if they need to
+			// be swapped out as well
+			if (cache->temporary) {
+				numPages += add_swap_cluster_pages(run, cache, page,
+					kNumPages - numPages);
+			}
+#endif
 		}
 
 #ifdef TRACE_VM_PAGE
@@ -2593,8 +2728,8 @@ idle_scan_active_pages(page_stats& pageStats)
 {
 	VMPageQueue& queue = sActivePageQueue;
 
-	// We want to scan the whole queue in roughly kIdleRunsForFullQueue runs.
-	uint32 maxToScan = queue.Count() / kIdleRunsForFullQueue + 1;
+	// We want to scan the whole queue in roughly sIdleRunsForFullQueue runs.
+	uint32 maxToScan = queue.Count() / sIdleRunsForFullQueue + 1;
 
 	while (maxToScan > 0) {
 		maxToScan--;
@@ -2642,12 +2777,12 @@ idle_scan_active_pages(page_stats& pageStats)
 			usageCount = vm_remove_all_page_mappings_if_unaccessed(page);
 
 		if (usageCount > 0) {
-			usageCount += page->usage_count + kPageUsageAdvance;
+			usageCount += page->usage_count + sPageUsageAdvance;
 			if (usageCount > kPageUsageMax)
 				usageCount = kPageUsageMax;
 // TODO: This would probably also be the place to reclaim swap space.
 		} else {
-			usageCount += page->usage_count - (int32)kPageUsageDecline;
+			usageCount += page->usage_count - sPageUsageDecline;
 			if (usageCount < 0) {
 				usageCount = 0;
 				set_page_state(page, PAGE_STATE_INACTIVE);
@@ -2734,11 +2869,11 @@ full_scan_inactive_pages(page_stats& pageStats, int32 despairLevel)
 
 		// update usage count
 		if (usageCount > 0) {
-			usageCount += page->usage_count + kPageUsageAdvance;
+			usageCount += page->usage_count + sPageUsageAdvance;
 			if (usageCount > kPageUsageMax)
 				usageCount = kPageUsageMax;
 		} else {
-			usageCount += page->usage_count - (int32)kPageUsageDecline;
+			usageCount += page->usage_count - sPageUsageDecline;
 			if (usageCount < 0)
 				usageCount = 0;
 		}
@@ -2856,13 +2991,13 @@ full_scan_active_pages(page_stats& pageStats, int32 despairLevel)
 		int32 usageCount = vm_clear_page_mapping_accessed_flags(page);
 
 		if (usageCount > 0) {
-			usageCount += page->usage_count + kPageUsageAdvance;
+			usageCount += page->usage_count + sPageUsageAdvance;
 			if (usageCount > kPageUsageMax)
 				usageCount = kPageUsageMax;
 			pagesAccessed++;
 // TODO: This would probably also be the place to reclaim swap space.
 		} else {
-			usageCount += page->usage_count - (int32)kPageUsageDecline;
+			usageCount += page->usage_count - sPageUsageDecline;
 			if (usageCount <= 0) {
 				usageCount = 0;
 				set_page_state(page, PAGE_STATE_INACTIVE);
@@ -2956,7 +3091,7 @@ page_daemon(void* /*unused*/)
 			// of actually free pages full enough.
 			despairLevel = 0;
 			page_daemon_idle_scan(pageStats);
-			sPageDaemonCondition.Wait(kIdleScanWaitInterval, false);
+			sPageDaemonCondition.Wait(sIdleScanWaitInterval, false);
 		} else {
 			// Not enough free pages. We need to do some real work.
 			despairLevel = std::max(despairLevel + 1, (int32)3);
@@ -2969,7 +3104,7 @@ page_daemon(void* /*unused*/)
 			// the modified list to avoid thrashing. The second scan, however,
 			// will not hold back.
 			if (despairLevel > 1)
-				snooze(kBusyScanWaitInterval);
+				snooze(sBusyScanWaitInterval);
 		}
 	}
 
@@ -2977,6 +3112,317 @@ page_daemon(void* /*unused*/)
 }
 
 
+// #pragma mark - page daemon tuning
+
+
+// The shortest page daemon wait interval that can be set.
+static const bigtime_t kMinScanWaitInterval = 10000LL;	// 10 ms
+
+static const struct {
+	const char*	name;
+	size_t		offset;
+	size_t		size;
+} kPageDaemonParameters[] = {
+	{ "free_pages_target", offsetof(page_daemon_tuning, free_pages_target),
+		sizeof(uint32) },
+	{ "free_or_cached_pages_target",
+		offsetof(page_daemon_tuning, free_or_cached_pages_target),
+		sizeof(uint32) },
+	{ "inactive_pages_target",
+		offsetof(page_daemon_tuning, inactive_pages_target), sizeof(uint32) },
+	{ "idle_scan_interval", offsetof(page_daemon_tuning, idle_scan_interval),
+		sizeof(bigtime_t) },
+	{ "busy_scan_interval", offsetof(page_daemon_tuning, busy_scan_interval),
+		sizeof(bigtime_t) },
+	{ "idle_runs_for_full_queue",
+		offsetof(page_daemon_tuning, idle_runs_for_full_queue),
+		sizeof(uint32) },
+	{ "page_usage_advance", offsetof(page_daemon_tuning, page_usage_advance),
+		sizeof(int32) },
+	{ "page_usage_decline", offsetof(page_daemon_tuning, page_usage_decline),
+		sizeof(int32) },
+	{ "min_clear_pages_target",
+		offsetof(page_daemon_tuning, min_clear_pages_target),
+		sizeof(uint32) },
+	{ "max_clear_pages_target",
+		offsetof(page_daemon_tuning, max_clear_pages_target),
+		sizeof(uint32) },
+};
+
+static const size_t kPageDaemonParameterCount
+	= sizeof(kPageDaemonParameters) / sizeof(kPageDaemonParameters[0]);
+
+
+static void
+get_page_daemon_tuning(page_daemon_tuning& tuning)
+{
+	tuning.free_pages_target = sFreePagesTarget;
+	tuning.free_or_cached_pages_target = sFreeOrCachedPagesTarget;
+	tuning.inactive_pages_target = sInactivePagesTarget;
+	tuning.idle_scan_interval = sIdleScanWaitInterval;
+	tuning.busy_scan_interval = sBusyScanWaitInterval;
+	tuning.idle_runs_for_full_queue = sIdleRunsForFullQueue;
+	tuning.page_usage_advance = sPageUsageAdvance;
+	tuning.page_usage_decline = sPageUsageDecline;
+	tuning.min_clear_pages_target = sMinClearPagesTarget;
+	tuning.max_clear_pages_target = sMaxClearPagesTarget;
+}
+
+
+/*!	Returns whether the given \a lock is held by anyone. Only to be used in
+	the kernel debugger, where the other CPUs are halted.
+*/
+static bool
+is_locked_in_debugger(const mutex& lock)
+{
+#if KDEBUG
+	return lock.holder >= 0;
+#else
+	return lock.count < 0;
+#endif
+}
+
+
+/*!	Validates and applies the given parameters. The daemons pick them up with
+	their next run; since this may be called from the kernel debugger, it's up
+	to the caller to wake them up earlier.
+	The caller must hold sPageDaemonTuningLock, unless in the kernel debugger.
+*/
+static status_t
+set_page_daemon_tuning(const page_daemon_tuning& tuning)
+{
+	page_num_t existingPages = sNumPages - sNonExistingPages;
+
+	if (tuning.free_pages_target < VM_PAGE_RESERVE_USER
+		|| tuning.free_or_cached_pages_target < tuning.free_pages_target
+		|| tuning.inactive_pages_target > existingPages
+		|| tuning.idle_scan_interval < kMinScanWaitInterval
+		|| tuning.busy_scan_interval < kMinScanWaitInterval
+		|| tuning.idle_runs_for_full_queue == 0
+		|| tuning.page_usage_advance < 0
+		|| tuning.page_usage_advance > kPageUsageMax
+		|| tuning.page_usage_decline < 0
+		|| tuning.page_usage_decline > kPageUsageMax
+		|| tuning.min_clear_pages_target > tuning.max_clear_pages_target
+		|| tuning.max_clear_pages_target > existingPages) {
+		return B_BAD_VALUE;
+	}
+
+	sFreePagesTarget = tuning.free_pages_target;
+	sFreeOrCachedPagesTarget = tuning.free_or_cached_pages_target;
+	sInactivePagesTarget = tuning.inactive_pages_target;
+	sIdleScanWaitInterval = tuning.idle_scan_interval;
+	sBusyScanWaitInterval = tuning.busy_scan_interval;
+	sIdleRunsForFullQueue = tuning.idle_runs_for_full_queue;
+	sPageUsageAdvance = tuning.page_usage_advance;
+	sPageUsageDecline = tuning.page_usage_decline;
+	sMinClearPagesTarget = tuning.min_clear_pages_target;
+	sMaxClearPagesTarget = tuning.max_clear_pages_target;
+
+	return B_OK;
+}
+
+
+/*!	The caller must hold sPageDeficitLock, unless in the kernel debugger.
+*/
+static void
+get_page_daemon_stats(page_daemon_stats& stats)
+{
+	stats.clear_pages = sClearPageQueue.Count();
+	stats.clear_pages_target = sClearPagesTarget;
+	stats.clear_page_allocations = atomic_get64(&sClearPageAllocations);
+	stats.clear_page_misses = atomic_get64(&sClearPageMisses);
+	stats.pages_scrubbed = atomic_get64(&sPagesScrubbed);
+
+	stats.reserve_waits = sReserveWaits;
+	stats.reserve_wait_time = sReserveWaitTime;
+	stats.max_reserve_wait_time = sMaxReserveWaitTime;
+	memcpy(stats.reserve_wait_histogram, sReserveWaitHistogram,
+		sizeof(sReserveWaitHistogram));
+}
+
+
+static int
+dump_page_daemon(int argc, char** argv)
+{
+	int argi = 1;
+	bool reset = false;
+	if (argi < argc && strcmp(argv[argi], "-r") == 0) {
+		reset = true;
+		argi++;
+	}
+
+	if (argi < argc) {
+		if (argi + 2 != argc) {
+			print_debugger_command_usage(argv[0]);
+			return 0;
+		}
+		if (is_locked_in_debugger(sPageDaemonTuningLock)) {
+			kprintf("the parameters are currently being changed, try again "
+				"later\n");
+			return 0;
+		}
+
+		size_t index = 0;
+		while (index < kPageDaemonParameterCount
+			&& strcmp(kPageDaemonParameters[index].name, argv[argi]) != 0) {
+			index++;
+		}
+		if (index == kPageDaemonParameterCount) {
+			kprintf("unknown parameter: \"%s\"\n", argv[argi]);
+			return 0;
+		}
+
+		page_daemon_tuning tuning;
+		get_page_daemon_tuning(tuning);
+
+		uint64 value = parse_expression(argv[argi + 1]);
+		uint8* field = (uint8*)&tuning + kPageDaemonParameters[index].offset;
+		if (kPageDaemonParameters[index].size == sizeof(bigtime_t))
+			*(bigtime_t*)field = value;
+		else
+			*(uint32*)field = value;
+
+		if (set_page_daemon_tuning(tuning) != B_OK) {
+			kprintf("invalid value for \"%s\"\n", argv[argi]);
+			return 0;
+		}
+	}
+
+	page_daemon_tuning tuning;
+	get_page_daemon_tuning(tuning);
+
+	kprintf("parameters:\n");
+	for (size_t i = 0; i < kPageDaemonParameterCount; i++) {
+		uint8* field = (uint8*)&tuning + kPageDaemonParameters[i].offset;
+		uint64 value = kPageDaemonParameters[i].size == sizeof(bigtime_t)
+			? *(bigtime_t*)field : *(uint32*)field;
+		kprintf("  %-28s %" B_PRIu64 "\n", kPageDaemonParameters[i].name,
+			value);
+	}
+
+	page_daemon_stats stats;
+	get_page_daemon_stats(stats);
+
+	kprintf("\npage scrubber:\n");
+	kprintf("  clear pages: %" B_PRIu32 ", target: %" B_PRIu32 "\n",
+		stats.clear_pages, stats.clear_pages_target);
+	kprintf("  clear page allocations: %" B_PRIu64 ", cleared synchronously: %"
+		B_PRIu64 "\n", stats.clear_page_allocations, stats.clear_page_misses);
+	kprintf("  pages scrubbed: %" B_PRIu64 "\n", stats.pages_scrubbed);
+
+	kprintf("\npage reservation waits: %" B_PRIu64 ", average: %" B_PRId64
+		" us, max: %" B_PRId64 " us\n", stats.reserve_waits,
+		stats.reserve_waits > 0
+			? stats.reserve_wait_time / (bigtime_t)stats.reserve_waits : 0,
+		stats.max_reserve_wait_time);
+	for (int32 i = 0; i < PAGE_RESERVE_WAIT_BUCKETS; i++) {
+		if (i == 0)
+			kprintf("  <  %7d us", 32);
+		else
+			kprintf("  >= %7" B_PRId64 " us", (bigtime_t)1 << (i + 4));
+		kprintf(": %" B_PRIu64 "\n", stats.reserve_wait_histogram[i]);
+	}
+
+	if (reset && is_locked_in_debugger(sPageDeficitLock)) {
+		kprintf("\nthe statistics are currently being updated, they have "
+			"not been reset\n");
+	} else if (reset) {
+		atomic_set64(&sClearPageAllocations, 0);
+		atomic_set64(&sClearPageMisses, 0);
+		atomic_set64(&sPagesScrubbed, 0);
+		sReserveWaits = 0;
+		sReserveWaitTime = 0;
+		sMaxReserveWaitTime = 0;
+		memset(sReserveWaitHistogram, 0, sizeof(sReserveWaitHistogram));
+	}
+
+	return 0;
+}
+
+
+static status_t
+page_daemon_syscall(const char* subsystem, uint32 function, void* buffer,
+	size_t bufferSize)
+{
+	if (!IS_USER_ADDRESS(buffer))
+		return B_BAD_ADDRESS;
+
+	switch (function) {
+		case GET_PAGE_DAEMON_TUNING:
+		{
+			if (bufferSize != sizeof(page_daemon_tuning))
+				return B_BAD_VALUE;
+
+			page_daemon_tuning tuning;
+			MutexLocker tuningLocker(sPageDaemonTuningLock);
+			get_page_daemon_tuning(tuning);
+			tuningLocker.Unlock();
+
+			return user_memcpy(buffer, &tuning, sizeof(tuning));
+		}
+
+		case SET_PAGE_DAEMON_TUNING:
+		{
+			if (geteuid() != 0)
+				return B_NOT_ALLOWED;
+			if (bufferSize != sizeof(page_daemon_tuning))
+				return B_BAD_VALUE;
+
+			page_daemon_tuning tuning;
+			if (user_memcpy(&tuning, buffer, sizeof(tuning)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			MutexLocker tuningLocker(sPageDaemonTuningLock);
+			status_t status = set_page_daemon_tuning(tuning);
+			if (status != B_OK)
+				return status;
+			tuningLocker.Unlock();
+
+			// let the changes take effect right away
+			sPageDaemonCondition.WakeUp();
+			sPageScrubberCondition.WakeUp();
+			return B_OK;
+		}
+
+		case GET_PAGE_DAEMON_STATS:
+		{
+			if (bufferSize != sizeof(page_daemon_stats))
+				return B_BAD_VALUE;
+
+			page_daemon_stats stats;
+			MutexLocker pageDeficitLocker(sPageDeficitLock);
+			get_page_daemon_stats(stats);
+			pageDeficitLocker.Unlock();
+
+			return user_memcpy(buffer, &stats, sizeof(stats));
+		}
+	}
+
+	return B_BAD_VALUE;
+}
+
+
+/*!	Adds a vm_page_reserve_pages() wait of the given duration to the
+	statistics. The caller must hold sPageDeficitLock.
+*/
+static void
+record_reserve_wait(bigtime_t waitTime)
+{
+	sReserveWaits++;
+	sReserveWaitTime += waitTime;
+	sMaxReserveWaitTime = std::max(sMaxReserveWaitTime, waitTime);
+
+	int32 bucket = 0;
+	for (bigtime_t limit = 32; waitTime >= limit
+			&& bucket < PAGE_RESERVE_WAIT_BUCKETS - 1; limit *= 2) {
+		bucket++;
+	}
+
+	sReserveWaitHistogram[bucket]++;
+}
+
+
 /*!	Returns how many pages could *not* be reserved.
 */
 static uint32
@@ -3037,10 +3483,14 @@ reserve_pages(uint32 count, int priority, bool dontWait)
 		pageDeficitLocker.Unlock();
 
 		low_resource(B_KERNEL_RESOURCE_PAGES, count, B_RELATIVE_TIMEOUT, 0);
+
+		bigtime_t waitStart = system_time();
 		thread_block();
 
 		pageDeficitLocker.Lock();
 
+		record_reserve_wait(system_time() - waitStart);
+
 		return 0;
 	}
 }
@@ -3325,6 +3775,11 @@ vm_page_init(kernel_args *args)
 		sInactivePagesTarget = sFreePagesTarget / 2;
 	}
 
+	// Don't let the page scrubber keep more than 1/64 of the memory cleared
+	// in advance.
+	sMaxClearPagesTarget = std::max((page_num_t)sMinClearPagesTarget,
+		(sNumPages - sNonExistingPages) / 64);
+
 	TRACE(("vm_page_init: exit\n"));
 
 	return B_OK;
@@ -3356,6 +3811,14 @@ vm_page_init_post_area(kernel_args *args)
 		"search all known address spaces for mappings to that page and print\n"
 		"them.\n", 0);
 	add_debugger_command("page_queue", &dump_page_queue, "Dump page queue");
+	add_debugger_command_etc("page_daemon", &dump_page_daemon,
+		"Dump or set page daemon and page scrubber parameters",
+		"[ -r ] [ <parameter> <value> ]\n"
+		"Prints the tunable parameters of the page daemon and page scrubber,\n"
+		"their statistics, and a histogram of the time threads had to wait\n"
+		"for pages in vm_page_reserve_pages().\n"
+		"If <parameter> and <value> are given, the parameter is set first.\n"
+		"If \"-r\" is given, the statistics are reset.\n", 0);
 	add_debugger_command("find_page", &find_page,
 		"Find out which queue a page is actually in");
 
@@ -3405,6 +3868,8 @@ vm_page_init_post_thread(kernel_args *args)
 
 	// create a kernel thread to clear out pages
 
+	sPageScrubberCondition.Init("page scrubber");
+
 	thread_id thread = spawn_kernel_thread(&page_scrubber, "page scrubber",
 		B_LOWEST_ACTIVE_PRIORITY, NULL);
 	resume_thread(thread);
@@ -3425,6 +3890,8 @@ vm_page_init_post_thread(kernel_args *args)
 		B_NORMAL_PRIORITY, NULL);
 	resume_thread(thread);
 
+	register_generic_syscall(PAGE_DAEMON_SYSCALLS, page_daemon_syscall, 1, 0);
+
 	return B_OK;
 }
 
@@ -3572,8 +4039,19 @@ vm_page_allocate_page(vm_page_reservation* reservation, uint32 flags)
 
 	// clear the page, if we had to take it from the free queue and a clear
 	// page was requested
-	if ((flags & VM_PAGE_ALLOC_CLEAR) != 0 && oldPageState != PAGE_STATE_CLEAR)
-		clear_page(page);
+	if ((flags & VM_PAGE_ALLOC_CLEAR) != 0) {
+		atomic_add64(&sClearPageAllocations, 1);
+
+		if (oldPageState != PAGE_STATE_CLEAR) {
+			clear_page(page);
+			atomic_add64(&sClearPageMisses, 1);
+
+			// Let the page scrubber catch up with the demand. The target is
+			// only set once it is running.
+			if (sClearPageQueue.Count() < sClearPagesTarget)
+				sPageScrubberCondition.WakeUp();
+		}
+	}
 
 #if VM_PAGE_ALLOCATION_TRACKING_AVAILABLE
 	page->allocation_tracking_info.Init(
@@ -3906,6 +4384,79 @@ vm_page_allocate_page_run(uint32 flags, page_num_t length,
 }
 
 
+/*!	Tries to allocate a physically contiguous run of \a length pages, aligned
+	to its size, from the pages reserved in \a reservation.
+
+	Unlike vm_page_allocate_page_run() this function never waits and doesn't
+	steal cached pages. It is meant for opportunistically backing memory with
+	large pages; when it fails, the caller is expected to fall back to
+	allocating the pages individually from the same reservation.
+
+	\param reservation The reservation to take the pages from. Must contain at
+		least \a length pages.
+	\param flags Page allocation flags, as for vm_page_allocate_page().
+	\param length The number of pages to allocate. Must be a power of two.
+	\return The first page of the allocated page run on success; \c NULL
+		when there is no suitable run of free pages.
+*/
+vm_page*
+vm_page_allocate_aligned_page_run(vm_page_reservation* reservation,
+	uint32 flags, page_num_t length)
+{
+	ASSERT(((length - 1) & length) == 0);
+	ASSERT(reservation->count >= length);
+
+	WriteLocker freeClearQueueLocker(sFreePageQueuesLock);
+
+	if ((page_num_t)sFreePageQueue.Count() + sClearPageQueue.Count() < length)
+		return NULL;
+
+	// Continue where the previous search ended, so that the large areas that
+	// are usually allocated in succession don't rescan the same used runs.
+	// To not hold the lock for a scan over all of memory, only a limited
+	// number of candidate runs is looked at per call.
+	page_num_t alignmentMask = length - 1;
+	page_num_t start = std::min(sNextAlignedPageRun, sNumPages);
+
+	for (uint32 candidates = 0; candidates < kMaxAlignedPageRunCandidates;
+			candidates++) {
+		start = ((start + sPhysicalPageOffset + alignmentMask) & ~alignmentMask)
+			- sPhysicalPageOffset;
+
+		if (start + length > sNumPages) {
+			start = 0;
+			continue;
+		}
+
+		page_num_t i;
+		for (i = 0; i < length; i++) {
+			uint32 pageState = sPages[start + i].State();
+			if (pageState != PAGE_STATE_FREE && pageState != PAGE_STATE_CLEAR)
+				break;
+		}
+
+		if (i == length) {
+			sNextAlignedPageRun = start + length;
+
+			// Since the run contains free and clear pages only, the pages
+			// are already accounted for by the reservation.
+			i = allocate_page_run(start, length, flags, freeClearQueueLocker);
+			if (i == length) {
+				reservation->count -= length;
+				return &sPages[start];
+			}
+
+			freeClearQueueLocker.Lock();
+		}
+
+		start += i + 1;
+	}
+
+	sNextAlignedPageRun = start;
+	return NULL;
+}
+
+
 vm_page *
 vm_page_at_index(int32 index)
 {
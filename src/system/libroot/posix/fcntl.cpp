@@ -75,3 +75,18 @@ fcntl(int fd, int op, ...)
 
 	RETURN_AND_SET_ERRNO(error);
 }
+
+
+int
+posix_fallocate(int fd, off_t offset, off_t length)
+{
+	// unlike most other functions, this one returns the error directly
+	if (offset < 0 || length <= 0)
+		return EINVAL;
+
+	status_t error = _kern_preallocate(fd, offset, length);
+	if (error == B_UNSUPPORTED)
+		return EOPNOTSUPP;
+
+	return error;
+}
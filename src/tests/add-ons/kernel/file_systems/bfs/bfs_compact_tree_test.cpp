@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//!	Tests that compacting a sparse directory keeps all of its entries
+
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <StorageDefs.h>
+
+#include "bfs_control.h"
+
+
+const char* kTempDirectory = "/tmp/bfs_compact_tree_test";
+const int32 kEntryCount = 4000;
+const int32 kKeepEvery = 16;
+
+
+static void
+entry_path(char* path, size_t size, int32 index)
+{
+	snprintf(path, size, "%s/entry %06" B_PRId32, kTempDirectory, index);
+}
+
+
+static int32
+count_entries()
+{
+	DIR* dir = opendir(kTempDirectory);
+	if (dir == NULL)
+		return -1;
+
+	int32 count = 0;
+	int32 last = -1;
+	while (struct dirent* entry = readdir(dir)) {
+		int32 index;
+		if (sscanf(entry->d_name, "entry %" B_PRId32, &index) != 1)
+			continue;
+
+		if (index <= last || index % kKeepEvery != 0) {
+			fprintf(stderr, "unexpected entry \"%s\"\n", entry->d_name);
+			closedir(dir);
+			return -1;
+		}
+		last = index;
+		count++;
+	}
+
+	closedir(dir);
+	return count;
+}
+
+
+static void
+remove_all()
+{
+	for (int32 i = 0; i < kEntryCount; i++) {
+		char path[B_PATH_NAME_LENGTH];
+		entry_path(path, sizeof(path), i);
+		unlink(path);
+	}
+	rmdir(kTempDirectory);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (mkdir(kTempDirectory, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "could not create \"%s\": %s\n", kTempDirectory,
+			strerror(errno));
+		return 1;
+	}
+
+	// entries are created in ascending order, and most of them are removed
+	// again, which leaves the directory with many almost empty nodes
+
+	for (int32 i = 0; i < kEntryCount; i++) {
+		char path[B_PATH_NAME_LENGTH];
+		entry_path(path, sizeof(path), i);
+		int fd = open(path, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "could not create \"%s\": %s\n", path,
+				strerror(errno));
+			remove_all();
+			return 1;
+		}
+		close(fd);
+	}
+	for (int32 i = 0; i < kEntryCount; i++) {
+		if (i % kKeepEvery == 0)
+			continue;
+
+		char path[B_PATH_NAME_LENGTH];
+		entry_path(path, sizeof(path), i);
+		unlink(path);
+	}
+
+	int fd = open(kTempDirectory, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "could not open \"%s\": %s\n", kTempDirectory,
+			strerror(errno));
+		remove_all();
+		return 1;
+	}
+
+	bfs_compact_tree compact;
+	memset(&compact, 0, sizeof(compact));
+
+	if (ioctl(fd, BFS_IOCTL_COMPACT_TREE, &compact, sizeof(compact)) != 0) {
+		fprintf(stderr, "could not compact the directory: %s\n",
+			strerror(errno));
+		close(fd);
+		remove_all();
+		return 1;
+	}
+	close(fd);
+
+	printf("merged %" B_PRIu32 " nodes, freed %" B_PRIu32 " nodes, size %"
+		B_PRIdOFF " -> %" B_PRIdOFF " bytes\n", compact.merged_nodes,
+		compact.freed_nodes, compact.size_before, compact.size_after);
+
+	int32 count = count_entries();
+	int32 expected = (kEntryCount + kKeepEvery - 1) / kKeepEvery;
+	bool failed = false;
+	if (count != expected) {
+		fprintf(stderr, "found %" B_PRId32 " entries, expected %" B_PRId32
+			"\n", count, expected);
+		failed = true;
+	}
+	if (compact.size_after >= compact.size_before) {
+		fprintf(stderr, "the directory did not shrink\n");
+		failed = true;
+	}
+
+	remove_all();
+
+	if (failed)
+		return 1;
+
+	puts("All tests passed!");
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	Tests that preallocated, unwritten parts of a file read as zeros, also
+	after the volume has been mounted again. The test runs on a BFS image that
+	is filled with garbage first, so that any block that is exposed without
+	having been written to shows.
+*/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fs_volume.h>
+#include <SupportDefs.h>
+
+
+const char* kImage = "/tmp/bfs_preallocate_test.image";
+const char* kMountPoint = "/tmp/bfs_preallocate_test";
+const char* kTempFile = "/tmp/bfs_preallocate_test/file";
+const off_t kImageSize = 32 * 1024 * 1024;
+const off_t kFileSize = 4 * 1024 * 1024;
+const char kData[] = "some data that is not zero";
+
+
+static bool
+check_zeros(int fd, off_t from, off_t to)
+{
+	char buffer[16384];
+
+	while (from < to) {
+		size_t length = (size_t)min_c((off_t)sizeof(buffer), to - from);
+		ssize_t bytesRead = pread(fd, buffer, length, from);
+		if (bytesRead != (ssize_t)length) {
+			fprintf(stderr, "could not read at %" B_PRIdOFF ": %s\n", from,
+				strerror(errno));
+			return false;
+		}
+
+		for (size_t i = 0; i < length; i++) {
+			if (buffer[i] != 0) {
+				fprintf(stderr, "found data at %" B_PRIdOFF "\n", from + i);
+				return false;
+			}
+		}
+
+		from += length;
+	}
+
+	return true;
+}
+
+
+static bool
+check_data(int fd, off_t offset)
+{
+	char buffer[sizeof(kData)];
+	if (pread(fd, buffer, sizeof(buffer), offset) != sizeof(buffer)
+		|| memcmp(buffer, kData, sizeof(kData)) != 0) {
+		fprintf(stderr, "data at %" B_PRIdOFF " is wrong\n", offset);
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+write_data(int fd, off_t offset)
+{
+	if (pwrite(fd, kData, sizeof(kData), offset) != sizeof(kData)) {
+		fprintf(stderr, "could not write at %" B_PRIdOFF ": %s\n", offset,
+			strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+mount_image()
+{
+	dev_t volume = fs_mount_volume(kMountPoint, kImage, "bfs", 0, NULL);
+	if (volume < 0) {
+		fprintf(stderr, "mounting failed: %s\n", strerror(volume));
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+unmount_image()
+{
+	status_t status = fs_unmount_volume(kMountPoint, 0);
+	if (status != B_OK) {
+		fprintf(stderr, "unmounting failed: %s\n", strerror(status));
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+create_image()
+{
+	int fd = open(kImage, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "could not create \"%s\": %s\n", kImage,
+			strerror(errno));
+		return false;
+	}
+
+	char buffer[65536];
+	memset(buffer, 0xa5, sizeof(buffer));
+
+	bool success = true;
+	for (off_t offset = 0; success && offset < kImageSize;
+			offset += sizeof(buffer)) {
+		success = write(fd, buffer, sizeof(buffer)) == sizeof(buffer);
+	}
+	close(fd);
+
+	if (!success) {
+		fprintf(stderr, "could not fill the image: %s\n", strerror(errno));
+		return false;
+	}
+
+	char command[256];
+	snprintf(command, sizeof(command), "mkfs -q -t bfs %s test > /dev/null",
+		kImage);
+	if (system(command) != 0) {
+		fprintf(stderr, "could not initialize the image\n");
+		return false;
+	}
+
+	mkdir(kMountPoint, 0755);
+	return mount_image();
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (!create_image()) {
+		unlink(kImage);
+		return 1;
+	}
+
+	int fd = open(kTempFile, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	bool failed = fd < 0;
+	if (failed) {
+		fprintf(stderr, "could not create \"%s\": %s\n", kTempFile,
+			strerror(errno));
+	} else
+		failed = !write_data(fd, 0);
+
+	int status = 0;
+	if (!failed && (status = posix_fallocate(fd, 0, kFileSize)) != 0) {
+		fprintf(stderr, "posix_fallocate() failed: %s\n", strerror(status));
+		failed = true;
+	}
+
+	struct stat stat;
+	if (!failed && (fstat(fd, &stat) != 0 || stat.st_size != kFileSize)) {
+		fprintf(stderr, "file has the wrong size\n");
+		failed = true;
+	}
+
+	// the old data must be left alone, the new range must be empty
+	if (!failed) {
+		failed = !check_data(fd, 0)
+			|| !check_zeros(fd, sizeof(kData), kFileSize);
+	}
+
+	// writing into the middle of the range must not expose anything that
+	// has not been written to
+	const off_t middle = kFileSize / 2 + 1000;
+	if (!failed) {
+		failed = !write_data(fd, middle) || fsync(fd) != 0
+			|| !check_data(fd, 0) || !check_data(fd, middle)
+			|| !check_zeros(fd, sizeof(kData), middle)
+			|| !check_zeros(fd, middle + sizeof(kData), kFileSize);
+	}
+
+	// a range within the file does not change it
+	if (!failed) {
+		status = posix_fallocate(fd, 4096, 4096);
+		if (status != 0 || fstat(fd, &stat) != 0
+			|| stat.st_size != kFileSize || !check_data(fd, middle)) {
+			fprintf(stderr, "preallocating within the file failed\n");
+			failed = true;
+		}
+	}
+
+	if (!failed && posix_fallocate(fd, -1, 10) != EINVAL) {
+		fprintf(stderr, "negative offsets are not refused\n");
+		failed = true;
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	// after a remount, everything has to come from the disk
+	bool mounted = true;
+	if (!failed) {
+		failed = !unmount_image();
+		if (!failed) {
+			mounted = mount_image();
+			failed = !mounted;
+		}
+	}
+	if (!failed) {
+		fd = open(kTempFile, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "could not open \"%s\" again: %s\n", kTempFile,
+				strerror(errno));
+			failed = true;
+		} else {
+			failed = !check_data(fd, 0) || !check_data(fd, middle)
+				|| !check_zeros(fd, sizeof(kData), middle)
+				|| !check_zeros(fd, middle + sizeof(kData), kFileSize);
+			close(fd);
+		}
+	}
+
+	unlink(kTempFile);
+	if (mounted)
+		unmount_image();
+	rmdir(kMountPoint);
+	unlink(kImage);
+
+	if (failed)
+		return 1;
+
+	puts("All tests passed!");
+	return 0;
+}
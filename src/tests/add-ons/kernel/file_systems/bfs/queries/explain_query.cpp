@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//! Shows how BFS would run a query, and what it thinks it will cost
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fs_query.h>
+
+#include "bfs_control.h"
+
+
+extern const char* __progname;
+
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: %s [-n] <query> [<path on the volume>]\n"
+		"  -n\tAllows the query to look at attributes without an index\n",
+		__progname);
+	exit(1);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	uint32 flags = 0;
+	int i = 1;
+	if (i < argc && !strcmp(argv[i], "-n")) {
+		flags |= B_QUERY_NON_INDEXED;
+		i++;
+	}
+	if (i >= argc || argc - i > 2)
+		usage();
+
+	const char* path = i + 1 < argc ? argv[i + 1] : ".";
+
+	bfs_explain_query explain;
+	memset(&explain, 0, sizeof(explain));
+	strlcpy(explain.query, argv[i], sizeof(explain.query));
+	explain.flags = flags;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: could not open \"%s\": %s\n", __progname, path,
+			strerror(errno));
+		return 1;
+	}
+
+	if (ioctl(fd, BFS_IOCTL_EXPLAIN_QUERY, &explain, sizeof(explain)) != 0) {
+		fprintf(stderr, "%s: could not explain query: %s\n", __progname,
+			strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	close(fd);
+
+	fputs(explain.plan, stdout);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//! Tests that substring queries are answered correctly via a trigram index
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fs_index.h>
+#include <fs_info.h>
+#include <fs_query.h>
+#include <TypeConstants.h>
+
+
+static const char* kTrigramIndex = "bfs:trigrams:name";
+static const char* kFiles[] = {
+	"_trigram_test_howto_1",
+	"_trigram_test_xHOWx_2",
+	"_trigram_test_other_3",
+};
+static const int32 kFileCount = sizeof(kFiles) / sizeof(kFiles[0]);
+
+
+static int32
+count_query_results(dev_t device, const char* predicate)
+{
+	DIR* query = fs_open_query(device, predicate, 0);
+	if (query == NULL) {
+		fprintf(stderr, "could not open query \"%s\": %s\n", predicate,
+			strerror(errno));
+		return -1;
+	}
+
+	int32 count = 0;
+	while (struct dirent* dirent = fs_read_query(query)) {
+		if (!strncmp(dirent->d_name, "_trigram_test_", 14))
+			count++;
+	}
+
+	fs_close_query(query);
+	return count;
+}
+
+
+static bool
+check_query(dev_t device, const char* predicate, int32 expected)
+{
+	int32 count = count_query_results(device, predicate);
+	if (count == expected) {
+		printf("  %s: passed\n", predicate);
+		return true;
+	}
+
+	printf("  %s: FAILED, expected %" B_PRId32 " matches, got %" B_PRId32
+		"\n", predicate, expected, count);
+	return false;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	dev_t device = dev_for_path(".");
+
+	bool createdIndex = false;
+	if (fs_create_index(device, kTrigramIndex, B_STRING_TYPE, 0) == 0)
+		createdIndex = true;
+	else if (errno != B_FILE_EXISTS) {
+		fprintf(stderr, "could not create trigram index: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	for (int32 i = 0; i < kFileCount; i++) {
+		int fd = open(kFiles[i], O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "could not create \"%s\": %s\n", kFiles[i],
+				strerror(errno));
+			return 1;
+		}
+		close(fd);
+	}
+
+	bool passed = true;
+	passed &= check_query(device, "name==*howto*", 1);
+	passed &= check_query(device, "name==*[Hh][Oo][Ww]*", 2);
+	passed &= check_query(device, "name==*HOW*", 1);
+	passed &= check_query(device, "name==*est_other*", 1);
+	passed &= check_query(device, "name==*nothing here*", 0);
+
+	// the index has to follow renames
+	rename(kFiles[2], "_trigram_test_xhowy_3");
+	passed &= check_query(device, "name==*[Hh][Oo][Ww]*", 3);
+	passed &= check_query(device, "name==*est_other*", 0);
+
+	unlink("_trigram_test_xhowy_3");
+	passed &= check_query(device, "name==*[Hh][Oo][Ww]*", 2);
+
+	for (int32 i = 0; i < kFileCount - 1; i++)
+		unlink(kFiles[i]);
+
+	if (createdIndex)
+		fs_remove_index(device, kTrigramIndex);
+
+	puts(passed ? "All tests passed." : "Some tests FAILED!");
+	return passed ? 0 : 1;
+}
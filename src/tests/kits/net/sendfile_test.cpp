@@ -0,0 +1,198 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//!	Tests that sendfile() transfers a file over a TCP connection unchanged
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+const char* kTempFile = "/tmp/sendfile_test";
+const size_t kFileSize = 3 * 1024 * 1024 + 1234;
+const off_t kOffset = 4097;
+
+
+static inline uint8_t
+pattern_at(size_t offset)
+{
+	return (uint8_t)(offset * 7 + (offset >> 12));
+}
+
+
+static bool
+create_file()
+{
+	int fd = open(kTempFile, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "could not create \"%s\": %s\n", kTempFile,
+			strerror(errno));
+		return false;
+	}
+
+	uint8_t buffer[16384];
+	size_t offset = 0;
+	while (offset < kFileSize) {
+		size_t length = kFileSize - offset;
+		if (length > sizeof(buffer))
+			length = sizeof(buffer);
+
+		for (size_t i = 0; i < length; i++)
+			buffer[i] = pattern_at(offset + i);
+
+		if (write(fd, buffer, length) != (ssize_t)length) {
+			fprintf(stderr, "could not write file: %s\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		offset += length;
+	}
+
+	close(fd);
+	return true;
+}
+
+
+static int
+send_file(const sockaddr_in& address)
+{
+	int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (socket < 0
+		|| connect(socket, (const sockaddr*)&address, sizeof(address)) != 0) {
+		fprintf(stderr, "child: could not connect: %s\n", strerror(errno));
+		return 1;
+	}
+
+	int fd = open(kTempFile, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "child: could not open file: %s\n", strerror(errno));
+		return 1;
+	}
+
+	// send the file from kOffset to the end, using an explicit offset
+	off_t offset = kOffset;
+	while ((size_t)offset < kFileSize) {
+		ssize_t bytesSent = sendfile(socket, fd, &offset, kFileSize - offset);
+		if (bytesSent <= 0) {
+			fprintf(stderr, "child: sendfile() failed: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+
+	// the file position must not have been touched
+	if (lseek(fd, 0, SEEK_CUR) != 0) {
+		fprintf(stderr, "child: the file position was moved\n");
+		return 1;
+	}
+
+	close(fd);
+	close(socket);
+	return 0;
+}
+
+
+static bool
+receive_file(int socket)
+{
+	uint8_t buffer[16384];
+	size_t offset = kOffset;
+
+	while (true) {
+		ssize_t bytesReceived = recv(socket, buffer, sizeof(buffer), 0);
+		if (bytesReceived < 0) {
+			fprintf(stderr, "recv() failed: %s\n", strerror(errno));
+			return false;
+		}
+		if (bytesReceived == 0)
+			break;
+
+		for (ssize_t i = 0; i < bytesReceived; i++) {
+			if (buffer[i] != pattern_at(offset + i)) {
+				fprintf(stderr, "received wrong data at offset %lu\n",
+					(unsigned long)(offset + i));
+				return false;
+			}
+		}
+		offset += bytesReceived;
+	}
+
+	if (offset != kFileSize) {
+		fprintf(stderr, "received %lu bytes, expected %lu\n",
+			(unsigned long)(offset - kOffset),
+			(unsigned long)(kFileSize - kOffset));
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (!create_file())
+		return 1;
+
+	int listenerSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenerSocket < 0) {
+		fprintf(stderr, "could not create socket: %s\n", strerror(errno));
+		return 1;
+	}
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+
+	if (bind(listenerSocket, (sockaddr*)&address, sizeof(address)) != 0
+		|| getsockname(listenerSocket, (sockaddr*)&address, &addressLength)
+			!= 0
+		|| listen(listenerSocket, 1) != 0) {
+		fprintf(stderr, "could not set up listener: %s\n", strerror(errno));
+		return 1;
+	}
+
+	pid_t child = fork();
+	if (child < 0) {
+		fprintf(stderr, "fork() failed: %s\n", strerror(errno));
+		return 1;
+	}
+	if (child == 0)
+		exit(send_file(address));
+
+	int socket = accept(listenerSocket, NULL, NULL);
+	if (socket < 0) {
+		fprintf(stderr, "accept() failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	bool failed = !receive_file(socket);
+
+	int childStatus;
+	if (waitpid(child, &childStatus, 0) != child
+		|| !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0)
+		failed = true;
+
+	close(socket);
+	close(listenerSocket);
+	unlink(kTempFile);
+
+	if (failed)
+		return 1;
+
+	puts("All tests passed!");
+	return 0;
+}
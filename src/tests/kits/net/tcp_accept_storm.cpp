@@ -0,0 +1,183 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//!	Measures how many TCP connections per second can be set up on loopback
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+extern const char* __progname;
+
+static const int kMaxThreads = 64;
+
+static sockaddr_in sAddress;
+static volatile bool sQuit;
+static int sListenerSocket;
+
+
+struct thread_stats {
+	long	connections;
+	long	failures;
+};
+
+
+static double
+current_time()
+{
+	timeval time;
+	gettimeofday(&time, NULL);
+	return time.tv_sec + time.tv_usec / 1000000.0;
+}
+
+
+static void*
+accept_thread(void* data)
+{
+	thread_stats* stats = (thread_stats*)data;
+
+	while (!sQuit) {
+		int socket = accept(sListenerSocket, NULL, NULL);
+		if (socket < 0) {
+			if (!sQuit)
+				stats->failures++;
+			continue;
+		}
+
+		stats->connections++;
+		close(socket);
+	}
+
+	return NULL;
+}
+
+
+static void*
+connect_thread(void* data)
+{
+	thread_stats* stats = (thread_stats*)data;
+
+	while (!sQuit) {
+		int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (socket < 0) {
+			stats->failures++;
+			continue;
+		}
+
+		if (connect(socket, (sockaddr*)&sAddress, sizeof(sAddress)) == 0)
+			stats->connections++;
+		else
+			stats->failures++;
+
+		close(socket);
+	}
+
+	return NULL;
+}
+
+
+static void
+usage(bool failure)
+{
+	printf("Usage: %s [-t <threads>] [-s <seconds>]\n"
+		"  Connects to and accepts from a loopback TCP socket as fast as\n"
+		"  possible, and prints the number of connections per second.\n\n"
+		"  -t\tNumber of connecting threads, default is 4\n"
+		"  -s\tDuration of the test in seconds, default is 10\n", __progname);
+
+	exit(failure ? 1 : 0);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int threadCount = 4;
+	int seconds = 10;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			seconds = atoi(argv[++i]);
+		else
+			usage(strcmp(argv[i], "--help") != 0);
+	}
+
+	if (threadCount < 1 || threadCount > kMaxThreads || seconds < 1)
+		usage(true);
+
+	sListenerSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (sListenerSocket < 0) {
+		fprintf(stderr, "%s: could not create socket: %s\n", __progname,
+			strerror(errno));
+		return 1;
+	}
+
+	memset(&sAddress, 0, sizeof(sAddress));
+	sAddress.sin_family = AF_INET;
+	sAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(sAddress);
+
+	if (bind(sListenerSocket, (sockaddr*)&sAddress, sizeof(sAddress)) != 0
+		|| getsockname(sListenerSocket, (sockaddr*)&sAddress, &addressLength)
+			!= 0
+		|| listen(sListenerSocket, 1024) != 0) {
+		fprintf(stderr, "%s: could not set up listener: %s\n", __progname,
+			strerror(errno));
+		return 1;
+	}
+
+	thread_stats acceptStats;
+	memset(&acceptStats, 0, sizeof(acceptStats));
+	thread_stats connectStats[kMaxThreads];
+	memset(connectStats, 0, sizeof(connectStats));
+
+	pthread_t acceptThread;
+	pthread_t connectThreads[kMaxThreads];
+
+	double start = current_time();
+
+	pthread_create(&acceptThread, NULL, &accept_thread, &acceptStats);
+	for (int i = 0; i < threadCount; i++) {
+		pthread_create(&connectThreads[i], NULL, &connect_thread,
+			&connectStats[i]);
+	}
+
+	sleep(seconds);
+	sQuit = true;
+
+	long connections = 0;
+	long failures = 0;
+	for (int i = 0; i < threadCount; i++) {
+		pthread_join(connectThreads[i], NULL);
+		connections += connectStats[i].connections;
+		failures += connectStats[i].failures;
+	}
+
+	double elapsed = current_time() - start;
+
+	// wake up the accepting thread
+	shutdown(sListenerSocket, SHUT_RDWR);
+	close(sListenerSocket);
+	pthread_join(acceptThread, NULL);
+
+	printf("%d threads: %ld connections in %.2f seconds, %.0f per second\n",
+		threadCount, connections, elapsed, connections / elapsed);
+	printf("accepted %ld, %ld connects and %ld accepts failed\n",
+		acceptStats.connections, failures, acceptStats.failures);
+
+	return 0;
+}
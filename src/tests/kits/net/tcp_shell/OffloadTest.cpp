@@ -0,0 +1,341 @@
+/*
+ * Copyright 2016, Haiku, Inc. All Rights Reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+//!	Tests the checksums of the generic TCP receive and segmentation offload.
+
+
+#include "offload.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include <net_socket.h>
+#include <net_stack.h>
+#include <util/list.h>
+
+
+#define TCP_FLAG_PUSH			0x08
+#define TCP_FLAG_ACKNOWLEDGE	0x10
+
+#define HEADER_LENGTH			(sizeof(ip) + sizeof(tcphdr))
+#define MAX_PACKET_SIZE			8192
+
+
+extern "C" status_t _add_builtin_module(module_info *info);
+
+extern struct net_buffer_module_info gNetBufferModule;
+	// from net_buffer.cpp
+
+struct net_socket_module_info gNetSocketModule;
+struct net_buffer_module_info* gBufferModule;
+
+static int sFailures;
+
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#condition); \
+			sFailures++; \
+		} \
+	} while (false)
+
+
+/*!	A plain RFC 1071 checksum over \a length bytes of \a data, added to
+	\a sum, without any of the tricks the offload code uses.
+*/
+static uint32
+sum_data(const uint8* data, size_t length, uint32 sum)
+{
+	for (size_t i = 0; i + 1 < length; i += 2)
+		sum += (data[i] << 8) | data[i + 1];
+	if ((length & 1) != 0)
+		sum += data[length - 1] << 8;
+
+	return sum;
+}
+
+
+static uint16
+finish_sum(uint32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum & 0xffff;
+}
+
+
+/*!	Computes the full TCP checksum of the IPv4 packet in \a packet, treating
+	the checksum field itself as zero. The result is in host byte order.
+*/
+static uint16
+full_tcp_checksum(const uint8* packet, size_t length)
+{
+	const ip& header = *(const ip*)packet;
+	uint16 tcpLength = length - sizeof(ip);
+
+	uint32 sum = sum_data((const uint8*)&header.ip_src, 4, 0);
+	sum = sum_data((const uint8*)&header.ip_dst, 4, sum);
+	sum += IPPROTO_TCP + tcpLength;
+
+	uint8 tcp[MAX_PACKET_SIZE];
+	memcpy(tcp, packet + sizeof(ip), tcpLength);
+	memset(tcp + offsetof(tcphdr, th_sum), 0, sizeof(uint16));
+
+	return finish_sum(sum_data(tcp, tcpLength, sum));
+}
+
+
+static uint16
+full_ip_checksum(const uint8* packet)
+{
+	uint8 header[sizeof(ip)];
+	memcpy(header, packet, sizeof(ip));
+	memset(header + offsetof(ip, ip_sum), 0, sizeof(uint16));
+
+	return finish_sum(sum_data(header, sizeof(ip), 0));
+}
+
+
+static uint8
+payload_byte(uint32 sequence)
+{
+	return (uint8)(sequence * 7 + (sequence >> 8));
+}
+
+
+static net_buffer*
+create_segment(uint32 sequence, size_t dataLength, uint8 flags,
+	bool corrupt = false)
+{
+	uint8 packet[MAX_PACKET_SIZE];
+	size_t length = HEADER_LENGTH + dataLength;
+	memset(packet, 0, HEADER_LENGTH);
+
+	ip& ipHeader = *(ip*)packet;
+	ipHeader.ip_v = IPVERSION;
+	ipHeader.ip_hl = sizeof(ip) / 4;
+	ipHeader.ip_len = htons(length);
+	ipHeader.ip_id = htons(sequence & 0xffff);
+	ipHeader.ip_ttl = 64;
+	ipHeader.ip_p = IPPROTO_TCP;
+	ipHeader.ip_src.s_addr = htonl(0x0a000001);
+	ipHeader.ip_dst.s_addr = htonl(0x0a000002);
+
+	tcphdr& tcpHeader = *(tcphdr*)(packet + sizeof(ip));
+	tcpHeader.th_sport = htons(1234);
+	tcpHeader.th_dport = htons(80);
+	tcpHeader.th_seq = htonl(sequence);
+	tcpHeader.th_ack = htonl(0x12345678);
+	packet[sizeof(ip) + 12] = (sizeof(tcphdr) / 4) << 4;
+	tcpHeader.th_flags = flags;
+	tcpHeader.th_win = htons(32768);
+
+	for (size_t i = 0; i < dataLength; i++)
+		packet[HEADER_LENGTH + i] = payload_byte(sequence + i);
+
+	ipHeader.ip_sum = htons(full_ip_checksum(packet));
+	tcpHeader.th_sum = htons(full_tcp_checksum(packet, length)
+		^ (corrupt ? 0x0100 : 0));
+
+	net_buffer* buffer = gBufferModule->create(256);
+	if (buffer == NULL || gBufferModule->append(buffer, packet, length)
+			!= B_OK) {
+		printf("creating a segment failed!\n");
+		exit(1);
+	}
+
+	buffer->type = B_NET_FRAME_TYPE_IPV4;
+	return buffer;
+}
+
+
+/*!	Checks that the IP, and TCP checksums stored in the \a buffer match the
+	ones computed over its complete contents, and that its data continues at
+	\a sequence.
+*/
+static bool
+verify_segment(net_buffer* buffer, uint32 sequence, size_t dataLength)
+{
+	uint8 packet[MAX_PACKET_SIZE];
+	if (buffer->size != HEADER_LENGTH + dataLength
+		|| gBufferModule->read(buffer, 0, packet, buffer->size) != B_OK) {
+		printf("segment has unexpected size %" B_PRIu32 "\n", buffer->size);
+		return false;
+	}
+
+	const ip& ipHeader = *(const ip*)packet;
+	const tcphdr& tcpHeader = *(const tcphdr*)(packet + sizeof(ip));
+
+	bool valid = true;
+	if (ntohs(ipHeader.ip_len) != buffer->size
+		|| ntohl(tcpHeader.th_seq) != sequence) {
+		printf("segment has wrong length, or sequence\n");
+		valid = false;
+	}
+	if (ntohs(ipHeader.ip_sum) != full_ip_checksum(packet)) {
+		printf("IP checksum %#x, expected %#x\n", ntohs(ipHeader.ip_sum),
+			full_ip_checksum(packet));
+		valid = false;
+	}
+	if (ntohs(tcpHeader.th_sum) != full_tcp_checksum(packet, buffer->size)) {
+		printf("TCP checksum %#x, expected %#x\n", ntohs(tcpHeader.th_sum),
+			full_tcp_checksum(packet, buffer->size));
+		valid = false;
+	}
+
+	for (size_t i = 0; i < dataLength; i++) {
+		if (packet[HEADER_LENGTH + i] != payload_byte(sequence + i)) {
+			printf("data mismatch at offset %" B_PRIuSIZE "\n", i);
+			valid = false;
+			break;
+		}
+	}
+
+	return valid;
+}
+
+
+static void
+test_merge(size_t firstLength, size_t secondLength, size_t thirdLength)
+{
+	printf("merge %" B_PRIuSIZE " + %" B_PRIuSIZE " + %" B_PRIuSIZE "\n",
+		firstLength, secondLength, thirdLength);
+
+	uint32 sequence = 1000;
+	net_buffer* buffer = create_segment(sequence, firstLength,
+		TCP_FLAG_ACKNOWLEDGE);
+	net_buffer* second = create_segment(sequence + firstLength, secondLength,
+		TCP_FLAG_ACKNOWLEDGE);
+	net_buffer* third = create_segment(sequence + firstLength + secondLength,
+		thirdLength, TCP_FLAG_ACKNOWLEDGE | TCP_FLAG_PUSH);
+
+	CHECK(is_mergeable_tcp_segment(buffer));
+	CHECK(merge_tcp_segment(buffer, second) == B_OK);
+	CHECK(verify_segment(buffer, sequence, firstLength + secondLength));
+
+	// the PUSH flag of the last segment is taken over as well
+	CHECK(merge_tcp_segment(buffer, third) == B_OK);
+	CHECK(verify_segment(buffer, sequence,
+		firstLength + secondLength + thirdLength));
+
+	tcphdr tcpHeader;
+	gBufferModule->read(buffer, sizeof(ip), &tcpHeader, sizeof(tcphdr));
+	CHECK((tcpHeader.th_flags & TCP_FLAG_PUSH) != 0);
+
+	gBufferModule->free(buffer);
+}
+
+
+static void
+test_merge_corrupt()
+{
+	printf("merge with a corrupt segment\n");
+
+	net_buffer* buffer = create_segment(1000, 101, TCP_FLAG_ACKNOWLEDGE);
+	net_buffer* next = create_segment(1101, 200, TCP_FLAG_ACKNOWLEDGE, true);
+
+	CHECK(merge_tcp_segment(buffer, next) == B_OK);
+
+	// the merged checksum must not verify
+	CHECK(!verify_segment(buffer, 1000, 301));
+
+	gBufferModule->free(buffer);
+}
+
+
+static void
+test_merge_mismatch()
+{
+	printf("merge segments out of order\n");
+
+	net_buffer* buffer = create_segment(1000, 100, TCP_FLAG_ACKNOWLEDGE);
+	net_buffer* next = create_segment(1200, 100, TCP_FLAG_ACKNOWLEDGE);
+
+	CHECK(merge_tcp_segment(buffer, next) == B_MISMATCHED_VALUES);
+	CHECK(verify_segment(buffer, 1000, 100));
+	CHECK(verify_segment(next, 1200, 100));
+
+	gBufferModule->free(buffer);
+	gBufferModule->free(next);
+}
+
+
+static void
+test_split(size_t dataLength, uint16 segmentSize)
+{
+	printf("split %" B_PRIuSIZE " into %u byte segments\n", dataLength,
+		segmentSize);
+
+	uint32 sequence = 5000;
+	net_buffer* buffer = create_segment(sequence, dataLength,
+		TCP_FLAG_ACKNOWLEDGE | TCP_FLAG_PUSH);
+	buffer->segment_size = segmentSize;
+
+	struct list segments;
+	list_init(&segments);
+
+	CHECK(split_tcp_segments(buffer, &segments) == B_OK);
+
+	size_t offset = 0;
+	while (net_buffer* segment
+			= (net_buffer*)list_remove_head_item(&segments)) {
+		size_t length = min_c(segmentSize, dataLength - offset);
+		CHECK(verify_segment(segment, sequence + offset, length));
+
+		tcphdr tcpHeader;
+		gBufferModule->read(segment, sizeof(ip), &tcpHeader, sizeof(tcphdr));
+		bool last = offset + length == dataLength;
+		CHECK(((tcpHeader.th_flags & TCP_FLAG_PUSH) != 0) == last);
+
+		offset += length;
+		gBufferModule->free(segment);
+	}
+
+	CHECK(offset == dataLength);
+
+	// the original buffer must be left untouched
+	CHECK(verify_segment(buffer, sequence, dataLength));
+	gBufferModule->free(buffer);
+}
+
+
+int
+main()
+{
+	_add_builtin_module((module_info*)&gNetBufferModule);
+	get_module(NET_BUFFER_MODULE_NAME, (module_info**)&gBufferModule);
+
+	test_merge(100, 200, 300);
+	test_merge(101, 200, 300);
+	test_merge(100, 201, 299);
+	test_merge(101, 57, 1);
+	test_merge_corrupt();
+	test_merge_mismatch();
+
+	test_split(3000, 1000);
+	test_split(2501, 1000);
+	test_split(2501, 999);
+	test_split(1, 1460);
+
+	put_module(NET_BUFFER_MODULE_NAME);
+
+	if (sFailures != 0) {
+		printf("%d checks failed!\n", sFailures);
+		return 1;
+	}
+
+	printf("All tests passed!\n");
+	return 0;
+}
@@ -20,6 +20,7 @@
 #include <net_protocol.h>
 #include <net_socket.h>
 #include <net_stack.h>
+#include <net_stat.h>
 #include <slab/Slab.h>
 #include <util/AutoLock.h>
 
@@ -30,6 +31,7 @@
 
 #include <ctype.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <new>
 #include <set>
 #include <stdio.h>
@@ -919,7 +921,7 @@ domain_receive_data(net_buffer *buffer)
 
 	bool drop = false;
 	if (sDropList.find(packetNumber) != sDropList.end()
-		|| (sRandomDrop > 0.0 && (1.0 * rand() / RAND_MAX) > sRandomDrop))
+		|| (sRandomDrop > 0.0 && (1.0 * rand() / RAND_MAX) < sRandomDrop))
 		drop = true;
 
 	if (!drop && (sRoundTripTime > 0 || sRandomRoundTrip || sIncreasingRoundTrip)) {
@@ -1529,6 +1531,49 @@ do_round_trip_time(int argc, char** argv)
 }
 
 
+static void
+do_congestion(int argc, char** argv)
+{
+	if (argc == 1) {
+		// show the congestion state of the client
+		net_stat stat;
+		size_t length = sizeof(net_stat);
+		status_t status = gClientSocket->first_info->control(
+			gClientSocket->first_protocol, IPPROTO_TCP, NET_STAT_SOCKET, &stat,
+			&length);
+		if (status < B_OK) {
+			fprintf(stderr, "Could not get client state: %s\n",
+				strerror(status));
+			return;
+		}
+
+		printf("%s: cwnd %" B_PRIu32 ", ssthresh %" B_PRIu32 ", rtt %g ms\n",
+			stat.congestion_control, stat.congestion_window,
+			stat.slow_start_threshold, stat.round_trip_time / 1000.0);
+	} else if (argc == 2 && argv[1][0] != '-') {
+		// set the algorithm, the server inherits it from its listener
+		status_t status = gClientSocket->first_info->setsockopt(
+			gClientSocket->first_protocol, IPPROTO_TCP, TCP_CONGESTION,
+			argv[1], strlen(argv[1]) + 1);
+		if (status == B_OK) {
+			status = gServerSocket->first_info->setsockopt(
+				gServerSocket->first_protocol, IPPROTO_TCP, TCP_CONGESTION,
+				argv[1], strlen(argv[1]) + 1);
+		}
+		if (status < B_OK) {
+			fprintf(stderr, "Could not set congestion control \"%s\": %s\n",
+				argv[1], strerror(status));
+		}
+	} else {
+		// print usage
+		puts("usage: congestion [<algorithm>]\n\n"
+			"Sets the congestion control algorithm (reno, cubic, or vegas) of\n"
+			"both ends; without any arguments, the current algorithm, window,\n"
+			"and round trip time of the client are printed.");
+	}
+}
+
+
 static void
 do_dprintf(int argc, char** argv)
 {
@@ -1545,6 +1590,7 @@ static cmd_entry sBuiltinCommands[] = {
 	{"connect", do_connect, "Connects the client"},
 	{"send", do_send, "Sends data from the client to the server"},
 	{"close", do_close, "Performs an active or simultaneous close"},
+	{"congestion", do_congestion, "Sets or shows the congestion control"},
 	{"dprintf", do_dprintf, "Toggles debug output"},
 	{"drop", do_drop, "Lets you drop packets during transfer"},
 	{"reorder", do_reorder, "Lets you reorder packets during transfer"},
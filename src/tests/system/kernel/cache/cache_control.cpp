@@ -20,7 +20,7 @@ extern const char *__progname;
 void
 usage()
 {
-	fprintf(stderr, "usage: %s [clear | unset | set <module-name>]\n", __progname);
+	fprintf(stderr, "usage: %s [clear | unset | set <module-name> | stats]\n", __progname);
 	exit(0);
 }
 
@@ -50,6 +50,19 @@ main(int argc, char **argv)
 		status = _kern_generic_syscall(CACHE_SYSCALLS, CACHE_SET_MODULE, argv[2], strlen(argv[2]));
 		if (status != B_OK)
 			fprintf(stderr, "%s: setting the module failed: %s\n", __progname, strerror(status));
+	} else if (!strcmp(argv[1], "stats")) {
+		file_cache_readahead_stats stats;
+		status = _kern_generic_syscall(CACHE_SYSCALLS, CACHE_GET_READAHEAD_STATS, &stats, sizeof(stats));
+		if (status != B_OK) {
+			fprintf(stderr, "%s: getting the readahead stats failed: %s\n", __progname, strerror(status));
+			return 1;
+		}
+
+		printf("readahead streams:  %" B_PRIu64 "\n", stats.streams);
+		printf("requests:           %" B_PRIu64 "\n", stats.requests);
+		printf("pages read ahead:   %" B_PRIu64 "\n", stats.pages_read_ahead);
+		printf("pages hit:          %" B_PRIu64 "\n", stats.pages_hit);
+		printf("pages wasted:       %" B_PRIu64 "\n", stats.pages_wasted);
 	} else
 		usage();
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <OS.h>
+
+#include <syscalls.h>
+#include <ici_statistics.h>
+
+
+static const size_t kProtectPages = 256;
+
+
+static status_t
+get_statistics(ici_statistics* statistics, int32 cpuCount)
+{
+	return _kern_generic_syscall(ICI_STATISTICS, GET_ICI_STATISTICS,
+		statistics, sizeof(ici_statistics) * cpuCount);
+}
+
+
+static uint64
+total_shootdowns(const ici_statistics* statistics, int32 cpuCount)
+{
+	uint64 total = 0;
+	for (int32 i = 0; i < cpuCount; i++)
+		total += statistics[i].tlb_shootdowns_sent;
+	return total;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	system_info info;
+	get_system_info(&info);
+	int32 cpuCount = info.cpu_count;
+
+	ici_statistics* statistics = (ici_statistics*)calloc(cpuCount,
+		sizeof(ici_statistics));
+	if (statistics == NULL)
+		return 1;
+
+	status_t status = get_statistics(statistics, cpuCount);
+	if (status != B_OK) {
+		fprintf(stderr, "Could not get ICI statistics: %s\n",
+			strerror(status));
+		return 1;
+	}
+
+	printf("cpu         sent     received   tlb sent   tlb recv\n");
+	for (int32 i = 0; i < cpuCount; i++) {
+		printf("%3" B_PRId32 " %12" B_PRIu64 " %12" B_PRIu64 " %10" B_PRIu64
+			" %10" B_PRIu64 "\n", i, statistics[i].sent,
+			statistics[i].received, statistics[i].tlb_shootdowns_sent,
+			statistics[i].tlb_shootdowns_received);
+	}
+
+	if (argc < 2 || strcmp(argv[1], "-p") != 0)
+		return 0;
+
+	// Write protect a range of touched pages, and see how many shootdowns
+	// that took. With batching, it should be a single one, at most.
+	size_t size = kProtectPages * B_PAGE_SIZE;
+	uint8* pages = (uint8*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pages == MAP_FAILED) {
+		fprintf(stderr, "Could not map pages\n");
+		return 1;
+	}
+	for (size_t offset = 0; offset < size; offset += B_PAGE_SIZE)
+		pages[offset] = 1;
+
+	uint64 before = total_shootdowns(statistics, cpuCount);
+	mprotect(pages, size, PROT_READ);
+	get_statistics(statistics, cpuCount);
+	uint64 after = total_shootdowns(statistics, cpuCount);
+
+	printf("\nmprotect() of %zu pages: %" B_PRIu64 " TLB shootdowns\n",
+		kProtectPages, after - before);
+
+	munmap(pages, size);
+	free(statistics);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SupportDefs.h>
+
+#include <syscalls.h>
+#include <page_daemon_tuning.h>
+
+
+static const struct {
+	const char*	name;
+	size_t		offset;
+	size_t		size;
+} kParameters[] = {
+	{ "free_pages_target", offsetof(page_daemon_tuning, free_pages_target),
+		sizeof(uint32) },
+	{ "free_or_cached_pages_target",
+		offsetof(page_daemon_tuning, free_or_cached_pages_target),
+		sizeof(uint32) },
+	{ "inactive_pages_target",
+		offsetof(page_daemon_tuning, inactive_pages_target), sizeof(uint32) },
+	{ "idle_scan_interval", offsetof(page_daemon_tuning, idle_scan_interval),
+		sizeof(bigtime_t) },
+	{ "busy_scan_interval", offsetof(page_daemon_tuning, busy_scan_interval),
+		sizeof(bigtime_t) },
+	{ "idle_runs_for_full_queue",
+		offsetof(page_daemon_tuning, idle_runs_for_full_queue),
+		sizeof(uint32) },
+	{ "page_usage_advance", offsetof(page_daemon_tuning, page_usage_advance),
+		sizeof(int32) },
+	{ "page_usage_decline", offsetof(page_daemon_tuning, page_usage_decline),
+		sizeof(int32) },
+	{ "min_clear_pages_target",
+		offsetof(page_daemon_tuning, min_clear_pages_target),
+		sizeof(uint32) },
+	{ "max_clear_pages_target",
+		offsetof(page_daemon_tuning, max_clear_pages_target),
+		sizeof(uint32) },
+};
+
+static const size_t kParameterCount
+	= sizeof(kParameters) / sizeof(kParameters[0]);
+
+
+static int32
+find_parameter(const char* name)
+{
+	for (size_t i = 0; i < kParameterCount; i++) {
+		if (strcmp(kParameters[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (argc % 2 != 1) {
+		fprintf(stderr, "usage: %s [<parameter> <value> ...]\n", argv[0]);
+		return 1;
+	}
+
+	page_daemon_tuning tuning;
+	status_t status = _kern_generic_syscall(PAGE_DAEMON_SYSCALLS,
+		GET_PAGE_DAEMON_TUNING, &tuning, sizeof(tuning));
+	if (status != B_OK) {
+		fprintf(stderr, "Could not get page daemon parameters: %s\n",
+			strerror(status));
+		return 1;
+	}
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i += 2) {
+			int32 index = find_parameter(argv[i]);
+			if (index < 0) {
+				fprintf(stderr, "Unknown parameter \"%s\"\n", argv[i]);
+				return 1;
+			}
+
+			uint8* field = (uint8*)&tuning + kParameters[index].offset;
+			int64 value = strtoll(argv[i + 1], NULL, 0);
+			if (kParameters[index].size == sizeof(bigtime_t))
+				*(bigtime_t*)field = value;
+			else
+				*(uint32*)field = value;
+		}
+
+		status = _kern_generic_syscall(PAGE_DAEMON_SYSCALLS,
+			SET_PAGE_DAEMON_TUNING, &tuning, sizeof(tuning));
+		if (status != B_OK) {
+			fprintf(stderr, "Could not set page daemon parameters: %s\n",
+				strerror(status));
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < kParameterCount; i++) {
+		uint8* field = (uint8*)&tuning + kParameters[i].offset;
+		int64 value = kParameters[i].size == sizeof(bigtime_t)
+			? *(bigtime_t*)field : *(uint32*)field;
+		printf("%-28s %" B_PRId64 "\n", kParameters[i].name, value);
+	}
+
+	page_daemon_stats stats;
+	status = _kern_generic_syscall(PAGE_DAEMON_SYSCALLS, GET_PAGE_DAEMON_STATS,
+		&stats, sizeof(stats));
+	if (status != B_OK) {
+		fprintf(stderr, "Could not get page daemon statistics: %s\n",
+			strerror(status));
+		return 1;
+	}
+
+	printf("\nclear pages: %" B_PRIu32 " (target %" B_PRIu32 "), %" B_PRIu64
+		" of %" B_PRIu64 " clear page allocations had to clear the page\n",
+		stats.clear_pages, stats.clear_pages_target, stats.clear_page_misses,
+		stats.clear_page_allocations);
+
+	printf("\npage reservation waits: %" B_PRIu64 ", max %" B_PRId64 " us\n",
+		stats.reserve_waits, stats.max_reserve_wait_time);
+	for (int32 i = 0; i < PAGE_RESERVE_WAIT_BUCKETS; i++) {
+		if (stats.reserve_wait_histogram[i] == 0)
+			continue;
+
+		if (i == 0)
+			printf("<  %7d us: ", 32);
+		else
+			printf(">= %7" B_PRId64 " us: ", (bigtime_t)1 << (i + 4));
+		printf("%" B_PRIu64 "\n", stats.reserve_wait_histogram[i]);
+	}
+
+	return 0;
+}
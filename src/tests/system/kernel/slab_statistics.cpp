@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <SupportDefs.h>
+
+#include <syscalls.h>
+#include <slab_statistics.h>
+
+
+static double
+hit_rate(uint64 hits, uint64 misses)
+{
+	if (hits + misses == 0)
+		return 0.0;
+
+	return 100.0 * hits / (hits + misses);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	bool all = argc > 1 && strcmp(argv[1], "-a") == 0;
+
+	printf("%-24s %4s %7s %7s %10s %10s %8s\n", "name", "mag", "alloc%",
+		"free%", "exchanges", "contended", "refills");
+
+	object_cache_stats_args args;
+	args.cookie = 0;
+
+	while (_kern_generic_syscall(SLAB_STATISTICS, GET_NEXT_OBJECT_CACHE_STATS,
+			&args, sizeof(args)) == B_OK) {
+		const object_cache_stats& stats = args.stats;
+
+		// only print the caches that have actually been used
+		if (!all && stats.alloc_hits == 0 && stats.slab_allocs == 0)
+			continue;
+
+		printf("%-24s %4" B_PRIu32 " %6.1f%% %6.1f%% %10" B_PRIu64 " %10"
+			B_PRIu64 " %8" B_PRIu64 "\n", stats.name, stats.magazine_capacity,
+			hit_rate(stats.alloc_hits, stats.slab_allocs),
+			hit_rate(stats.free_hits, stats.slab_frees),
+			stats.depot_exchanges, stats.depot_contentions,
+			stats.slab_refills);
+	}
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	The "inlinetest" command checks that the data of small files survives
+	being stored in their inode, moved into a data stream when the file
+	grows, truncated again, and reading it back after a remount.
+	The volume must have been initialized with the "inline_data" parameter.
+*/
+
+
+#include "fssh_fcntl.h"
+#include "fssh_fs_info.h"
+#include "fssh_stat.h"
+#include "fssh_stdio.h"
+#include "fssh_string.h"
+#include "syscalls.h"
+
+#include "bfs.h"
+#include "bfs_control.h"
+
+
+namespace FSShell {
+
+
+static const char* kMountPoint = "/myfs";
+static const char* kTestFile = "/myfs/inline test";
+static const size_t kSmallSize = 100;
+static const size_t kLargeSize = 65536;
+	// larger than any inode
+
+
+static uint8
+test_byte(off_t offset)
+{
+	return (uint8)(offset * 13 + offset / 256 + 7);
+}
+
+
+static bool
+write_pattern(int fd, off_t offset, size_t length)
+{
+	uint8 buffer[1024];
+
+	while (length > 0) {
+		size_t bytes = min_c(length, sizeof(buffer));
+		for (size_t i = 0; i < bytes; i++)
+			buffer[i] = test_byte(offset + i);
+
+		if (_kern_write(fd, offset, buffer, bytes) != (ssize_t)bytes) {
+			fssh_dprintf("inlinetest: writing at %" B_PRIdOFF " failed\n",
+				offset);
+			return false;
+		}
+
+		offset += bytes;
+		length -= bytes;
+	}
+
+	return true;
+}
+
+
+/*!	Reopens the test file, and checks that it has the expected \a size and
+	contents.
+*/
+static bool
+check_file(const char* step, off_t size)
+{
+	int fd = _kern_open(-1, kTestFile, O_RDONLY, 0);
+	if (fd < 0) {
+		fssh_dprintf("inlinetest: %s: could not open file: %s\n", step,
+			strerror(fd));
+		return false;
+	}
+
+	struct stat stat;
+	if (_kern_read_stat(fd, NULL, false, &stat, sizeof(stat)) != B_OK
+		|| stat.st_size != size) {
+		fssh_dprintf("inlinetest: %s: file has the wrong size\n", step);
+		_kern_close(fd);
+		return false;
+	}
+
+	uint8 buffer[1024];
+	off_t offset = 0;
+	bool valid = true;
+
+	while (valid && offset < size) {
+		size_t bytes = (size_t)min_c((off_t)sizeof(buffer), size - offset);
+		if (_kern_read(fd, offset, buffer, bytes) != (ssize_t)bytes) {
+			fssh_dprintf("inlinetest: %s: reading at %" B_PRIdOFF
+				" failed\n", step, offset);
+			valid = false;
+			break;
+		}
+
+		for (size_t i = 0; i < bytes; i++) {
+			if (buffer[i] != test_byte(offset + i)) {
+				fssh_dprintf("inlinetest: %s: wrong data at %" B_PRIdOFF
+					"\n", step, offset + i);
+				valid = false;
+				break;
+			}
+		}
+
+		offset += bytes;
+	}
+
+	_kern_close(fd);
+	return valid;
+}
+
+
+/*!	Returns the number of blocks allocated for the test file, or -1 if that
+	could not be determined.
+*/
+static off_t
+file_blocks()
+{
+	int fd = _kern_open(-1, kTestFile, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+
+	bfs_allocation_stats stats;
+	status_t status = _kern_ioctl(fd, BFS_IOCTL_GET_ALLOCATION_STATS, &stats,
+		sizeof(stats));
+	_kern_close(fd);
+
+	return status == B_OK ? (off_t)stats.file_blocks : -1;
+}
+
+
+/*!	Unmounts and mounts the volume again, so that everything has to be read
+	from the disk.
+*/
+static bool
+remount()
+{
+	struct stat stat;
+	fs_info info;
+	status_t status = _kern_read_stat(-1, kMountPoint, false, &stat,
+		sizeof(stat));
+	if (status == B_OK)
+		status = _kern_read_fs_info(stat.st_dev, &info);
+
+	if (status == B_OK) {
+		_kern_setcwd(-1, "/");
+		status = _kern_unmount(kMountPoint, 0);
+	}
+	if (status == B_OK) {
+		dev_t device = _kern_mount(kMountPoint, info.device_name,
+			info.fsh_name, 0, NULL, 0);
+		if (device < 0)
+			status = device;
+	}
+	if (status == B_OK)
+		status = _kern_setcwd(-1, kMountPoint);
+
+	if (status != B_OK) {
+		fssh_dprintf("inlinetest: remounting failed: %s\n", strerror(status));
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+resize_file(off_t size)
+{
+	struct stat stat;
+	stat.st_size = size;
+
+	return _kern_write_stat(-1, kTestFile, false, &stat, sizeof(stat),
+		B_STAT_SIZE) == B_OK;
+}
+
+
+static bool
+run_tests()
+{
+	int fd = _kern_open(-1, kTestFile, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) {
+		fssh_dprintf("inlinetest: could not create \"%s\": %s\n", kTestFile,
+			strerror(fd));
+		return false;
+	}
+
+	// a small file is stored in its inode
+	bool success = write_pattern(fd, 0, kSmallSize) && _kern_fsync(fd) == B_OK;
+	_kern_close(fd);
+
+	if (!success || !check_file("write small", kSmallSize))
+		return false;
+	if (file_blocks() != 0) {
+		fssh_dprintf("inlinetest: small file has blocks, was the volume "
+			"initialized with \"inline_data\"?\n");
+		return false;
+	}
+
+	if (!remount() || !check_file("remount small", kSmallSize))
+		return false;
+
+	// growing it beyond the inode moves the data into a data stream
+	fd = _kern_open(-1, kTestFile, O_RDWR, 0);
+	if (fd < 0)
+		return false;
+
+	success = write_pattern(fd, kSmallSize, kLargeSize - kSmallSize)
+		&& _kern_fsync(fd) == B_OK;
+	_kern_close(fd);
+
+	if (!success || !check_file("grow", kLargeSize))
+		return false;
+	if (file_blocks() <= 0) {
+		fssh_dprintf("inlinetest: grown file has no blocks\n");
+		return false;
+	}
+
+	if (!remount() || !check_file("remount large", kLargeSize))
+		return false;
+
+	// truncating it keeps the data at the start
+	if (!resize_file(kSmallSize) || !check_file("truncate", kSmallSize))
+		return false;
+
+	if (!remount() || !check_file("remount truncated", kSmallSize))
+		return false;
+
+	return true;
+}
+
+
+fssh_status_t
+command_inlinetest(int argc, const char* const* argv)
+{
+	if (argc != 1) {
+		fssh_dprintf("Usage: %s\n", argv[0]);
+		return B_BAD_VALUE;
+	}
+
+	bool success = run_tests();
+	_kern_unlink(-1, kTestFile);
+
+	if (!success) {
+		fssh_dprintf("inlinetest: failed!\n");
+		return B_ERROR;
+	}
+
+	fssh_dprintf("inlinetest: All tests passed!\n");
+	return B_OK;
+}
+
+
+}	// namespace FSShell
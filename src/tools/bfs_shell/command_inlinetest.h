@@ -0,0 +1,21 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef INLINE_TEST_H
+#define INLINE_TEST_H
+
+
+#include "fssh_types.h"
+
+
+namespace FSShell {
+
+
+fssh_status_t command_inlinetest(int argc, const char* const* argv);
+
+
+}	// namespace FSShell
+
+
+#endif	// INLINE_TEST_H
@@ -1743,3 +1743,34 @@ fssh_block_cache_put(void* _cache, fssh_off_t blockNumber)
 	put_cached_block(cache, blockNumber);
 }
 
+
+/*!	Reads up to \a _numBlocks blocks beginning with \a blockNumber into the
+	cache, stopping at the first block that is already cached. There is no
+	asynchronous I/O in the FS shell, so the blocks are read right away.
+*/
+fssh_status_t
+fssh_block_cache_prefetch(void* _cache, fssh_off_t blockNumber,
+	fssh_size_t* _numBlocks)
+{
+	block_cache* cache = (block_cache*)_cache;
+	MutexLocker locker(&cache->lock);
+
+	fssh_size_t numBlocks = *_numBlocks;
+	*_numBlocks = 0;
+
+	for (; numBlocks > 0 && blockNumber < cache->max_blocks;
+			numBlocks--, blockNumber++) {
+		if (hash_lookup(cache->hash, &blockNumber) != NULL)
+			break;
+
+		bool allocated;
+		cached_block* block = get_cached_block(cache, blockNumber, &allocated);
+		if (block == NULL)
+			return FSSH_B_IO_ERROR;
+
+		put_cached_block(cache, block);
+		(*_numBlocks)++;
+	}
+
+	return FSSH_B_OK;
+}
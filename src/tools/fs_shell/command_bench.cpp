@@ -0,0 +1,1036 @@
+/*
+ * Copyright 2016, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	The "bench" command runs a set of repeatable metadata and data workloads
+	against the mounted file system, and reports one JSON object per workload
+	and line, so that the results of different runs, builds, or file systems
+	can easily be compared by scripts.
+
+	Since all workloads only use the generic VFS interface, they work with any
+	file system hosted by the FS shell; workloads a file system does not
+	support (like attributes or queries) just report an error.
+*/
+
+
+#include "compatibility.h"
+
+#include "command_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "fssh_dirent.h"
+#include "fssh_errors.h"
+#include "fssh_fcntl.h"
+#include "fssh_fs_info.h"
+#include "fssh_os.h"
+#include "fssh_stat.h"
+#include "fssh_string.h"
+#include "fssh_type_constants.h"
+#include "syscalls.h"
+
+
+namespace FSShell {
+
+
+static const char* kDefaultDirectory = "/myfs/bench";
+static const int32_t kDefaultCount = 1000;
+static const int32_t kDefaultFileSize = 16;				// MB
+static const int32_t kDefaultThreads = 4;
+static const fssh_size_t kSequentialChunkSize = 64 * 1024;
+static const fssh_size_t kRandomBlockSize = 4096;
+static const int32_t kTreeFanOut = 8;
+static const fssh_size_t kAttributeSize = 256;
+static const int32_t kQueryValues = 100;
+static const fssh_size_t kParallelFileSize = 64 * 1024;
+static const char* kAttributeName = "bench:data";
+static const char* kIndexName = "bench:value";
+
+
+struct Options {
+	Options()
+		:
+		count(kDefaultCount),
+		fileSize((fssh_off_t)kDefaultFileSize * 1024 * 1024),
+		seed(1),
+		threads(kDefaultThreads),
+		directory(kDefaultDirectory),
+		output(stdout)
+	{
+	}
+
+	int32_t		count;
+	fssh_off_t	fileSize;
+	uint32_t	seed;
+	int32_t		threads;
+	const char*	directory;
+	FILE*		output;
+};
+
+
+/*!	Collects the latencies of the operations of a single workload run, and
+	prints the results. Only the time between StartOperation() and
+	EndOperation() is measured, so that setting up and cleaning up the test
+	data does not influence the results.
+*/
+class Benchmark {
+public:
+	Benchmark(const Options& options, const char* workload)
+		:
+		fOptions(options),
+		fWorkload(workload),
+		fRandom(options.seed != 0 ? options.seed : 1),
+		fBytes(0),
+		fTotalTime(0),
+		fStart(0),
+		fWallTime(0),
+		fThreads(0)
+	{
+		fPath = options.directory;
+		fPath += "/";
+		fPath += workload;
+	}
+
+	const Options& GetOptions() const { return fOptions; }
+	const char* Path() const { return fPath.c_str(); }
+
+	void EntryPath(std::string& path, int32_t index) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/file%06" FSSH_B_PRId32, index);
+		path = fPath;
+		path += name;
+	}
+
+	uint32_t Random()
+	{
+		// xorshift, so that every run uses the same sequence for a given seed
+		fRandom ^= fRandom << 13;
+		fRandom ^= fRandom >> 17;
+		fRandom ^= fRandom << 5;
+		return fRandom;
+	}
+
+	void StartOperation()
+	{
+		fStart = fssh_system_time();
+	}
+
+	void EndOperation(fssh_size_t bytes = 0)
+	{
+		fssh_bigtime_t latency = fssh_system_time() - fStart;
+		fLatencies.push_back(latency);
+		fTotalTime += latency;
+		fBytes += bytes;
+	}
+
+	void AddToLastOperation()
+	{
+		// account the time since StartOperation() to the previous operation,
+		// ie. for an fsync() that completes a series of writes
+		fssh_bigtime_t latency = fssh_system_time() - fStart;
+		if (!fLatencies.empty())
+			fLatencies.back() += latency;
+		fTotalTime += latency;
+	}
+
+	void AddOperations(const std::vector<fssh_bigtime_t>& latencies,
+		fssh_off_t bytes)
+	{
+		// collects the results of a thread of a parallel workload
+		for (size_t i = 0; i < latencies.size(); i++) {
+			fLatencies.push_back(latencies[i]);
+			fTotalTime += latencies[i];
+		}
+		fBytes += bytes;
+	}
+
+	void SetWallTime(fssh_bigtime_t wallTime, int32_t threads)
+	{
+		// the throughput of parallel workloads is based on the time it took
+		// all threads to finish, not on the sum of their latencies
+		fWallTime = wallTime;
+		fThreads = threads;
+	}
+
+	void Report(const char* fsName, fssh_status_t status)
+	{
+		FILE* out = fOptions.output;
+
+		fprintf(out, "{\"fs\":\"%s\",\"workload\":\"%s\"", fsName, fWorkload);
+		if (fThreads > 0)
+			fprintf(out, ",\"threads\":%" FSSH_B_PRId32, fThreads);
+		if (status != FSSH_B_OK) {
+			fprintf(out, ",\"error\":\"%s\"}\n", fssh_strerror(status));
+			fflush(out);
+			return;
+		}
+
+		std::sort(fLatencies.begin(), fLatencies.end());
+
+		double seconds = (fWallTime > 0 ? fWallTime : fTotalTime) / 1000000.0;
+		size_t operations = fLatencies.size();
+
+		fprintf(out, ",\"ops\":%lu,\"bytes\":%" FSSH_B_PRId64
+			",\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"mb_per_sec\":%.2f,"
+			"\"latency_us\":{\"min\":%" FSSH_B_PRId64 ",\"p50\":%" FSSH_B_PRId64
+			",\"p90\":%" FSSH_B_PRId64 ",\"p99\":%" FSSH_B_PRId64 ",\"max\":%"
+			FSSH_B_PRId64 "}}\n", (unsigned long)operations, (int64_t)fBytes,
+			seconds, seconds > 0 ? operations / seconds : 0.0,
+			seconds > 0 ? fBytes / seconds / (1024 * 1024) : 0.0,
+			(int64_t)_Percentile(0), (int64_t)_Percentile(50),
+			(int64_t)_Percentile(90), (int64_t)_Percentile(99),
+			(int64_t)_Percentile(100));
+		fflush(out);
+	}
+
+private:
+	fssh_bigtime_t _Percentile(int32_t percent) const
+	{
+		// nearest rank, expects the latencies to be sorted already
+		size_t count = fLatencies.size();
+		if (count == 0)
+			return 0;
+
+		size_t rank = (percent * count + 99) / 100;
+		if (rank > 0)
+			rank--;
+		return fLatencies[std::min(rank, count - 1)];
+	}
+
+private:
+	const Options&				fOptions;
+	const char*					fWorkload;
+	std::string					fPath;
+	uint32_t					fRandom;
+	fssh_off_t					fBytes;
+	fssh_bigtime_t				fTotalTime;
+	fssh_bigtime_t				fStart;
+	fssh_bigtime_t				fWallTime;
+	int32_t						fThreads;
+	std::vector<fssh_bigtime_t>	fLatencies;
+};
+
+
+typedef fssh_status_t (*workload_function)(Benchmark& benchmark);
+
+
+// #pragma mark - helper functions
+
+
+static fssh_status_t
+create_files(Benchmark& benchmark, int32_t count)
+{
+	std::string path;
+	for (int32_t i = 0; i < count; i++) {
+		benchmark.EntryPath(path, i);
+		int fd = _kern_open(-1, path.c_str(),
+			FSSH_O_CREAT | FSSH_O_TRUNC | FSSH_O_WRONLY, 0644);
+		if (fd < 0)
+			return fd;
+		_kern_close(fd);
+	}
+
+	return FSSH_B_OK;
+}
+
+
+static void
+remove_files(Benchmark& benchmark, int32_t count)
+{
+	std::string path;
+	for (int32_t i = 0; i < count; i++) {
+		benchmark.EntryPath(path, i);
+		_kern_unlink(-1, path.c_str());
+	}
+}
+
+
+static fssh_status_t
+create_data_file(Benchmark& benchmark, int& _fd, char*& _buffer)
+{
+	_buffer = (char*)malloc(kSequentialChunkSize);
+	if (_buffer == NULL)
+		return FSSH_B_NO_MEMORY;
+
+	// fill the buffer with something that does not compress too well
+	for (fssh_size_t i = 0; i < kSequentialChunkSize; i++)
+		_buffer[i] = (char)benchmark.Random();
+
+	std::string path;
+	benchmark.EntryPath(path, 0);
+
+	_fd = _kern_open(-1, path.c_str(),
+		FSSH_O_CREAT | FSSH_O_TRUNC | FSSH_O_RDWR, 0644);
+	if (_fd < 0) {
+		free(_buffer);
+		_buffer = NULL;
+		return _fd;
+	}
+
+	return FSSH_B_OK;
+}
+
+
+static void
+remove_data_file(Benchmark& benchmark, int fd, char* buffer)
+{
+	_kern_close(fd);
+	free(buffer);
+
+	std::string path;
+	benchmark.EntryPath(path, 0);
+	_kern_unlink(-1, path.c_str());
+}
+
+
+static fssh_status_t
+fill_data_file(Benchmark& benchmark, int fd, const char* buffer,
+	bool measure)
+{
+	fssh_off_t fileSize = benchmark.GetOptions().fileSize;
+
+	for (fssh_off_t offset = 0; offset < fileSize;
+			offset += kSequentialChunkSize) {
+		fssh_size_t length = (fssh_size_t)std::min(
+			(fssh_off_t)kSequentialChunkSize, fileSize - offset);
+
+		if (measure)
+			benchmark.StartOperation();
+
+		fssh_ssize_t bytesWritten = _kern_write(fd, offset, buffer, length);
+		if (bytesWritten < 0)
+			return bytesWritten;
+		if ((fssh_size_t)bytesWritten != length)
+			return FSSH_B_DEVICE_FULL;
+
+		if (measure)
+			benchmark.EndOperation(length);
+	}
+
+	if (measure)
+		benchmark.StartOperation();
+
+	fssh_status_t status = _kern_fsync(fd);
+
+	if (measure)
+		benchmark.AddToLastOperation();
+
+	return status;
+}
+
+
+// #pragma mark - metadata workloads
+
+
+static fssh_status_t
+bench_create(Benchmark& benchmark)
+{
+	int32_t count = benchmark.GetOptions().count;
+	std::string path;
+	fssh_status_t status = FSSH_B_OK;
+
+	for (int32_t i = 0; i < count; i++) {
+		benchmark.EntryPath(path, i);
+
+		benchmark.StartOperation();
+		int fd = _kern_open(-1, path.c_str(),
+			FSSH_O_CREAT | FSSH_O_EXCL | FSSH_O_WRONLY, 0644);
+		if (fd < 0) {
+			status = fd;
+			break;
+		}
+		_kern_close(fd);
+		benchmark.EndOperation();
+	}
+
+	remove_files(benchmark, count);
+	return status;
+}
+
+
+static fssh_status_t
+bench_stat(Benchmark& benchmark)
+{
+	int32_t count = benchmark.GetOptions().count;
+	std::string path;
+
+	fssh_status_t status = create_files(benchmark, count);
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < count; i++) {
+		// look the entries up in a different order than they were created in
+		benchmark.EntryPath(path, benchmark.Random() % count);
+
+		struct fssh_stat stat;
+		benchmark.StartOperation();
+		status = _kern_read_stat(-1, path.c_str(), false, &stat, sizeof(stat));
+		benchmark.EndOperation();
+	}
+
+	remove_files(benchmark, count);
+	return status;
+}
+
+
+static fssh_status_t
+bench_unlink(Benchmark& benchmark)
+{
+	int32_t count = benchmark.GetOptions().count;
+	std::string path;
+
+	fssh_status_t status = create_files(benchmark, count);
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < count; i++) {
+		benchmark.EntryPath(path, i);
+
+		benchmark.StartOperation();
+		status = _kern_unlink(-1, path.c_str());
+		benchmark.EndOperation();
+	}
+
+	remove_files(benchmark, count);
+	return status;
+}
+
+
+static fssh_status_t
+bench_tree(Benchmark& benchmark)
+{
+	// Builds a tree of "count" directories in breadth first order, so that
+	// every directory gets kTreeFanOut subdirectories.
+	int32_t count = benchmark.GetOptions().count;
+	std::vector<std::string> paths;
+	paths.reserve(count);
+
+	fssh_status_t status = FSSH_B_OK;
+
+	for (int32_t i = 0; i < count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "/dir%" FSSH_B_PRId32, i % kTreeFanOut);
+
+		std::string path = i < kTreeFanOut
+			? std::string(benchmark.Path()) : paths[i / kTreeFanOut - 1];
+		path += name;
+
+		benchmark.StartOperation();
+		status = _kern_create_dir(-1, path.c_str(), 0755);
+		if (status != FSSH_B_OK)
+			break;
+		benchmark.EndOperation();
+
+		paths.push_back(path);
+	}
+
+	// remove the deepest directories first
+	for (int32_t i = (int32_t)paths.size() - 1; i >= 0; i--)
+		_kern_remove_dir(-1, paths[i].c_str());
+
+	return status;
+}
+
+
+static fssh_status_t
+bench_attr(Benchmark& benchmark)
+{
+	int32_t count = benchmark.GetOptions().count;
+	std::string path;
+
+	char buffer[kAttributeSize];
+	for (fssh_size_t i = 0; i < sizeof(buffer); i++)
+		buffer[i] = (char)benchmark.Random();
+
+	fssh_status_t status = create_files(benchmark, count);
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < count; i++) {
+		benchmark.EntryPath(path, i);
+
+		int fd = _kern_open(-1, path.c_str(), FSSH_O_RDWR, 0);
+		if (fd < 0) {
+			status = fd;
+			break;
+		}
+
+		int32_t value = i;
+
+		benchmark.StartOperation();
+		int attribute = _kern_create_attr(fd, kIndexName, FSSH_B_INT32_TYPE,
+			FSSH_O_WRONLY | FSSH_O_TRUNC);
+		if (attribute >= 0) {
+			fssh_ssize_t written = _kern_write(attribute, 0, &value,
+				sizeof(value));
+			_kern_close(attribute);
+
+			attribute = _kern_create_attr(fd, kAttributeName,
+				FSSH_B_RAW_TYPE, FSSH_O_WRONLY | FSSH_O_TRUNC);
+			if (attribute >= 0 && written >= 0) {
+				written = _kern_write(attribute, 0, buffer, sizeof(buffer));
+				_kern_close(attribute);
+			}
+			if (written < 0)
+				attribute = written;
+		}
+		benchmark.EndOperation(sizeof(value) + sizeof(buffer));
+
+		_kern_close(fd);
+
+		if (attribute < 0)
+			status = attribute;
+	}
+
+	remove_files(benchmark, count);
+	return status;
+}
+
+
+static fssh_status_t
+bench_query(Benchmark& benchmark)
+{
+	int32_t count = benchmark.GetOptions().count;
+	std::string path;
+
+	struct fssh_stat stat;
+	fssh_status_t status = _kern_read_stat(-1, benchmark.Path(), false, &stat,
+		sizeof(stat));
+	if (status != FSSH_B_OK)
+		return status;
+
+	fssh_dev_t volume = stat.fssh_st_dev;
+
+	status = _kern_create_index(volume, kIndexName, FSSH_B_INT32_TYPE, 0);
+	if (status != FSSH_B_OK && status != FSSH_B_FILE_EXISTS)
+		return status;
+
+	status = create_files(benchmark, count);
+
+	// every value is shared by count / kQueryValues files
+	for (int32_t i = 0; status == FSSH_B_OK && i < count; i++) {
+		benchmark.EntryPath(path, i);
+
+		int fd = _kern_open(-1, path.c_str(), FSSH_O_RDWR, 0);
+		if (fd < 0) {
+			status = fd;
+			break;
+		}
+
+		int32_t value = i % kQueryValues;
+		int attribute = _kern_create_attr(fd, kIndexName, FSSH_B_INT32_TYPE,
+			FSSH_O_WRONLY | FSSH_O_TRUNC);
+		if (attribute >= 0) {
+			fssh_ssize_t written = _kern_write(attribute, 0, &value,
+				sizeof(value));
+			_kern_close(attribute);
+			if (written < 0)
+				attribute = written;
+		}
+		_kern_close(fd);
+
+		if (attribute < 0)
+			status = attribute;
+	}
+
+	int32_t queries = std::max(count / 10, (int32_t)1);
+	char buffer[sizeof(fssh_dirent) + FSSH_B_FILE_NAME_LENGTH];
+	fssh_dirent* entry = (fssh_dirent*)buffer;
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < queries; i++) {
+		char query[64];
+		snprintf(query, sizeof(query), "%s==%" FSSH_B_PRIu32, kIndexName,
+			benchmark.Random() % kQueryValues);
+
+		benchmark.StartOperation();
+		int fd = _kern_open_query(volume, query, strlen(query), 0, -1, -1);
+		if (fd < 0) {
+			status = fd;
+			break;
+		}
+
+		fssh_ssize_t entriesRead;
+		while ((entriesRead = _kern_read_dir(fd, entry, sizeof(buffer), 1))
+				== 1) {
+		}
+		_kern_close(fd);
+		benchmark.EndOperation();
+
+		if (entriesRead < 0)
+			status = entriesRead;
+	}
+
+	remove_files(benchmark, count);
+	_kern_remove_index(volume, kIndexName);
+	return status;
+}
+
+
+// #pragma mark - data workloads
+
+
+static fssh_status_t
+bench_sequential_write(Benchmark& benchmark)
+{
+	int fd;
+	char* buffer;
+	fssh_status_t status = create_data_file(benchmark, fd, buffer);
+	if (status != FSSH_B_OK)
+		return status;
+
+	status = fill_data_file(benchmark, fd, buffer, true);
+
+	remove_data_file(benchmark, fd, buffer);
+	return status;
+}
+
+
+static fssh_status_t
+bench_sequential_read(Benchmark& benchmark)
+{
+	int fd;
+	char* buffer;
+	fssh_status_t status = create_data_file(benchmark, fd, buffer);
+	if (status != FSSH_B_OK)
+		return status;
+
+	status = fill_data_file(benchmark, fd, buffer, false);
+
+	fssh_off_t fileSize = benchmark.GetOptions().fileSize;
+
+	for (fssh_off_t offset = 0; status == FSSH_B_OK && offset < fileSize;
+			offset += kSequentialChunkSize) {
+		benchmark.StartOperation();
+		fssh_ssize_t bytesRead = _kern_read(fd, offset, buffer,
+			kSequentialChunkSize);
+		if (bytesRead < 0) {
+			status = bytesRead;
+			break;
+		}
+		benchmark.EndOperation(bytesRead);
+	}
+
+	remove_data_file(benchmark, fd, buffer);
+	return status;
+}
+
+
+static fssh_status_t
+bench_random(Benchmark& benchmark, bool write)
+{
+	int fd;
+	char* buffer;
+	fssh_status_t status = create_data_file(benchmark, fd, buffer);
+	if (status != FSSH_B_OK)
+		return status;
+
+	status = fill_data_file(benchmark, fd, buffer, false);
+
+	int32_t count = benchmark.GetOptions().count;
+	uint32_t blocks = (uint32_t)std::max(
+		benchmark.GetOptions().fileSize / (fssh_off_t)kRandomBlockSize,
+		(fssh_off_t)1);
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < count; i++) {
+		fssh_off_t offset = (fssh_off_t)(benchmark.Random() % blocks)
+			* kRandomBlockSize;
+
+		benchmark.StartOperation();
+		fssh_ssize_t bytes = write
+			? _kern_write(fd, offset, buffer, kRandomBlockSize)
+			: _kern_read(fd, offset, buffer, kRandomBlockSize);
+		if (bytes < 0) {
+			status = bytes;
+			break;
+		}
+		benchmark.EndOperation(bytes);
+	}
+
+	if (write && status == FSSH_B_OK) {
+		benchmark.StartOperation();
+		status = _kern_fsync(fd);
+		benchmark.AddToLastOperation();
+	}
+
+	remove_data_file(benchmark, fd, buffer);
+	return status;
+}
+
+
+static fssh_status_t
+bench_random_write(Benchmark& benchmark)
+{
+	return bench_random(benchmark, true);
+}
+
+
+static fssh_status_t
+bench_random_read(Benchmark& benchmark)
+{
+	return bench_random(benchmark, false);
+}
+
+
+// #pragma mark - parallel workloads
+
+
+struct ParallelWriter {
+	ParallelWriter()
+		:
+		count(0),
+		buffer(NULL),
+		thread(-1),
+		created(false),
+		bytes(0),
+		status(FSSH_B_OK)
+	{
+	}
+
+	std::string					path;
+	int32_t						count;
+	const char*					buffer;
+	fssh_thread_id				thread;
+	bool						created;
+	fssh_off_t					bytes;
+	fssh_status_t				status;
+	std::vector<fssh_bigtime_t>	latencies;
+};
+
+
+static fssh_status_t
+parallel_writer(void* _writer)
+{
+	ParallelWriter& writer = *(ParallelWriter*)_writer;
+
+	for (int32_t i = 0; i < writer.count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "/file%06" FSSH_B_PRId32, i);
+		std::string path = writer.path + name;
+
+		// the fsync() makes sure the blocks are actually allocated, even if
+		// the file system delays that until the data is written back
+		fssh_bigtime_t start = fssh_system_time();
+		int fd = _kern_open(-1, path.c_str(),
+			FSSH_O_CREAT | FSSH_O_EXCL | FSSH_O_WRONLY, 0644);
+		if (fd < 0) {
+			writer.status = fd;
+			break;
+		}
+
+		fssh_ssize_t bytesWritten = _kern_write(fd, 0, writer.buffer,
+			kParallelFileSize);
+		fssh_status_t status = bytesWritten < 0
+			? (fssh_status_t)bytesWritten : _kern_fsync(fd);
+		_kern_close(fd);
+
+		if (status == FSSH_B_OK
+			&& (fssh_size_t)bytesWritten != kParallelFileSize) {
+			status = FSSH_B_DEVICE_FULL;
+		}
+		if (status != FSSH_B_OK) {
+			writer.status = status;
+			break;
+		}
+
+		writer.latencies.push_back(fssh_system_time() - start);
+		writer.bytes += bytesWritten;
+	}
+
+	return writer.status;
+}
+
+
+/*!	Lets several threads create, write, and fsync() files at the same time,
+	each of them in its own directory. Running it with a different number of
+	threads shows how well block and inode allocation scale.
+*/
+static fssh_status_t
+bench_parallel_write(Benchmark& benchmark)
+{
+	const Options& options = benchmark.GetOptions();
+	int32_t threads = options.threads;
+
+	char* buffer = (char*)malloc(kParallelFileSize);
+	if (buffer == NULL)
+		return FSSH_B_NO_MEMORY;
+
+	for (fssh_size_t i = 0; i < kParallelFileSize; i++)
+		buffer[i] = (char)benchmark.Random();
+
+	std::vector<ParallelWriter> writers(threads);
+	fssh_status_t status = FSSH_B_OK;
+
+	for (int32_t i = 0; status == FSSH_B_OK && i < threads; i++) {
+		ParallelWriter& writer = writers[i];
+
+		char name[32];
+		snprintf(name, sizeof(name), "/writer%" FSSH_B_PRId32, i);
+		writer.path = benchmark.Path();
+		writer.path += name;
+		writer.count = options.count / threads
+			+ (i < options.count % threads ? 1 : 0);
+		writer.buffer = buffer;
+
+		status = _kern_create_dir(-1, writer.path.c_str(), 0755);
+		if (status != FSSH_B_OK)
+			break;
+		writer.created = true;
+
+		writer.thread = fssh_spawn_thread(&parallel_writer, "bench writer",
+			FSSH_B_NORMAL_PRIORITY, &writer);
+		if (writer.thread < 0)
+			status = writer.thread;
+	}
+
+	// all threads are started at once, and only then the clock starts
+	fssh_bigtime_t start = fssh_system_time();
+
+	for (int32_t i = 0; i < threads; i++) {
+		if (writers[i].thread >= 0)
+			fssh_resume_thread(writers[i].thread);
+	}
+
+	for (int32_t i = 0; i < threads; i++) {
+		ParallelWriter& writer = writers[i];
+		if (writer.thread < 0)
+			continue;
+
+		fssh_status_t result;
+		fssh_wait_for_thread(writer.thread, &result);
+		if (result != FSSH_B_OK && status == FSSH_B_OK)
+			status = result;
+
+		benchmark.AddOperations(writer.latencies, writer.bytes);
+	}
+
+	benchmark.SetWallTime(fssh_system_time() - start, threads);
+
+	for (int32_t i = 0; i < threads; i++) {
+		ParallelWriter& writer = writers[i];
+		if (!writer.created)
+			continue;
+
+		for (int32_t j = 0; j < writer.count; j++) {
+			char name[32];
+			snprintf(name, sizeof(name), "/file%06" FSSH_B_PRId32, j);
+			_kern_unlink(-1, (writer.path + name).c_str());
+		}
+		_kern_remove_dir(-1, writer.path.c_str());
+	}
+
+	free(buffer);
+	return status;
+}
+
+
+// #pragma mark -
+
+
+static const struct {
+	const char*			name;
+	workload_function	function;
+	const char*			description;
+} kWorkloads[] = {
+	{"create",			bench_create,
+		"create <count> empty files"},
+	{"stat",			bench_stat,
+		"stat <count> files in random order"},
+	{"unlink",			bench_unlink,
+		"remove <count> files"},
+	{"tree",			bench_tree,
+		"create <count> directories, 8 per directory"},
+	{"attr",			bench_attr,
+		"write two attributes to each of <count> files"},
+	{"query",			bench_query,
+		"run <count> / 10 queries on an int32 index"},
+	{"seq-write",		bench_sequential_write,
+		"write a <size> MB file in 64 KB chunks"},
+	{"seq-read",		bench_sequential_read,
+		"read a <size> MB file in 64 KB chunks"},
+	{"random-write",	bench_random_write,
+		"<count> 4 KB writes to a <size> MB file"},
+	{"random-read",		bench_random_read,
+		"<count> 4 KB reads from a <size> MB file"},
+	{"parallel-write",	bench_parallel_write,
+		"<threads> threads create, write and fsync <count> 64 KB files"},
+};
+static const int32_t kWorkloadCount
+	= sizeof(kWorkloads) / sizeof(kWorkloads[0]);
+
+
+static void
+print_usage(const char* command)
+{
+	fprintf(stderr, "Usage: %s [ <options> ] [ <workload> ... | all ]\n"
+		"Runs the given file system benchmarks, and prints the results as one\n"
+		"JSON object per workload.\n"
+		"\n"
+		"Options:\n"
+		"  -n <count>      - number of operations per workload (default %"
+			FSSH_B_PRId32 ")\n"
+		"  -s <size>       - file size in MB for the data workloads "
+			"(default %" FSSH_B_PRId32 ")\n"
+		"  -r <seed>       - seed of the random number generator\n"
+		"  -t <threads>    - number of threads for the parallel workloads "
+			"(default %" FSSH_B_PRId32 ")\n"
+		"  -d <directory>  - where to create the test files (default %s)\n"
+		"  -o <file>       - append the results to the given host file\n"
+		"\n"
+		"Workloads:\n", command, kDefaultCount, kDefaultFileSize,
+		kDefaultThreads, kDefaultDirectory);
+
+	for (int32_t i = 0; i < kWorkloadCount; i++) {
+		fprintf(stderr, "  %-14s  - %s\n", kWorkloads[i].name,
+			kWorkloads[i].description);
+	}
+}
+
+
+static fssh_status_t
+run_workload(const Options& options, const char* fsName, int32_t index)
+{
+	Benchmark benchmark(options, kWorkloads[index].name);
+
+	fssh_status_t status = _kern_create_dir(-1, benchmark.Path(), 0755);
+	if (status == FSSH_B_OK) {
+		status = kWorkloads[index].function(benchmark);
+		_kern_remove_dir(-1, benchmark.Path());
+	}
+
+	benchmark.Report(fsName, status);
+
+	// make sure the next workload does not have to write back our changes
+	_kern_sync();
+
+	return status;
+}
+
+
+fssh_status_t
+command_bench(int argc, const char* const* argv)
+{
+	Options options;
+	const char* outputPath = NULL;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char* arg = argv[argi];
+		if (strcmp(arg, "--help") == 0) {
+			print_usage(argv[0]);
+			return FSSH_B_OK;
+		}
+		if (arg[1] == '\0' || arg[2] != '\0' || argi + 1 >= argc) {
+			print_usage(argv[0]);
+			return FSSH_B_BAD_VALUE;
+		}
+
+		const char* value = argv[++argi];
+		switch (arg[1]) {
+			case 'n':
+				options.count = atol(value);
+				break;
+			case 's':
+				options.fileSize = (fssh_off_t)atol(value) * 1024 * 1024;
+				break;
+			case 'r':
+				options.seed = strtoul(value, NULL, 0);
+				break;
+			case 't':
+				options.threads = atol(value);
+				break;
+			case 'd':
+				options.directory = value;
+				break;
+			case 'o':
+				outputPath = value;
+				break;
+			default:
+				print_usage(argv[0]);
+				return FSSH_B_BAD_VALUE;
+		}
+	}
+
+	if (options.count <= 0 || options.fileSize <= 0 || options.threads <= 0) {
+		print_usage(argv[0]);
+		return FSSH_B_BAD_VALUE;
+	}
+
+	// determine the workloads to run
+	bool selected[kWorkloadCount];
+	bool all = argi == argc;
+	for (int32_t i = 0; i < kWorkloadCount; i++)
+		selected[i] = all;
+
+	for (; argi < argc; argi++) {
+		if (strcmp(argv[argi], "all") == 0) {
+			for (int32_t i = 0; i < kWorkloadCount; i++)
+				selected[i] = true;
+			continue;
+		}
+
+		int32_t i = 0;
+		for (; i < kWorkloadCount; i++) {
+			if (strcmp(argv[argi], kWorkloads[i].name) == 0)
+				break;
+		}
+		if (i == kWorkloadCount) {
+			fprintf(stderr, "Error: Unknown workload \"%s\"\n", argv[argi]);
+			print_usage(argv[0]);
+			return FSSH_B_BAD_VALUE;
+		}
+		selected[i] = true;
+	}
+
+	// get the name of the file system
+	fssh_status_t status = _kern_create_dir(-1, options.directory, 0755);
+	if (status != FSSH_B_OK && status != FSSH_B_FILE_EXISTS) {
+		fprintf(stderr, "Error: Could not create \"%s\": %s\n",
+			options.directory, fssh_strerror(status));
+		return status;
+	}
+	bool createdDirectory = status == FSSH_B_OK;
+
+	struct fssh_stat stat;
+	fssh_fs_info info;
+	status = _kern_read_stat(-1, options.directory, false, &stat,
+		sizeof(stat));
+	if (status == FSSH_B_OK)
+		status = _kern_read_fs_info(stat.fssh_st_dev, &info);
+	if (status != FSSH_B_OK) {
+		fprintf(stderr, "Error: Could not get the file system of \"%s\": %s\n",
+			options.directory, fssh_strerror(status));
+		return status;
+	}
+
+	if (outputPath != NULL) {
+		options.output = fopen(outputPath, "a");
+		if (options.output == NULL) {
+			fprintf(stderr, "Error: Could not open \"%s\"\n", outputPath);
+			return FSSH_B_ERROR;
+		}
+	}
+
+	fssh_status_t result = FSSH_B_OK;
+	for (int32_t i = 0; i < kWorkloadCount; i++) {
+		if (!selected[i])
+			continue;
+
+		status = run_workload(options, info.fsh_name, i);
+		if (status != FSSH_B_OK && result == FSSH_B_OK)
+			result = status;
+	}
+
+	if (createdDirectory)
+		_kern_remove_dir(-1, options.directory);
+
+	if (options.output != stdout)
+		fclose(options.output);
+
+	return result;
+}
+
+
+}	// namespace FSShell
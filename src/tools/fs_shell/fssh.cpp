@@ -17,6 +17,7 @@
 
 #include <vector>
 
+#include "command_bench.h"
 #include "command_cp.h"
 #include "driver_settings.h"
 #include "external_commands.h"
@@ -1211,6 +1212,7 @@ static void
 register_commands()
 {
 	CommandManager::Default()->AddCommands(
+		command_bench,		"bench",		"run file system benchmarks",
 		command_cd,			"cd",			"change current directory",
 		command_chmod,		"chmod",		"change file permissions",
 		command_cp,			"cp",			"copy files and directories",
@@ -1720,6 +1720,19 @@ get_new_fd(int type, struct fs_mount *mount, struct vnode *vnode,
 }
 
 
+/*!	Clears memory specified by an iovec array.
+*/
+static void
+zero_iovecs(const fssh_iovec *vecs, fssh_size_t vecCount, fssh_size_t bytes)
+{
+	for (fssh_size_t i = 0; i < vecCount && bytes > 0; i++) {
+		fssh_size_t length = fssh_min_c(vecs[i].iov_len, bytes);
+		fssh_memset(vecs[i].iov_base, 0, length);
+		bytes -= length;
+	}
+}
+
+
 /*!	Does the dirty work of combining the file_io_vecs with the iovecs
 	and calls the file system hooks to read/write the request to disk.
 */
@@ -1750,8 +1763,14 @@ common_file_io_vec_pages(int fd, const fssh_file_io_vec *fileVecs,
 		if (size > numBytes)
 			size = numBytes;
 
-		status = fssh_read_pages(fd, fileVecs[0].offset, &vecs[vecIndex],
-			vecCount - vecIndex, &size);
+		if (fileVecs[0].offset >= 0) {
+			status = fssh_read_pages(fd, fileVecs[0].offset, &vecs[vecIndex],
+				vecCount - vecIndex, &size);
+		} else {
+			// sparse read
+			zero_iovecs(&vecs[vecIndex], vecCount - vecIndex, size);
+			status = FSSH_B_OK;
+		}
 		if (status < FSSH_B_OK)
 			return status;
 
@@ -1844,7 +1863,16 @@ common_file_io_vec_pages(int fd, const fssh_file_io_vec *fileVecs,
 			}
 
 			fssh_size_t bytes = size;
-			if (doWrite) {
+			if (fileOffset == -1) {
+				if (doWrite) {
+					fssh_panic("sparse write attempt: fd %d", fd);
+					status = FSSH_B_IO_ERROR;
+				} else {
+					// sparse read
+					zero_iovecs(tempVecs, tempCount, bytes);
+					status = FSSH_B_OK;
+				}
+			} else if (doWrite) {
 				status = fssh_write_pages(fd, fileOffset, tempVecs,
 					tempCount, &bytes);
 			} else {
@@ -1856,7 +1884,8 @@ common_file_io_vec_pages(int fd, const fssh_file_io_vec *fileVecs,
 
 			totalSize += bytes;
 			bytesLeft -= size;
-			fileOffset += size;
+			if (fileOffset >= 0)
+				fileOffset += size;
 			fileLeft -= size;
 
 			if (size != bytes || vecIndex >= vecCount) {